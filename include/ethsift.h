@@ -14,6 +14,22 @@ extern "C" {
     uint32_t height;
   };
 
+  // Pixel formats of borrowed images, see struct ethsift_image_view.
+  #define ETHSIFT_FORMAT_F32 0
+  #define ETHSIFT_FORMAT_U8 1
+  #define ETHSIFT_FORMAT_U16 2
+
+  // Borrowed image in caller memory, converted to float while being blurred. ETHSIFT_FORMAT_U16 samples
+  // are scaled to the 0..255 range of 8-bit images, which the thresholds of the pipeline assume.
+  struct ethsift_image_view{
+    const void *data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;  // Bytes from the start of one row to the next
+    uint32_t format;  // ETHSIFT_FORMAT_*
+    uint32_t bits;    // Significant bits of ETHSIFT_FORMAT_U16 samples, 0 for all 16
+  };
+
   struct ethsift_coordinate{
     float x;      // Col
     float y;      // Row
@@ -27,13 +43,111 @@ extern "C" {
     struct ethsift_coordinate layer_pos;
     float orientation;
     float magnitude;
+    float response;   // |DoG| contrast at the refined position
     float descriptors[DESCRIPTORS];
   };
 
+  struct ethsift_roi{
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+  };
+
   struct ethsift_match{
     uint32_t x1, y1, x2, y2;
   };
 
+  // Binary PGM or PPM file mapped into memory, see ethsift_map_pnm.
+  struct ethsift_pnm{
+    struct ethsift_image_view view;  // The pixels in place for 8-bit PGM files, ELSE data is NULL
+    const uint8_t *pixels;  // First pixel in the mapping
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;    // Bytes from the start of one row to the next
+    uint32_t channels;  // 1 for PGM, 3 for PPM
+    uint32_t maxval;    // Samples above 255 take two bytes, big-endian
+    void *mapping;
+    uint64_t mapping_size;
+  };
+
+  // Descriptor formats of keypoint files, see ethsift_write_keypoints.
+  #define ETHSIFT_STORE_F32 0
+  #define ETHSIFT_STORE_U8 1
+  #define ETHSIFT_STORE_F16 2
+
+  // Keypoint file mapped into memory, see ethsift_map_keypoints. Every field of the keypoints is
+  // one array in the mapping.
+  struct ethsift_keypoint_file{
+    uint64_t keypoint_count;
+    uint32_t format;           // ETHSIFT_STORE_* of the descriptors
+    uint32_t descriptor_size;  // Bytes of one descriptor
+    const uint32_t *octaves;
+    const uint32_t *layers;
+    const float *x, *y, *scales;                    // global_pos
+    const float *layer_x, *layer_y, *layer_scales;  // layer_pos
+    const float *orientations;
+    const float *magnitudes;
+    const float *responses;
+    const void *descriptors;   // 64-byte aligned, one descriptor after the other
+    void *mapping;
+    uint64_t mapping_size;
+  };
+
+  // Uncompressed video file mapped into memory, see ethsift_sequence_open.
+  struct ethsift_sequence;
+
+  // State carried between the frames of a video, see ethsift_video_create.
+  struct ethsift_video;
+
+  // Frames in flight on the threads of a pipeline, see ethsift_pipeline_create.
+  struct ethsift_pipeline;
+
+  // Keypoint budget modes, see ethsift_set_keypoint_budget.
+  #define ETHSIFT_BUDGET_SCAN_ORDER 0
+  #define ETHSIFT_BUDGET_SCAN_ORDER_NO_COUNT 1
+  #define ETHSIFT_BUDGET_STRONGEST 2
+
+  // Gaussian pyramid schedules, see ethsift_set_pyramid_schedule.
+  #define ETHSIFT_SCHEDULE_SEQUENTIAL 0
+  #define ETHSIFT_SCHEDULE_DIRECT 1
+
+  // Gradient orientation modes, see ethsift_set_orientation_mode.
+  #define ETHSIFT_ORIENTATION_ATAN2 0
+  #define ETHSIFT_ORIENTATION_OCTANT 1
+
+  // Descriptor sampling modes, see ethsift_set_descriptor_mode.
+  #define ETHSIFT_DESCRIPTOR_WINDOW 0
+  #define ETHSIFT_DESCRIPTOR_PATCH 1
+
+  // What ethsift_pipeline_submit does when all frame slots are taken.
+  #define ETHSIFT_BACKPRESSURE_BLOCK 0
+  #define ETHSIFT_BACKPRESSURE_REJECT 1
+
+  // Batch modes, see ethsift_set_batch_mode.
+  #define ETHSIFT_BATCH_IMAGES 0
+  #define ETHSIFT_BATCH_LANES 1
+
+  // Accuracy tiers of the math approximations, see ethsift_set_math_accuracy.
+  #define ETHSIFT_ACCURACY_FAST 0
+  #define ETHSIFT_ACCURACY_MEDIUM 1
+  #define ETHSIFT_ACCURACY_EXACT 2
+
+  // Math functions, see ethsift_evaluate_math.
+  #define ETHSIFT_MATH_EXP 0
+  #define ETHSIFT_MATH_ATAN2 1
+  #define ETHSIFT_MATH_SIN 2
+  #define ETHSIFT_MATH_COS 3
+  #define ETHSIFT_MATH_FLOOR 4
+  #define ETHSIFT_MATH_RSQRT 5
+
+  // Kernel backends, see ethsift_set_backend.
+  #define ETHSIFT_BACKEND_AUTO 0
+  #define ETHSIFT_BACKEND_SCALAR 1
+  #define ETHSIFT_BACKEND_SSE 2
+  #define ETHSIFT_BACKEND_AVX2 3
+  #define ETHSIFT_BACKEND_AVX512 4
+
   //// General notes:
   // All API functions return a result indicator that should be
   // 0 on failure and greater than zero on success.
@@ -51,6 +165,162 @@ extern "C" {
   /// <remarks> 0 flops </remarks>
   int ethsift_init();
   
+  /// <summary> 
+  /// Select how keypoint detection behaves once the keypoint array is full.
+  /// </summary>
+  /// <param name="mode"> IN: ETHSIFT_BUDGET_SCAN_ORDER keeps the first keypoints in scan order and still
+  ///                     refines all remaining extrema to report the total count (default).
+  ///                     ETHSIFT_BUDGET_SCAN_ORDER_NO_COUNT stops detection as soon as the array is full.
+  ///                     ETHSIFT_BUDGET_STRONGEST keeps the keypoints with the largest response, sorted
+  ///                     strongest first, and skips the histogram of candidates that cannot enter the set. </param>
+  /// <returns> 1 IF the mode is valid, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_set_keypoint_budget(uint32_t mode);
+
+  /// <summary> 
+  /// Limit the number of keypoints per grid cell to spread keypoints across the image. Extrema are
+  /// refined in order of decreasing |DoG| value and kept until max_per_cell keypoints, orientation
+  /// peaks included, lie in a cell. Cells are anchored to the input image, also for a region of interest.
+  /// </summary>
+  /// <param name="cell_size"> IN: Edge length of a grid cell in pixels of the input image. 0 disables the grid (default). </param>
+  /// <param name="max_per_cell"> IN: How many keypoints a cell keeps at most. </param>
+  /// <returns> 1 IF the grid is valid, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_set_keypoint_grid(uint32_t cell_size, uint32_t max_per_cell);
+
+  /// <summary> 
+  /// Double the size of the first octave, like ezsift's SIFT_IMG_DBL. This finds smaller
+  /// structures at the cost of an extra, four times larger octave.
+  /// </summary>
+  /// <param name="enable"> IN: 1 to upsample the input by 2x before blurring, 0 to disable (default). </param>
+  /// <returns> 1 IF the setting is valid, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_set_upsample(uint32_t enable);
+
+  /// <summary> 
+  /// Select how the levels of an octave of the Gaussian pyramid are computed.
+  /// </summary>
+  /// <param name="schedule"> IN: ETHSIFT_SCHEDULE_SEQUENTIAL blurs each level from the previous one (default).
+  ///                         ETHSIFT_SCHEDULE_DIRECT blurs each level from the octave base with the combined
+  ///                         sigma. The levels no longer depend on each other and share a single pass over the
+  ///                         rows of the base, at the cost of wider kernels. </param>
+  /// <returns> 1 IF the schedule is valid, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_set_pyramid_schedule(uint32_t schedule);
+
+  /// <summary> 
+  /// Select how gradient orientations are computed for the orientation histogram and descriptors.
+  /// </summary>
+  /// <param name="mode"> IN: ETHSIFT_ORIENTATION_ATAN2 stores the atan2 of every gradient in a rotation pyramid (default).
+  ///                     ETHSIFT_ORIENTATION_OCTANT skips the rotation pyramid. The histograms derive the bin of
+  ///                     a pixel from (dx, dy) of the Gaussian level, picking the octant by comparisons and
+  ///                     interpolating by the ratio of the components. Bins shift by up to 4 degrees. </param>
+  /// <returns> 1 IF the mode is valid, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_set_orientation_mode(uint32_t mode);
+
+  /// <summary> 
+  /// Select how the descriptors of the keypoints are sampled.
+  /// </summary>
+  /// <param name="mode"> IN: ETHSIFT_DESCRIPTOR_WINDOW bins every pixel of a window around the keypoint, whose size
+  ///                     grows with the keypoint scale (default).
+  ///                     ETHSIFT_DESCRIPTOR_PATCH resamples a fixed ETHSIFT_DESCR_PATCH_SIZE squared patch, rotated to
+  ///                     the keypoint orientation, from the Gaussian level and bins its gradients. The cost per
+  ///                     keypoint no longer depends on its scale, large keypoints are sampled more coarsely.
+  ///                     See ethsift_extract_descriptor_patch. </param>
+  /// <returns> 1 IF the mode is valid, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_set_descriptor_mode(uint32_t mode);
+
+  /// <summary> 
+  /// Select how ethsift_compute_keypoints_batch spreads its images over the threads.
+  /// </summary>
+  /// <param name="mode"> IN: ETHSIFT_BATCH_IMAGES gives every thread one image at a time (default).
+  ///                     ETHSIFT_BATCH_LANES gives every thread groups of 8 consecutive images. If they share
+  ///                     their size, their pyramids are built together with the pixels interleaved, one image
+  ///                     per AVX2 lane, so small images use whole vectors without tail loops. Blur and DoG
+  ///                     match the AVX-512 backend, gradients on the image border can differ in the last bits.
+  ///                     Needs the AVX2 or AVX-512 backend, float pyramids, no upsampling and the sequential
+  ///                     schedule, other groups are processed one image at a time. </param>
+  /// <returns> 1 IF the mode is valid, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_set_batch_mode(uint32_t mode);
+
+  /// <summary> 
+  /// Set the number of threads that extract descriptors. The keypoints are ordered by pyramid level
+  /// and split into chunks of ETHSIFT_DESCR_CHUNK, which the threads take in turn. The threads are
+  /// started once and wait for work in between calls. Calls into the library must not overlap.
+  /// </summary>
+  /// <param name="count"> IN: Number of threads including the calling one, 1 by default. 0 starts one per online CPU. </param>
+  /// <returns> 1 IF all threads could be started, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_set_thread_count(uint32_t count);
+
+  /// <summary> 
+  /// Build the Gaussian and DoG pyramids of 8-bit images in int16 fixed point. Pixels are blurred
+  /// as Q8.7 with Q0.15 kernels, which doubles the vector width and halves the memory traffic of
+  /// the blur. The pyramids are converted to float for keypoint refinement and descriptors.
+  /// Other pixel formats, the doubled first octave and the direct schedule keep using float.
+  /// </summary>
+  /// <param name="enable"> IN: 1 to use fixed point for ETHSIFT_FORMAT_U8 images, 0 to disable (default). </param>
+  /// <returns> 1 IF the setting is valid, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_set_fixed_point(uint32_t enable);
+
+  /// <summary> 
+  /// Generate exactly symmetric Gaussian kernels. By default the kernel taps carry the same
+  /// slight skew as ezsift so that results match it. Symmetric kernels let the blur fold
+  /// mirrored taps and save almost half of its multiplications, but shift results slightly.
+  /// </summary>
+  /// <param name="enable"> IN: 1 for symmetric kernels, 0 for ezsift compatible ones (default). </param>
+  /// <returns> 1 IF the kernels were regenerated, ELSE 0 IF the setting is invalid or a pipeline exists. </returns>
+  /// <remarks> Regenerates all kernels, see ethsift_init. Not synchronised: call it before creating pipelines
+  ///           and never while another thread is inside the library. </remarks>
+  int ethsift_set_symmetric_kernels(uint32_t enable);
+
+  /// <summary> 
+  /// Select the accuracy of exp, atan2, sin, cos and rsqrt in every stage of the pipeline.
+  /// The maximum errors of each tier are listed in src/vector_math.h. floor is exact in every tier.
+  /// </summary>
+  /// <param name="accuracy"> IN: ETHSIFT_ACCURACY_FAST uses short polynomials for exp, sin, cos and rsqrt and
+  ///                         the atan2 approximation of ezsift (default). Descriptors differ slightly from
+  ///                         ezsift and from earlier versions, which called libm for exp, sin and cos.
+  ///                         ETHSIFT_ACCURACY_MEDIUM uses polynomials within a few ulp.
+  ///                         ETHSIFT_ACCURACY_EXACT calls libm for every value, one lane at a time. </param>
+  /// <returns> 1 IF the tier is valid, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_set_math_accuracy(uint32_t accuracy);
+
+  /// <summary> 
+  /// Evaluate one of the math functions of the pipeline over an array, with the current backend and
+  /// accuracy tier. Meant to test and benchmark the approximations.
+  /// </summary>
+  /// <param name="function"> IN: One of the ETHSIFT_MATH_* values. </param>
+  /// <param name="x"> IN: Arguments, the x of atan2(y, x). </param>
+  /// <param name="y"> IN: The y of atan2(y, x), ignored by the other functions. </param>
+  /// <param name="out"> OUT: Results. </param>
+  /// <param name="count"> IN: Number of values. </param>
+  /// <returns> 1 IF the function is valid, ELSE 0. </returns>
+  /// <remarks> count * (function) flops </remarks>
+  int ethsift_evaluate_math(uint32_t function, const float *x, const float *y, float *out, uint32_t count);
+
+  /// <summary> 
+  /// Select which instruction set the blur, pyramid and descriptor kernels use.
+  /// ethsift_init selects the best backend the CPU supports.
+  /// </summary>
+  /// <param name="backend"> IN: One of the ETHSIFT_BACKEND_* values. ETHSIFT_BACKEND_AUTO picks the
+  ///                        widest backend supported by the running CPU. </param>
+  /// <returns> 1 IF the backend is supported by the running CPU, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_set_backend(uint32_t backend);
+
+  /// <summary> 
+  /// Query the currently selected kernel backend.
+  /// </summary>
+  /// <returns> One of the ETHSIFT_BACKEND_* values, never ETHSIFT_BACKEND_AUTO. </returns>
+  /// <remarks> 0 flops </remarks>
+  uint32_t ethsift_get_backend();
+
   /// <summary> 
   /// Smartly allocate the image pyramid contents (allocate pixels, set sizes).
   /// </summary>
@@ -94,6 +364,18 @@ extern "C" {
   /// <remarks> ak = gaussian_count * (powf + sqrt + ceilf + 7 + ggk) </remarks>
   int ethsift_generate_all_kernels(int layers_count, uint32_t gaussian_count, float **kernels_ptrs, int kernel_rads[], int kernel_sizes[]);
 
+  /// <summary> 
+  /// Creates the gaussian kernels that blur the base of an octave directly to each of its levels.
+  /// </summary>
+  /// <param name="layers_count"> IN: Amount of layers. </param>
+  /// <param name="gaussian_count"> IN: Amount of gaussian levels per octave. </param>
+  /// <param name="kernel_ptrs"> OUT: Pointers to the kernels, the first one is NULL as the base needs no kernel. </param>
+  /// <param name="kernel_rads"> OUT: The radii of all the kernels stored in an array. </param> 
+  /// <param name="kernel_sizes"> OUT: The sizes of all the kernels stored in an array. </param> 
+  /// <returns> 1 IF generation was successful, ELSE 0. </returns>
+  /// <remarks> (gaussian_count - 1) * (powf + sqrt + ceilf + 5 + ggk) </remarks>
+  int ethsift_generate_direct_kernels(int layers_count, uint32_t gaussian_count, float **kernels_ptrs, int kernel_rads[], int kernel_sizes[]);
+
   /// <summary> 
   /// Frees up the allocated memory of the kernels
   /// </summary>
@@ -116,6 +398,19 @@ extern "C" {
   /// <remarks> 2 * (h * w * (2 * kernel_size)) flops </remarks>
   int ethsift_apply_kernel(struct ethsift_image image, float *kernel, uint32_t kernel_size, uint32_t kernel_rad, struct ethsift_image output);
 
+  /// <summary> 
+  /// Apply the gaussian kernel to a borrowed image and write the result to the output.
+  /// The conversion to float is fused into the first filter pass.
+  /// </summary>
+  /// <param name="image"> IN: Input image to blur. </param>
+  /// <param name="kernel"> IN: The gaussian kernel/filter we use for blurring. </param>
+  /// <param name="kernel_size"> IN: Size of gaussian kernels. </param>
+  /// <param name="kernel_rad"> IN: Radius of the kernel. </param>
+  /// <param name="output"> OUT: Blurred output image. </param>
+  /// <returns> 1 IF generation was successful, ELSE 0. </returns>
+  /// <remarks> 2 * (h * w * (2 * kernel_size)) flops </remarks>
+  int ethsift_apply_kernel_view(struct ethsift_image_view image, float *kernel, uint32_t kernel_size, uint32_t kernel_rad, struct ethsift_image output);
+
   /// <summary> 
   /// Downscale the image by half and write the result to the output.
   /// </summary>
@@ -129,7 +424,8 @@ extern "C" {
   /// Fill the octave pyramid by downsampling repeatedly.
   /// </summary>
   /// <param name="image"> IN: The original image we want to process. </param>
-  /// <param name="octaves"> OUT: Octaves to generate. </param>
+  /// <param name="octaves"> OUT: Octaves to generate. octaves[0] may share the pixels of the image,
+  ///                       in which case it is not copied. </param>
   /// <param name="kernerl_rad"> IN: Octaves image array size. </param>
   /// <returns> 1 IF generation was successful, ELSE 0. </returns>
   /// <remarks> 0 flops</remarks>
@@ -147,6 +443,35 @@ extern "C" {
   /// <remarks> ggk + ((gaussian_count-1)*octave_count + 1) * ak </remarks>
   int ethsift_generate_gaussian_pyramid(struct ethsift_image image, uint32_t octave_count, struct ethsift_image gaussians[], uint32_t gaussian_count);
 
+  /// <summary> 
+  /// Creates a pyramid of images containing blurred versions of a borrowed input image.
+  /// </summary>
+  /// <param name="image"> IN: The input image, converted to float during the first blur. </param>
+  /// <param name="octave_count"> IN: Number of octaves. </param>
+  /// <param name="gaussians"> IN/OUT: Struct of gaussians to compute. 
+  /// NOTE: Size = octave_count * gaussian_count. If the first octave is allocated at twice the
+  /// size of the image, the image is upsampled bilinearly while it is blurred. </param>
+  /// <param name="gaussian_count"> IN: Number of gaussian blurred images per layer. </param> 
+  /// <returns> 1 IF generation was successful, ELSE 0. </returns>
+  /// <remarks> ggk + ((gaussian_count-1)*octave_count + 1) * ak </remarks>
+  int ethsift_generate_gaussian_pyramid_view(struct ethsift_image_view image, uint32_t octave_count, struct ethsift_image gaussians[], uint32_t gaussian_count);
+
+  /// <summary> 
+  /// Creates the Gaussian and Difference of Gaussian pyramids of an 8-bit image in int16 fixed point,
+  /// see ethsift_set_fixed_point. Both pyramids are converted to float when they are stored.
+  /// </summary>
+  /// <param name="image"> IN: The input image, must be ETHSIFT_FORMAT_U8. </param>
+  /// <param name="octave_count"> IN: Number of octaves. </param>
+  /// <param name="gaussians"> OUT: Struct of gaussians to compute, the first octave the size of the image.
+  /// NOTE: Size = octave_count * gaussian_count. </param>
+  /// <param name="gaussian_count"> IN: Number of gaussian blurred images per layer. </param> 
+  /// <param name="differences"> OUT: Struct of differences to compute.
+  /// NOTE: Size = octave_count * dog_count. </param>
+  /// <param name="dog_count"> IN: Number of difference images per layer. </param> 
+  /// <returns> 1 IF generation was successful, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_generate_pyramids_fixed(struct ethsift_image_view image, uint32_t octave_count, struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image differences[], uint32_t dog_count);
+
   /// <summary> 
   /// Build the Difference of Gaussian pyramids
   /// NOTE: Size of Pyramids = octave_count * gaussian_count with empty entries!
@@ -167,7 +492,7 @@ extern "C" {
   /// <param name="gaussians"> IN: The octaves of the input image. </param>
   /// <param name="gaussian_count"> IN: Number of gaussian blurred images per layer.  </param>
   /// <param name="gradients"> IN/OUT: Struct of gradients to compute.  </param>
-  /// <param name="rotations"> IN/OUT: Struct of rotations to compute.  </param>
+  /// <param name="rotations"> IN/OUT: Struct of rotations to compute, or NULL to skip the orientations.  </param>
   /// <param name="layers"> IN: Number of layers in the gradients and rotation pyramids.  </param>
   /// <param name="octave_count"> IN: Number of octaves.  </param>
   /// <returns> 1 IF generation was successful, ELSE 0. </returns>
@@ -197,7 +522,8 @@ extern "C" {
   /// <param name="layers"> IN: Number of layers. </param> 
   /// <param name="keypoints"> OUT: Array of detected keypoints. </param> 
   /// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
-  ///                               OUT: Number of keypoints found. </param> 
+  ///                               OUT: Number of keypoints found. Only the ETHSIFT_BUDGET_SCAN_ORDER mode
+  ///                               reports more keypoints than were stored. </param> 
   /// <returns> 1 IF computation was successful, ELSE 0. </returns>
   /// <remarks> 1 + (layersDoG - 1)*(h - 2*image_border(w - 2*image_border(if (isExtrema) then ... ))) flops</remarks>
   int ethsift_detect_keypoints(struct ethsift_image differences[], struct ethsift_image gradients[], struct ethsift_image rotations[], uint32_t octave_count, uint32_t gaussian_count, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count);
@@ -233,6 +559,19 @@ extern "C" {
   /// <remarks> 2 + keypoint_count(13 + ((bottom-top+1)((right-left+1)(44))))</remarks>
   int ethsift_extract_descriptor(struct ethsift_image gradients[], struct ethsift_image rotations[], uint32_t octave_count, uint32_t gaussian_count, struct ethsift_keypoint keypoints[], uint32_t keypoint_count);
 
+  /// <summary> 
+  /// Extract the keypoint descriptors from a fixed size patch that is resampled bilinearly from the
+  /// Gaussian level, rotated to the keypoint orientation. Its gradients are binned on a fixed grid.
+  /// </summary>
+  /// <param name="gaussians"> IN: Gaussian pyramid. </param>
+  /// <param name="octave_count"> IN: Number of Octaves. </param> 
+  /// <param name="gaussian_count"> IN: Number of gaussian layers. </param> 
+  /// <param name="keypoints"> IN/OUT: Keypoints to describe. </param> 
+  /// <param name="keypoint_count"> IN: Number of keypoints. </param> 
+  /// <returns> 1 IF computation was successful, ELSE 0. </returns>
+  /// <remarks> keypoint_count * (ETHSIFT_DESCR_PATCH_SIZE + 2)^2 * 40 + keypoint_count * ETHSIFT_DESCR_PATCH_SIZE^2 * 100 flops </remarks>
+  int ethsift_extract_descriptor_patch(struct ethsift_image gaussians[], uint32_t octave_count, uint32_t gaussian_count, struct ethsift_keypoint keypoints[], uint32_t keypoint_count);
+
   
   /// <summary> 
   /// Perform SIFT and compute all known keypoints.
@@ -245,6 +584,271 @@ extern "C" {
   /// <remarks> 5 * ethsift_allocate_pyramid + ethsift_generate_octaves + ethsift_generate_gaussian_pyramid + ethsift_generate_difference_pyramid + ethsift_generate_gradient_pyramid + ethsift_detect_keypoints + ethsift_extract_descriptor flops </remarks>
   int ethsift_compute_keypoints(struct ethsift_image image, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count);
 
+  /// <summary> 
+  /// Perform SIFT on a region of interest of the image and compute the keypoints inside of it.
+  /// The pyramids are only built for the ROI plus a halo of ETHSIFT_ROI_HALO pixels.
+  /// </summary>
+  /// <param name="image"> IN: Image to compute the SIFT descriptors of. </param>
+  /// <param name="roi"> IN: Region to detect keypoints in. A zero width or height selects the whole image. </param>
+  /// <param name="mask"> IN: Optional mask of the size of the image, keypoints on zero entries are skipped. May be NULL. </param>
+  /// <param name="keypoints"> OUT: Array of detected keypoints, in coordinates of the full image. </param> 
+  /// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
+  ///                               OUT: Number of keypoints found. </param> 
+  /// <returns> 1 IF computation was successful, ELSE 0. </returns>
+  /// <remarks> ethsift_compute_keypoints on the cropped image flops.
+  ///           Keypoints of coarse octaves within a few dozen octave pixels of the ROI border are approximate,
+  ///           as their blur reaches past the halo. </remarks>
+  int ethsift_compute_keypoints_roi(struct ethsift_image image, struct ethsift_roi roi, const uint8_t *mask, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count);
+
+  /// <summary> 
+  /// Perform SIFT on a borrowed image without copying it, optionally limited to a region of interest.
+  /// </summary>
+  /// <param name="image"> IN: Image to compute the SIFT descriptors of. </param>
+  /// <param name="roi"> IN: Region to detect keypoints in. A zero width or height selects the whole image. </param>
+  /// <param name="mask"> IN: Optional mask of image.width * image.height entries, keypoints on zero entries are skipped. May be NULL. </param>
+  /// <param name="keypoints"> OUT: Array of detected keypoints, in coordinates of the full image. </param> 
+  /// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
+  ///                               OUT: Number of keypoints found. </param> 
+  /// <returns> 1 IF computation was successful, ELSE 0. </returns>
+  /// <remarks> ethsift_compute_keypoints on the viewed region flops.
+  ///           With a ROI, keypoints near its border are approximate as for ethsift_compute_keypoints_roi. </remarks>
+  int ethsift_compute_keypoints_view(struct ethsift_image_view image, struct ethsift_roi roi, const uint8_t *mask, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count);
+
+  /// <summary> 
+  /// Perform SIFT on many borrowed images at once, spread over the threads of ethsift_set_thread_count.
+  /// Every thread reuses its blur buffers and pyramids from one image to the next.
+  /// </summary>
+  /// <param name="images"> IN: Images to compute the SIFT descriptors of. </param>
+  /// <param name="image_count"> IN: Number of images. </param>
+  /// <param name="keypoints"> OUT: One array of detected keypoints per image. </param> 
+  /// <param name="keypoint_counts"> IN: How many keypoints each array can store at most.
+  ///                                OUT: Number of keypoints found per image, 0 for images that failed. </param> 
+  /// <returns> 1 IF computation was successful for all images, ELSE 0. </returns>
+  /// <remarks> ethsift_compute_keypoints_view per image flops </remarks>
+  int ethsift_compute_keypoints_batch(const struct ethsift_image_view images[], uint32_t image_count, struct ethsift_keypoint *keypoints[], uint32_t keypoint_counts[]);
+
+  /// <summary> 
+  /// Create the state that carries pyramids and keypoints from one frame of a video to the next.
+  /// The pyramids are allocated once for the whole frame. Upsampling and the orientation mode are
+  /// fixed at creation, ethsift_video_process fails if they change afterwards.
+  /// </summary>
+  /// <param name="width"> IN: Width of the frames. </param>
+  /// <param name="height"> IN: Height of the frames. </param>
+  /// <param name="threshold"> IN: Mean absolute difference per pixel, in units of the pixel format, above
+  ///                          which a tile of ETHSIFT_VIDEO_TILE pixels counts as changed. </param>
+  /// <param name="video"> OUT: The new state, release it with ethsift_video_free. </param>
+  /// <returns> 1 IF the state could be allocated, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_video_create(uint32_t width, uint32_t height, float threshold, struct ethsift_video **video);
+
+  /// <summary> 
+  /// Release the state of a video and all of its pyramids.
+  /// </summary>
+  /// <param name="video"> IN: State created by ethsift_video_create, may be NULL. </param>
+  /// <returns> 1 </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_video_free(struct ethsift_video *video);
+
+  /// <summary> 
+  /// Compute the keypoints of the next frame of a video. The frame is compared against the pixels the
+  /// pyramids were built from, tile by tile. Only changed tiles and the tiles around them are rebuilt,
+  /// from a crop with a halo of ETHSIFT_VIDEO_HALO pixels, and searched for keypoints again. Keypoints of
+  /// all other tiles are carried over. The first frame, and any frame whose format or bit depth differs
+  /// from the previous one, is processed whole and gives the same keypoints as ethsift_compute_keypoints_view.
+  /// Later frames are approximate: coarse octaves blur a change further than the rebuilt tiles and their
+  /// halo, so keypoints of those octaves near changed tiles can differ from a full computation.
+  /// </summary>
+  /// <param name="video"> IN/OUT: State of the video. </param>
+  /// <param name="frame"> IN: The frame, of the size the state was created with. </param>
+  /// <param name="keypoints"> OUT: Keypoints of the frame, carried over ones first. </param> 
+  /// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
+  ///                               OUT: Number of keypoints of the frame. </param> 
+  /// <returns> 1 IF computation was successful, ELSE 0. </returns>
+  /// <remarks> 3 * w * h + ethsift_compute_keypoints on the rebuilt tiles flops </remarks>
+  int ethsift_video_process(struct ethsift_video *video, struct ethsift_image_view frame, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count);
+
+  /// <summary> 
+  /// Report how much of the last frame had to be rebuilt.
+  /// </summary>
+  /// <param name="video"> IN: State of the video. </param>
+  /// <param name="recomputed_tiles"> OUT: Number of tiles the last call to ethsift_video_process rebuilt. </param>
+  /// <param name="tile_count"> OUT: Number of tiles of a frame. </param>
+  /// <returns> 1 </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_video_stats(const struct ethsift_video *video, uint32_t *recomputed_tiles, uint32_t *tile_count);
+
+  /// <summary> 
+  /// Create a pipeline that computes the keypoints of a stream of frames on two threads of its own.
+  /// One thread builds the pyramids of a frame while the other detects and describes the keypoints of
+  /// the frame before it. The stages hand frames to each other over lock-free bounded queues, the
+  /// results come out in the order the frames went in and equal those of ethsift_compute_keypoints_view.
+  /// </summary>
+  /// <param name="width"> IN: Width of the frames. </param>
+  /// <param name="height"> IN: Height of the frames. </param>
+  /// <param name="depth"> IN: Number of frames that can wait for the pyramid stage, 1 to ETHSIFT_PIPELINE_MAX_DEPTH. </param>
+  /// <param name="keypoint_capacity"> IN: How many keypoints are kept per frame. </param>
+  /// <param name="backpressure"> IN: One of the ETHSIFT_BACKPRESSURE_* modes, for when all of the depth frames wait. </param>
+  /// <param name="pipeline"> OUT: The new pipeline, release it with ethsift_pipeline_free. </param>
+  /// <returns> 1 IF the pipeline could be allocated and started, ELSE 0. </returns>
+  /// <remarks> 0 flops. The settings must not change while frames are in flight. The stages run their
+  ///           parallel sections serially, so the pipeline does not use the threads of ethsift_set_thread_count. </remarks>
+  int ethsift_pipeline_create(uint32_t width, uint32_t height, uint32_t depth, uint32_t keypoint_capacity, uint32_t backpressure, struct ethsift_pipeline **pipeline);
+
+  /// <summary> 
+  /// Stop the threads of a pipeline and release it. Frames that were not polled yet are dropped.
+  /// </summary>
+  /// <param name="pipeline"> IN: Pipeline created by ethsift_pipeline_create, may be NULL. </param>
+  /// <returns> 1 </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_pipeline_free(struct ethsift_pipeline *pipeline);
+
+  /// <summary> 
+  /// Queue a frame for the pipeline. The frame is copied, the caller may reuse it right away.
+  /// With ETHSIFT_BACKPRESSURE_BLOCK a full queue makes the call wait for the pyramid stage to take a
+  /// frame, unless the pipeline is held up by results that were not polled. With
+  /// ETHSIFT_BACKPRESSURE_REJECT it returns right away, and the caller decides whether to drop the frame.
+  /// </summary>
+  /// <param name="pipeline"> IN/OUT: The pipeline. </param>
+  /// <param name="frame"> IN: The frame, of the size the pipeline was created with. </param>
+  /// <returns> 1 IF the frame was queued, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_pipeline_submit(struct ethsift_pipeline *pipeline, struct ethsift_image_view frame);
+
+  /// <summary> 
+  /// Take the keypoints of the oldest frame the pipeline has finished. A frame whose pyramids could
+  /// not be built gives no keypoints.
+  /// </summary>
+  /// <param name="pipeline"> IN/OUT: The pipeline. </param>
+  /// <param name="keypoints"> OUT: Keypoints of the frame. </param>
+  /// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
+  ///                               OUT: Number of keypoints found in the frame. </param>
+  /// <param name="frame_index"> OUT: Number of frames submitted before this one. </param>
+  /// <param name="wait"> IN: Whether to wait for a frame that is still in flight. </param>
+  /// <returns> 1 IF a frame was taken, ELSE 0 when none is finished, or none is in flight with wait. </returns>
+  /// <remarks> ethsift_compute_keypoints per frame flops, on the threads of the pipeline </remarks>
+  int ethsift_pipeline_poll(struct ethsift_pipeline *pipeline, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count, uint32_t *frame_index, int wait);
+
+  /// <summary> 
+  /// Map a binary PGM (P5) or PPM (P6) file into memory and parse its header, without reading the pixels.
+  /// The view of an 8-bit PGM file points into the mapping and can be handed to ethsift_compute_keypoints_view
+  /// as is, other files are read with ethsift_pnm_to_float.
+  /// </summary>
+  /// <param name="path"> IN: Path of the file. </param>
+  /// <param name="pnm"> OUT: The mapped file, release it with ethsift_unmap_pnm. </param>
+  /// <returns> 1 IF the file could be mapped and is a valid binary PGM or PPM, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_map_pnm(const char *path, struct ethsift_pnm *pnm);
+
+  /// <summary> 
+  /// Unmap a file mapped by ethsift_map_pnm. Views into it are invalid afterwards.
+  /// </summary>
+  /// <param name="pnm"> IN/OUT: The mapped file, may be all zero. </param>
+  /// <returns> 1 </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_unmap_pnm(struct ethsift_pnm *pnm);
+
+  /// <summary> 
+  /// Convert the pixels of a mapped file to float, in chunks of rows spread over the threads of
+  /// ethsift_set_thread_count. Colour is converted to gray with the BT.601 weights.
+  /// </summary>
+  /// <param name="pnm"> IN: File mapped by ethsift_map_pnm. </param>
+  /// <param name="image"> OUT: Image with allocated pixels, of the size of the file. </param>
+  /// <returns> 1 IF the sizes match, ELSE 0. </returns>
+  /// <remarks> 5 * w * h flops for PPM files, ELSE 0 </remarks>
+  int ethsift_pnm_to_float(const struct ethsift_pnm *pnm, struct ethsift_image image);
+
+  /// <summary> 
+  /// Open an uncompressed video file for streaming, either Y4M or raw 8-bit luma frames. The file is
+  /// mapped, frames are read straight from the mapping.
+  /// </summary>
+  /// <param name="path"> IN: Path of the file. </param>
+  /// <param name="width"> IN: Width of the frames of a raw file, ignored for Y4M. </param>
+  /// <param name="height"> IN: Height of the frames of a raw file, ignored for Y4M. </param>
+  /// <param name="sequence"> OUT: The opened sequence, close it with ethsift_sequence_close. </param>
+  /// <returns> 1 IF the file could be mapped and holds at least one frame, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_sequence_open(const char *path, uint32_t width, uint32_t height, struct ethsift_sequence **sequence);
+
+  /// <summary> 
+  /// Close a sequence and unmap its file. Frames read from it are invalid afterwards.
+  /// </summary>
+  /// <param name="sequence"> IN: Sequence opened by ethsift_sequence_open, may be NULL. </param>
+  /// <returns> 1 </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_sequence_close(struct ethsift_sequence *sequence);
+
+  /// <summary> 
+  /// Describe the frames of a sequence.
+  /// </summary>
+  /// <param name="sequence"> IN: The sequence. </param>
+  /// <param name="width"> OUT: Width of the frames. </param>
+  /// <param name="height"> OUT: Height of the frames. </param>
+  /// <param name="frame_count"> OUT: Number of complete frames in the file. </param>
+  /// <param name="fps"> OUT: Frame rate of the file, 25 for raw files. </param>
+  /// <returns> 1 </returns>
+  /// <remarks> 1 flop </remarks>
+  int ethsift_sequence_info(const struct ethsift_sequence *sequence, uint32_t *width, uint32_t *height, uint32_t *frame_count, float *fps);
+
+  /// <summary> 
+  /// Hand out the luma plane of the next frame as a view into the mapped file. The chroma planes are
+  /// never touched.
+  /// </summary>
+  /// <param name="sequence"> IN/OUT: The sequence. </param>
+  /// <param name="frame"> OUT: The frame, valid until the next call. ETHSIFT_FORMAT_U8, or ETHSIFT_FORMAT_U16
+  ///                      with the sample values of the file and bits set to its depth for more than 8 bits. </param>
+  /// <returns> 1 IF there was another frame, ELSE 0 at the end of the file. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_sequence_read(struct ethsift_sequence *sequence, struct ethsift_image_view *frame);
+
+  /// <summary> 
+  /// Start reading the sequence from its first frame again.
+  /// </summary>
+  /// <param name="sequence"> IN/OUT: The sequence. </param>
+  /// <returns> 1 </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_sequence_rewind(struct ethsift_sequence *sequence);
+
+  /// <summary> 
+  /// Write keypoints to a versioned binary file: a header, one array per keypoint field, and a
+  /// 64-byte aligned block with the descriptors one after the other, all little-endian.
+  /// </summary>
+  /// <param name="path"> IN: Path of the file, replaced if it exists. </param>
+  /// <param name="keypoints"> IN: Keypoints to write. </param>
+  /// <param name="keypoint_count"> IN: Number of keypoints. </param>
+  /// <param name="format"> IN: ETHSIFT_STORE_F32 to keep the descriptors as they are, ETHSIFT_STORE_U8 to round
+  ///                       them to bytes, or ETHSIFT_STORE_F16 for half precision. </param>
+  /// <returns> 1 IF the file could be written, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_write_keypoints(const char *path, const struct ethsift_keypoint keypoints[], uint32_t keypoint_count, uint32_t format);
+
+  /// <summary> 
+  /// Map a keypoint file into memory and check its header, without reading the keypoints. The
+  /// arrays of the file point into the mapping and can be used in place.
+  /// </summary>
+  /// <param name="path"> IN: Path of the file. </param>
+  /// <param name="file"> OUT: The mapped file, release it with ethsift_unmap_keypoints. </param>
+  /// <returns> 1 IF the file could be mapped and is a complete keypoint file of a known version, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_map_keypoints(const char *path, struct ethsift_keypoint_file *file);
+
+  /// <summary> 
+  /// Unmap a keypoint file. Pointers into it are invalid afterwards.
+  /// </summary>
+  /// <param name="file"> IN/OUT: The mapped file, may be all zero. </param>
+  /// <returns> 1 </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_unmap_keypoints(struct ethsift_keypoint_file *file);
+
+  /// <summary> 
+  /// Unpack a range of the keypoints of a mapped file into keypoint structs.
+  /// </summary>
+  /// <param name="file"> IN: File mapped by ethsift_map_keypoints. </param>
+  /// <param name="first"> IN: Index of the first keypoint to unpack. </param>
+  /// <param name="keypoints"> OUT: The keypoints. </param>
+  /// <param name="count"> IN: Number of keypoints to unpack. </param>
+  /// <returns> 1 IF the range lies within the file, ELSE 0. </returns>
+  /// <remarks> 0 flops </remarks>
+  int ethsift_load_keypoints(const struct ethsift_keypoint_file *file, uint64_t first, struct ethsift_keypoint keypoints[], uint32_t count);
 
   /// <summary> 
   /// Match up the common keypoints between two sets.
@@ -13,6 +13,22 @@ int ethsift_allocate_pyramid(struct ethsift_image pyramid[], uint32_t ref_width,
   if(layer_count == 0) return 1;
   if(image_per_layer_count == 0) return 1;
 
+  size_t total_size = pyramid_size(ref_width, ref_height, layer_count, image_per_layer_count);
+  if(total_size == 0) return 0;
+
+  float *pixels = 0;
+  if(posix_memalign((void*)&pixels, ETHSIFT_MEMALIGN, total_size*sizeof(float)))
+    return 0;
+
+  layout_pyramid(pyramid, pixels, ref_width, ref_height, layer_count, image_per_layer_count, 1);
+  return 1;
+}
+
+/// <summary> 
+/// Number of pixels of all levels of a pyramid, see ethsift_allocate_pyramid.
+/// </summary>
+/// <returns> The number of pixels, 0 IF the pyramid cannot be built at the requested depth. </returns>
+size_t pyramid_size(uint32_t ref_width, uint32_t ref_height, uint32_t layer_count, uint32_t image_per_layer_count){
   uint32_t dim;
 
   // Ensure the pyramid can even be built at the requested depth.
@@ -25,13 +41,18 @@ int ethsift_allocate_pyramid(struct ethsift_image pyramid[], uint32_t ref_width,
   // sum(i=0..n-1) w/(2^i)*y/(2^i)
   // = 1/3*w*h*(4-4^(1-n))
   // = (4*w*h-2*w*h/(2^(2*(n-1))))/3
-  size_t total_size = (4*dim - 2*dim / (2 << 2*(layer_count-1))) / 3;
-  total_size *= image_per_layer_count;
-
-  float *pixels = 0;
-  if(posix_memalign((void*)&pixels, ETHSIFT_MEMALIGN, total_size*sizeof(float)))
-    return 0;
+  size_t total_size = (4*(size_t)dim - 2*(size_t)dim / (2 << 2*(layer_count-1))) / 3;
+  return total_size * image_per_layer_count;
+}
 
+/// <summary> 
+/// Point the levels of a pyramid into the given pixels, one after the other.
+/// </summary>
+/// <param name="pyramid"> OUT: The pyramid to lay out. </param>
+/// <param name="pixels"> IN: At least lanes * pyramid_size floats. </param>
+/// <param name="lanes"> IN: Floats per pixel, 1 or ETHSIFT_LANES for interleaved images, see lanes.c. </param>
+/// <returns> The pixels past the last level. </returns>
+float *layout_pyramid(struct ethsift_image pyramid[], float *pixels, uint32_t ref_width, uint32_t ref_height, uint32_t layer_count, uint32_t image_per_layer_count, uint32_t lanes){
   uint32_t width = ref_width;
   uint32_t height = ref_height;
 
@@ -41,15 +62,59 @@ int ethsift_allocate_pyramid(struct ethsift_image pyramid[], uint32_t ref_width,
       pyramid[i*image_per_layer_count + j].pixels = pixels;
       pyramid[i*image_per_layer_count + j].width = width;
       pyramid[i*image_per_layer_count + j].height = height;
-      pixels += width * height;
+      pixels += width * height * lanes;
     }
     width /= 2;
     height /= 2;
   }
-  
+  return pixels;
+}
+
+/// <summary> 
+/// Lay out the pyramids of an image in the block of the set, which only grows when the image does not fit.
+/// </summary>
+/// <param name="pyramids"> IN/OUT: The set, zeroed before its first use. </param>
+/// <param name="ref_width"> IN: Width of the first octave. </param>
+/// <param name="ref_height"> IN: Height of the first octave. </param>
+/// <param name="octave_count"> IN: Number of octaves, at most ETHSIFT_MAX_OCTAVES. </param>
+/// <param name="rotations"> IN: 1 to lay out the rotation pyramid as well, 0 to leave it empty. </param>
+/// <param name="lanes"> IN: Floats per pixel, see layout_pyramid. </param>
+/// <returns> 1 IF the pyramids fit, ELSE 0. </returns>
+int pyramids_reserve(struct ethsift_pyramids *pyramids, uint32_t ref_width, uint32_t ref_height, uint32_t octave_count, uint32_t rotations, uint32_t lanes){
+  const uint32_t gaussian_count = ETHSIFT_INTVLS + 3;
+  const uint32_t dog_count = ETHSIFT_INTVLS + 2;
+  if(octave_count == 0 || ETHSIFT_MAX_OCTAVES < octave_count) return 0;
+
+  const size_t level_size = pyramid_size(ref_width, ref_height, octave_count, 1);
+  if(level_size == 0) return 0;
+  const size_t total_size = level_size * ((2 + rotations) * gaussian_count + dog_count) * lanes;
+  if(pyramids->capacity < total_size){
+    free(pyramids->pixels);
+    pyramids->pixels = NULL;
+    pyramids->capacity = 0;
+    if(posix_memalign((void*)&pyramids->pixels, ETHSIFT_MEMALIGN, total_size*sizeof(float)))
+      return 0;
+    pyramids->capacity = total_size;
+  }
+
+  float *pixels = pyramids->pixels;
+  pixels = layout_pyramid(pyramids->gaussians, pixels, ref_width, ref_height, octave_count, gaussian_count, lanes);
+  pixels = layout_pyramid(pyramids->differences, pixels, ref_width, ref_height, octave_count, dog_count, lanes);
+  pixels = layout_pyramid(pyramids->gradients, pixels, ref_width, ref_height, octave_count, gaussian_count, lanes);
+  if(rotations)
+    layout_pyramid(pyramids->rotations, pixels, ref_width, ref_height, octave_count, gaussian_count, lanes);
   return 1;
 }
 
+/// <summary> 
+/// Free the block of a pyramid set, it can be reserved again afterwards.
+/// </summary>
+void pyramids_release(struct ethsift_pyramids *pyramids){
+  free(pyramids->pixels);
+  pyramids->pixels = NULL;
+  pyramids->capacity = 0;
+}
+
 /// <summary> 
 /// Free up the pyramids allocated memory.
 /// </summary>
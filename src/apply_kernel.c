@@ -1,105 +1,467 @@
 #include "internal.h"
 
 /// <summary> 
-/// Apply Gaussian row filter to image and then transpose the image.
+/// Filter the padded row src and write it as column r of the transposed output.
+/// Scalar variant of filter_row_transpose_avx2.
+/// </summary>
+/// <remarks> (w * (2* kernel_size)) flops </remarks>
+void filter_row_transpose_scalar(float * restrict output, const float * restrict src, int r, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int symmetric) {
+  int dst_ind = r;
+  for (int c = 0; c < w; ++c) {
+    float s_partialSum = 0.0f;       
+
+    for (int i = 0; i < kernel_size; i++) {
+      s_partialSum += kernel[i] * src[c + i];
+      inc_adds(1);
+      inc_mults(1);
+      inc_read(2, float);
+    }
+
+    output[dst_ind] = s_partialSum;
+    inc_write(1, float);
+    dst_ind += h;
+  }
+}
+
+/// <summary> 
+/// Filter the padded row src and write it as column r of the transposed output.
+/// SSE variant of filter_row_transpose_avx2, four outputs at a time.
+/// </summary>
+/// <remarks> (w * (2* kernel_size)) flops </remarks>
+ETHSIFT_TARGET_SSE
+void filter_row_transpose_sse(float * restrict output, const float * restrict src, int r, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int symmetric) {
+  int dst_ind = r;
+  float partialSum[4];
+  int c;
+  for (c = 0; c < w - 3; c += 4) {
+    __m128 d_partialSum = _mm_setzero_ps();
+    for (int i = 0; i < kernel_size; ++i) {
+      __m128 d_kernel = _mm_set1_ps(kernel[i]);
+      __m128 d_rowbuf = _mm_loadu_ps(src + c + i);
+      d_partialSum = _mm_add_ps(d_partialSum, _mm_mul_ps(d_kernel, d_rowbuf));
+      inc_read(1+4, float);
+      inc_adds(4);
+      inc_mults(4);
+    }
+    _mm_storeu_ps(partialSum, d_partialSum);
+    for (int i = 0; i < 4; ++i) {
+      output[dst_ind] = partialSum[i];
+      dst_ind += h;
+    }
+    inc_write(4, float);
+  }
+
+  for (; c < w; ++c) {
+    float s_partialSum = 0.0f;       
+    for (int i = 0; i < kernel_size; i++) {
+      s_partialSum += kernel[i] * src[c + i];
+      inc_adds(1);
+      inc_mults(1);
+      inc_read(2, float);
+    }
+    output[dst_ind] = s_partialSum;
+    inc_write(1, float);
+    dst_ind += h;
+  }
+}
+
+/// <summary> 
+/// Filter the padded row src and write it as column r of the transposed output.
+/// Generic AVX2 variant for kernels without a specialisation, see filter_specialised.c.
 /// </summary>
-/// <param name="pixels"> IN: Pixels to filter. </param>
 /// <param name="output"> OUT: Filtered image. </param>
+/// <param name="src"> IN: Row to filter, padded by kernel_rad on both sides. </param>
+/// <param name="r"> IN: Row that is held in src. </param>
 /// <param name="w"> IN: Width of image to filter. </param>
 /// <param name="h"> IN: Height of image to filter. </param>
 /// <param name="kernel"> IN: Kernel to filter with. </param>
 /// <param name="kernel_size"> IN: Size of the kernel. </param>
 /// <param name="kernel_rad"> IN: Radius of the kernel. </param>
-/// <returns> 1 IF generation was successful, ELSE 0. </returns>
- /// <remarks> (h * w * (2* kernel_size)) flops </remarks>
-int row_filter_transpose(float * restrict pixels, float * restrict output, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad) {
-  
-  // ==========================================================================
-  // TODO Work in progress
-  //      - Rewrite to make it in place
-  int elemSize = sizeof(float);
-
+/// <remarks> (w * (2* kernel_size)) flops </remarks>
+ETHSIFT_TARGET_AVX2
+void filter_row_transpose_avx2_generic(float * restrict output, const float * restrict src, int r, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad) {
   int buf_ind = 0;
-  int dst_ind = 0;
-  int row_ind = 0;
-
-  // const int align = 32;
-  // void *p = alloca(8*sizeof(float) + align - 1);
-  // float *partialSum = (float*)((((intptr_t)p + align - 1) / align) * align);
+  int dst_ind = r;
 
   float partialSum[8];
   
   __m256 d_partialSum;
   __m256 d_kernel, d_rowbuf;
 
-  float firstData, lastData;
+  int w_lim = w - 7;
+  int c;
+  for (c = 0; c < w_lim; c += 8) {
+    d_partialSum = _mm256_setzero_ps();    
+
+    for (int i = 0; i < kernel_size; ++i) {
+      d_kernel = _mm256_broadcast_ss(kernel + i);
+      d_rowbuf = _mm256_loadu_ps(src + buf_ind);
+      inc_read(1+8, float);
+
+      d_partialSum = _mm256_fmadd_ps(d_kernel, d_rowbuf, d_partialSum);
+
+      ++buf_ind;
+        
+      inc_adds(8);
+      inc_mults(8);
+    }
+
+    _mm256_storeu_ps(partialSum, d_partialSum);
+    inc_write(8, float);
+
+    buf_ind -= 2 * kernel_rad;
+    buf_ind += 7;
+
+    for (int i = 0; i < 8; ++i) {
+      output[dst_ind] = partialSum[i];
+      inc_write(1, float);
+      inc_read(1, float);
+      dst_ind += h;
+    }
+  }
+
+  for (; c < w; ++c) {
+    float s_partialSum = 0.0f;       
+
+    for (int i = 0; i < kernel_size; i++) {
+      s_partialSum += kernel[i] * src[buf_ind];
+      inc_adds(1);
+      inc_mults(1);
+      inc_read(2, float);
+      ++buf_ind;
+    }
+
+    buf_ind -= 2 * kernel_rad;
+    output[dst_ind] = s_partialSum;
+    inc_write(1, float);
+    dst_ind += h;
+  }
+}
+
+/// <summary> 
+/// Filter the padded row src and write it as column r of the transposed output.
+/// Generic AVX-512 variant of filter_row_transpose_avx2, sixteen outputs at a time. The last
+/// block is masked instead of being finished with a scalar loop.
+/// </summary>
+/// <remarks> (w * (2* kernel_size)) flops </remarks>
+ETHSIFT_TARGET_AVX512
+void filter_row_transpose_avx512_generic(float * restrict output, const float * restrict src, int r, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad) {
+  // Lane i of a block lands i rows further down in the transposed output.
+  const __m512i d_scatter = _mm512_mullo_epi32(_mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0),
+                                               _mm512_set1_epi32(h));
+
+  for (int c = 0; c < w; c += 16) {
+    const int lanes = internal_min(16, w - c);
+    const __mmask16 mask = (__mmask16)((1u << lanes) - 1);
+    __m512 d_partialSum = _mm512_setzero_ps();
+
+    for (int i = 0; i < kernel_size; ++i) {
+      __m512 d_kernel = _mm512_set1_ps(kernel[i]);
+      __m512 d_rowbuf = _mm512_maskz_loadu_ps(mask, src + c + i);
+      d_partialSum = _mm512_fmadd_ps(d_kernel, d_rowbuf, d_partialSum);
+      inc_read(1+lanes, float);
+      inc_adds(lanes);
+      inc_mults(lanes);
+    }
+
+    _mm512_mask_i32scatter_ps(output + r + c * h, mask, d_scatter, d_partialSum, sizeof(float));
+    inc_write(lanes, float);
+  }
+}
+
+/// <summary> 
+/// Replicate the first and last pixel of the row in row_buf into the kernel padding.
+/// </summary>
+static inline void pad_row(int w, uint32_t kernel_rad) {
+  float firstData = row_buf[kernel_rad];
+  float lastData = row_buf[kernel_rad + w - 1];
+  inc_read(2, float);
+  for (int i = 0; i < kernel_rad; i++) {
+    row_buf[i] = firstData;
+    row_buf[i + w + kernel_rad] = lastData;
+    inc_write(2, float);
+  }
+}
+
+/// <summary> 
+/// Apply Gaussian row filter to image and then transpose the image.
+/// </summary>
+/// <param name="pixels"> IN: Pixels to filter. </param>
+/// <param name="output"> OUT: Filtered image. </param>
+/// <param name="w"> IN: Width of image to filter. </param>
+/// <param name="h"> IN: Height of image to filter. </param>
+/// <param name="kernel"> IN: Kernel to filter with. </param>
+/// <param name="kernel_size"> IN: Size of the kernel. </param>
+/// <param name="kernel_rad"> IN: Radius of the kernel. </param>
+/// <returns> 1 IF generation was successful, ELSE 0. </returns>
+ /// <remarks> (h * w * (2* kernel_size)) flops </remarks>
+int row_filter_transpose(float * restrict pixels, float * restrict output, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int symmetric) {
+  int row_ind = 0;
   
   for (int r = 0; r < h; r++) {
-    memcpy(&row_buf[kernel_rad], &pixels[row_ind], elemSize * w);
+    memcpy(&row_buf[kernel_rad], &pixels[row_ind], sizeof(float) * w);
     inc_read(w, float);
     inc_write(w, float);
-    firstData = pixels[row_ind];
-    lastData = pixels[row_ind + w - 1];
-    inc_read(2, float);
-    for (int i = 0; i < kernel_rad; i++) {
-      row_buf[i] = firstData;
-      row_buf[i + w + kernel_rad] = lastData;
-      inc_write(2, float);
-    }
+    pad_row(w, kernel_rad);
 
-    dst_ind = r;
-    buf_ind = 0;
-    
-    int w_lim = w - 7;
-    int c;
-    for (c = 0; c < w_lim; c += 8) {
-      d_partialSum = _mm256_setzero_ps();    
+    g_kernels.filter_row_transpose(output, row_buf, r, w, h, kernel, kernel_size, kernel_rad, symmetric);
 
-      for (int i = 0; i < kernel_size; ++i) {
-        d_kernel = _mm256_broadcast_ss(kernel + i);
-        d_rowbuf = _mm256_loadu_ps(row_buf + buf_ind);
-        inc_read(1+8, float);
+    row_ind += w;
+  }
 
-        d_partialSum = _mm256_fmadd_ps(d_kernel, d_rowbuf, d_partialSum);
+  return 1;
+}
 
-        ++buf_ind;
-          
-        inc_adds(8);
-        inc_mults(8);
+/// <summary> 
+/// Apply Gaussian row filter to the 2x bilinear upsampling of a borrowed image and then transpose it.
+/// Each upsampled row is interpolated straight into row_buf, so the upsampled image never exists.
+/// </summary>
+/// <param name="view"> IN: Image to upsample and filter. </param>
+/// <param name="output"> OUT: Filtered image of size (2 * view.height) * (2 * view.width). </param>
+/// <param name="kernel"> IN: Kernel to filter with. </param>
+/// <param name="kernel_size"> IN: Size of the kernel. </param>
+/// <param name="kernel_rad"> IN: Radius of the kernel. </param>
+/// <returns> 1 IF generation was successful, ELSE 0. </returns>
+/// <remarks> (4 * h * w * (2* kernel_size + 1)) flops </remarks>
+static int row_filter_transpose_upsample(struct ethsift_image_view view, float * restrict output, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int symmetric) {
+  const int w = view.width;
+  const int h = view.height;
+  const int up_w = w << 1;
+  const int up_h = h << 1;
+  // The two input rows an upsampled row lies between, converted to float once each.
+  float rows[2][w];
+  float interpolated[w];
+  const float range = view_range(view);
+  int loaded = -1;
+
+  for (int r = 0; r < up_h; r++) {
+    const int r1 = r >> 1;
+    const int r2 = internal_min(r1 + 1, h - 1);
+    while (loaded < r2) {
+      ++loaded;
+      g_kernels.convert_row(rows[loaded & 1], (const uint8_t *) view.data + loaded * view.stride, w, view.format, range);
+    }
+
+    // Even rows sit on an input row, odd rows halfway to the next one.
+    const float *vertical = rows[r1 & 1];
+    if (r & 1) {
+      const float *next = rows[r2 & 1];
+      for (int c = 0; c < w; ++c) {
+        interpolated[c] = 0.5f * (vertical[c] + next[c]);
       }
+      inc_adds(w);
+      inc_mults(w);
+      vertical = interpolated;
+    }
 
-      _mm256_store_ps(partialSum, d_partialSum);
-      inc_write(8, float);
+    float *dst = &row_buf[kernel_rad];
+    for (int c = 0; c < w - 1; ++c) {
+      dst[2 * c] = vertical[c];
+      dst[2 * c + 1] = 0.5f * (vertical[c] + vertical[c + 1]);
+    }
+    dst[up_w - 2] = vertical[w - 1];
+    dst[up_w - 1] = vertical[w - 1];
+    inc_adds(w);
+    inc_mults(w);
+    inc_read(w, float);
+    inc_write(up_w, float);
+    pad_row(up_w, kernel_rad);
 
-      buf_ind -= 2 * kernel_rad;
-      buf_ind += 7;
+    g_kernels.filter_row_transpose(output, row_buf, r, up_w, up_h, kernel, kernel_size, kernel_rad, symmetric);
+  }
 
-      for (int i = 0; i < 8; ++i) {
-        output[dst_ind] = partialSum[i];
-        inc_write(1, float);
-        inc_read(1, float);
-        dst_ind += h;
+  return 1;
+}
+
+/// <summary> 
+/// Apply Gaussian row filter to the transposed image, transpose it back and decimate the result.
+/// </summary>
+/// <param name="pixels"> IN: Transposed pixels to filter. </param>
+/// <param name="output"> OUT: Filtered image. </param>
+/// <param name="w"> IN: Width of the transposed image, the height of the output. </param>
+/// <param name="h"> IN: Height of the transposed image, the width of the output. </param>
+/// <param name="kernel"> IN: Kernel to filter with. </param>
+/// <param name="kernel_size"> IN: Size of the kernel. </param>
+/// <param name="kernel_rad"> IN: Radius of the kernel. </param>
+/// <param name="half"> OUT: Every second pixel of every second row of the output. </param>
+/// <returns> 1 IF generation was successful, ELSE 0. </returns>
+/// <remarks> (h * w * (2* kernel_size)) flops </remarks>
+static int row_filter_transpose_decimate(float * restrict pixels, float * restrict output, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int symmetric, struct ethsift_image half) {
+  const int dst_w = half.width;
+  const int dst_h = half.height;
+  int row_ind = 0;
+  
+  for (int r = 0; r < h; r++) {
+    memcpy(&row_buf[kernel_rad], &pixels[row_ind], sizeof(float) * w);
+    inc_read(w, float);
+    inc_write(w, float);
+    pad_row(w, kernel_rad);
+
+    g_kernels.filter_row_transpose(output, row_buf, r, w, h, kernel, kernel_size, kernel_rad, symmetric);
+
+    // The column we just wrote is still in cache, take the even pixels of it for the next octave.
+    if ((r & 1) == 0 && (r >> 1) < dst_w) {
+      for (int y = 0; y < dst_h; ++y) {
+        half.pixels[y * dst_w + (r >> 1)] = output[2 * y * h + r];
       }
+      inc_read(dst_h, float);
+      inc_write(dst_h, float);
     }
 
-    for (; c < w; ++c) {
-      float s_partialSum = 0.0f;       
+    row_ind += w;
+  }
 
-      for (int i = 0; i < kernel_size; i++) {
-        s_partialSum += kernel[i] * row_buf[buf_ind];
-        inc_adds(1);
-        inc_mults(1);
-        inc_read(2, float);
-        ++buf_ind;
-      }
+  return 1;
+}
 
-      buf_ind -= 2 * kernel_rad;
-      output[dst_ind] = s_partialSum;
-      inc_write(1, float);
-      dst_ind += h;
+/// <summary> 
+/// Convert a row of a borrowed image to float into row_buf.
+/// Scalar variant of convert_row_avx2.
+/// </summary>
+void convert_row_scalar(float * restrict dst, const void * restrict row, int w, uint32_t format, float range) {
+  switch (format) {
+  case ETHSIFT_FORMAT_U8:
+    for (int c = 0; c < w; ++c) {
+      dst[c] = (float) ((const uint8_t *) row)[c];
+    }
+    inc_read(w, uint8_t);
+    break;
+  case ETHSIFT_FORMAT_U16:
+    for (int c = 0; c < w; ++c) {
+      dst[c] = (float) ((const uint16_t *) row)[c] * 255.0f / range;
     }
+    inc_read(w, uint16_t);
+    inc_mults(w);
+    inc_div(w);
+    break;
+  default:
+    memcpy(dst, row, sizeof(float) * w);
+    inc_read(w, float);
+    break;
+  }
+  inc_write(w, float);
+}
 
-    row_ind += w;
+/// <summary> 
+/// Convert a row of a borrowed image to float into row_buf.
+/// SSE variant of convert_row_avx2.
+/// </summary>
+/// <param name="dst"> OUT: Where to write the converted pixels. </param>
+/// <param name="row"> IN: Start of the row in the view. </param>
+/// <param name="w"> IN: Number of pixels in the row. </param>
+/// <param name="format"> IN: One of the ETHSIFT_FORMAT_* pixel formats. </param>
+/// <param name="range"> IN: Largest ETHSIFT_FORMAT_U16 sample, see view_range. </param>
+ETHSIFT_TARGET_SSE
+void convert_row_sse(float * restrict dst, const void * restrict row, int w, uint32_t format, float range) {
+  int c = 0;
+  switch (format) {
+  case ETHSIFT_FORMAT_U8: {
+    const uint8_t *src = (const uint8_t *) row;
+    for (; c < w - 3; c += 4) {
+      __m128i bytes = _mm_cvtsi32_si128(*(const int32_t *) (src + c));
+      _mm_storeu_ps(dst + c, _mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes)));
+    }
+    for (; c < w; ++c) {
+      dst[c] = (float) src[c];
+    }
+    inc_read(w, uint8_t);
+    break;
+  }
+  case ETHSIFT_FORMAT_U16: {
+    const uint16_t *src = (const uint16_t *) row;
+    const __m128 scale = _mm_set1_ps(255.0f), divisor = _mm_set1_ps(range);
+    for (; c < w - 3; c += 4) {
+      __m128i words = _mm_loadl_epi64((const __m128i *) (src + c));
+      _mm_storeu_ps(dst + c, _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(words)), scale), divisor));
+    }
+    for (; c < w; ++c) {
+      dst[c] = (float) src[c] * 255.0f / range;
+    }
+    inc_read(w, uint16_t);
+    inc_mults(w);
+    inc_div(w);
+    break;
+  }
+  default:
+    memcpy(dst, row, sizeof(float) * w);
+    inc_read(w, float);
+    break;
+  }
+  inc_write(w, float);
+}
+
+/// <summary> 
+/// Convert a row of a borrowed image to float into row_buf.
+/// </summary>
+/// <param name="dst"> OUT: Where to write the converted pixels. </param>
+/// <param name="row"> IN: Start of the row in the view. </param>
+/// <param name="w"> IN: Number of pixels in the row. </param>
+/// <param name="format"> IN: One of the ETHSIFT_FORMAT_* pixel formats. </param>
+/// <param name="range"> IN: Largest ETHSIFT_FORMAT_U16 sample. Samples are multiplied by 255 and then divided
+///                      by it, so that 8-bit values scaled up by 257 come back exactly. </param>
+ETHSIFT_TARGET_AVX2
+void convert_row_avx2(float * restrict dst, const void * restrict row, int w, uint32_t format, float range) {
+  int c = 0;
+  switch (format) {
+  case ETHSIFT_FORMAT_U8: {
+    const uint8_t *src = (const uint8_t *) row;
+    for (; c < w - 7; c += 8) {
+      __m128i bytes = _mm_loadl_epi64((const __m128i *) (src + c));
+      _mm256_storeu_ps(dst + c, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)));
+    }
+    for (; c < w; ++c) {
+      dst[c] = (float) src[c];
+    }
+    inc_read(w, uint8_t);
+    break;
+  }
+  case ETHSIFT_FORMAT_U16: {
+    const uint16_t *src = (const uint16_t *) row;
+    const __m256 scale = _mm256_set1_ps(255.0f), divisor = _mm256_set1_ps(range);
+    for (; c < w - 7; c += 8) {
+      __m128i words = _mm_loadu_si128((const __m128i *) (src + c));
+      _mm256_storeu_ps(dst + c, _mm256_div_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(words)), scale), divisor));
+    }
+    for (; c < w; ++c) {
+      dst[c] = (float) src[c] * 255.0f / range;
+    }
+    inc_read(w, uint16_t);
+    inc_mults(w);
+    inc_div(w);
+    break;
+  }
+  default:
+    memcpy(dst, row, sizeof(float) * w);
+    inc_read(w, float);
+    break;
+  }
+  inc_write(w, float);
+}
+
+/// <summary> 
+/// Apply Gaussian row filter to a borrowed image and then transpose it, converting
+/// the pixels to float while loading each row.
+/// </summary>
+/// <param name="view"> IN: Image to filter. </param>
+/// <param name="output"> OUT: Filtered image of size view.height * view.width. </param>
+/// <param name="kernel"> IN: Kernel to filter with. </param>
+/// <param name="kernel_size"> IN: Size of the kernel. </param>
+/// <param name="kernel_rad"> IN: Radius of the kernel. </param>
+/// <returns> 1 IF generation was successful, ELSE 0. </returns>
+/// <remarks> (h * w * (2* kernel_size)) flops </remarks>
+int row_filter_transpose_view(struct ethsift_image_view view, float * restrict output, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int symmetric) {
+  const int w = view.width;
+  const int h = view.height;
+  const uint8_t *row = (const uint8_t *) view.data;
+  const float range = view_range(view);
+  
+  for (int r = 0; r < h; r++) {
+    g_kernels.convert_row(&row_buf[kernel_rad], row, w, view.format, range);
+    pad_row(w, kernel_rad);
+
+    g_kernels.filter_row_transpose(output, row_buf, r, w, h, kernel, kernel_size, kernel_rad, symmetric);
+
+    row += view.stride;
   }
 
   return 1;
@@ -136,6 +498,7 @@ int row_filter_transpose_fft(float * restrict pixels, float * restrict output, i
 }
 
 // First prototype, to show each optimization step
+ETHSIFT_TARGET_AVX2
 int row_filter_transpose_first(float * restrict pixels, float * restrict output, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad) {
   int elemSize = sizeof(float);
 
@@ -222,6 +585,7 @@ int row_filter_transpose_first(float * restrict pixels, float * restrict output,
 }
 
 // Another AVX version, that should decrease the amount of split_loads
+ETHSIFT_TARGET_AVX2
 int row_filter_transpose_useing_shuffles(float * restrict pixels, float * restrict output, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad) {
   
   int elemSize = sizeof(float);
@@ -358,8 +722,123 @@ int row_filter_transpose_useing_shuffles(float * restrict pixels, float * restri
 int ethsift_apply_kernel(struct ethsift_image image, float *kernel, uint32_t kernel_size, uint32_t kernel_rad, struct ethsift_image output) {
   uint32_t w = image.width;
   uint32_t h = image.height;
+  const int symmetric = kernel_symmetric(kernel, kernel_size, kernel_rad);
   
-  row_filter_transpose(image.pixels, img_buf, w, h, kernel, kernel_size, kernel_rad);
-  row_filter_transpose(img_buf, output.pixels, h, w, kernel, kernel_size, kernel_rad);
+  row_filter_transpose(image.pixels, img_buf, w, h, kernel, kernel_size, kernel_rad, symmetric);
+  row_filter_transpose(img_buf, output.pixels, h, w, kernel, kernel_size, kernel_rad, symmetric);
+  return 1;
+}
+
+/// <summary> 
+/// Apply the gaussian kernel to a borrowed image and write the result to the output.
+/// </summary>
+/// <param name="image"> IN: Input image to blur. </param>
+/// <param name="kernel"> IN: The gaussian kernel/filter we use for blurring. </param>
+/// <param name="kernel_size"> IN: Size of gaussian kernels. </param>
+/// <param name="kernel_rad"> IN: Radius of the kernel. </param>
+/// <param name="output"> OUT: Blurred output image. </param>
+/// <returns> 1 IF generation was successful, ELSE 0. </returns>
+/// <remarks> 2 * (h * w * (2 * kernel_size)) flops </remarks>
+int ethsift_apply_kernel_view(struct ethsift_image_view image, float *kernel, uint32_t kernel_size, uint32_t kernel_rad, struct ethsift_image output) {
+  const int symmetric = kernel_symmetric(kernel, kernel_size, kernel_rad);
+  row_filter_transpose_view(image, img_buf, kernel, kernel_size, kernel_rad, symmetric);
+  row_filter_transpose(img_buf, output.pixels, image.height, image.width, kernel, kernel_size, kernel_rad, symmetric);
+  return 1;
+}
+
+/// <summary> 
+/// Upsample a borrowed image by 2x bilinearly, apply the gaussian kernel and write the result to the output.
+/// </summary>
+/// <param name="image"> IN: Input image to upsample and blur. </param>
+/// <param name="kernel"> IN: The gaussian kernel/filter we use for blurring. </param>
+/// <param name="kernel_size"> IN: Size of gaussian kernels. </param>
+/// <param name="kernel_rad"> IN: Radius of the kernel. </param>
+/// <param name="output"> OUT: Blurred output image, twice the width and height of the input. </param>
+/// <returns> 1 IF generation was successful, ELSE 0. </returns>
+/// <remarks> 2 * (4 * h * w * (2 * kernel_size)) flops </remarks>
+int ethsift_apply_kernel_upsample(struct ethsift_image_view image, float *kernel, uint32_t kernel_size, uint32_t kernel_rad, struct ethsift_image output) {
+  const int symmetric = kernel_symmetric(kernel, kernel_size, kernel_rad);
+  row_filter_transpose_upsample(image, img_buf, kernel, kernel_size, kernel_rad, symmetric);
+  row_filter_transpose(img_buf, output.pixels, image.height << 1, image.width << 1, kernel, kernel_size, kernel_rad, symmetric);
+  return 1;
+}
+
+/// <summary> 
+/// Apply the gaussian kernel to the image and write the result to the output. The decimated
+/// result is written to half during the second pass, replacing a separate ethsift_downscale_half.
+/// </summary>
+/// <param name="image"> IN: Input image to blur. </param>
+/// <param name="kernel"> IN: The gaussian kernel/filter we use for blurring. </param>
+/// <param name="kernel_size"> IN: Size of gaussian kernels. </param>
+/// <param name="kernel_rad"> IN: Radius of the kernel. </param>
+/// <param name="output"> OUT: Blurred output image. </param>
+/// <param name="half"> OUT: Blurred output image downscaled by half. </param>
+/// <returns> 1 IF generation was successful, ELSE 0. </returns>
+/// <remarks> 2 * (h * w * (2 * kernel_size)) flops </remarks>
+int ethsift_apply_kernel_decimate(struct ethsift_image image, float *kernel, uint32_t kernel_size, uint32_t kernel_rad, struct ethsift_image output, struct ethsift_image half) {
+  uint32_t w = image.width;
+  uint32_t h = image.height;
+  const int symmetric = kernel_symmetric(kernel, kernel_size, kernel_rad);
+  
+  row_filter_transpose(image.pixels, img_buf, w, h, kernel, kernel_size, kernel_rad, symmetric);
+  row_filter_transpose_decimate(img_buf, output.pixels, h, w, kernel, kernel_size, kernel_rad, symmetric, half);
+  return 1;
+}
+
+/// <summary> 
+/// Apply several gaussian kernels to the same image. The first pass reads every row of the image once
+/// and filters it with all kernels, so the levels do not wait on each other.
+/// </summary>
+/// <param name="image"> IN: Input image to blur. </param>
+/// <param name="kernels"> IN: The gaussian kernels to blur with. </param>
+/// <param name="kernel_sizes"> IN: Sizes of the gaussian kernels. </param>
+/// <param name="kernel_rads"> IN: Radii of the kernels. </param>
+/// <param name="outputs"> OUT: One blurred output image per kernel. </param>
+/// <param name="count"> IN: Number of kernels and outputs. </param>
+/// <param name="decimate"> IN: Index of the output to also write decimated to half. </param>
+/// <param name="half"> OUT: Output decimate downscaled by half, skipped if its pixels are NULL. </param>
+/// <returns> 1 IF generation was successful, ELSE 0. </returns>
+/// <remarks> sum(2 * (h * w * (2 * kernel_size))) flops </remarks>
+int ethsift_apply_kernels_direct(struct ethsift_image image, float **kernels, int kernel_sizes[], int kernel_rads[], struct ethsift_image outputs[], uint32_t count, uint32_t decimate, struct ethsift_image half) {
+  const int w = image.width;
+  const int h = image.height;
+  const size_t size = (size_t) w * h;
+
+  // Every level needs its own transposed intermediate in img_buf.
+  if (img_buf_size < count * size) {
+    for (int k = 0; k < count; ++k) {
+      if (half.pixels && k == decimate)
+        ethsift_apply_kernel_decimate(image, kernels[k], kernel_sizes[k], kernel_rads[k], outputs[k], half);
+      else
+        ethsift_apply_kernel(image, kernels[k], kernel_sizes[k], kernel_rads[k], outputs[k]);
+    }
+    return 1;
+  }
+
+  int max_rad = 0;
+  int symmetric[count];
+  for (int k = 0; k < count; ++k) {
+    max_rad = int_max(max_rad, kernel_rads[k]);
+    symmetric[k] = kernel_symmetric(kernels[k], kernel_sizes[k], kernel_rads[k]);
+  }
+
+  // Pad once for the widest kernel, narrower kernels start further into the padding.
+  for (int r = 0; r < h; r++) {
+    memcpy(&row_buf[max_rad], &image.pixels[r * w], sizeof(float) * w);
+    inc_read(w, float);
+    inc_write(w, float);
+    pad_row(w, max_rad);
+
+    for (int k = 0; k < count; ++k) {
+      g_kernels.filter_row_transpose(img_buf + k * size, row_buf + max_rad - kernel_rads[k], r, w, h, kernels[k], kernel_sizes[k], kernel_rads[k], symmetric[k]);
+    }
+  }
+
+  for (int k = 0; k < count; ++k) {
+    if (half.pixels && k == decimate)
+      row_filter_transpose_decimate(img_buf + k * size, outputs[k].pixels, h, w, kernels[k], kernel_sizes[k], kernel_rads[k], symmetric[k], half);
+    else
+      row_filter_transpose(img_buf + k * size, outputs[k].pixels, h, w, kernels[k], kernel_sizes[k], kernel_rads[k], symmetric[k]);
+  }
   return 1;
 }
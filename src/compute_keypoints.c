@@ -1,5 +1,116 @@
 #include "internal.h"
 
+/// <summary> 
+/// Build the Gaussian, DoG, gradient and rotation pyramids of the image with the current settings.
+/// </summary>
+/// <param name="image"> IN: Borrowed image to build the pyramids of. </param>
+/// <param name="octave_count"> IN: Number of octaves. </param>
+/// <param name="gaussians"> OUT: Gaussian pyramid, octave_count * (ETHSIFT_INTVLS + 3) levels. </param>
+/// <param name="differences"> OUT: DoG pyramid, octave_count * (ETHSIFT_INTVLS + 2) levels. </param>
+/// <param name="gradients"> OUT: Gradient pyramid, sized like the Gaussians. </param>
+/// <param name="rotations"> OUT: Rotation pyramid sized like the Gaussians, or NULL to skip the orientations. </param>
+/// <returns> 1 IF computation was successful, ELSE 0. </returns>
+int ethsift_build_pyramids(struct ethsift_image_view image, uint32_t octave_count, struct ethsift_image gaussians[], struct ethsift_image differences[], struct ethsift_image gradients[], struct ethsift_image rotations[]) {
+  const int layers = ETHSIFT_INTVLS;
+  const int gaussian_count = layers + 3;
+  const int dog_count = layers + 2;
+
+  // Threads other than the one of ethsift_init get their blur buffers here.
+  if (!workspace_reserve((size_t) (image.width << g_upsample) * (image.height << g_upsample)))
+    return 0;
+
+  if (g_fixed_point && image.format == ETHSIFT_FORMAT_U8 && !g_upsample && g_pyramid_schedule == ETHSIFT_SCHEDULE_SEQUENTIAL) {
+    // Gaussians and their differences in int16, converted to float as they are stored.
+    ethsift_generate_pyramids_fixed(image, octave_count, gaussians, gaussian_count, differences, dog_count);
+  } else {
+    //Create Gaussians for ethSift    
+    ethsift_generate_gaussian_pyramid_view(image, octave_count, gaussians, gaussian_count);
+
+    // Caculate Difference of Gaussians
+    ethsift_generate_difference_pyramid(gaussians, gaussian_count, differences, dog_count, octave_count);
+  }
+
+  ethsift_generate_gradient_pyramid(gaussians, gaussian_count, gradients, rotations, layers, octave_count);
+  return 1;
+}
+
+/// <summary> 
+/// Lay out the pyramids for the image and build them with the current settings.
+/// </summary>
+/// <param name="image"> IN: Borrowed image to build the pyramids of. </param>
+/// <param name="pyramids"> IN/OUT: Pyramids to build into, grown as needed and kept for the caller. </param>
+/// <param name="octave_count"> OUT: Number of octaves built. </param>
+/// <returns> 1 IF computation was successful, ELSE 0. </returns>
+int build_image_pyramids(struct ethsift_image_view image, struct ethsift_pyramids *pyramids, uint32_t *octave_count) {
+  // Number of octaves according to the size of image.
+  // A doubled first octave adds one octave in front.
+  const int octaves = (int)log2f((float)int_min((int) image.width, (int) image.height)) - 3 + (int) g_upsample; // 2 or 3, need further research
+  const uint32_t base_width = image.width << g_upsample;
+  const uint32_t base_height = image.height << g_upsample;
+
+  if (octaves < 1)
+    return 0;
+  if (!fits_blur_buffers(image.width, image.height) || ETHSIFT_FORMAT_U16 < image.format)
+    return 0;
+
+  // Without atan2 the histograms take their orientations from the Gaussians directly.
+  const int octant = (g_orientation_mode == ETHSIFT_ORIENTATION_OCTANT);
+
+  // Lay out the pyramids!
+  if (!pyramids_reserve(pyramids, base_width, base_height, octaves, !octant, 1))
+    return 0;
+
+  *octave_count = octaves;
+  return ethsift_build_pyramids(image, octaves, pyramids->gaussians, pyramids->differences, pyramids->gradients, octant ? NULL : pyramids->rotations);
+}
+
+/// <summary> 
+/// Run the SIFT pipeline on the image and detect keypoints inside the region.
+/// </summary>
+/// <param name="image"> IN: Borrowed image to compute the SIFT descriptors of. </param>
+/// <param name="region"> IN: Region to detect keypoints in, or NULL for the whole image. </param>
+/// <param name="keypoints"> OUT: Array of detected keypoints. </param> 
+/// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
+///                               OUT: Number of keypoints found. </param> 
+/// <param name="pyramids"> IN/OUT: Pyramids to build into, grown as needed and kept for the caller. </param>
+/// <returns> 1 IF computation was successful, ELSE 0. </returns>
+static int compute_keypoints(struct ethsift_image_view image, const struct detect_region *region, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count, struct ethsift_pyramids *pyramids) {
+  uint32_t octave_count;
+  if (!build_image_pyramids(image, pyramids, &octave_count))
+    return 0;
+
+  ethsift_describe_pyramids(pyramids, octave_count, region, keypoints, keypoint_count);
+  return 1;
+}
+
+/// <summary> 
+/// Detect the keypoints in built pyramids and extract their descriptors.
+/// </summary>
+/// <param name="pyramids"> IN: Pyramids built by ethsift_build_pyramids with the current settings. </param>
+/// <param name="octave_count"> IN: Number of octaves. </param>
+/// <param name="region"> IN: Region to detect keypoints in, or NULL for the whole image. </param>
+/// <param name="keypoints"> OUT: Array of detected keypoints. </param> 
+/// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
+///                               OUT: Number of keypoints found. </param> 
+void ethsift_describe_pyramids(struct ethsift_pyramids *pyramids, uint32_t octave_count, const struct detect_region *region, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count) {
+  const int gaussian_count = ETHSIFT_INTVLS + 3;
+  const int octant = (g_orientation_mode == ETHSIFT_ORIENTATION_OCTANT);
+  struct ethsift_image *eth_gaussians = pyramids->gaussians;
+  struct ethsift_image *eth_gradients = pyramids->gradients;
+  struct ethsift_image *eth_differences = pyramids->differences;
+  struct ethsift_image *orientations = octant ? eth_gaussians : pyramids->rotations;
+
+  // Ethsift keypoint detection:
+  const uint32_t keypoint_capacity = *keypoint_count;
+  ethsift_detect_keypoints_region(eth_differences, eth_gradients, orientations, octave_count, gaussian_count, keypoints, keypoint_count, region);
+
+  // The reported count may exceed the capacity, only describe what was stored.
+  if (g_descriptor_mode == ETHSIFT_DESCRIPTOR_PATCH)
+    ethsift_extract_descriptor_patch(eth_gaussians, octave_count, gaussian_count, keypoints, internal_min(*keypoint_count, keypoint_capacity));
+  else
+    ethsift_extract_descriptor(eth_gradients, orientations, octave_count, gaussian_count, keypoints, internal_min(*keypoint_count, keypoint_capacity));
+}
+
 /// <summary> 
 /// Perform SIFT and compute all known keypoints.
 /// </summary>
@@ -9,48 +120,152 @@
 ///                               OUT: Number of keypoints found. </param> 
 /// <returns> 1 IF computation was successful, ELSE 0. </returns>
 int ethsift_compute_keypoints(struct ethsift_image image, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count) {
+  struct ethsift_image_view view = {image.pixels, image.width, image.height, image.width * sizeof(float), ETHSIFT_FORMAT_F32};
+  struct ethsift_pyramids pyramids = {0};
+  int result = compute_keypoints(view, NULL, keypoints, keypoint_count, &pyramids);
+  pyramids_release(&pyramids);
+  return result;
+}
 
-  // Number of layers in one octave; same as s in the paper.
-  const int layers = ETHSIFT_INTVLS;
-  // Number of Gaussian images in one octave.
-  const int gaussian_count = layers + 3;
-  // Number of DoG images in one octave.
-  const int dog_count = layers + 2;
-  // Number of octaves according to the size of image.
-  const int octave_count = (int)log2f((float)int_min((int) image.width, (int) image.height)) - 3; // 2 or 3, need further research
-
+/// <summary> 
+/// Perform SIFT on a region of interest of the image and compute the keypoints inside of it.
+/// </summary>
+/// <param name="image"> IN: Image to compute the SIFT descriptors of. </param>
+/// <param name="roi"> IN: Region to detect keypoints in. A zero width or height selects the whole image. </param>
+/// <param name="mask"> IN: Optional image sized mask, keypoints on zero entries are skipped. May be NULL. </param>
+/// <param name="keypoints"> OUT: Array of detected keypoints, in coordinates of the full image. </param> 
+/// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
+///                               OUT: Number of keypoints found. </param> 
+/// <returns> 1 IF computation was successful, ELSE 0. </returns>
+int ethsift_compute_keypoints_roi(struct ethsift_image image, struct ethsift_roi roi, const uint8_t *mask, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count) {
+  struct ethsift_image_view view = {image.pixels, image.width, image.height, image.width * sizeof(float), ETHSIFT_FORMAT_F32};
+  return ethsift_compute_keypoints_view(view, roi, mask, keypoints, keypoint_count);
+}
 
-  // Allocate the pyramids!
-  struct ethsift_image eth_gaussians[octave_count * gaussian_count];
-  ethsift_allocate_pyramid(eth_gaussians, image.width, image.height, octave_count, gaussian_count);
+/// <summary> 
+/// Perform SIFT on a borrowed image without copying it, optionally limited to a region of interest.
+/// </summary>
+/// <param name="image"> IN: Image to compute the SIFT descriptors of. </param>
+/// <param name="roi"> IN: Region to detect keypoints in. A zero width or height selects the whole image. </param>
+/// <param name="mask"> IN: Optional image sized mask, keypoints on zero entries are skipped. May be NULL. </param>
+/// <param name="keypoints"> OUT: Array of detected keypoints, in coordinates of the full image. </param> 
+/// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
+///                               OUT: Number of keypoints found. </param> 
+/// <returns> 1 IF computation was successful, ELSE 0. </returns>
+int ethsift_compute_keypoints_view(struct ethsift_image_view image, struct ethsift_roi roi, const uint8_t *mask, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count) {
+  if (roi.width == 0 || roi.height == 0) {
+    roi.x = 0;
+    roi.y = 0;
+    roi.width = image.width;
+    roi.height = image.height;
+  }
+  // Compared without summing, so that huge sizes cannot wrap around into the image.
+  if (image.width < roi.x || image.height < roi.y
+      || image.width - roi.x < roi.width || image.height - roi.y < roi.height)
+    return 0;
+  if (ETHSIFT_FORMAT_U16 < image.format)
+    return 0;
 
-  struct ethsift_image eth_gradients[octave_count*gaussian_count];
-  ethsift_allocate_pyramid(eth_gradients, image.width, image.height, octave_count, gaussian_count);
+  // Align the crop to the coarsest octave, so that every octave samples the
+  // same pixels as when processing the whole image.
+  const int octave_count = (int)log2f((float)int_min((int) image.width, (int) image.height)) - 3;
+  const uint32_t align = 1u << int_max(octave_count - 1, 0);
+  // The halo does not grow with the octaves, so coarse keypoints near the border are approximate.
+  const uint32_t halo = ETHSIFT_ROI_HALO;
 
-  struct ethsift_image eth_rotations[octave_count*gaussian_count];
-  ethsift_allocate_pyramid(eth_rotations, image.width, image.height, octave_count, gaussian_count);
+  const uint32_t x0 = (roi.x < halo ? 0 : roi.x - halo) & ~(align - 1);
+  const uint32_t y0 = (roi.y < halo ? 0 : roi.y - halo) & ~(align - 1);
+  const uint32_t x1 = int_min(roi.x + roi.width + halo, image.width);
+  const uint32_t y1 = int_min(roi.y + roi.height + halo, image.height);
 
-  struct ethsift_image eth_differences[octave_count*dog_count];
-  ethsift_allocate_pyramid(eth_differences, image.width, image.height, octave_count, dog_count);
+  struct detect_region region = {x0, y0, roi.x, roi.y, roi.x + roi.width, roi.y + roi.height, mask, image.width};
+  
+  // The crop is just a view into the caller's image.
+  const uint32_t pixel_size = (image.format == ETHSIFT_FORMAT_U8) ? 1 : (image.format == ETHSIFT_FORMAT_U16) ? 2 : 4;
+  struct ethsift_image_view crop = image;
+  crop.data = (const uint8_t *) image.data + y0 * image.stride + x0 * pixel_size;
+  crop.width = x1 - x0;
+  crop.height = y1 - y0;
 
-  //Create Gaussians for ethSift    
-  ethsift_generate_gaussian_pyramid(image, octave_count, eth_gaussians, gaussian_count);
+  const uint32_t keypoint_capacity = *keypoint_count;
+  struct ethsift_pyramids pyramids = {0};
+  int result = compute_keypoints(crop, &region, keypoints, keypoint_count, &pyramids);
+  pyramids_release(&pyramids);
 
-  // Caculate Difference of Gaussians
-  ethsift_generate_difference_pyramid(eth_gaussians, gaussian_count, eth_differences, dog_count, octave_count);
+  // Move the keypoints back into the coordinates of the full image.
+  const uint32_t stored = internal_min(*keypoint_count, keypoint_capacity);
+  if (x0 != 0 || y0 != 0) {
+    for (uint32_t i = 0; i < stored; ++i) {
+      keypoints[i].global_pos.x += x0;
+      keypoints[i].global_pos.y += y0;
+      keypoints[i].layer_pos.x += (x0 << g_upsample) >> keypoints[i].octave;
+      keypoints[i].layer_pos.y += (y0 << g_upsample) >> keypoints[i].octave;
+    }
+  }
+  return result;
+}
 
-  ethsift_generate_gradient_pyramid(eth_gaussians, gaussian_count, eth_gradients, eth_rotations, layers, octave_count);
-  
-  // Ethsift keypoint detection:
-  ethsift_detect_keypoints(eth_differences, eth_gradients, eth_rotations, octave_count, gaussian_count, keypoints, keypoint_count);
+struct batch_job{
+  const struct ethsift_image_view *images;
+  struct ethsift_keypoint **keypoints;
+  uint32_t *keypoint_counts;
+  uint32_t image_count;
+  int failed;
+};
 
-  ethsift_extract_descriptor(eth_gradients, eth_rotations, octave_count, gaussian_count, keypoints, *keypoint_count);
+/// <summary> 
+/// Compute the keypoints of one image of a batch with the pyramids of the calling thread.
+/// </summary>
+static void compute_batch_image(void *arg, uint32_t index) {
+  struct batch_job *job = arg;
+  struct ethsift_pyramids *pyramids = workspace_pyramids(0);
+  if (!pyramids || !compute_keypoints(job->images[index], NULL, job->keypoints[index], &job->keypoint_counts[index], pyramids)) {
+    job->keypoint_counts[index] = 0;
+    __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+  }
+}
 
-  // Free up memory allocated for all the pyramids 
-  ethsift_free_pyramid(eth_gaussians);
-  ethsift_free_pyramid(eth_gradients);
-  ethsift_free_pyramid(eth_rotations);
-  ethsift_free_pyramid(eth_differences);
+/// <summary> 
+/// Compute the keypoints of a group of ETHSIFT_LANES images of a batch, one image per vector lane
+/// if they allow it, else one after the other.
+/// </summary>
+static void compute_batch_lanes(void *arg, uint32_t index) {
+  struct batch_job *job = arg;
+  const uint32_t first = index * ETHSIFT_LANES;
+  const uint32_t count = internal_min(ETHSIFT_LANES, job->image_count - first);
+  if (count == ETHSIFT_LANES && lanes_supported(job->images + first)) {
+    if (!compute_keypoints_lanes(job->images + first, job->keypoints + first, job->keypoint_counts + first)) {
+      for (uint32_t i = 0; i < count; ++i)
+        job->keypoint_counts[first + i] = 0;
+      __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+    return;
+  }
+  for (uint32_t i = 0; i < count; ++i)
+    compute_batch_image(arg, first + i);
+}
 
-  return 1;
+/// <summary> 
+/// Perform SIFT on many borrowed images at once, spread over the threads of ethsift_set_thread_count.
+/// Every thread keeps its blur buffers and pyramids from one image to the next, so for small images
+/// this avoids most of the allocation that separate calls of ethsift_compute_keypoints_view do.
+/// </summary>
+/// <param name="images"> IN: Images to compute the SIFT descriptors of. </param>
+/// <param name="image_count"> IN: Number of images. </param>
+/// <param name="keypoints"> OUT: One array of detected keypoints per image. </param> 
+/// <param name="keypoint_counts"> IN: How many keypoints each array can store at most.
+///                                OUT: Number of keypoints found per image, 0 for images that failed. </param> 
+/// <returns> 1 IF computation was successful for all images, ELSE 0. </returns>
+/// <remarks> Descriptors of one image are extracted on a single thread, the parallelism is across images.
+///           Workers keep their scratch memory until the thread count changes. See ethsift_set_batch_mode
+///           for building the pyramids of several images at once. </remarks>
+int ethsift_compute_keypoints_batch(const struct ethsift_image_view images[], uint32_t image_count, struct ethsift_keypoint *keypoints[], uint32_t keypoint_counts[]) {
+  struct batch_job job = {images, keypoints, keypoint_counts, image_count, 0};
+  if (g_batch_mode == ETHSIFT_BATCH_LANES)
+    thread_pool_run(compute_batch_lanes, &job, (image_count + ETHSIFT_LANES - 1) / ETHSIFT_LANES);
+  else
+    thread_pool_run(compute_batch_image, &job, image_count);
+  // Only the workers hold on to their pyramids, the caller's are freed right away.
+  workspace_release();
+  return !job.failed;
 }
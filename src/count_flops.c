@@ -81,6 +81,23 @@ int test_gaussian_pyramid() {
   return 1;
 }
 
+int test_gaussian_pyramid_direct() {
+  // Allocate the pyramids!
+  struct ethsift_image eth_gaussians[OCTAVE_COUNT * GAUSSIAN_COUNT];
+  ethsift_allocate_pyramid(eth_gaussians, input_img.width, input_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+
+  // Create gaussians for ethSift, every level directly from the octave base
+  ethsift_set_pyramid_schedule(ETHSIFT_SCHEDULE_DIRECT);
+  #ifdef IS_COUNTING
+  reset_counters();
+  #endif
+  ethsift_generate_gaussian_pyramid(input_img, OCTAVE_COUNT, eth_gaussians, GAUSSIAN_COUNT);
+  ethsift_set_pyramid_schedule(ETHSIFT_SCHEDULE_SEQUENTIAL);
+  ethsift_free_pyramid(eth_gaussians);
+  
+  return 1;
+}
+
 int test_dog() {
   // Allocate the pyramids!  
   struct ethsift_image eth_differences[OCTAVE_COUNT*DOG_COUNT];
@@ -298,7 +315,7 @@ int test_compute_keypoints() {
 
 int init_tests() {
   // Specify number of tests
-  test_count = 10;
+  test_count = 11;
 
   tests = (test *)malloc(test_count * sizeof(test));
   // Add tests here
@@ -312,6 +329,7 @@ int init_tests() {
   tests[7] = (test){"KeypointDetection", 1, test_keypoint_detection};
   tests[8] = (test){"ExtractDescriptor", 1, test_extract_descriptor};
   tests[9] = (test){"MeasureFull", 1, test_compute_keypoints};
+  tests[10] = (test){"GaussianPyramidDirect", 1, test_gaussian_pyramid_direct};
 
   return 1;
 }
@@ -0,0 +1,295 @@
+#include "internal.h"
+
+// The patch covers the bin range (-1, d) along both axes, like the samples counted by
+// ethsift_extract_descriptor. It is resampled with a border of one sample for the gradients.
+#define PATCH_SIZE ETHSIFT_DESCR_PATCH_SIZE
+#define PATCH_CELLS (ETHSIFT_DESCR_WIDTH + 2)
+// Patch rows are padded to a multiple of 8 samples.
+#define PATCH_STRIDE (((PATCH_SIZE + 2) + 7) & ~7)
+
+/// <summary>
+/// Bilinearly sample the image at (y, x), clamped to the image.
+/// </summary>
+static inline float sample_bilinear(const float *image, int w, int h, float y, float x){
+    y = fminf(fmaxf(y, 0.0f), (float) (h - 1));
+    x = fminf(fmaxf(x, 0.0f), (float) (w - 1));
+    const int y0 = internal_min((int) y, h - 2);
+    const int x0 = internal_min((int) x, w - 2);
+    const float fy = y - y0;
+    const float fx = x - x0;
+    const float *p = image + y0 * w + x0;
+    const float top = p[0] + fx * (p[1] - p[0]);
+    const float bottom = p[w] + fx * (p[w + 1] - p[w]);
+    inc_read(4, float);
+    inc_adds(7);
+    inc_mults(3);
+    return top + fy * (bottom - top);
+}
+
+/// <summary>
+/// Add a sample with weight gm at orientation bin obin into the eight orientations of the four
+/// neighbouring cells. The orientation weights are a triangle around obin that wraps at 2PI.
+/// </summary>
+static inline void patch_accumulate(float *hist, const struct descriptor_patch *patch, int a, int b, float gm, float obin){
+    const int ca = patch->cells[a] + 1;
+    const int cb = patch->cells[b] + 1;
+    const float fa = patch->fracs[a];
+    const float fb = patch->fracs[b];
+    // Rows of the histogram follow the patch columns, like rbin in ethsift_extract_descriptor.
+    float *h00 = hist + (cb * PATCH_CELLS + ca) * ETHSIFT_DESCR_HIST_BINS;
+    float *h01 = h00 + ETHSIFT_DESCR_HIST_BINS;
+    float *h10 = h00 + PATCH_CELLS * ETHSIFT_DESCR_HIST_BINS;
+    float *h11 = h10 + ETHSIFT_DESCR_HIST_BINS;
+    const float w11 = gm * fb * fa;
+    const float w10 = gm * fb - w11;
+    const float w01 = gm * fa - w11;
+    const float w00 = gm - w10 - w01 - w11;
+    inc_adds(5);
+    inc_mults(3);
+    for (int o = 0; o < ETHSIFT_DESCR_HIST_BINS; ++o) {
+        float d = obin - o;
+        if (d >= ETHSIFT_DESCR_HIST_BINS / 2) d -= ETHSIFT_DESCR_HIST_BINS;
+        if (d < -ETHSIFT_DESCR_HIST_BINS / 2) d += ETHSIFT_DESCR_HIST_BINS;
+        const float ow = fmaxf(1.0f - fabsf(d), 0.0f);
+        h00[o] += w00 * ow;
+        h01[o] += w01 * ow;
+        h10[o] += w10 * ow;
+        h11[o] += w11 * ow;
+        inc_adds(7);
+        inc_mults(4);
+    }
+    inc_read(32, float);
+    inc_write(32, float);
+}
+
+/// <summary>
+/// Resample the patch of a keypoint and accumulate its gradients into the descriptor histogram.
+/// </summary>
+/// <param name="image"> IN: Gaussian level of the keypoint. </param>
+/// <param name="w"> IN: Width of the level. </param>
+/// <param name="h"> IN: Height of the level. </param>
+/// <param name="patch"> IN: Placement of the patch in the level. </param>
+/// <param name="hist"> OUT: Histogram of (ETHSIFT_DESCR_WIDTH + 2)^2 cells of ETHSIFT_DESCR_HIST_BINS bins. </param>
+void descriptor_patch_scalar(const float *image, int w, int h, const struct descriptor_patch *patch, float *hist){
+    float samples[(PATCH_SIZE + 2) * PATCH_STRIDE];
+
+    memset(hist, 0, PATCH_CELLS * PATCH_CELLS * ETHSIFT_DESCR_HIST_BINS * sizeof(float));
+    for (int a = 0; a < PATCH_SIZE + 2; ++a) {
+        for (int b = 0; b < PATCH_SIZE + 2; ++b) {
+            const float y = patch->r0 + a * patch->row_step_r + b * patch->col_step_r;
+            const float x = patch->c0 + a * patch->row_step_c + b * patch->col_step_c;
+            samples[a * PATCH_STRIDE + b] = sample_bilinear(image, w, h, y, x);
+            inc_adds(4);
+            inc_mults(4);
+        }
+    }
+
+    for (int a = 0; a < PATCH_SIZE; ++a) {
+        const float *row = samples + (a + 1) * PATCH_STRIDE + 1;
+        for (int b = 0; b < PATCH_SIZE; ++b) {
+            // The patch is already rotated, so the gradient angle is relative to the keypoint.
+            const float dx = row[b + 1] - row[b - 1];
+            const float dy = row[b + PATCH_STRIDE] - row[b - PATCH_STRIDE];
+            const float mag = sqrtf(dx * dx + dy * dy);
+            const float obin = eth_atan2_f(dy, dx) * ETHSIFT_DESCR_HIST_BINS_DEGREE;
+            const float gm = mag * patch->weights[a] * patch->weights[b];
+            inc_read(4, float);
+            inc_adds(3);
+            inc_mults(5);
+            patch_accumulate(hist, patch, a, b, gm, obin);
+        }
+    }
+}
+
+/// <summary>
+/// Resample and accumulate a patch using AVX2, see descriptor_patch_scalar.
+/// The bilinear taps are gathered for 8 samples at a time. Each sample adds its orientation
+/// triangle to all eight bins of a cell at once, so no step depends on the data.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+void descriptor_patch_avx2(const float *image, int w, int h, const struct descriptor_patch *patch, float *hist){
+    float samples[(PATCH_SIZE + 2) * PATCH_STRIDE];
+    float gm[PATCH_SIZE];
+    float obin[PATCH_SIZE];
+
+    const __m256 lane_index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 zeros = _mm256_setzero_ps();
+    const __m256 max_y = _mm256_set1_ps((float) (h - 1));
+    const __m256 max_x = _mm256_set1_ps((float) (w - 1));
+    const __m256i max_y0 = _mm256_set1_epi32(h - 2);
+    const __m256i max_x0 = _mm256_set1_epi32(w - 2);
+    const __m256i width = _mm256_set1_epi32(w);
+    const __m256 col_step_r = _mm256_set1_ps(patch->col_step_r);
+    const __m256 col_step_c = _mm256_set1_ps(patch->col_step_c);
+
+    for (int a = 0; a < PATCH_SIZE + 2; ++a) {
+        const float row_r = patch->r0 + a * patch->row_step_r;
+        const float row_c = patch->c0 + a * patch->row_step_c;
+        for (int b = 0; b < PATCH_STRIDE; b += 8) {
+            const __m256 index = _mm256_add_ps(_mm256_set1_ps((float) b), lane_index);
+            __m256 y = _mm256_fmadd_ps(index, col_step_r, _mm256_set1_ps(row_r));
+            __m256 x = _mm256_fmadd_ps(index, col_step_c, _mm256_set1_ps(row_c));
+            y = _mm256_min_ps(_mm256_max_ps(y, zeros), max_y);
+            x = _mm256_min_ps(_mm256_max_ps(x, zeros), max_x);
+            const __m256i y0 = _mm256_min_epi32(_mm256_cvttps_epi32(y), max_y0);
+            const __m256i x0 = _mm256_min_epi32(_mm256_cvttps_epi32(x), max_x0);
+            const __m256 fy = _mm256_sub_ps(y, _mm256_cvtepi32_ps(y0));
+            const __m256 fx = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x0));
+
+            const __m256i offset = _mm256_add_epi32(_mm256_mullo_epi32(y0, width), x0);
+            const __m256 p00 = _mm256_i32gather_ps(image, offset, 4);
+            const __m256 p01 = _mm256_i32gather_ps(image + 1, offset, 4);
+            const __m256 p10 = _mm256_i32gather_ps(image + w, offset, 4);
+            const __m256 p11 = _mm256_i32gather_ps(image + w + 1, offset, 4);
+            const __m256 top = _mm256_fmadd_ps(fx, _mm256_sub_ps(p01, p00), p00);
+            const __m256 bottom = _mm256_fmadd_ps(fx, _mm256_sub_ps(p11, p10), p10);
+            _mm256_storeu_ps(samples + a * PATCH_STRIDE + b, _mm256_fmadd_ps(fy, _mm256_sub_ps(bottom, top), top));
+            inc_read(32, float);
+            inc_write(8, float);
+            inc_adds(80);
+            inc_mults(40);
+        }
+    }
+
+    const __m256 bins_per_degree = _mm256_set1_ps(ETHSIFT_DESCR_HIST_BINS_DEGREE);
+    const __m256 orientations = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 half_bins = _mm256_set1_ps(ETHSIFT_DESCR_HIST_BINS / 2);
+    const __m256 minus_half_bins = _mm256_set1_ps(-ETHSIFT_DESCR_HIST_BINS / 2);
+    const __m256 bins = _mm256_set1_ps(ETHSIFT_DESCR_HIST_BINS);
+    const __m256 ones = _mm256_set1_ps(1.0f);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+
+    __m256 cells[PATCH_CELLS * PATCH_CELLS];
+    for (int i = 0; i < PATCH_CELLS * PATCH_CELLS; ++i)
+        cells[i] = zeros;
+
+    for (int a = 0; a < PATCH_SIZE; ++a) {
+        const float *row = samples + (a + 1) * PATCH_STRIDE + 1;
+        const __m256 weight_a = _mm256_set1_ps(patch->weights[a]);
+        for (int b = 0; b < PATCH_SIZE; b += 8) {
+            __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(row + b + 1), _mm256_loadu_ps(row + b - 1));
+            __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(row + b + PATCH_STRIDE), _mm256_loadu_ps(row + b - PATCH_STRIDE));
+            const __m256 mag = _mm256_sqrt_ps(_mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy)));
+            const __m256 angle = eth_mm256_atan2_ps(dy, dx);
+            const __m256 weight = _mm256_mul_ps(weight_a, _mm256_loadu_ps(patch->weights + b));
+            _mm256_storeu_ps(gm + b, _mm256_mul_ps(mag, weight));
+            _mm256_storeu_ps(obin + b, _mm256_mul_ps(angle, bins_per_degree));
+            inc_read(36, float);
+            inc_write(16, float);
+            inc_adds(24);
+            inc_mults(40);
+        }
+
+        const int ca = patch->cells[a] + 1;
+        const __m256 fa = _mm256_set1_ps(patch->fracs[a]);
+        for (int b = 0; b < PATCH_SIZE; ++b) {
+            __m256 d = _mm256_sub_ps(_mm256_set1_ps(obin[b]), orientations);
+            d = _mm256_sub_ps(d, _mm256_and_ps(_mm256_cmp_ps(d, half_bins, _CMP_GE_OQ), bins));
+            d = _mm256_add_ps(d, _mm256_and_ps(_mm256_cmp_ps(d, minus_half_bins, _CMP_LT_OQ), bins));
+            const __m256 ow = _mm256_max_ps(_mm256_sub_ps(ones, _mm256_andnot_ps(sign, d)), zeros);
+
+            const __m256 v = _mm256_mul_ps(_mm256_set1_ps(gm[b]), ow);
+            const __m256 v1 = _mm256_mul_ps(v, _mm256_set1_ps(patch->fracs[b]));
+            const __m256 v0 = _mm256_sub_ps(v, v1);
+            const __m256 v11 = _mm256_mul_ps(v1, fa);
+            const __m256 v01 = _mm256_mul_ps(v0, fa);
+            __m256 *cell = cells + (patch->cells[b] + 1) * PATCH_CELLS + ca;
+            cell[0] = _mm256_add_ps(cell[0], _mm256_sub_ps(v0, v01));
+            cell[1] = _mm256_add_ps(cell[1], v01);
+            cell[PATCH_CELLS] = _mm256_add_ps(cell[PATCH_CELLS], _mm256_sub_ps(v1, v11));
+            cell[PATCH_CELLS + 1] = _mm256_add_ps(cell[PATCH_CELLS + 1], v11);
+            inc_adds(72);
+            inc_mults(32);
+        }
+    }
+
+    for (int i = 0; i < PATCH_CELLS * PATCH_CELLS; ++i)
+        _mm256_storeu_ps(hist + i * ETHSIFT_DESCR_HIST_BINS, cells[i]);
+    inc_write(PATCH_CELLS * PATCH_CELLS * ETHSIFT_DESCR_HIST_BINS, float);
+}
+
+/// <summary>
+/// Extract the keypoint descriptors from resampled, orientation normalised patches.
+/// </summary>
+/// <param name="gaussians"> IN: Gaussian pyramid. </param>
+/// <param name="octave_count"> IN: Number of Octaves. </param>
+/// <param name="gaussian_count"> IN: Number of gaussian layers. </param>
+/// <param name="keypoints"> IN/OUT: Keypoints to describe. </param>
+/// <param name="keypoint_count"> IN: Number of keypoints. </param>
+/// <returns> 1 IF computation was successful, ELSE 0. </returns>
+int ethsift_extract_descriptor_patch(struct ethsift_image gaussians[],
+                                     uint32_t octave_count,
+                                     uint32_t gaussian_count,
+                                     struct ethsift_keypoint keypoints[],
+                                     uint32_t keypoint_count)
+{
+    const int nSubregion = ETHSIFT_DESCR_WIDTH;
+    const int nBinsPerSubregion = ETHSIFT_DESCR_HIST_BINS;
+    const int nBins = nSubregion * nSubregion * nBinsPerSubregion;
+    // Samples are spaced evenly over the bin range (-1, d), centred in their slot.
+    const float spacing = (float) (nSubregion + 1) / PATCH_SIZE;
+
+    // Gaussian weight, cell and offset within the cell are the same for every keypoint,
+    // and the same along both axes of the patch.
+    float weights[PATCH_SIZE];
+    int cells[PATCH_SIZE];
+    float fracs[PATCH_SIZE];
+    for (int i = 0; i < PATCH_SIZE; ++i) {
+        const float bin = -1.0f + (i + 0.5f) * spacing;
+        const float offset = bin - ETHSIFT_DESCR_WIDTH_PRECISE_HALF;
+        weights[i] = eth_exp_f(offset * offset * ETHSIFT_DESCR_EXP_SCALE);
+        cells[i] = (int) eth_floor_f(bin);
+        fracs[i] = bin - cells[i];
+        inc_adds(4);
+        inc_mults(3);
+    }
+
+    float hist[PATCH_CELLS * PATCH_CELLS * ETHSIFT_DESCR_HIST_BINS];
+    float dstBins[nBins];
+    for (int k = 0; k < keypoint_count; ++k) {
+        struct ethsift_keypoint *kpt = &keypoints[k];
+        const int layer_index = kpt->octave * gaussian_count + kpt->layer;
+        const struct ethsift_image level = gaussians[layer_index];
+        inc_read(2, int32_t);
+
+        const float size_desc = ETHSIFT_DESCR_SCL_FCTR;
+        const float subregion_width = size_desc * kpt->layer_pos.scale;
+        const float step = subregion_width * spacing;
+        float sin_t, cos_t;
+        eth_sincos_f(kpt->orientation, &sin_t, &cos_t);
+        inc_read(4, float);
+        inc_mults(2);
+
+        // Bin coordinates (rb, cb) relative to the keypoint sit at pixel offset
+        // (rr, cc) = w * (sin rb + cos cb, cos rb - sin cb). Sample (-1, -1) is the corner of the border.
+        const float first = subregion_width * (-1.0f - 0.5f * spacing - ETHSIFT_DESCR_WIDTH_PRECISE_HALF);
+        struct descriptor_patch patch = {
+            kpt->layer_pos.y + first * (sin_t + cos_t),
+            kpt->layer_pos.x + first * (cos_t - sin_t),
+            step * cos_t, -step * sin_t,
+            step * sin_t, step * cos_t,
+            weights, cells, fracs};
+        inc_adds(5);
+        inc_mults(8);
+
+        g_kernels.descriptor_patch(level.pixels, level.width, level.height, &patch, hist);
+
+        // The border cells only collect the tails of the interpolation and are dropped.
+        for (int i = 1; i <= nSubregion; i++) {
+            for (int j = 1; j <= nSubregion; j++) {
+                memcpy(dstBins + ((i - 1) * nSubregion + j - 1) * nBinsPerSubregion,
+                       hist + (i * PATCH_CELLS + j) * nBinsPerSubregion, nBinsPerSubregion * sizeof(float));
+            }
+        }
+        inc_read(nBins, float);
+        inc_write(nBins, float);
+
+        g_kernels.normalize_descriptor(dstBins);
+
+        memcpy(kpt->descriptors, dstBins, nBins * sizeof(float));
+        inc_read(nBins, float);
+        inc_write(nBins, float);
+    }
+
+    return 1;
+}
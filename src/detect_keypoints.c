@@ -64,36 +64,391 @@ static inline int is_local_min(float pixel, int pos, int w, float *curData, floa
 
 
 /// <summary> 
-/// Detect the keypoints in the image that SIFT finds interesting.
+/// Find the dominant orientations of a refined keypoint and write one keypoint per orientation peak.
 /// </summary>
-/// <param name="differences"> IN: DOG pyramid. </param>
-/// <param name="gradients"> IN: Gradients pyramid. </param>
-/// <param name="rotations"> IN: Rotation pyramid.  </param>
-/// <param name="octave_count"> IN: Number of octaves. </param> 
-/// <param name="gaussian_count"> IN: Number of layers. </param> 
-/// <param name="keypoints"> OUT: Array of detected keypoints. </param> 
-/// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
-///                               OUT: Number of keypoints found. </param> 
+/// <param name="gradient"> IN: Layer from gradient pyramid. </param>
+/// <param name="rotation"> IN: Layer from orientation pyramid, or the Gaussian level with ETHSIFT_ORIENTATION_OCTANT. </param>
+/// <param name="keypoint"> IN: Refined keypoint to assign orientations to. </param>
+/// <param name="out"> OUT: Keypoints with orientation and magnitude set. May be NULL to only count the peaks. </param>
+/// <param name="out_capacity"> IN: How many keypoints we can store at most in out. </param>
+/// <returns> Number of orientation peaks written (or found, if out is NULL). </returns>
+static int assign_orientations(struct ethsift_image gradient, struct ethsift_image rotation, struct ethsift_keypoint *keypoint, struct ethsift_keypoint out[], int out_capacity){
+  const float orientation_peak_ratio = ETHSIFT_ORI_PEAK_RATIO;
+  const int nBins = ETHSIFT_ORI_HIST_BINS;
+  const float invBins = ETHSIFT_ORI_HIST_BINS_INV;
+  int peaks = 0;
+
+  // Histogram
+  float hist[nBins];
+  float max_mag;
+
+  ethsift_compute_orientation_histogram(gradient, rotation, keypoint, hist, &max_mag);
+
+  float hist_threshold = max_mag * orientation_peak_ratio; // 1 MUL
+  inc_mults(1);
+
+  for (int ii = 0; ii < nBins; ++ii) {
+    int left = ii > 0 ? ii - 1 : nBins - 1;
+    int right = ii < (nBins - 1) ? ii + 1 : 0;
+    float currHist = hist[ii];
+    float lhist = hist[left];
+    float rhist = hist[right];
+    inc_read(3,float);
+
+    if (currHist > lhist && currHist > rhist &&
+      currHist > hist_threshold) {
+      if (out == NULL) {
+        // Only counting the keypoints that would be emitted.
+        ++peaks;
+        continue;
+      }
+
+      // Refer to here:
+      // http://stackoverflow.com/questions/717762/how-to-calculate-the-vertex-of-a-parabola-given-three-points
+      float accu_ii =
+        ii + 0.5f * (lhist - rhist) /
+        (lhist - 2.0f * currHist + rhist);  // 2 ADD + 2 SUBs + 2 MULs
+
+      inc_adds(4);
+      inc_mults(2);
+
+      // Since bin index means the starting point of a
+      // bin, so the real orientation should be bin
+      // index plus 0.5. for example, angles in bin 0
+      // should have a mean value of 5 instead of 0;
+      accu_ii += 0.5f; // 1 ADD
+      accu_ii = accu_ii < 0 ? (accu_ii + nBins) // 1 ADD
+                            : accu_ii >= nBins
+                              ? (accu_ii - nBins) // 1 SUB
+                              : accu_ii;
+
+      if (accu_ii < 0) {
+        inc_adds(1);
+      } else if (accu_ii >= nBins) {
+        inc_adds(1);
+      }
+
+      // Copy the refined position of the keypoint into the new orientation slot
+      out[peaks] = *keypoint;
+      inc_read(1, struct ethsift_keypoint);
+      inc_write(1, struct ethsift_keypoint);
+
+      // The magnitude should also calculate the max
+      // number based on fitting But since we didn't
+      // actually use it in image matching, we just
+      // lazily use the histogram value.
+      out[peaks].magnitude = currHist;
+      out[peaks].orientation = accu_ii * M_TWOPI * invBins; // 2 MUL
+      inc_write(2,float);
+      inc_mults(2);
+      // The histogram was binned by pseudo angle, report the true one.
+      if (g_orientation_mode == ETHSIFT_ORIENTATION_OCTANT)
+        out[peaks].orientation = octant_to_angle_f(out[peaks].orientation);
+
+      ++peaks;
+      if (peaks >= out_capacity) {
+        break;
+      }
+    }
+  }
+  return peaks;
+}
+
+/// <summary> 
+/// Restore the min-heap property (keyed by response) below the given index.
+/// </summary>
+static void heap_sift_down(struct ethsift_keypoint heap[], int count, int index){
+  struct ethsift_keypoint item = heap[index];
+  for (;;) {
+    int child = 2 * index + 1;
+    if (child >= count) break;
+    if (child + 1 < count && heap[child + 1].response < heap[child].response) ++child;
+    if (item.response <= heap[child].response) break;
+    heap[index] = heap[child];
+    index = child;
+  }
+  heap[index] = item;
+}
+
+/// <summary> 
+/// Add a keypoint to the min-heap of the strongest keypoints, evicting the weakest one if the heap is full.
+/// </summary>
+static void heap_offer(struct ethsift_keypoint heap[], int *count, int capacity, struct ethsift_keypoint *keypoint){
+  if (*count < capacity) {
+    int index = (*count)++;
+    while (index > 0) {
+      int parent = (index - 1) / 2;
+      if (heap[parent].response <= keypoint->response) break;
+      heap[index] = heap[parent];
+      index = parent;
+    }
+    heap[index] = *keypoint;
+  } else if (heap[0].response < keypoint->response) {
+    heap[0] = *keypoint;
+    heap_sift_down(heap, *count, 0);
+  }
+}
+
+// Where detected keypoints go and how the keypoint budget is applied to them.
+struct detect_state{
+  struct ethsift_keypoint *keypoints;
+  int keypoints_required;
+  int keypoints_current;
+  int keypoints_found;
+  uint32_t budget;
+};
+
+// Extremum that passed the 26-neighbour test, kept for grid bucketing.
+struct detect_candidate{
+  uint32_t octave;
+  uint32_t layer;
+  uint32_t r;
+  uint32_t c;
+  uint32_t cell;
+  uint32_t order;
+  float contrast;
+};
+
+// Keypoint kept by grid bucketing, with the scan position of its extremum and its orientation peak.
+struct grid_keypoint{
+  struct ethsift_keypoint keypoint;
+  uint32_t order;
+  uint32_t peak;
+};
+
+/// <summary> 
+/// Set up a keypoint at an extremum and refine its location.
+/// </summary>
+/// <param name="keypoint"> OUT: The refined keypoint, without orientation. </param>
+/// <returns> 1 IF the keypoint is usable, ELSE 0. </returns>
+static int refine_extremum(struct ethsift_image differences[], uint32_t octave_count, uint32_t gaussian_count, int octave, int layer, int r, int c, struct ethsift_keypoint *keypoint){
+  memset(keypoint, 0, sizeof(struct ethsift_keypoint));
+  keypoint->layer = layer;
+  keypoint->octave = octave;
+  inc_write(2, uint32_t);
+
+  keypoint->layer_pos.y = (float) r;
+  keypoint->layer_pos.x = (float) c;
+  inc_write(2, float);
+
+  // EzSift does the refinement here and decides at this moment if the keypoint is useable
+  return ethsift_refine_local_extrema(differences, octave_count, gaussian_count, keypoint);
+}
+
+/// <summary> 
+/// Store a keypoint according to the budget, as process_extremum does for every orientation.
+/// </summary>
+/// <param name="state"> IN/OUT: Detection output and counters. </param>
+/// <returns> 0 IF detection should stop because the budget is exhausted, ELSE 1. </returns>
+static int store_keypoint(struct detect_state *state, struct ethsift_keypoint *keypoint){
+  if (state->budget == ETHSIFT_BUDGET_STRONGEST) {
+    // Without capacity there is no heap to compare against or keep anything in.
+    if (state->keypoints_required == 0) {
+      return 0;
+    }
+    heap_offer(state->keypoints, &state->keypoints_current, state->keypoints_required, keypoint);
+    state->keypoints_found = state->keypoints_current;
+    return 1;
+  }
+  if (state->keypoints_current < state->keypoints_required) {
+    state->keypoints[state->keypoints_current++] = *keypoint;
+    inc_write(1, struct ethsift_keypoint);
+  } else if (state->budget == ETHSIFT_BUDGET_SCAN_ORDER_NO_COUNT) {
+    return 0;
+  }
+  state->keypoints_found++;
+  return 1;
+}
+
+/// <summary> 
+/// Refine an extremum, assign its orientations and store the resulting keypoints according to the budget.
+/// </summary>
+/// <param name="state"> IN/OUT: Detection output and counters. </param>
+/// <returns> 0 IF detection should stop because the budget is exhausted, ELSE 1. </returns>
+static int process_extremum(struct detect_state *state, struct ethsift_image differences[], struct ethsift_image gradients[], struct ethsift_image rotations[], uint32_t octave_count, uint32_t gaussian_count, int octave, int layer, int r, int c){
+  const int nBins = ETHSIFT_ORI_HIST_BINS;
+  struct ethsift_keypoint *keypoints = state->keypoints;
+  struct ethsift_keypoint temp;
+  struct ethsift_keypoint peaks[nBins];
+  const struct ethsift_image gradient = gradients[octave * ((int) gaussian_count) + layer];
+  const struct ethsift_image rotation = rotations[octave * ((int) gaussian_count) + layer];
+
+  if (!refine_extremum(differences, octave_count, gaussian_count, octave, layer, r, c, &temp)) {
+    return 1;
+  }
+
+  if (state->budget == ETHSIFT_BUDGET_STRONGEST) {
+    // Without capacity there is no heap to compare against or keep anything in.
+    if (state->keypoints_required == 0) {
+      return 0;
+    }
+    // Candidates weaker than the weakest kept keypoint cannot enter the set,
+    // so skip their histogram entirely.
+    if (state->keypoints_current >= state->keypoints_required && temp.response <= keypoints[0].response) {
+      return 1;
+    }
+    int found = assign_orientations(gradient, rotation, &temp, peaks, nBins);
+    for (int p = 0; p < found; ++p) {
+      heap_offer(keypoints, &state->keypoints_current, state->keypoints_required, &peaks[p]);
+    }
+    state->keypoints_found = state->keypoints_current;
+  } else if (state->keypoints_current < state->keypoints_required) {
+    int found = assign_orientations(gradient, rotation, &temp, &keypoints[state->keypoints_current], state->keypoints_required - state->keypoints_current);
+    state->keypoints_current += found;
+    state->keypoints_found += found;
+    if (state->budget == ETHSIFT_BUDGET_SCAN_ORDER_NO_COUNT && state->keypoints_current >= state->keypoints_required) {
+      return 0;
+    }
+  } else {
+    // Still test keypoint if usable, to find the actual number of keypoints
+    state->keypoints_found += assign_orientations(gradient, rotation, &temp, NULL, 0);
+  }
+  return 1;
+}
+
+/// <summary> 
+/// Test whether an extremum of the given octave lies inside the detection region.
+/// </summary>
+static inline int region_accepts(const struct detect_region *region, int octave, int r, int c){
+  const uint32_t x = octave_to_input(c, octave) + region->offset_x;
+  const uint32_t y = octave_to_input(r, octave) + region->offset_y;
+  if (x < region->x0 || region->x1 <= x || y < region->y0 || region->y1 <= y)
+    return 0;
+  return region->mask == NULL || region->mask[y * region->mask_stride + x] != 0;
+}
+
+/// <summary> 
+/// First pyramid coordinate of the given octave that lies at or past an input coordinate of the region.
+/// </summary>
+static inline uint32_t region_to_octave(uint32_t v, uint32_t offset, int octave){
+  if (v <= offset)
+    return 0;
+  return (((v - offset) << g_upsample) + (1u << octave) - 1) >> octave;
+}
+
+static int compare_candidate_contrast(const void *a, const void *b){
+  const struct detect_candidate *x = a, *y = b;
+  if (x->contrast != y->contrast) return (x->contrast > y->contrast) ? -1 : 1;
+  return (x->order < y->order) ? -1 : (x->order > y->order);
+}
+
+static int compare_grid_keypoint(const void *a, const void *b){
+  const struct grid_keypoint *x = a, *y = b;
+  if (x->order != y->order) return (x->order < y->order) ? -1 : 1;
+  return (x->peak < y->peak) ? -1 : (x->peak > y->peak);
+}
+
+// Grid of cells over the input image that keypoints are bucketed into.
+struct detect_grid{
+  uint32_t cell_size;
+  uint32_t max_per_cell;
+  uint32_t cols;
+  uint32_t rows;
+  // Position of the pyramid base image within the input image.
+  uint32_t offset_x, offset_y;
+};
+
+/// <summary> 
+/// Cell of the grid that a position of the pyramid base image lies in, clamped to the grid.
+/// </summary>
+static inline uint32_t grid_cell_of(const struct detect_grid *grid, float x, float y){
+  const int col = int_min(int_max((int) x + (int) grid->offset_x, 0) / (int) grid->cell_size, (int) grid->cols - 1);
+  const int row = int_min(int_max((int) y + (int) grid->offset_y, 0) / (int) grid->cell_size, (int) grid->rows - 1);
+  return (uint32_t) row * grid->cols + (uint32_t) col;
+}
+
+/// <summary> 
+/// Refine the candidates in order of decreasing |DoG| value and keep their keypoints, orientation peaks
+/// included, until max_per_cell of them lie in a cell. Cells are taken at the refined position, so
+/// candidates that fail refinement leave room for weaker ones of the same cell. Candidates whose
+/// extremum lies in a full cell are skipped without refinement.
+/// </summary>
+/// <param name="candidates"> IN: Candidates to select from, sorted in place. </param>
+/// <param name="count"> IN: Number of candidates. </param>
+/// <param name="grid"> IN: Grid to bucket the keypoints in. </param>
+/// <param name="selected"> OUT: Kept keypoints in scan order, release with free. </param>
+/// <returns> Number of keypoints kept, -1 IF memory could not be allocated. </returns>
+static int select_grid_keypoints(struct detect_candidate candidates[], int count, const struct detect_grid *grid,
+                                 struct ethsift_image differences[], struct ethsift_image gradients[], struct ethsift_image rotations[],
+                                 uint32_t octave_count, uint32_t gaussian_count, struct grid_keypoint **selected){
+  const int nBins = ETHSIFT_ORI_HIST_BINS;
+  struct ethsift_keypoint temp;
+  struct ethsift_keypoint peaks[nBins];
+  uint32_t *in_cell = calloc((size_t) grid->cols * grid->rows, sizeof(uint32_t));
+  struct grid_keypoint *kept = NULL;
+  int kept_count = 0;
+  int kept_capacity = 0;
+  *selected = NULL;
+  if (in_cell == NULL)
+    return -1;
+
+  qsort(candidates, count, sizeof(struct detect_candidate), compare_candidate_contrast);
+  for (int k = 0; k < count; ++k) {
+    const struct detect_candidate *candidate = &candidates[k];
+    if (in_cell[candidate->cell] >= grid->max_per_cell)
+      continue;
+    if (!refine_extremum(differences, octave_count, gaussian_count, candidate->octave, candidate->layer, candidate->r, candidate->c, &temp))
+      continue;
+    const uint32_t cell = grid_cell_of(grid, temp.global_pos.x, temp.global_pos.y);
+    const int room = (int) (grid->max_per_cell - internal_min(in_cell[cell], grid->max_per_cell));
+    if (room == 0)
+      continue;
+    const struct ethsift_image gradient = gradients[candidate->octave * gaussian_count + candidate->layer];
+    const struct ethsift_image rotation = rotations[candidate->octave * gaussian_count + candidate->layer];
+    const int found = assign_orientations(gradient, rotation, &temp, peaks, int_min(room, nBins));
+    if (kept_capacity < kept_count + found) {
+      kept_capacity = int_max(kept_capacity * 2, kept_count + nBins);
+      struct grid_keypoint *grown = realloc(kept, kept_capacity * sizeof(struct grid_keypoint));
+      if (grown == NULL) {
+        free(kept);
+        free(in_cell);
+        return -1;
+      }
+      kept = grown;
+    }
+    for (int p = 0; p < found; ++p) {
+      kept[kept_count].keypoint = peaks[p];
+      kept[kept_count].order = candidate->order;
+      kept[kept_count].peak = p;
+      ++kept_count;
+    }
+    in_cell[cell] += found;
+  }
+  free(in_cell);
+
+  qsort(kept, kept_count, sizeof(struct grid_keypoint), compare_grid_keypoint);
+  *selected = kept;
+  return kept_count;
+}
+
+/// <summary> 
+/// Detect keypoints, only considering extrema that lie inside the given region.
+/// </summary>
+/// <param name="region"> IN: Region of the input image to detect keypoints in, or NULL for the whole image. </param>
 /// <returns> 1 IF computation was successful, ELSE 0. </returns>
-int ethsift_detect_keypoints(struct ethsift_image differences[], struct ethsift_image gradients[], struct ethsift_image rotations[], uint32_t octave_count, uint32_t gaussian_count, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count){
+int ethsift_detect_keypoints_region(struct ethsift_image differences[], struct ethsift_image gradients[], struct ethsift_image rotations[], uint32_t octave_count, uint32_t gaussian_count, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count, const struct detect_region *region){
   
   // Settings
   const int image_border = ETHSIFT_IMG_BORDER;
   const float contr_thr = ETHSIFT_CONTR_THR;
-  const float orientation_peak_ratio = ETHSIFT_ORI_PEAK_RATIO;
-  const int nBins = ETHSIFT_ORI_HIST_BINS;
-  const float invBins = ETHSIFT_ORI_HIST_BINS_INV;
   const float threshold = 0.8f * contr_thr;
   const int layersDoG = gaussian_count - 1;
-  const int keypoints_required = *keypoint_count;
-  int keypoints_found = 0;
-  int keypoints_current = 0;
+  const uint32_t grid_cell = g_grid_cell_size;
 
-  struct ethsift_keypoint temp;
+  // The grid is anchored to the input image, which the pyramids may only cover part of.
+  struct detect_grid grid = {grid_cell, g_grid_max_per_cell, 0, 0, region ? region->offset_x : 0, region ? region->offset_y : 0};
+  if (grid_cell) {
+    grid.cols = (grid.offset_x + (differences[0].width >> g_upsample) + grid_cell - 1) / grid_cell;
+    grid.rows = (grid.offset_y + (differences[0].height >> g_upsample) + grid_cell - 1) / grid_cell;
+  }
 
-  // Histogram
-  float hist[nBins];
-  float max_mag;
+  struct detect_state state = {keypoints, *keypoint_count, 0, 0, g_keypoint_budget};
+
+  // With grid bucketing enabled, extrema are collected first and refined
+  // strongest first until their cells are full.
+  struct detect_candidate *candidates = NULL;
+  int candidate_count = 0;
+  int candidate_capacity = 0;
 
   for (int i = 0; i < octave_count; ++i) {
     const size_t w = differences[i * layersDoG].width;
@@ -101,6 +456,16 @@ int ethsift_detect_keypoints(struct ethsift_image differences[], struct ethsift_
 
     inc_read(2,uint32_t);
 
+    // Only scan the rows and columns that map into the region, region_accepts decides the rest.
+    int r_begin = image_border, r_end = h - image_border;
+    int c_begin = image_border, c_end = w - image_border;
+    if (region) {
+      r_begin = int_max(r_begin, (int) region_to_octave(region->y0, region->offset_y, i));
+      r_end = int_min(r_end, (int) region_to_octave(region->y1, region->offset_y, i));
+      c_begin = int_max(c_begin, (int) region_to_octave(region->x0, region->offset_x, i));
+      c_end = int_min(c_end, (int) region_to_octave(region->x1, region->offset_x, i));
+    }
+
     // (h-10)(w-10)(11 + rle + coh)*layersDoG*
     for (int j = 1; j < layersDoG - 1; ++j) {
       const int layer_ind = i * layersDoG + j;
@@ -111,9 +476,9 @@ int ethsift_detect_keypoints(struct ethsift_image differences[], struct ethsift_
 
       // (h-10)(w-10)(11 + rle + coh)
       // Iterate over all pixels in image, ignore border values
-      for (int r = image_border; r < h - image_border; ++r) {
-        int pos = r*w+image_border;
-        for (int c = image_border; c < w - image_border; ++c) {
+      for (int r = r_begin; r < r_end; ++r) {
+        int pos = r*w+c_begin;
+        for (int c = c_begin; c < c_end; ++c) {
           // Pixel position and value
           const float pixel = curData[pos];
           inc_read(1,float);
@@ -172,146 +537,91 @@ int ethsift_detect_keypoints(struct ethsift_image differences[], struct ethsift_
           inc_read(2*26,float);
 
           // 11 + rle + coh
-          if (isExtrema) {
-            if (keypoints_found < keypoints_required) {
-              keypoints[keypoints_current].layer = j;
-              keypoints[keypoints_current].octave = i;
-              inc_write(2,uint32_t);
-
-              keypoints[keypoints_current].layer_pos.y = (float) r;
-              keypoints[keypoints_current].layer_pos.x = (float) c;
-              inc_write(2,float);
-  
-              // EzSift does the refinement here and decides at this moment if the keypoint is useable
-              int isGoodKeypoint = ethsift_refine_local_extrema(differences, octave_count, gaussian_count, &keypoints[keypoints_current]);
-              
-              if (!isGoodKeypoint) {
-                continue;
-              }
-              
-              ethsift_compute_orientation_histogram(
-                gradients[i * ((int) gaussian_count) + j], 
-                rotations[i * ((int) gaussian_count) + j], 
-                &(keypoints[keypoints_current]), 
-                hist, &max_mag);
-
-              float hist_threshold = max_mag * orientation_peak_ratio; // 1 MUL
-
-              for (int ii = 0; ii < nBins; ++ii) {
-                int left = ii > 0 ? ii - 1 : nBins - 1;
-                int right = ii < (nBins - 1) ? ii + 1 : 0;
-                float currHist = hist[ii];
-                float lhist = hist[left];
-                float rhist = hist[right];
-                inc_read(3,float);
-
-                if (currHist > lhist && currHist > rhist &&
-                  currHist > hist_threshold) {
-                  // Refer to here:
-                  // http://stackoverflow.com/questions/717762/how-to-calculate-the-vertex-of-a-parabola-given-three-points
-                  float accu_ii =
-                    ii + 0.5f * (lhist - rhist) /
-                    (lhist - 2.0f * currHist + rhist);  // 2 ADD + 2 SUBs + 2 MULs
-
-                  inc_adds(4);
-                  inc_mults(2);
-
-                  // Since bin index means the starting point of a
-                  // bin, so the real orientation should be bin
-                  // index plus 0.5. for example, angles in bin 0
-                  // should have a mean value of 5 instead of 0;
-                  accu_ii += 0.5f; // 1 ADD
-                  accu_ii = accu_ii < 0 ? (accu_ii + nBins) // 1 ADD
-                                        : accu_ii >= nBins
-                                          ? (accu_ii - nBins) // 1 SUB
-                                          : accu_ii;
-
-                  if (accu_ii < 0) {
-                    inc_adds(1);
-                  } else if (accu_ii >= nBins) {
-                    inc_adds(1);
-                  }
-                  
-                  // The magnitude should also calculate the max
-                  // number based on fitting But since we didn't
-                  // actually use it in image matching, we just
-                  // lazily use the histogram value.
-                  keypoints[keypoints_current].magnitude = currHist;
-                  keypoints[keypoints_current].orientation = accu_ii * M_TWOPI * invBins; // 2 MUL
-                  inc_write(2,float);
-                  inc_mults(2);
-
-                  // Update keypoint counters
-                  ++keypoints_current;
-                  ++keypoints_found;
-                  
-                  if (keypoints_current >= keypoints_required) {
-                    break;
-                  }
-
-                  // Copy values of previous keypoint to possible new keypoint
-                  keypoints[keypoints_current].layer = keypoints[keypoints_current - 1].layer;
-                  keypoints[keypoints_current].octave = keypoints[keypoints_current - 1].octave;
-                  inc_read(2, uint32_t);
-                  inc_write(2, uint32_t);
-
-                  keypoints[keypoints_current].layer_pos = keypoints[keypoints_current - 1].layer_pos;
-                  keypoints[keypoints_current].global_pos =  keypoints[keypoints_current - 1].global_pos;
-                  inc_read(4, struct ethsift_coordinate);
-                  inc_write(4, struct ethsift_coordinate);
-                }
-              }    
-            } else {
-              // Still test keypoint if usable, to find the actual number of keypoints
-              temp.layer = j;
-              temp.octave = i;
-              inc_write(2, uint32_t);
-
-              temp.layer_pos.y = (float) r;
-              temp.layer_pos.x = (float) c;
-              inc_write(2, float);
-
-              // EzSift does the refinement here and decides at this moment if the keypoint is useable
-              int isGoodKeypoint = ethsift_refine_local_extrema(differences, octave_count, gaussian_count, &temp);
-              
-              if (!isGoodKeypoint) {
-                continue;
-              }
-
-              ethsift_compute_orientation_histogram(
-                gradients[i * ((int) gaussian_count) + j], 
-                rotations[i * ((int) gaussian_count) + j], 
-                &temp, 
-                hist, &max_mag);
-
-              float hist_threshold = max_mag * orientation_peak_ratio; // 1 MUL
-
-              inc_mults(1);
+          if (!isExtrema) {
+            continue;
+          }
 
-              for (int ii = 0; ii < nBins; ++ii) {
-                int left = ii > 0 ? ii - 1 : nBins - 1;
-                int right = ii < (nBins - 1) ? ii + 1 : 0;
-                float currHist = hist[ii];
-                float lhist = hist[left];
-                float rhist = hist[right];
-                inc_read(3, float);
+          if (region && !region_accepts(region, i, r, c)) {
+            continue;
+          }
 
-                if (currHist > lhist && currHist > rhist &&
-                  currHist > hist_threshold) {
+          if (grid_cell) {
+            if (candidate_count == candidate_capacity) {
+              candidate_capacity = candidate_capacity ? candidate_capacity * 2 : 1024;
+              struct detect_candidate *grown = realloc(candidates, candidate_capacity * sizeof(struct detect_candidate));
+              if (grown == NULL) {
+                free(candidates);
+                return 0;
+              }
+              candidates = grown;
+            }
+            struct detect_candidate *candidate = &candidates[candidate_count];
+            candidate->octave = i;
+            candidate->layer = j;
+            candidate->r = r;
+            candidate->c = c;
+            candidate->cell = grid_cell_of(&grid, (float) octave_to_input(c, i), (float) octave_to_input(r, i));
+            candidate->order = candidate_count;
+            candidate->contrast = fabsf(pixel);
+            ++candidate_count;
+            continue;
+          }
 
-                  // Update keypoint counter
-                  ++keypoints_found;      
-                }
-              } 
-            }     
+          if (!process_extremum(&state, differences, gradients, rotations, octave_count, gaussian_count, i, j, r, c)) {
+            goto done;
           }
         }
       }
     }
   }
 
+  if (grid_cell) {
+    struct grid_keypoint *selected;
+    const int selected_count = select_grid_keypoints(candidates, candidate_count, &grid, differences, gradients, rotations,
+                                                     octave_count, gaussian_count, &selected);
+    if (selected_count < 0) {
+      free(candidates);
+      return 0;
+    }
+    for (int k = 0; k < selected_count; ++k) {
+      if (!store_keypoint(&state, &selected[k].keypoint)) {
+        break;
+      }
+    }
+    free(selected);
+  }
+
+ done:
+  free(candidates);
+
+  if (state.budget == ETHSIFT_BUDGET_STRONGEST) {
+    // Heap sort the kept keypoints so that the strongest one comes first.
+    for (int k = state.keypoints_current - 1; k > 0; --k) {
+      struct ethsift_keypoint swap = keypoints[0];
+      keypoints[0] = keypoints[k];
+      keypoints[k] = swap;
+      heap_sift_down(keypoints, k, 0);
+    }
+  }
+
   // Update count with actual number of keypoints found
-  *keypoint_count = keypoints_found;
+  *keypoint_count = state.keypoints_found;
   inc_write(1, uint32_t);
   return 1;
 }
+
+/// <summary> 
+/// Detect the keypoints in the image that SIFT finds interesting.
+/// </summary>
+/// <param name="differences"> IN: DOG pyramid. </param>
+/// <param name="gradients"> IN: Gradients pyramid. </param>
+/// <param name="rotations"> IN: Rotation pyramid.  </param>
+/// <param name="octave_count"> IN: Number of octaves. </param> 
+/// <param name="gaussian_count"> IN: Number of layers. </param> 
+/// <param name="keypoints"> OUT: Array of detected keypoints. </param> 
+/// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
+///                               OUT: Number of keypoints found. </param> 
+/// <returns> 1 IF computation was successful, ELSE 0. </returns>
+int ethsift_detect_keypoints(struct ethsift_image differences[], struct ethsift_image gradients[], struct ethsift_image rotations[], uint32_t octave_count, uint32_t gaussian_count, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count){
+  return ethsift_detect_keypoints_region(differences, gradients, rotations, octave_count, gaussian_count, keypoints, keypoint_count, NULL);
+}
@@ -0,0 +1,145 @@
+#include "internal.h"
+
+struct ethsift_kernels g_kernels = {
+  ETHSIFT_BACKEND_SCALAR,
+  filter_row_transpose_scalar,
+  convert_row_scalar,
+  difference_pyramid_scalar,
+  gradient_pyramid_scalar,
+  magnitude_pyramid_scalar,
+  normalize_descriptor_scalar,
+  downscale_half_scalar,
+  orientation_histogram_scalar,
+  filter_row_transpose_s16_scalar,
+  descriptor_histogram_scalar,
+  descriptor_patch_scalar,
+  window_samples_scalar,
+  sample_histogram_scalar,
+  math_array_scalar,
+  row_sad_scalar
+};
+
+/// <summary> 
+/// Check whether the running CPU can execute the given backend.
+/// </summary>
+/// <param name="backend"> IN: One of the ETHSIFT_BACKEND_* values except AUTO. </param>
+/// <returns> 1 IF the backend is supported, ELSE 0. </returns>
+static int backend_supported(uint32_t backend){
+  __builtin_cpu_init();
+  switch(backend){
+  case ETHSIFT_BACKEND_SCALAR:
+    return 1;
+  case ETHSIFT_BACKEND_SSE:
+    return __builtin_cpu_supports("sse4.2");
+  case ETHSIFT_BACKEND_AVX2:
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  case ETHSIFT_BACKEND_AVX512:
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  default:
+    return 0;
+  }
+}
+
+/// <summary> 
+/// Select which instruction set the blur, pyramid and descriptor kernels use.
+/// </summary>
+/// <param name="backend"> IN: One of the ETHSIFT_BACKEND_* values. </param>
+/// <returns> 1 IF the backend is supported by the running CPU, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_set_backend(uint32_t backend){
+  if(backend == ETHSIFT_BACKEND_AUTO){
+    backend = ETHSIFT_BACKEND_AVX512;
+    while(!backend_supported(backend))
+      --backend;
+  }
+  if(!backend_supported(backend))
+    return 0;
+
+  switch(backend){
+  case ETHSIFT_BACKEND_SCALAR:
+    g_kernels.filter_row_transpose = filter_row_transpose_scalar;
+    g_kernels.convert_row = convert_row_scalar;
+    g_kernels.difference_pyramid = difference_pyramid_scalar;
+    g_kernels.gradient_pyramid = gradient_pyramid_scalar;
+    g_kernels.magnitude_pyramid = magnitude_pyramid_scalar;
+    g_kernels.normalize_descriptor = normalize_descriptor_scalar;
+    g_kernels.downscale_half = downscale_half_scalar;
+    g_kernels.orientation_histogram = orientation_histogram_scalar;
+    g_kernels.filter_row_transpose_s16 = filter_row_transpose_s16_scalar;
+    g_kernels.descriptor_histogram = descriptor_histogram_scalar;
+    g_kernels.descriptor_patch = descriptor_patch_scalar;
+    g_kernels.window_samples = window_samples_scalar;
+    g_kernels.sample_histogram = sample_histogram_scalar;
+    g_kernels.math_array = math_array_scalar;
+    g_kernels.row_sad = row_sad_scalar;
+    break;
+  case ETHSIFT_BACKEND_SSE:
+    g_kernels.filter_row_transpose = filter_row_transpose_sse;
+    g_kernels.convert_row = convert_row_sse;
+    g_kernels.difference_pyramid = difference_pyramid_sse;
+    g_kernels.gradient_pyramid = gradient_pyramid_sse;
+    g_kernels.magnitude_pyramid = magnitude_pyramid_sse;
+    g_kernels.normalize_descriptor = normalize_descriptor_sse;
+    g_kernels.downscale_half = downscale_half_sse;
+    g_kernels.orientation_histogram = orientation_histogram_sse;
+    g_kernels.filter_row_transpose_s16 = filter_row_transpose_s16_sse;
+    // Four lanes do not pay for the scattered bin updates of the descriptor histogram,
+    // and the patch resampling needs gathers.
+    g_kernels.descriptor_histogram = descriptor_histogram_scalar;
+    g_kernels.descriptor_patch = descriptor_patch_scalar;
+    g_kernels.window_samples = window_samples_scalar;
+    g_kernels.sample_histogram = sample_histogram_scalar;
+    // Only atan2 has an SSE variant, inside the gradient pyramid.
+    g_kernels.math_array = math_array_scalar;
+    g_kernels.row_sad = row_sad_sse;
+    break;
+  case ETHSIFT_BACKEND_AVX2:
+    g_kernels.filter_row_transpose = filter_row_transpose_avx2;
+    g_kernels.convert_row = convert_row_avx2;
+    g_kernels.difference_pyramid = difference_pyramid_avx2;
+    g_kernels.gradient_pyramid = gradient_pyramid_avx2;
+    g_kernels.magnitude_pyramid = magnitude_pyramid_avx2;
+    g_kernels.normalize_descriptor = normalize_descriptor_avx2;
+    g_kernels.downscale_half = downscale_half_avx2;
+    g_kernels.orientation_histogram = orientation_histogram_avx2;
+    g_kernels.filter_row_transpose_s16 = filter_row_transpose_s16_avx2;
+    g_kernels.descriptor_histogram = descriptor_histogram_avx2;
+    g_kernels.descriptor_patch = descriptor_patch_avx2;
+    g_kernels.window_samples = window_samples_avx2;
+    g_kernels.sample_histogram = sample_histogram_avx2;
+    g_kernels.math_array = math_array_avx2;
+    g_kernels.row_sad = row_sad_avx2;
+    break;
+  case ETHSIFT_BACKEND_AVX512:
+    // Pixel conversion, decimation and frame differences are bound by memory bandwidth, the AVX2 variants suffice.
+    // The fixed point filter would need AVX-512BW, it stays on AVX2 as well.
+    // Descriptor windows are rarely wider than 16 samples, so they stay on AVX2 too.
+    g_kernels.filter_row_transpose = filter_row_transpose_avx512;
+    g_kernels.convert_row = convert_row_avx2;
+    g_kernels.difference_pyramid = difference_pyramid_avx512;
+    g_kernels.gradient_pyramid = gradient_pyramid_avx512;
+    g_kernels.magnitude_pyramid = magnitude_pyramid_avx512;
+    g_kernels.normalize_descriptor = normalize_descriptor_avx512;
+    g_kernels.downscale_half = downscale_half_avx2;
+    g_kernels.orientation_histogram = orientation_histogram_avx512;
+    g_kernels.filter_row_transpose_s16 = filter_row_transpose_s16_avx2;
+    g_kernels.descriptor_histogram = descriptor_histogram_avx2;
+    g_kernels.descriptor_patch = descriptor_patch_avx2;
+    g_kernels.window_samples = window_samples_avx2;
+    g_kernels.sample_histogram = sample_histogram_avx2;
+    g_kernels.math_array = math_array_avx512;
+    g_kernels.row_sad = row_sad_avx2;
+    break;
+  }
+  g_kernels.backend = backend;
+  return 1;
+}
+
+/// <summary> 
+/// Query the currently selected kernel backend.
+/// </summary>
+/// <returns> One of the ETHSIFT_BACKEND_* values. </returns>
+/// <remarks> 0 flops </remarks>
+uint32_t ethsift_get_backend(){
+  return g_kernels.backend;
+}
@@ -13,6 +13,104 @@ int ethsift_generate_difference_pyramid(struct ethsift_image gaussians[],
                                         struct ethsift_image differences[], 
                                         uint32_t layers,
                                         uint32_t octave_count){
+    return g_kernels.difference_pyramid(gaussians, gaussian_count, differences, layers, octave_count);
+}
+
+/// <summary> 
+/// Difference pyramid kernel without vector instructions.
+/// </summary>
+int difference_pyramid_scalar(struct ethsift_image gaussians[], 
+                              uint32_t gaussian_count, 
+                              struct ethsift_image differences[], 
+                              uint32_t layers,
+                              uint32_t octave_count){
+    for(int i = 0; i < octave_count; i++){
+        const int size = gaussians[i * gaussian_count].width * gaussians[i * gaussian_count].height;
+        inc_read(2, uint32_t);
+        for(int j = 0; j < layers; j++){
+            const float *low = gaussians[i * gaussian_count + j].pixels;
+            const float *high = gaussians[i * gaussian_count + j + 1].pixels;
+            float *dif = differences[i * layers + j].pixels;
+            for(int idx = 0; idx < size; ++idx){
+                dif[idx] = high[idx] - low[idx];
+            }
+            inc_read(2*size, float);
+            inc_adds(size);
+            inc_write(size, float);
+        }
+    }
+    return 1;
+}
+
+/// <summary> 
+/// Difference pyramid kernel for SSE, 4 pixels at a time.
+/// </summary>
+ETHSIFT_TARGET_SSE
+int difference_pyramid_sse(struct ethsift_image gaussians[], 
+                           uint32_t gaussian_count, 
+                           struct ethsift_image differences[], 
+                           uint32_t layers,
+                           uint32_t octave_count){
+    for(int i = 0; i < octave_count; i++){
+        const int size = gaussians[i * gaussian_count].width * gaussians[i * gaussian_count].height;
+        inc_read(2, uint32_t);
+        for(int j = 0; j < layers; j++){
+            const float *low = gaussians[i * gaussian_count + j].pixels;
+            const float *high = gaussians[i * gaussian_count + j + 1].pixels;
+            float *dif = differences[i * layers + j].pixels;
+            int idx = 0;
+            for(; idx < size - 3; idx += 4){
+                _mm_storeu_ps(dif + idx, _mm_sub_ps(_mm_loadu_ps(high + idx), _mm_loadu_ps(low + idx)));
+            }
+            for(; idx < size; ++idx){
+                dif[idx] = high[idx] - low[idx];
+            }
+            inc_read(2*size, float);
+            inc_adds(size);
+            inc_write(size, float);
+        }
+    }
+    return 1;
+}
+
+/// <summary> 
+/// Difference pyramid kernel for AVX-512. Every gaussian of the octave is read once per
+/// block of 16 pixels, the last block is masked.
+/// </summary>
+ETHSIFT_TARGET_AVX512
+int difference_pyramid_avx512(struct ethsift_image gaussians[], 
+                              uint32_t gaussian_count, 
+                              struct ethsift_image differences[], 
+                              uint32_t layers,
+                              uint32_t octave_count){
+    for(int i = 0; i < octave_count; i++){
+        const int size = gaussians[i * gaussian_count].width * gaussians[i * gaussian_count].height;
+        inc_read(2, uint32_t);
+        for(int idx = 0; idx < size; idx += 16){
+            const __mmask16 mask = (__mmask16)((1u << internal_min(16, size - idx)) - 1);
+            __m512 low = _mm512_maskz_loadu_ps(mask, gaussians[i * gaussian_count].pixels + idx);
+            for(int j = 0; j < layers; j++){
+                __m512 high = _mm512_maskz_loadu_ps(mask, gaussians[i * gaussian_count + j + 1].pixels + idx);
+                _mm512_mask_storeu_ps(differences[i * layers + j].pixels + idx, mask, _mm512_sub_ps(high, low));
+                low = high;
+            }
+        }
+        inc_read((layers+1)*size, float);
+        inc_adds(layers*size);
+        inc_write(layers*size, float);
+    }
+    return 1;
+}
+
+/// <summary> 
+/// Difference pyramid kernel for AVX2, 16 pixels of all five DoG layers per iteration.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+int difference_pyramid_avx2(struct ethsift_image gaussians[], 
+                                        uint32_t gaussian_count, 
+                                        struct ethsift_image differences[], 
+                                        uint32_t layers,
+                                        uint32_t octave_count){
     uint32_t width, height;
     int row_index;
     __m256 gaussian_vec0_0, gaussian_vec0_1;
@@ -54,7 +152,9 @@ int ethsift_generate_difference_pyramid(struct ethsift_image gaussians[],
         float * gaussian4 = gaussians[row_index + 4].pixels;
         float * gaussian5 = gaussians[row_index + 5].pixels;
         
-        for(int idx = 0; idx < (width * height); idx+= 16){
+        const int size = width * height;
+        int idx = 0;
+        for(; idx < size - 15; idx+= 16){
             int idx2 = idx + 8;
 
             gaussian_vec0_0 =  _mm256_loadu_ps(gaussian0 + idx);
@@ -101,6 +201,18 @@ int ethsift_generate_difference_pyramid(struct ethsift_image gaussians[],
             inc_write(2*5*8, float);
         }
 
+        // Images whose size is not a multiple of 16
+        for(; idx < size; ++idx){
+            dif_layer0[idx] = gaussian1[idx] - gaussian0[idx];
+            dif_layer1[idx] = gaussian2[idx] - gaussian1[idx];
+            dif_layer2[idx] = gaussian3[idx] - gaussian2[idx];
+            dif_layer3[idx] = gaussian4[idx] - gaussian3[idx];
+            dif_layer4[idx] = gaussian5[idx] - gaussian4[idx];
+            inc_read(6, float);
+            inc_adds(5);
+            inc_write(5, float);
+        }
+
     }
 
     return 1;
@@ -7,17 +7,78 @@
 /// <param name="output"> OUT: Downscaled image. </param>
 /// <returns> 1 IF generation was successful, ELSE 0. </returns>
 int ethsift_downscale_half(struct ethsift_image image, struct ethsift_image output){
-  int srcW = image.width, srcH = image.height;
-  int dstW = output.width, dstH = output.height;
+  g_kernels.downscale_half(image.pixels, image.width, output.pixels, output.width, output.height);
+  return 1;
+}
 
-  for (int r = 0; r < dstH; r++) {
-    for (int c = 0; c < dstW; c++) {
+/// <summary> 
+/// Downscale kernel without vector instructions.
+/// </summary>
+/// <param name="src"> IN: Pixels of the image to downscale. </param>
+/// <param name="src_w"> IN: Width of the image to downscale. </param>
+/// <param name="dst"> OUT: Pixels of the downscaled image. </param>
+/// <param name="dst_w"> IN: Width of the downscaled image. </param>
+/// <param name="dst_h"> IN: Height of the downscaled image. </param>
+void downscale_half_scalar(const float * restrict src, int src_w, float * restrict dst, int dst_w, int dst_h){
+  for (int r = 0; r < dst_h; r++) {
+    for (int c = 0; c < dst_w; c++) {
       int ori_r = r << 1;
       int ori_c = c << 1;
-      output.pixels[r * dstW + c] = image.pixels[ori_r * srcW + ori_c];
+      dst[r * dst_w + c] = src[ori_r * src_w + ori_c];
+      inc_read(1, float);
+      inc_write(1, float);
+    }
+  }
+}
+
+/// <summary> 
+/// Downscale kernel for SSE, picks the even pixels of two vectors with one shuffle.
+/// </summary>
+ETHSIFT_TARGET_SSE
+void downscale_half_sse(const float * restrict src, int src_w, float * restrict dst, int dst_w, int dst_h){
+  for (int r = 0; r < dst_h; r++) {
+    const float *src_row = src + (r << 1) * src_w;
+    float *dst_row = dst + r * dst_w;
+    int c = 0;
+    // The second vector reaches up to pixel 2c+7, which must lie within the row.
+    for (; c < dst_w - 3 && 2 * c + 7 < src_w; c += 4) {
+      __m128 lo = _mm_loadu_ps(src_row + 2 * c);
+      __m128 hi = _mm_loadu_ps(src_row + 2 * c + 4);
+      _mm_storeu_ps(dst_row + c, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+      inc_read(8, float);
+      inc_write(4, float);
+    }
+    for (; c < dst_w; c++) {
+      dst_row[c] = src_row[c << 1];
+      inc_read(1, float);
+      inc_write(1, float);
+    }
+  }
+}
+
+/// <summary> 
+/// Downscale kernel for AVX2. The even pixels of two vectors are gathered with an
+/// in-lane shuffle and put in order with a cross-lane permute.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+void downscale_half_avx2(const float * restrict src, int src_w, float * restrict dst, int dst_w, int dst_h){
+  for (int r = 0; r < dst_h; r++) {
+    const float *src_row = src + (r << 1) * src_w;
+    float *dst_row = dst + r * dst_w;
+    int c = 0;
+    for (; c < dst_w - 7 && 2 * c + 15 < src_w; c += 8) {
+      __m256 lo = _mm256_loadu_ps(src_row + 2 * c);
+      __m256 hi = _mm256_loadu_ps(src_row + 2 * c + 8);
+      // Per lane: lo0 lo2 hi0 hi2 | lo4 lo6 hi4 hi6
+      __m256 even = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+      _mm256_storeu_ps(dst_row + c, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(even), _MM_SHUFFLE(3, 1, 2, 0))));
+      inc_read(16, float);
+      inc_write(8, float);
+    }
+    for (; c < dst_w; c++) {
+      dst_row[c] = src_row[c << 1];
       inc_read(1, float);
       inc_write(1, float);
     }
   }
-  return 1;
 }
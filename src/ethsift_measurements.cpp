@@ -16,6 +16,61 @@ define_test(eth_Downscale, 1, {
                      fail("Failed to downscale image!"));
   })
 
+define_test(eth_LoadReadPgm, 1, {
+    // Read into a buffer, then copy to float.
+    struct ethsift_image eth_img = {0};
+    with_repeating(ezsift::Image<unsigned char> ez_img;
+                   ez_img.read_pgm(get_testimg_path());
+                   convert_image(ez_img, &eth_img))
+    free(eth_img.pixels);
+  })
+
+define_test(eth_LoadMapped, 1, {
+    // Convert straight out of the mapping.
+    struct ethsift_pnm pnm;
+    if(!ethsift_map_pnm(get_testimg_path(), &pnm))
+      fail("Failed to map image");
+    struct ethsift_image eth_img = allocate_image(pnm.width, pnm.height);
+    ethsift_unmap_pnm(&pnm);
+    with_repeating(ethsift_map_pnm(get_testimg_path(), &pnm);
+                   ethsift_pnm_to_float(&pnm, eth_img);
+                   ethsift_unmap_pnm(&pnm))
+    free(eth_img.pixels);
+  })
+
+define_test(eth_KeypointFileWrite, 1, {
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img))
+      fail("Failed to load image");
+    uint32_t keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    struct ethsift_keypoint eth_kpt_list[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+    ethsift_compute_keypoints(eth_img, eth_kpt_list, &keypoint_count);
+    char path[] = "/tmp/ethsift-kpt-XXXXXX";
+    close(mkstemp(path));
+
+    with_repeating(ethsift_write_keypoints(path, eth_kpt_list, keypoint_count, ETHSIFT_STORE_F16))
+    unlink(path);
+  })
+
+define_test(eth_KeypointFileMap, 1, {
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img))
+      fail("Failed to load image");
+    uint32_t keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    struct ethsift_keypoint eth_kpt_list[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+    ethsift_compute_keypoints(eth_img, eth_kpt_list, &keypoint_count);
+    char path[] = "/tmp/ethsift-kpt-XXXXXX";
+    close(mkstemp(path));
+    ethsift_write_keypoints(path, eth_kpt_list, keypoint_count, ETHSIFT_STORE_F16);
+
+    // Map the file and unpack all keypoints again.
+    struct ethsift_keypoint_file file;
+    with_repeating(ethsift_map_keypoints(path, &file);
+                   ethsift_load_keypoints(&file, 0, eth_kpt_list, keypoint_count);
+                   ethsift_unmap_keypoints(&file))
+    unlink(path);
+  })
+
 define_test(eth_Convolution, 1, {
     struct ethsift_image eth_img = {0};
     if(!load_image(get_testimg_path(), eth_img))
@@ -78,6 +133,40 @@ define_test(eth_GaussianPyramid, 1, {
     ethsift_free_pyramid(eth_gaussians);
   })
 
+define_test(eth_GaussianPyramidSymmetric, 1, {
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img))
+      fail("Failed to load image");
+    
+    // Allocate the pyramids!
+    struct ethsift_image eth_gaussians[OCTAVE_COUNT * GAUSSIAN_COUNT];
+    ethsift_allocate_pyramid(eth_gaussians, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+
+    // Blur with folded symmetric kernels
+    ethsift_set_symmetric_kernels(1);
+    with_repeating(ethsift_generate_gaussian_pyramid(eth_img, OCTAVE_COUNT, eth_gaussians, GAUSSIAN_COUNT));
+    ethsift_set_symmetric_kernels(0);
+    
+    ethsift_free_pyramid(eth_gaussians);
+  })
+
+define_test(eth_GaussianPyramidDirect, 1, {
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img))
+      fail("Failed to load image");
+    
+    // Allocate the pyramids!
+    struct ethsift_image eth_gaussians[OCTAVE_COUNT * GAUSSIAN_COUNT];
+    ethsift_allocate_pyramid(eth_gaussians, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+
+    // Blur every level from the octave base
+    ethsift_set_pyramid_schedule(ETHSIFT_SCHEDULE_DIRECT);
+    with_repeating(ethsift_generate_gaussian_pyramid(eth_img, OCTAVE_COUNT, eth_gaussians, GAUSSIAN_COUNT));
+    ethsift_set_pyramid_schedule(ETHSIFT_SCHEDULE_SEQUENTIAL);
+    
+    ethsift_free_pyramid(eth_gaussians);
+  })
+
 define_test(eth_DOGPyramid, 1, {
     struct ethsift_image eth_img = {0};
     if(!load_image(get_testimg_path(), eth_img))
@@ -302,6 +391,272 @@ define_test(eth_ExtractDescriptor, 1, {
     ethsift_free_pyramid(eth_rotations);
   })
 
+define_test(eth_ExtractDescriptorPatch, 1, {
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img))
+      fail("Failed to load image");
+
+    struct ethsift_image eth_gaussians[OCTAVE_COUNT*GAUSSIAN_COUNT];
+    ethsift_allocate_pyramid(eth_gaussians, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_generate_gaussian_pyramid(eth_img, OCTAVE_COUNT, eth_gaussians, GAUSSIAN_COUNT);
+
+    uint32_t keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    struct ethsift_keypoint eth_kpt_list[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+    ethsift_compute_keypoints(eth_img, eth_kpt_list, &keypoint_count);
+
+    with_repeating(ethsift_extract_descriptor_patch(eth_gaussians, OCTAVE_COUNT, GAUSSIAN_COUNT, eth_kpt_list, keypoint_count));
+
+    ethsift_free_pyramid(eth_gaussians);
+  })
+
+define_test(eth_ExtractDescriptorThreads, 1, {
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img))
+      fail("Failed to load image");
+
+    struct ethsift_image eth_gaussians[OCTAVE_COUNT*GAUSSIAN_COUNT];
+    struct ethsift_image eth_gradients[OCTAVE_COUNT*GAUSSIAN_COUNT];
+    struct ethsift_image eth_rotations[OCTAVE_COUNT*GAUSSIAN_COUNT];
+    ethsift_allocate_pyramid(eth_gaussians, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_allocate_pyramid(eth_gradients, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_allocate_pyramid(eth_rotations, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_generate_gaussian_pyramid(eth_img, OCTAVE_COUNT, eth_gaussians, GAUSSIAN_COUNT);
+    ethsift_generate_gradient_pyramid(eth_gaussians, GAUSSIAN_COUNT, eth_gradients, eth_rotations, GRAD_ROT_LAYERS, OCTAVE_COUNT);
+
+    uint32_t keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    struct ethsift_keypoint eth_kpt_list[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+    ethsift_compute_keypoints(eth_img, eth_kpt_list, &keypoint_count);
+
+    ethsift_set_thread_count(0);
+    with_repeating(ethsift_extract_descriptor(eth_gradients, eth_rotations, OCTAVE_COUNT, GAUSSIAN_COUNT, eth_kpt_list, keypoint_count));
+    ethsift_set_thread_count(1);
+
+    ethsift_free_pyramid(eth_gaussians);
+    ethsift_free_pyramid(eth_gradients);
+    ethsift_free_pyramid(eth_rotations);
+  })
+
+define_test(eth_VideoStatic, 1, {
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img))
+      fail("Failed to load image");
+    struct ethsift_video *video = NULL;
+    if(!ethsift_video_create(eth_img.width, eth_img.height, 1.0f, &video))
+      fail("Failed to create the video state");
+    struct ethsift_image_view frame = {eth_img.pixels, eth_img.width, eth_img.height, eth_img.width * (uint32_t) sizeof(float), ETHSIFT_FORMAT_F32};
+    uint32_t keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    struct ethsift_keypoint eth_kpt_list[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+    ethsift_video_process(video, frame, eth_kpt_list, &keypoint_count);
+
+    // Only the frame difference runs when nothing changed.
+    with_repeating(keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+                   ethsift_video_process(video, frame, eth_kpt_list, &keypoint_count));
+    ethsift_video_free(video);
+  })
+
+define_test(eth_VideoMovingSquare, 1, {
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img))
+      fail("Failed to load image");
+    struct ethsift_video *video = NULL;
+    if(!ethsift_video_create(eth_img.width, eth_img.height, 1.0f, &video))
+      fail("Failed to create the video state");
+    std::vector<float> pixels(eth_img.pixels, eth_img.pixels + eth_img.width * eth_img.height);
+    struct ethsift_image_view frame = {pixels.data(), eth_img.width, eth_img.height, eth_img.width * (uint32_t) sizeof(float), ETHSIFT_FORMAT_F32};
+    uint32_t keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    struct ethsift_keypoint eth_kpt_list[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+    ethsift_video_process(video, frame, eth_kpt_list, &keypoint_count);
+
+    // A 40 pixel square moves along a row, the background stays.
+    uint32_t x = 0;
+    with_repeating({
+        const uint32_t next = (x + 16) % (eth_img.width - 40);
+        for (uint32_t r = 300; r < 340; ++r)
+          memcpy(&pixels[r * eth_img.width + x], &eth_img.pixels[r * eth_img.width + x], 40 * sizeof(float));
+        for (uint32_t r = 300; r < 340; ++r)
+          std::fill(&pixels[r * eth_img.width + next], &pixels[r * eth_img.width + next + 40], 255.0f);
+        x = next;
+        keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+        ethsift_video_process(video, frame, eth_kpt_list, &keypoint_count);
+      })
+    ethsift_video_free(video);
+  })
+
+// Frames streamed through a pipeline per repetition.
+#define PIPELINE_FRAMES 8
+
+define_test(eth_PipelineSerial, 1, {
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img))
+      fail("Failed to load image");
+    struct ethsift_image_view frame = {eth_img.pixels, eth_img.width, eth_img.height, eth_img.width * (uint32_t) sizeof(float), ETHSIFT_FORMAT_F32};
+    uint32_t keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    struct ethsift_keypoint eth_kpt_list[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+
+    with_repeating(for (uint32_t i = 0; i < PIPELINE_FRAMES; ++i) {
+        keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+        ethsift_compute_keypoints_view(frame, {0, 0, 0, 0}, NULL, eth_kpt_list, &keypoint_count);
+      })
+  })
+
+define_test(eth_PipelineStream, 1, {
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img))
+      fail("Failed to load image");
+    struct ethsift_pipeline *pipeline = NULL;
+    if(!ethsift_pipeline_create(eth_img.width, eth_img.height, 2, ETHSIFT_MAX_TRACKABLE_KEYPOINTS, ETHSIFT_BACKPRESSURE_BLOCK, &pipeline))
+      fail("Failed to create the pipeline");
+    struct ethsift_image_view frame = {eth_img.pixels, eth_img.width, eth_img.height, eth_img.width * (uint32_t) sizeof(float), ETHSIFT_FORMAT_F32};
+    uint32_t keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS, index;
+    struct ethsift_keypoint eth_kpt_list[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+
+    // Submit as a live source would and take the results as they come, then drain the rest.
+    with_repeating(for (uint32_t i = 0; i < PIPELINE_FRAMES; ++i) {
+        ethsift_pipeline_submit(pipeline, frame);
+        keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+        ethsift_pipeline_poll(pipeline, eth_kpt_list, &keypoint_count, &index, 0);
+      }
+      keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+      while (ethsift_pipeline_poll(pipeline, eth_kpt_list, &keypoint_count, &index, 1))
+        keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;)
+    ethsift_pipeline_free(pipeline);
+  })
+
+// A batch of small frames: the 240p, 360p and 480p images four times each.
+#define BATCH_COPIES 4
+
+static int load_batch(std::vector<struct ethsift_image> &images, std::vector<struct ethsift_image_view> &views){
+  const char *names[] = {"auto-240p.pgm", "auto-360p.pgm", "auto-480p.pgm"};
+  images.assign(3, {0});
+  for (uint32_t i = 0; i < 3; ++i) {
+    if (!load_image(data_file(names[i]), images[i]))
+      return 0;
+  }
+  for (uint32_t c = 0; c < BATCH_COPIES; ++c) {
+    for (auto &image : images)
+      views.push_back({image.pixels, image.width, image.height, image.width * (uint32_t) sizeof(float), ETHSIFT_FORMAT_F32});
+  }
+  return 1;
+}
+
+define_test(eth_BatchSeparate, 1, {
+    std::vector<struct ethsift_image> images;
+    std::vector<struct ethsift_image_view> views;
+    if(!load_batch(images, views))
+      fail("Failed to load the batch images");
+    std::vector<struct ethsift_keypoint> kpts(ETHSIFT_MAX_TRACKABLE_KEYPOINTS);
+    uint32_t keypoint_count;
+
+    // One call per image, each allocating its own pyramids.
+    with_repeating(for (auto &view : views) {
+        keypoint_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+        ethsift_compute_keypoints_view(view, {0, 0, 0, 0}, NULL, kpts.data(), &keypoint_count);
+      })
+  })
+
+define_test(eth_BatchThreads, 1, {
+    std::vector<struct ethsift_image> images;
+    std::vector<struct ethsift_image_view> views;
+    if(!load_batch(images, views))
+      fail("Failed to load the batch images");
+    const uint32_t count = (uint32_t) views.size();
+    std::vector<std::vector<struct ethsift_keypoint>> kpts(count, std::vector<struct ethsift_keypoint>(ETHSIFT_MAX_TRACKABLE_KEYPOINTS));
+    std::vector<struct ethsift_keypoint *> outputs(count);
+    std::vector<uint32_t> keypoint_counts(count);
+    for (uint32_t i = 0; i < count; ++i)
+      outputs[i] = kpts[i].data();
+
+    ethsift_set_thread_count(0);
+    with_repeating(std::fill(keypoint_counts.begin(), keypoint_counts.end(), ETHSIFT_MAX_TRACKABLE_KEYPOINTS);
+                   ethsift_compute_keypoints_batch(views.data(), count, outputs.data(), keypoint_counts.data()));
+
+    // Throughput of one more batch, for comparison with eth_BatchSeparate.
+    auto begin = std::chrono::high_resolution_clock::now();
+    ethsift_compute_keypoints_batch(views.data(), count, outputs.data(), keypoint_counts.data());
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - begin;
+    printf("Batch of %d images: %.1f images/s\n", count, count / elapsed.count());
+    ethsift_set_thread_count(1);
+  })
+
+// 64 patches of 64x64 pixels from the 8-bit image, as a detector would hand them over.
+#define BATCH_PATCHES 64
+
+static int load_patches(ezsift::Image<unsigned char> &image, std::vector<struct ethsift_image_view> &views){
+  if (image.read_pgm(get_testimg_path()) != 0)
+    return 0;
+  for (uint32_t i = 0; i < BATCH_PATCHES; ++i) {
+    const uint32_t x = (i * 97) % (image.w - 64), y = (i * 59) % (image.h - 64);
+    views.push_back({image.data + y * image.w + x, 64, 64, (uint32_t) image.w, ETHSIFT_FORMAT_U8});
+  }
+  return 1;
+}
+
+static void run_patches(uint32_t mode){
+  ezsift::Image<unsigned char> image;
+  std::vector<struct ethsift_image_view> views;
+  if (!load_patches(image, views))
+    return;
+  std::vector<std::vector<struct ethsift_keypoint>> kpts(BATCH_PATCHES, std::vector<struct ethsift_keypoint>(ETHSIFT_MAX_TRACKABLE_KEYPOINTS));
+  std::vector<struct ethsift_keypoint *> outputs(BATCH_PATCHES);
+  std::vector<uint32_t> keypoint_counts(BATCH_PATCHES);
+  for (uint32_t i = 0; i < BATCH_PATCHES; ++i)
+    outputs[i] = kpts[i].data();
+
+  ethsift_set_batch_mode(mode);
+  with_repeating(std::fill(keypoint_counts.begin(), keypoint_counts.end(), ETHSIFT_MAX_TRACKABLE_KEYPOINTS);
+                 ethsift_compute_keypoints_batch(views.data(), BATCH_PATCHES, outputs.data(), keypoint_counts.data()));
+  ethsift_set_batch_mode(ETHSIFT_BATCH_IMAGES);
+}
+
+define_test(eth_BatchPatches, 1, {
+    run_patches(ETHSIFT_BATCH_IMAGES);
+  })
+
+define_test(eth_BatchPatchesLanes, 1, {
+    run_patches(ETHSIFT_BATCH_LANES);
+  })
+
+// The math functions are measured over 2^20 values at the default accuracy tier, spread over
+// the range the pipeline feeds them.
+#define MATH_VALUES (1 << 20)
+
+define_test(eth_MathExp, 1, {
+    std::vector<float> x(MATH_VALUES), out(MATH_VALUES);
+    for (uint32_t i = 0; i < MATH_VALUES; ++i)
+      x[i] = -20.0f * i / MATH_VALUES;
+    with_repeating(ethsift_evaluate_math(ETHSIFT_MATH_EXP, x.data(), NULL, out.data(), MATH_VALUES));
+  })
+
+define_test(eth_MathAtan2, 1, {
+    std::vector<float> x(MATH_VALUES), y(MATH_VALUES), out(MATH_VALUES);
+    for (uint32_t i = 0; i < MATH_VALUES; ++i) {
+      x[i] = (float) (i % 1024) - 512.0f;
+      y[i] = (float) (i / 1024) - 512.0f;
+    }
+    with_repeating(ethsift_evaluate_math(ETHSIFT_MATH_ATAN2, x.data(), y.data(), out.data(), MATH_VALUES));
+  })
+
+define_test(eth_MathSinCos, 1, {
+    std::vector<float> x(MATH_VALUES), out(MATH_VALUES);
+    for (uint32_t i = 0; i < MATH_VALUES; ++i)
+      x[i] = 2.0f * M_PI * i / MATH_VALUES;
+    with_repeating(ethsift_evaluate_math(ETHSIFT_MATH_SIN, x.data(), NULL, out.data(), MATH_VALUES));
+  })
+
+define_test(eth_MathFloor, 1, {
+    std::vector<float> x(MATH_VALUES), out(MATH_VALUES);
+    for (uint32_t i = 0; i < MATH_VALUES; ++i)
+      x[i] = 0.37f * i - 1000.0f;
+    with_repeating(ethsift_evaluate_math(ETHSIFT_MATH_FLOOR, x.data(), NULL, out.data(), MATH_VALUES));
+  })
+
+define_test(eth_MathRsqrt, 1, {
+    std::vector<float> x(MATH_VALUES), out(MATH_VALUES);
+    for (uint32_t i = 0; i < MATH_VALUES; ++i)
+      x[i] = 1.0f + 0.25f * i;
+    with_repeating(ethsift_evaluate_math(ETHSIFT_MATH_RSQRT, x.data(), NULL, out.data(), MATH_VALUES));
+  })
+
 define_test(eth_MeasureFull, 1, {
     ezsift::Image<unsigned char> ez_img;
     struct ethsift_image eth_img = {0};
@@ -314,6 +669,139 @@ define_test(eth_MeasureFull, 1, {
     with_repeating(ethsift_compute_keypoints(eth_img, keypoints, &keypoint_count))
   })
 
+define_test(eth_MeasureFullScalar, 1, {
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img, &ez_img))
+      fail("Failed to load image");
+    if(!ethsift_set_backend(ETHSIFT_BACKEND_SCALAR))
+      fail("Backend not supported by this CPU");
+    
+    uint32_t keypoint_count = 2048;
+    struct ethsift_keypoint keypoints[2048] = {0};
+
+    with_repeating(ethsift_compute_keypoints(eth_img, keypoints, &keypoint_count))
+    ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+  })
+
+define_test(eth_MeasureFullSSE, 1, {
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img, &ez_img))
+      fail("Failed to load image");
+    if(!ethsift_set_backend(ETHSIFT_BACKEND_SSE))
+      fail("Backend not supported by this CPU");
+    
+    uint32_t keypoint_count = 2048;
+    struct ethsift_keypoint keypoints[2048] = {0};
+
+    with_repeating(ethsift_compute_keypoints(eth_img, keypoints, &keypoint_count))
+    ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+  })
+
+define_test(eth_MeasureFullAVX2, 1, {
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img, &ez_img))
+      fail("Failed to load image");
+    if(!ethsift_set_backend(ETHSIFT_BACKEND_AVX2))
+      fail("Backend not supported by this CPU");
+    
+    uint32_t keypoint_count = 2048;
+    struct ethsift_keypoint keypoints[2048] = {0};
+
+    with_repeating(ethsift_compute_keypoints(eth_img, keypoints, &keypoint_count))
+    ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+  })
+
+define_test(eth_MeasureFullAVX512, 1, {
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img, &ez_img))
+      fail("Failed to load image");
+    if(!ethsift_set_backend(ETHSIFT_BACKEND_AVX512))
+      fail("Backend not supported by this CPU");
+    
+    uint32_t keypoint_count = 2048;
+    struct ethsift_keypoint keypoints[2048] = {0};
+
+    with_repeating(ethsift_compute_keypoints(eth_img, keypoints, &keypoint_count))
+    ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+  })
+
+define_test(eth_MeasureFullUpsample, 1, {
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img, &ez_img))
+      fail("Failed to load image");
+    
+    uint32_t keypoint_count = 2048;
+    struct ethsift_keypoint keypoints[2048] = {0};
+
+    ethsift_set_upsample(1);
+    with_repeating(ethsift_compute_keypoints(eth_img, keypoints, &keypoint_count))
+    ethsift_set_upsample(0);
+  })
+
+define_test(eth_MeasureFullOctant, 1, {
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img, &ez_img))
+      fail("Failed to load image");
+    
+    uint32_t keypoint_count = 2048;
+    struct ethsift_keypoint keypoints[2048] = {0};
+
+    ethsift_set_orientation_mode(ETHSIFT_ORIENTATION_OCTANT);
+    with_repeating(ethsift_compute_keypoints(eth_img, keypoints, &keypoint_count))
+    ethsift_set_orientation_mode(ETHSIFT_ORIENTATION_ATAN2);
+  })
+
+define_test(eth_MeasureFullView, 1, {
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img, &ez_img))
+      fail("Failed to load image");
+
+    // Hand the 8 bit pixels over directly, without converting them to float first.
+    struct ethsift_image_view view = {ez_img.data, eth_img.width, eth_img.height, eth_img.width, ETHSIFT_FORMAT_U8};
+    struct ethsift_roi full = {0};
+    uint32_t keypoint_count = 2048;
+    struct ethsift_keypoint keypoints[2048] = {0};
+
+    with_repeating(ethsift_compute_keypoints_view(view, full, NULL, keypoints, &keypoint_count))
+  })
+
+define_test(eth_MeasureFullMapped, 1, {
+    // The 8 bit pixels of the mapped file go to the pyramids without any copy.
+    struct ethsift_pnm pnm;
+    if(!ethsift_map_pnm(get_testimg_path(), &pnm) || !pnm.view.data)
+      fail("Failed to map image");
+    struct ethsift_roi full = {0};
+    uint32_t keypoint_count = 2048;
+    struct ethsift_keypoint keypoints[2048] = {0};
+
+    with_repeating(ethsift_compute_keypoints_view(pnm.view, full, NULL, keypoints, &keypoint_count))
+    ethsift_unmap_pnm(&pnm);
+  })
+
+define_test(eth_MeasureFullFixed, 1, {
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(!load_image(get_testimg_path(), eth_img, &ez_img))
+      fail("Failed to load image");
+
+    // Blur the 8 bit pixels in int16 fixed point
+    struct ethsift_image_view view = {ez_img.data, eth_img.width, eth_img.height, eth_img.width, ETHSIFT_FORMAT_U8};
+    struct ethsift_roi full = {0};
+    uint32_t keypoint_count = 2048;
+    struct ethsift_keypoint keypoints[2048] = {0};
+
+    ethsift_set_fixed_point(1);
+    with_repeating(ethsift_compute_keypoints_view(view, full, NULL, keypoints, &keypoint_count))
+    ethsift_set_fixed_point(0);
+  })
+
 define_test(eth_MeasureFullNoAlloc, 1, {
     ezsift::Image<unsigned char> ez_img;
     struct ethsift_image eth_img = {0};
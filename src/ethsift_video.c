@@ -0,0 +1,173 @@
+// Streams an uncompressed video through the library and reports the sustained frame rate and
+// the latency of single frames, to measure how the pipeline behaves across consecutive frames.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ethsift.h"
+
+#define MAX_KEYPOINTS 4096
+
+static double now(){
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// Sleep until the given time of now().
+static void sleep_until(double time){
+  double wait = time - now();
+  if (wait <= 0)
+    return;
+  struct timespec duration = {(time_t) wait, (long) ((wait - (time_t) wait) * 1e9)};
+  nanosleep(&duration, NULL);
+}
+
+struct stats{
+  double *submitted;
+  double *latency;
+  uint32_t done;
+  uint64_t keypoints;
+};
+
+// Take the next result of the pipeline and note its latency.
+static int take_result(struct ethsift_pipeline *pipeline, struct ethsift_keypoint *keypoints, struct stats *stats, int wait){
+  uint32_t count = MAX_KEYPOINTS, index;
+  if (!ethsift_pipeline_poll(pipeline, keypoints, &count, &index, wait))
+    return 0;
+  stats->latency[stats->done++] = now() - stats->submitted[index];
+  stats->keypoints += count;
+  return 1;
+}
+
+static int compare_doubles(const void *a, const void *b){
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x < y) ? -1 : (y < x);
+}
+
+// Nearest rank percentile of sorted values.
+static double percentile(const double *sorted, uint32_t count, double p){
+  uint32_t rank = (uint32_t) (p / 100.0 * count + 0.5);
+  return sorted[(rank == 0) ? 0 : rank - 1];
+}
+
+static void usage(){
+  fprintf(stderr,
+          "ethsift_video file [width height]\n"
+          "\n"
+          "   file   --- An uncompressed .y4m file, or raw 8-bit luma frames.\n"
+          "   width  --- Width of the frames of a raw file.\n"
+          "   height --- Height of the frames of a raw file.\n"
+          "\n"
+          "Additionally, the following environment variables are considered:\n"
+          "\n"
+          "   MODE    --- pipeline to stream the frames through ethsift_pipeline_submit,\n"
+          "               serial to compute one frame after the other. Defaults to pipeline.\n"
+          "   DEPTH   --- Frames the pipeline queues. Defaults to 4.\n"
+          "   LOOPS   --- How many times to play the file. Defaults to 1.\n"
+          "   THREADS --- Threads of ethsift_set_thread_count. Defaults to 1.\n"
+          "   LIVE    --- 1 to hand the frames over at the frame rate of the file, like a\n"
+          "               camera would, instead of as fast as they are taken. Defaults to 0.\n"
+          "\n"
+          "Latency is the time from handing a frame over to getting its keypoints back. Without\n"
+          "LIVE it includes the time a frame waits in the queue of the pipeline.\n");
+}
+
+int main(int argc, const char *argv[]){
+  if (argc != 2 && argc != 4) {
+    usage();
+    return 1;
+  }
+  const char *mode = getenv("MODE") ? getenv("MODE") : "pipeline";
+  const uint32_t depth = getenv("DEPTH") ? atoi(getenv("DEPTH")) : 4;
+  const uint32_t loops = getenv("LOOPS") ? atoi(getenv("LOOPS")) : 1;
+  const uint32_t threads = getenv("THREADS") ? atoi(getenv("THREADS")) : 1;
+  const int live = getenv("LIVE") ? atoi(getenv("LIVE")) : 0;
+  const int serial = !strcmp(mode, "serial");
+  if (!serial && strcmp(mode, "pipeline")) {
+    usage();
+    return 1;
+  }
+
+  struct ethsift_sequence *sequence = NULL;
+  if (!ethsift_sequence_open(argv[1], (argc == 4) ? atoi(argv[2]) : 0, (argc == 4) ? atoi(argv[3]) : 0, &sequence)) {
+    fprintf(stderr, "Failed to open %s\n", argv[1]);
+    return 1;
+  }
+  uint32_t width, height, frame_count;
+  float fps;
+  ethsift_sequence_info(sequence, &width, &height, &frame_count, &fps);
+  fprintf(stderr, "%s: %d frames of %d x %d at %.2f fps, %s mode\n", argv[1], frame_count, width, height, fps, mode);
+
+  ethsift_init();
+  if (!ethsift_set_thread_count(threads)) {
+    fprintf(stderr, "Failed to start %d threads\n", threads);
+    return 1;
+  }
+  struct ethsift_pipeline *pipeline = NULL;
+  if (!serial && !ethsift_pipeline_create(width, height, depth, MAX_KEYPOINTS, ETHSIFT_BACKPRESSURE_BLOCK, &pipeline)) {
+    fprintf(stderr, "Failed to create a pipeline of depth %d\n", depth);
+    return 1;
+  }
+
+  const uint32_t total = frame_count * loops;
+  struct stats stats = {calloc(total, sizeof(double)), calloc(total, sizeof(double)), 0, 0};
+  struct ethsift_keypoint *keypoints = malloc(MAX_KEYPOINTS * sizeof(struct ethsift_keypoint));
+  if (!stats.submitted || !stats.latency || !keypoints) {
+    fprintf(stderr, "Failed to allocate the frame statistics\n");
+    return 1;
+  }
+
+  const double begin = now();
+  for (uint32_t i = 0; i < total; ++i) {
+    struct ethsift_image_view frame;
+    if (i % frame_count == 0)
+      ethsift_sequence_rewind(sequence);
+    if (!ethsift_sequence_read(sequence, &frame))
+      break;
+    // Until the frame is due, take the results that come in meanwhile.
+    const double due = begin + i / fps;
+    while (live && now() < due) {
+      if (serial || !take_result(pipeline, keypoints, &stats, 0))
+        sleep_until((due < now() + 0.001) ? due : now() + 0.001);
+    }
+    stats.submitted[i] = now();
+    if (serial) {
+      uint32_t count = MAX_KEYPOINTS;
+      if (!ethsift_compute_keypoints_view(frame, (struct ethsift_roi){0}, NULL, keypoints, &count))
+        count = 0;
+      stats.latency[stats.done++] = now() - stats.submitted[i];
+      stats.keypoints += count;
+      continue;
+    }
+    if (!ethsift_pipeline_submit(pipeline, frame)) {
+      fprintf(stderr, "Frame %d was not accepted\n", i);
+      break;
+    }
+    // Take everything that is ready without waiting, as a live consumer would.
+    while (take_result(pipeline, keypoints, &stats, 0));
+  }
+  while (!serial && take_result(pipeline, keypoints, &stats, 1));
+  const double elapsed = now() - begin;
+
+  const uint32_t done = stats.done;
+  const double *latency = stats.latency;
+  if (done == 0) {
+    fprintf(stderr, "No frames were processed\n");
+    return 1;
+  }
+  qsort(stats.latency, done, sizeof(double), compare_doubles);
+  printf("Frames:     %d in %.3f s\n", done, elapsed);
+  printf("Throughput: %.2f fps\n", done / elapsed);
+  printf("Latency:    p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+         percentile(latency, done, 50) * 1e3, percentile(latency, done, 90) * 1e3,
+         percentile(latency, done, 99) * 1e3, latency[done - 1] * 1e3);
+  printf("Keypoints:  %.1f per frame\n", (double) stats.keypoints / done);
+
+  ethsift_pipeline_free(pipeline);
+  ethsift_sequence_close(sequence);
+  free(keypoints);
+  free(stats.latency);
+  free(stats.submitted);
+  return 0;
+}
@@ -1,429 +1,1165 @@
 #include "internal.h"
 
 /// <summary> 
-/// Extract the keypoint descriptors.
+/// Normalize a descriptor, clamp large bins and re-normalize to the integer descriptor range.
 /// </summary>
-/// <param name="gradients"> IN: Gradients pyramid. </param>
-/// <param name="rotations"> IN: Rotation pyramid.  </param>
-/// <param name="octave_count"> IN: Number of Octaves. </param> 
-/// <param name="gaussian_count"> IN: Number of gaussian layers. </param> 
-/// <param name="keypoints"> OUT: Array of detected keypoints. </param> 
-/// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
-///                               OUT: Number of keypoints found. </param> 
-/// <returns> 1 IF computation was successful, ELSE 0. </returns>
-int ethsift_extract_descriptor(struct ethsift_image gradients[], 
-                              struct ethsift_image rotations[], 
-                              uint32_t octave_count, 
-                              uint32_t gaussian_count, 
-                              struct ethsift_keypoint keypoints[], 
-                              uint32_t keypoint_count)
-{
-    // Number of subregions, default 4x4 subregions.
-    // The width of subregion is determined by the scale of the keypoint.
-    // Or, in Lowe's SIFT paper[2004], width of subregion is 16x16.
-    int nSubregion = ETHSIFT_DESCR_WIDTH;
-    int nHalfSubregion = ETHSIFT_DESCR_WIDTH_HALF;
+/// <param name="bins"> IN/OUT: The 128 descriptor bins. </param>
+void normalize_descriptor_scalar(float *bins){
+    const int nBins = ETHSIFT_DESCR_WIDTH * ETHSIFT_DESCR_WIDTH * ETHSIFT_DESCR_HIST_BINS;
+    float sum_square = 0.0f;
+    for (int i = 0; i < nBins; ++i) {
+        sum_square += bins[i] * bins[i];
+        inc_adds(1);
+        inc_mults(1);
+        inc_read(1, float);
+    }
 
-    // Center is 1.5
-    float precise_nHalfSubregion = ETHSIFT_DESCR_WIDTH_PRECISE_HALF;
+    float thr = sqrtf(sum_square) * ETHSIFT_DESCR_MAG_THR;
+    inc_mults(1);
 
-    // Number of histogram bins for each descriptor subregion.
-    int nBinsPerSubregion = ETHSIFT_DESCR_HIST_BINS;
-    float nBinsPerSubregionPerDegree = ETHSIFT_DESCR_HIST_BINS_DEGREE;
+    // Cut off the numbers bigger than 0.2 after normalized.
+    sum_square = 0.0f;
+    for (int i = 0; i < nBins; ++i) {
+        bins[i] = float_min(thr, bins[i]);
+        sum_square += bins[i] * bins[i];
+        inc_adds(1);
+        inc_mults(1);
+        inc_read(1, float);
+        inc_write(1, float);
+    }
 
-    // 3-D structure for histogram bins (rbin, cbin, obin);
-    // (rbin, cbin, obin) means (row of hist bin, column of hist bin,
-    // orientation bin) In Lowe's paper, 4x4 histogram, each has 8 bins. that
-    // means for each (rbin, cbin), there are 8 bins in the histogram.
+    // Re-normalize
+    // The numbers are usually too small to store, so we use
+    // a constant factor to scale up the numbers.
+    float conv_f_to_char = ETHSIFT_INT_DESCR_FCTR;
+    float norm_factor = conv_f_to_char * eth_rsqrt_f(sum_square);
+    inc_div(1);
 
-    // In this implementation, histBin is a circular buffer.
-    // we expand the cube by 1 for each direction.
-    int nBins = nSubregion * nSubregion * nBinsPerSubregion;
-    int nHistBins = (nSubregion + 2) * (nSubregion + 2) * (nBinsPerSubregion + 2);
-    int nSliceStep = (nSubregion + 2) * (nBinsPerSubregion + 2);
-    int nRowStep = (nBinsPerSubregion + 2);
-    float histBin[nHistBins];
-
-    float exp_scale = ETHSIFT_DESCR_EXP_SCALE;
-
-    struct ethsift_keypoint* kpt;
-    for (int k = 0; k < keypoint_count; ++k) {
-        kpt = &keypoints[k];
-        // Keypoint information
-        int octave = kpt->octave;
-        int layer = kpt->layer;
-        inc_read(2, int32_t);
-
-        float kpt_ori = kpt->orientation;
-        float kptr = kpt->layer_pos.y;
-        float kptc = kpt->layer_pos.x;
-        float kpt_scale = kpt->layer_pos.scale;
+    for (int i = 0; i < nBins; ++i) {
+        bins[i] *= norm_factor;
+        inc_mults(1);
+        inc_read(1, float);
+        inc_write(1, float);
+    }
+}
+
+/// <summary> 
+/// Horizontal sum of a 4-wide vector.
+/// </summary>
+ETHSIFT_TARGET_SSE
+static inline float hsum_ps(__m128 x){
+    const __m128 x64 = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    const __m128 x32 = _mm_add_ss(x64, _mm_shuffle_ps(x64, x64, 0x55));
+    return _mm_cvtss_f32(x32);
+}
+
+/// <summary> 
+/// Normalize a descriptor using SSE, see normalize_descriptor_scalar.
+/// </summary>
+ETHSIFT_TARGET_SSE
+void normalize_descriptor_sse(float *bins){
+    const int nBins = ETHSIFT_DESCR_WIDTH * ETHSIFT_DESCR_WIDTH * ETHSIFT_DESCR_HIST_BINS;
+    __m128 vec_sum = _mm_setzero_ps();
+    for (int i = 0; i < nBins; i+=4) {
+        __m128 vec_bins = _mm_loadu_ps(bins+i);
+        vec_sum = _mm_add_ps(vec_sum, _mm_mul_ps(vec_bins, vec_bins));
+        inc_adds(4);
+        inc_mults(4);
         inc_read(4, float);
+    }
 
-        // Nearest coordinate of keypoints
-        int kptr_i = (int)(kptr + 0.5f);
-        int kptc_i = (int)(kptc + 0.5f);
-        float d_kptr = kptr_i - kptr;
-        float d_kptc = kptc_i - kptc;
+    float thr = sqrtf(hsum_ps(vec_sum)) * ETHSIFT_DESCR_MAG_THR;
+    inc_mults(1);
+
+    __m128 vec_thr = _mm_set1_ps(thr);
+    vec_sum = _mm_setzero_ps();
+    for (int i = 0; i < nBins; i+=4) {
+        __m128 vec_bins = _mm_min_ps(_mm_loadu_ps(bins+i), vec_thr);
+        _mm_storeu_ps(bins+i, vec_bins);
+        vec_sum = _mm_add_ps(vec_sum, _mm_mul_ps(vec_bins, vec_bins));
         inc_adds(4);
+        inc_mults(4);
+        inc_read(4, float);
+        inc_write(4, float);
+    }
 
-        int layer_index = octave * gaussian_count + layer;
-        int w = gradients[layer_index].width;
-        int h = gradients[layer_index].height;
-        inc_read(2, int32_t);
-
-        // Note for Gaussian weighting.
-        // OpenCV and vl_feat uses non-fixed size of subregion.
-        // But they all use (0.5 * 4) as the Gaussian weighting sigma.
-        // In Lowe's paper, he uses 16x16 sample region,
-        // partition 16x16 region into 16 4x4 subregion.
-        float size_desc = ETHSIFT_DESCR_SCL_FCTR;
-        float subregion_width = size_desc * kpt_scale;
-        int win_size =
-            (int)(M_SQRT2 * subregion_width * (nSubregion + 1) * 0.5f + 0.5f);
+    float conv_f_to_char = ETHSIFT_INT_DESCR_FCTR;
+    __m128 vec_norm_factor = _mm_set1_ps(conv_f_to_char * eth_rsqrt_f(hsum_ps(vec_sum)));
+    inc_div(1);
 
+    for (int i = 0; i < nBins; i+=4) {
+        _mm_storeu_ps(bins+i, _mm_mul_ps(_mm_loadu_ps(bins+i), vec_norm_factor));
         inc_mults(4);
-        inc_adds(1);
+        inc_read(4, float);
+        inc_write(4, float);
+    }
+}
+
+/// <summary> 
+/// Normalize a descriptor using AVX-512, see normalize_descriptor_scalar.
+/// </summary>
+ETHSIFT_TARGET_AVX512
+void normalize_descriptor_avx512(float *bins){
+    const int nBins = ETHSIFT_DESCR_WIDTH * ETHSIFT_DESCR_WIDTH * ETHSIFT_DESCR_HIST_BINS;
+    __m512 vec_sum = _mm512_setzero_ps();
+    for (int i = 0; i < nBins; i+=16) {
+        __m512 vec_bins = _mm512_loadu_ps(bins+i);
+        vec_sum = _mm512_fmadd_ps(vec_bins, vec_bins, vec_sum);
+        inc_adds(16);
+        inc_mults(16);
+        inc_read(16, float);
+    }
 
-        // Normalized cos() and sin() value.
-        float sin_t = sinf(kpt_ori) / (float)subregion_width;
-        float cos_t = cosf(kpt_ori) / (float)subregion_width;
+    float thr = sqrtf(_mm512_reduce_add_ps(vec_sum)) * ETHSIFT_DESCR_MAG_THR;
+    inc_mults(1);
+
+    __m512 vec_thr = _mm512_set1_ps(thr);
+    vec_sum = _mm512_setzero_ps();
+    for (int i = 0; i < nBins; i+=16) {
+        __m512 vec_bins = _mm512_min_ps(_mm512_loadu_ps(bins+i), vec_thr);
+        _mm512_storeu_ps(bins+i, vec_bins);
+        vec_sum = _mm512_fmadd_ps(vec_bins, vec_bins, vec_sum);
+        inc_adds(16);
+        inc_mults(16);
+        inc_read(16, float);
+        inc_write(16, float);
+    }
 
-        inc_div(2);
+    float conv_f_to_char = ETHSIFT_INT_DESCR_FCTR;
+    __m512 vec_norm_factor = _mm512_set1_ps(conv_f_to_char * eth_rsqrt_f(_mm512_reduce_add_ps(vec_sum)));
+    inc_div(1);
 
-        // Re-init histBin
-        memset(histBin, 0, nHistBins * sizeof(float));
-        inc_write(nHistBins, float);
+    for (int i = 0; i < nBins; i+=16) {
+        _mm512_storeu_ps(bins+i, _mm512_mul_ps(_mm512_loadu_ps(bins+i), vec_norm_factor));
+        inc_mults(16);
+        inc_read(16, float);
+        inc_write(16, float);
+    }
+}
+
+/// <summary> 
+/// Normalize a descriptor using AVX2, see normalize_descriptor_scalar.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+void normalize_descriptor_avx2(float *bins){
+    const int nBins = ETHSIFT_DESCR_WIDTH * ETHSIFT_DESCR_WIDTH * ETHSIFT_DESCR_HIST_BINS;
+    __m256 vec_sum = _mm256_setzero_ps();
+    for (int i = 0; i < nBins; i+=8) {
+        __m256 vec_bins = _mm256_loadu_ps(bins+i);
+        vec_sum = _mm256_fmadd_ps(vec_bins, vec_bins, vec_sum);
+        inc_adds(8);
+        inc_mults(8);
+        inc_read(8, float);
+    }
 
-        // Start to calculate the histogram in the sample region.
-        float rr, cc;
-        float mag, angle, gaussian_weight;
+    // https://stackoverflow.com/questions/23189488/horizontal-sum-of-32-bit-floats-in-256-bit-avx-vector
+    float sum_square = hsum_ps(_mm_add_ps(_mm256_extractf128_ps(vec_sum, 1), _mm256_castps256_ps128(vec_sum)));
+    float thr = sqrtf(sum_square) * ETHSIFT_DESCR_MAG_THR;
+    inc_mults(1);
+
+    __m256 vec_thr = _mm256_set1_ps(thr);
+    vec_sum = _mm256_setzero_ps();
+    for (int i = 0; i < nBins; i+=8) {
+        __m256 vec_bins = _mm256_min_ps(_mm256_loadu_ps(bins+i), vec_thr);
+        _mm256_storeu_ps(bins+i, vec_bins);
+        vec_sum = _mm256_fmadd_ps(vec_bins, vec_bins, vec_sum);
+        inc_adds(8);
+        inc_mults(8);
+        inc_read(8, float);
+        inc_write(8, float);
+    }
 
-        // Used for tri-linear interpolation.
-        // int rbin_i, cbin_i, obin_i;
-        float rrotate, crotate;
-        float rbin, cbin, obin;
-        float d_rbin, d_cbin, d_obin;
+    sum_square = hsum_ps(_mm_add_ps(_mm256_extractf128_ps(vec_sum, 1), _mm256_castps256_ps128(vec_sum)));
+    float conv_f_to_char = ETHSIFT_INT_DESCR_FCTR;
+    __m256 vec_norm_factor = _mm256_set1_ps(conv_f_to_char * eth_rsqrt_f(sum_square));
+    inc_div(1);
 
-        float sin_t_rr, cos_t_rr;
+    for (int i = 0; i < nBins; i+=8) {
+        _mm256_storeu_ps(bins+i, _mm256_mul_ps(_mm256_loadu_ps(bins+i), vec_norm_factor));
+        inc_mults(8);
+        inc_read(8, float);
+        inc_write(8, float);
+    }
+}
 
-        // Boundary of sample region.
-        int r, c;
-        int left = int_max(-win_size, 1 - kptc_i);
-        int right = int_min(win_size, w - 2 - kptc_i);
-        int top = int_max(-win_size, 1 - kptr_i);
-        int bottom = int_min(win_size, h - 2 - kptr_i);
+/// <summary> 
+/// Add a sample to the circular histogram with tri-linear interpolation.
+/// </summary>
+/// <param name="histBin"> IN/OUT: Histogram of (ETHSIFT_DESCR_WIDTH + 2)^2 * (ETHSIFT_DESCR_HIST_BINS + 2) bins. </param>
+/// <param name="rbin"> IN: Row of the sample in histogram cells, in (-1, ETHSIFT_DESCR_WIDTH). </param>
+/// <param name="cbin"> IN: Column of the sample in histogram cells, in (-1, ETHSIFT_DESCR_WIDTH). </param>
+/// <param name="obin"> IN: Orientation of the sample in bins, in [0, ETHSIFT_DESCR_HIST_BINS]. </param>
+/// <param name="gm"> IN: Gaussian-weighted magnitude of the sample. </param>
+static inline void accumulate_sample(float *histBin, float rbin, float cbin, float obin, float gm){
+    const int nSliceStep = (ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_HIST_BINS + 2);
+    const int nRowStep = (ETHSIFT_DESCR_HIST_BINS + 2);
+    float d_rbin, d_cbin, d_obin;
+
+    int x0, y0, z0;
+    int x1, y1;
+    y0 = (int)eth_floor_f(rbin);
+    x0 = (int)eth_floor_f(cbin);
+    z0 = (int)eth_floor_f(obin);
+    d_rbin = rbin - y0;
+    d_cbin = cbin - x0;
+    d_obin = obin - z0;
+    x1 = x0 + 1;
+    y1 = y0 + 1;
+
+    inc_adds(3);
+
+    // Tri-linear interpolation
+    float vr1, vr0;
+    float vrc11, vrc10, vrc01, vrc00;
+    float vrco110, vrco111, vrco100, vrco101, vrco010, vrco011,
+        vrco000, vrco001;
+
+    vr1 = gm * d_rbin;
+    vr0 = gm - vr1;
+    vrc11 = vr1 * d_cbin;
+    vrc10 = vr1 - vrc11;
+    vrc01 = vr0 * d_cbin;
+    vrc00 = vr0 - vrc01;
+    vrco111 = vrc11 * d_obin;
+    vrco110 = vrc11 - vrco111;
+    vrco101 = vrc10 * d_obin;
+    vrco100 = vrc10 - vrco101;
+    vrco011 = vrc01 * d_obin;
+    vrco010 = vrc01 - vrco011;
+    vrco001 = vrc00 * d_obin;
+    vrco000 = vrc00 - vrco001;
+
+    inc_adds(7);
+    inc_mults(7);
+
+    // int idx =  y0  * nSliceStep + x0  * nRowStep + z0;
+    // All coords are offseted by 1. so x=[1, 4], y=[1, 4];
+    // data for -1 coord is stored at position 0;
+    // data for 8 coord is stored at position 9.
+    // z doesn't need to move.
+    int idx = y1 * nSliceStep + x1 * nRowStep + z0;
+    histBin[idx] += vrco000;
+
+    idx++;
+    histBin[idx] += vrco001;
+
+    idx += nRowStep - 1;
+    histBin[idx] += vrco010;
+
+    idx++;
+    histBin[idx] += vrco011;
+
+    idx += nSliceStep - nRowStep - 1;
+    histBin[idx] += vrco100;
+
+    idx++;
+    histBin[idx] += vrco101;
+
+    idx += nRowStep - 1;
+    histBin[idx] += vrco110;
+
+    idx++;
+    histBin[idx] += vrco111;
+
+    inc_adds(8);
+    inc_write(8, float);
+}
 
-        for (int i = top; i <= bottom; i++) // rows
+/// <summary> 
+/// Accumulate the samples of a descriptor window into the circular histogram with tri-linear interpolation.
+/// </summary>
+/// <param name="window"> IN: Sample window of the keypoint. </param>
+/// <param name="histBin"> IN/OUT: Histogram of (ETHSIFT_DESCR_WIDTH + 2)^2 * (ETHSIFT_DESCR_HIST_BINS + 2) bins. </param>
+void descriptor_histogram_scalar(const struct descriptor_window *window, float *histBin){
+    const int nSubregion = ETHSIFT_DESCR_WIDTH;
+    const float precise_nHalfSubregion = ETHSIFT_DESCR_WIDTH_PRECISE_HALF;
+    const float nBinsPerSubregionPerDegree = ETHSIFT_DESCR_HIST_BINS_DEGREE;
+    const float exp_scale = ETHSIFT_DESCR_EXP_SCALE;
+
+    const int w = window->w;
+    const int kptr_i = window->kptr_i, kptc_i = window->kptc_i;
+    const int top = window->top, bottom = window->bottom;
+    const int left = window->left, right = window->right;
+    const float d_kptr = window->d_kptr, d_kptc = window->d_kptc;
+    const float sin_t = window->sin_t, cos_t = window->cos_t;
+    const float kpt_ori = window->kpt_ori;
+    const int octant = window->octant;
+
+    float rr, cc;
+    float mag, angle, gaussian_weight;
+
+    // Used for tri-linear interpolation.
+    float rrotate, crotate;
+    float rbin, cbin, obin;
+
+    float sin_t_rr, cos_t_rr;
+    int r, c;
+
+    for (int i = top; i <= bottom; i++) // rows
+    {
+        // Accurate position relative to kptr
+        rr = i + d_kptr;
+        sin_t_rr = sin_t * rr;
+        cos_t_rr = cos_t * rr;
+        inc_adds(1);
+        inc_mults(2);
+        
+        for (int j = left; j <= right; j++) // columns
         {
-            // Accurate position relative to kptr
-            rr = i + d_kptr;
-            sin_t_rr = sin_t * rr;
-            cos_t_rr = cos_t * rr;
+            // Accurate position relative to kptc
+            cc = j + d_kptc;
+
             inc_adds(1);
+
+            // Rotate the coordinate of (i, j)
+            rrotate = (cos_t * cc + sin_t_rr);
+            crotate = (-sin_t * cc + cos_t_rr);
+
             inc_mults(2);
-            
-            for (int j = left; j <= right; j++) // columns
-            {
-                // Accurate position relative to kptc
-                cc = j + d_kptc;
+            inc_adds(3);
+
+            // Since for a bin array with 4x4 bins, the center is actually
+            // at (1.5, 1.5)
+            rbin = rrotate + precise_nHalfSubregion;
+            cbin = crotate + precise_nHalfSubregion;
+
+            inc_adds(2);
+
+            // rbin, cbin range is (-1, d); if outside this range, then the
+            // pixel is counted.
+            if (rbin <= -1 || rbin >= nSubregion || cbin <= -1 ||
+                cbin >= nSubregion)
+                continue;
+
+            // All the data need for gradient computation are valid, no
+            // border issues.
+            r = kptr_i + i;
+            c = kptc_i + j;
+            mag = window->gradient[r * w + c];
+            if (octant) {
+                const float *g = window->rotation + r * w + c;
+                angle = octant_angle_f(g[w] - g[-w], g[1] - g[-1]) - kpt_ori;
+                inc_read(4, float);
+                inc_adds(2);
+            } else {
+                angle = window->rotation[r * w + c] - kpt_ori;
+            }
+            float angle1 = (angle < 0) ? (M_TWOPI + angle) : angle; // Adjust angle to [0, 2PI)
+            obin = angle1 * nBinsPerSubregionPerDegree;
+
+            inc_read(2, float);
+            inc_adds(1);
+            inc_mults(1);
 
+            if (angle < 0) {
                 inc_adds(1);
+            }
 
-                // Rotate the coordinate of (i, j)
-                rrotate = (cos_t * cc + sin_t_rr);
-                crotate = (-sin_t * cc + cos_t_rr);
+            // Gaussian weight relative to the center of sample region.
+            gaussian_weight =
+                eth_exp_f((rrotate * rrotate + crotate * crotate) * exp_scale);
 
-                inc_mults(2);
-                inc_adds(3);
+            inc_mults(3);
+            inc_adds(1);
 
-                // Since for a bin array with 4x4 bins, the center is actually
-                // at (1.5, 1.5)
-                rbin = rrotate + precise_nHalfSubregion;
-                cbin = crotate + precise_nHalfSubregion;
+            // Gaussian-weighted magnitude
+            accumulate_sample(histBin, rbin, cbin, obin, mag * gaussian_weight);
 
-                inc_adds(2);
+            inc_mults(1);
+        }
+    }
+}
 
-                // rbin, cbin range is (-1, d); if outside this range, then the
-                // pixel is counted.
-                if (rbin <= -1 || rbin >= nSubregion || cbin <= -1 ||
-                    cbin >= nSubregion)
-                    continue;
-
-                // All the data need for gradient computation are valid, no
-                // border issues.
-                r = kptr_i + i;
-                c = kptc_i + j;
-                mag = gradients[layer_index].pixels[r * w + c];
-                angle = rotations[layer_index].pixels[r * w + c] - kpt_ori;
-                float angle1 = (angle < 0) ? (M_TWOPI + angle) : angle; // Adjust angle to [0, 2PI)
-                obin = angle1 * nBinsPerSubregionPerDegree;
-
-                inc_read(2, float);
-                inc_adds(1);
-                inc_mults(1);
-
-                if (angle < 0) {
-                    inc_adds(1);
-                }
-
-                int x0, y0, z0;
-                int x1, y1;
-                y0 = (int)floor(rbin);
-                x0 = (int)floor(cbin);
-                z0 = (int)floor(obin);
-                d_rbin = rbin - y0;
-                d_cbin = cbin - x0;
-                d_obin = obin - z0;
-                x1 = x0 + 1;
-                y1 = y0 + 1;
-
-                inc_adds(3);
-
-                // Gaussian weight relative to the center of sample region.
-                gaussian_weight =
-                    expf((rrotate * rrotate + crotate * crotate) * exp_scale);
-
-                inc_mults(3);
-                inc_adds(1);
+/// <summary> 
+/// Add 8 samples to lane-private copies of the circular histogram with tri-linear interpolation,
+/// see accumulate_sample. Lane l adds to lane_hist + l * nHistBins, so neighbouring samples never collide.
+/// </summary>
+/// <param name="lane_hist"> IN/OUT: 8 copies of the histogram. </param>
+/// <param name="lanes"> IN: Bit mask of the lanes that hold a valid sample. </param>
+ETHSIFT_TARGET_AVX2
+static inline void accumulate_lanes_avx2(float *lane_hist, __m256 rbin, __m256 cbin, __m256 obin, __m256 gm, int lanes){
+    const int nSliceStep = (ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_HIST_BINS + 2);
+    const int nRowStep = (ETHSIFT_DESCR_HIST_BINS + 2);
+    const int nHistBins = (ETHSIFT_DESCR_WIDTH + 2) * nSliceStep;
+    const __m256i one = _mm256_set1_epi32(1);
+    float weights[8][8];
+    int idx[8];
+
+    const __m256 y0 = eth_mm256_floor_ps(rbin);
+    const __m256 x0 = eth_mm256_floor_ps(cbin);
+    const __m256 z0 = eth_mm256_floor_ps(obin);
+    const __m256 d_rbin = _mm256_sub_ps(rbin, y0);
+    const __m256 d_cbin = _mm256_sub_ps(cbin, x0);
+    const __m256 d_obin = _mm256_sub_ps(obin, z0);
+    inc_adds(24);
+
+    // Tri-linear interpolation
+    const __m256 vr1 = _mm256_mul_ps(gm, d_rbin);
+    const __m256 vr0 = _mm256_sub_ps(gm, vr1);
+    const __m256 vrc11 = _mm256_mul_ps(vr1, d_cbin);
+    const __m256 vrc10 = _mm256_sub_ps(vr1, vrc11);
+    const __m256 vrc01 = _mm256_mul_ps(vr0, d_cbin);
+    const __m256 vrc00 = _mm256_sub_ps(vr0, vrc01);
+    const __m256 vrco111 = _mm256_mul_ps(vrc11, d_obin);
+    const __m256 vrco101 = _mm256_mul_ps(vrc10, d_obin);
+    const __m256 vrco011 = _mm256_mul_ps(vrc01, d_obin);
+    const __m256 vrco001 = _mm256_mul_ps(vrc00, d_obin);
+    _mm256_storeu_ps(weights[0], _mm256_sub_ps(vrc00, vrco001));
+    _mm256_storeu_ps(weights[1], vrco001);
+    _mm256_storeu_ps(weights[2], _mm256_sub_ps(vrc01, vrco011));
+    _mm256_storeu_ps(weights[3], vrco011);
+    _mm256_storeu_ps(weights[4], _mm256_sub_ps(vrc10, vrco101));
+    _mm256_storeu_ps(weights[5], vrco101);
+    _mm256_storeu_ps(weights[6], _mm256_sub_ps(vrc11, vrco111));
+    _mm256_storeu_ps(weights[7], vrco111);
+    inc_adds(56);
+    inc_mults(56);
+
+    // All coords are offseted by 1, see accumulate_sample.
+    __m256i bin = _mm256_mullo_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(y0), one), _mm256_set1_epi32(nSliceStep));
+    bin = _mm256_add_epi32(bin, _mm256_mullo_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(x0), one), _mm256_set1_epi32(nRowStep)));
+    bin = _mm256_add_epi32(bin, _mm256_cvttps_epi32(z0));
+    bin = _mm256_add_epi32(bin, _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(nHistBins)));
+    _mm256_storeu_si256((__m256i *) idx, bin);
+
+    for (int l = 0; l < 8; ++l) {
+        if (!(lanes & (1 << l)))
+            continue;
+        float *h = lane_hist + idx[l];
+        h[0] += weights[0][l];
+        h[1] += weights[1][l];
+        h[nRowStep] += weights[2][l];
+        h[nRowStep + 1] += weights[3][l];
+        h[nSliceStep] += weights[4][l];
+        h[nSliceStep + 1] += weights[5][l];
+        h[nSliceStep + nRowStep] += weights[6][l];
+        h[nSliceStep + nRowStep + 1] += weights[7][l];
+        inc_adds(8);
+        inc_write(8, float);
+    }
+}
+
+/// <summary> 
+/// Add the 8 lane-private copies of the histogram of accumulate_lanes_avx2 to histBin.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+static inline void merge_lanes_avx2(const float *lane_hist, float *histBin){
+    const int nHistBins = (ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_HIST_BINS + 2);
+    for (int b = 0; b < nHistBins; b += 8) {
+        __m256 sum = _mm256_loadu_ps(histBin + b);
+        for (int l = 0; l < 8; ++l)
+            sum = _mm256_add_ps(sum, _mm256_loadu_ps(lane_hist + l * nHistBins + b));
+        _mm256_storeu_ps(histBin + b, sum);
+        inc_adds(64);
+        inc_read(72, float);
+        inc_write(8, float);
+    }
+}
+
+/// <summary> 
+/// Accumulate a descriptor window using AVX2, see descriptor_histogram_scalar.
+/// Eight samples of a window row are binned at once, each lane adds its eight tri-linear weights
+/// into a private copy of the histogram so that the updates of neighbouring samples never collide.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+void descriptor_histogram_avx2(const struct descriptor_window *window, float *histBin){
+    const int nSubregion = ETHSIFT_DESCR_WIDTH;
+    const int nHistBins = (nSubregion + 2) * (nSubregion + 2) * (ETHSIFT_DESCR_HIST_BINS + 2);
+
+    const int w = window->w;
+    const float *gradient = window->gradient + window->kptr_i * w + window->kptc_i;
+    const float *rotation = window->rotation + window->kptr_i * w + window->kptc_i;
+    const int octant = window->octant;
+
+    float lane_hist[8 * nHistBins];
+    memset(lane_hist, 0, sizeof(lane_hist));
+    inc_write(8 * nHistBins, float);
+
+    const __m256 lane_index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 neg_sin_t = _mm256_set1_ps(-window->sin_t);
+    const __m256 cos_t = _mm256_set1_ps(window->cos_t);
+    const __m256 kpt_ori = _mm256_set1_ps(window->kpt_ori);
+    const __m256 half = _mm256_set1_ps(ETHSIFT_DESCR_WIDTH_PRECISE_HALF);
+    const __m256 minus_one = _mm256_set1_ps(-1.0f);
+    const __m256 subregions = _mm256_set1_ps((float) nSubregion);
+    const __m256 twopi = _mm256_set1_ps(M_TWOPI);
+    const __m256 bins_per_degree = _mm256_set1_ps(ETHSIFT_DESCR_HIST_BINS_DEGREE);
+    const __m256 exp_scale = _mm256_set1_ps(ETHSIFT_DESCR_EXP_SCALE);
+
+    for (int i = window->top; i <= window->bottom; i++) // rows
+    {
+        const float rr = i + window->d_kptr;
+        const __m256 sin_t_rr = _mm256_set1_ps(window->sin_t * rr);
+        const __m256 cos_t_rr = _mm256_set1_ps(window->cos_t * rr);
+        const float *grad_row = gradient + i * w;
+        const float *rot_row = rotation + i * w;
+        inc_adds(1);
+        inc_mults(2);
 
-                // Gaussian-weighted magnitude
-                float gm = mag * gaussian_weight;
-                // Tri-linear interpolation
-
-                inc_mults(1);
-
-                float vr1, vr0;
-                float vrc11, vrc10, vrc01, vrc00;
-                float vrco110, vrco111, vrco100, vrco101, vrco010, vrco011,
-                    vrco000, vrco001;
-
-                vr1 = gm * d_rbin;
-                vr0 = gm - vr1;
-                vrc11 = vr1 * d_cbin;
-                vrc10 = vr1 - vrc11;
-                vrc01 = vr0 * d_cbin;
-                vrc00 = vr0 - vrc01;
-                vrco111 = vrc11 * d_obin;
-                vrco110 = vrc11 - vrco111;
-                vrco101 = vrc10 * d_obin;
-                vrco100 = vrc10 - vrco101;
-                vrco011 = vrc01 * d_obin;
-                vrco010 = vrc01 - vrco011;
-                vrco001 = vrc00 * d_obin;
-                vrco000 = vrc00 - vrco001;
-
-                inc_adds(7);
-                inc_mults(7);
-
-                // int idx =  y0  * nSliceStep + x0  * nRowStep + z0;
-                // All coords are offseted by 1. so x=[1, 4], y=[1, 4];
-                // data for -1 coord is stored at position 0;
-                // data for 8 coord is stored at position 9.
-                // z doesn't need to move.
-                int idx = y1 * nSliceStep + x1 * nRowStep + z0;
-                histBin[idx] += vrco000;
-
-                idx++;
-                histBin[idx] += vrco001;
-
-                idx += nRowStep - 1;
-                histBin[idx] += vrco010;
-
-                idx++;
-                histBin[idx] += vrco011;
-
-                idx += nSliceStep - nRowStep - 1;
-                histBin[idx] += vrco100;
-
-                idx++;
-                histBin[idx] += vrco101;
-
-                idx += nRowStep - 1;
-                histBin[idx] += vrco110;
-
-                idx++;
-                histBin[idx] += vrco111;
-
-                inc_adds(8);
-                inc_write(8, float);
+        for (int j = window->left; j <= window->right; j += 8) // columns
+        {
+            const __m256 cc = _mm256_add_ps(_mm256_set1_ps(j + window->d_kptc), lane_index);
+            const __m256 rrotate = _mm256_fmadd_ps(cos_t, cc, sin_t_rr);
+            const __m256 crotate = _mm256_fmadd_ps(neg_sin_t, cc, cos_t_rr);
+            const __m256 rbin = _mm256_add_ps(rrotate, half);
+            const __m256 cbin = _mm256_add_ps(crotate, half);
+            inc_adds(40);
+            inc_mults(16);
+
+            // Lanes past the end of the row or outside of the (-1, d) bin range are not counted.
+            __m256 valid = _mm256_and_ps(_mm256_cmp_ps(rbin, minus_one, _CMP_GT_OQ), _mm256_cmp_ps(rbin, subregions, _CMP_LT_OQ));
+            valid = _mm256_and_ps(valid, _mm256_cmp_ps(cbin, minus_one, _CMP_GT_OQ));
+            valid = _mm256_and_ps(valid, _mm256_cmp_ps(cbin, subregions, _CMP_LT_OQ));
+            valid = _mm256_and_ps(valid, _mm256_cmp_ps(lane_index, _mm256_set1_ps((float) (window->right - j)), _CMP_LE_OQ));
+            const int lanes = _mm256_movemask_ps(valid);
+            if (!lanes)
+                continue;
+            const __m256i load_mask = _mm256_castps_si256(valid);
+
+            const __m256 mag = _mm256_maskload_ps(grad_row + j, load_mask);
+            __m256 angle;
+            if (octant) {
+                const float *g = rot_row + j;
+                const __m256 dy = _mm256_sub_ps(_mm256_maskload_ps(g + w, load_mask), _mm256_maskload_ps(g - w, load_mask));
+                const __m256 dx = _mm256_sub_ps(_mm256_maskload_ps(g + 1, load_mask), _mm256_maskload_ps(g - 1, load_mask));
+                angle = _mm256_sub_ps(eth_mm256_octant_angle_ps(dy, dx), kpt_ori);
+                inc_read(32, float);
+                inc_adds(16);
+            } else {
+                angle = _mm256_sub_ps(_mm256_maskload_ps(rot_row + j, load_mask), kpt_ori);
+                inc_read(8, float);
             }
-        }
+            // Adjust angle to [0, 2PI)
+            angle = _mm256_add_ps(angle, _mm256_and_ps(_mm256_cmp_ps(angle, _mm256_setzero_ps(), _CMP_LT_OQ), twopi));
+            const __m256 obin = _mm256_mul_ps(angle, bins_per_degree);
+            inc_read(8, float);
+            inc_adds(16);
+            inc_mults(8);
 
-        // Discard all the edges for row and column.
-        // Only retrieve edges for orientation bins.
+            // Gaussian-weighted magnitude
+            const __m256 dist = _mm256_fmadd_ps(rrotate, rrotate, _mm256_mul_ps(crotate, crotate));
+            const __m256 gm = _mm256_mul_ps(mag, eth_mm256_exp_ps(_mm256_mul_ps(dist, exp_scale)));
+            inc_adds(8);
+            inc_mults(32);
 
+            accumulate_lanes_avx2(lane_hist, rbin, cbin, obin, gm, lanes);
+        }
+    }
 
-        // NB: mainly int operations - so no AVX on it for the time being
-        float dstBins[nBins];
-        for (int i = 1; i <= nSubregion; i++) // slice
-        {
-            for (int j = 1; j <= nSubregion; j+=4) // row
-            {
-                int idx = i * nSliceStep + j * nRowStep;
-                int idx1 = i * nSliceStep + (j+1) * nRowStep;
-                int idx2 = i * nSliceStep + (j+2) * nRowStep;
-                int idx3 = i * nSliceStep + (j+3) * nRowStep;
-                // comments: how this line works.
-                // Suppose you want to write w=width, y=1, due to circular
-                // buffer, we should write it to w=0, y=1; since we use a
-                // circular buffer, it is written into w=width, y=1. Now, we
-                // fectch the data back.
-                histBin[idx] = histBin[idx + nBinsPerSubregion];
-                histBin[idx1] = histBin[idx1 + nBinsPerSubregion];
-                histBin[idx2] = histBin[idx2 + nBinsPerSubregion];
-                histBin[idx3] = histBin[idx3 + nBinsPerSubregion];
+    merge_lanes_avx2(lane_hist, histBin);
+}
 
+/// <summary> 
+/// Gather the samples of a window that can fall into the descriptor under any orientation,
+/// with their Gaussian-weighted magnitude and unrotated angle.
+/// </summary>
+/// <param name="window"> IN: Sample window, only its orientation is ignored. </param>
+/// <param name="samples"> OUT: Samples, with room for every pixel of the window. </param>
+void window_samples_scalar(const struct descriptor_window *window, struct descriptor_samples *samples){
+    // The rotation keeps the distance to the keypoint, so the Gaussian weight does not depend
+    // on the orientation. A sample lands in a histogram cell only if both of its rotated
+    // coordinates are within (-2.5, 2.5), which every orientation can reach inside the
+    // circumscribed circle.
+    const float limit = 2.0f * (ETHSIFT_DESCR_WIDTH_PRECISE_HALF + 1) * (ETHSIFT_DESCR_WIDTH_PRECISE_HALF + 1) * 1.001f;
+    const float scale = window->sin_t * window->sin_t + window->cos_t * window->cos_t;
+    const int w = window->w;
+    inc_adds(1);
+    inc_mults(2);
+
+    uint32_t count = 0;
+    for (int i = window->top; i <= window->bottom; i++) {
+        const float rr = i + window->d_kptr;
+        const int r = window->kptr_i + i;
+        inc_adds(1);
+        for (int j = window->left; j <= window->right; j++) {
+            const float cc = j + window->d_kptc;
+            const float dist = (rr * rr + cc * cc) * scale;
+            inc_adds(2);
+            inc_mults(3);
+            if (dist >= limit)
+                continue;
+
+            const int c = window->kptc_i + j;
+            samples->rr[count] = rr;
+            samples->cc[count] = cc;
+            samples->gm[count] = window->gradient[r * w + c] * eth_exp_f(dist * ETHSIFT_DESCR_EXP_SCALE);
+            if (window->octant) {
+                const float *g = window->rotation + r * w + c;
+                samples->angle[count] = octant_angle_f(g[w] - g[-w], g[1] - g[-1]);
                 inc_read(4, float);
-                inc_write(4, float);
-
-                // comments: how this line works.
-                // Suppose you want to write x=-1 y=1, due to circular, it
-                // should be at y=1, x=width-1; since we use circular buffer,
-                // the value goes to y=0, x=width, now, we need to get it back.
-                if (idx != 0) {
-                    histBin[idx + nBinsPerSubregion + 1] = histBin[idx - 1];
-                    inc_read(1, float);
-                    inc_write(1, float);
-                }
-
-                if (idx1 != 0) {
-                    histBin[idx1 + nBinsPerSubregion + 1] = histBin[idx1 - 1];
-                    inc_read(1, float);
-                    inc_write(1, float);
-                }
-
-                if (idx2 != 0) {
-                    histBin[idx2 + nBinsPerSubregion + 1] = histBin[idx2 - 1];
-                    inc_read(1, float);
-                    inc_write(1, float);
-                }
-
-                if (idx3 != 0) {
-                    histBin[idx3 + nBinsPerSubregion + 1] = histBin[idx3 - 1];
-                    inc_read(1, float);
-                    inc_write(1, float);
-                }
-
-                int idx4 = ((i - 1) * nSubregion + j - 1) * nBinsPerSubregion;
-                for (int k = 0; k < nBinsPerSubregion; k++) {
-                    dstBins[idx4 + k] = histBin[idx + k];
-                    inc_read(1, float);
-                    inc_write(1, float);
-                }
-
-                int idx5 = ((i - 1) * nSubregion + (j+1) - 1) * nBinsPerSubregion;
-                for (int k = 0; k < nBinsPerSubregion; k++) {
-                    dstBins[idx5 + k] = histBin[idx1 + k];
-                    inc_read(1, float);
-                    inc_write(1, float);
-                }
-
-                int idx6 = ((i - 1) * nSubregion + (j+2) - 1) * nBinsPerSubregion;
-                for (int k = 0; k < nBinsPerSubregion; k++) {
-                    dstBins[idx6 + k] = histBin[idx2 + k];
-                    inc_read(1, float);
-                    inc_write(1, float);
-                }
-
-                int idx7 = ((i - 1) * nSubregion + (j+3) - 1) * nBinsPerSubregion;
-                for (int k = 0; k < nBinsPerSubregion; k++) {
-                    dstBins[idx7 + k] = histBin[idx3 + k];
-                    inc_read(1, float);
-                    inc_write(1, float);
-                }
+                inc_adds(2);
+            } else {
+                samples->angle[count] = window->rotation[r * w + c];
+                inc_read(1, float);
             }
+            inc_read(1, float);
+            inc_mults(2);
+            inc_write(4, float);
+            count++;
         }
+    }
+    samples->count = count;
+}
 
-        // Normalize the histogram
-        __m256 vec_dstBins;
-        float sum_square = 0.0f;
-        for (int i = 0; i < nBins; i+=8) {
 
-            vec_dstBins = _mm256_loadu_ps(dstBins+i);
-            inc_read(8, float);
-            vec_dstBins = _mm256_mul_ps(vec_dstBins,vec_dstBins);
+/// <summary> 
+/// Accumulate gathered window samples into the circular histogram for one orientation.
+/// </summary>
+/// <param name="samples"> IN: Samples gathered by gather_window_samples. </param>
+/// <param name="sin_t"> IN: Sine of the orientation divided by the subregion width. </param>
+/// <param name="cos_t"> IN: Cosine of the orientation divided by the subregion width. </param>
+/// <param name="kpt_ori"> IN: Orientation subtracted from the sample angles. </param>
+/// <param name="histBin"> IN/OUT: Histogram of (ETHSIFT_DESCR_WIDTH + 2)^2 * (ETHSIFT_DESCR_HIST_BINS + 2) bins. </param>
+void sample_histogram_scalar(const struct descriptor_samples *samples, float sin_t, float cos_t, float kpt_ori, float *histBin){
+    const int nSubregion = ETHSIFT_DESCR_WIDTH;
+    for (uint32_t s = 0; s < samples->count; ++s) {
+        // Rotate the coordinate of the sample
+        const float rr = samples->rr[s];
+        const float cc = samples->cc[s];
+        const float rbin = (cos_t * cc + sin_t * rr) + ETHSIFT_DESCR_WIDTH_PRECISE_HALF;
+        const float cbin = (-sin_t * cc + cos_t * rr) + ETHSIFT_DESCR_WIDTH_PRECISE_HALF;
+        inc_read(2, float);
+        inc_mults(4);
+        inc_adds(4);
 
-            // https://stackoverflow.com/questions/23189488/horizontal-sum-of-32-bit-floats-in-256-bit-avx-vector
-            const __m128 x128 = _mm_add_ps(_mm256_extractf128_ps(vec_dstBins, 1), _mm256_castps256_ps128(vec_dstBins));
-            const __m128 x64 = _mm_add_ps(x128, _mm_movehl_ps(x128, x128));
-            const __m128 x32 = _mm_add_ss(x64, _mm_shuffle_ps(x64, x64, 0x55));
-            sum_square += _mm_cvtss_f32(x32);
+        if (rbin <= -1 || rbin >= nSubregion || cbin <= -1 || cbin >= nSubregion)
+            continue;
 
-            inc_adds(8);
-            inc_mults(8);
+        float angle = samples->angle[s] - kpt_ori;
+        if (angle < 0) { // Adjust angle to [0, 2PI)
+            angle += M_TWOPI;
+            inc_adds(1);
         }
+        const float obin = angle * ETHSIFT_DESCR_HIST_BINS_DEGREE;
+        inc_read(2, float);
+        inc_adds(1);
+        inc_mults(1);
 
-        float thr = sqrtf(sum_square) * ETHSIFT_DESCR_MAG_THR;
+        accumulate_sample(histBin, rbin, cbin, obin, samples->gm[s]);
+    }
+}
 
+/// <summary> 
+/// Gather window samples using AVX2, see window_samples_scalar.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+void window_samples_avx2(const struct descriptor_window *window, struct descriptor_samples *samples){
+    const float scale = window->sin_t * window->sin_t + window->cos_t * window->cos_t;
+    const __m256 limit = _mm256_set1_ps(2.0f * (ETHSIFT_DESCR_WIDTH_PRECISE_HALF + 1) * (ETHSIFT_DESCR_WIDTH_PRECISE_HALF + 1) * 1.001f);
+    const __m256 lane_index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 exp_scale = _mm256_set1_ps(ETHSIFT_DESCR_EXP_SCALE);
+    const int w = window->w;
+    float cc_lanes[8], gm_lanes[8], angle_lanes[8];
+    inc_adds(1);
+    inc_mults(2);
+
+    uint32_t count = 0;
+    for (int i = window->top; i <= window->bottom; i++) {
+        const float rr = i + window->d_kptr;
+        const __m256 rr2 = _mm256_set1_ps(rr * rr);
+        const __m256 vec_scale = _mm256_set1_ps(scale);
+        const int r = window->kptr_i + i;
+        const float *grad_row = window->gradient + r * w + window->kptc_i;
+        const float *rot_row = window->rotation + r * w + window->kptc_i;
+        inc_adds(1);
         inc_mults(1);
-
-        float tmp = 0.0;
-        float tmp1 = 0.0;
-        float tmp2 = 0.0;
-        float tmp3 = 0.0;
-        float tmp4 = 0.0;
-        float tmp5 = 0.0;
-        float tmp6 = 0.0;
-        float tmp7 = 0.0;
-
-        sum_square = 0.0;
-
-        __m256 vec_float_min;
-
-        // Cut off the numbers bigger than 0.2 after normalized.
-        for (int i = 0; i < nBins; i+=8) {
-
-            tmp = float_min(thr, dstBins[i]);
-            tmp1 = float_min(thr, dstBins[i+1]);
-            tmp2 = float_min(thr, dstBins[i+2]);
-            tmp3 = float_min(thr, dstBins[i+3]);
-            tmp4 = float_min(thr, dstBins[i+4]);
-            tmp5 = float_min(thr, dstBins[i+5]);
-            tmp6 = float_min(thr, dstBins[i+6]);
-            tmp7 = float_min(thr, dstBins[i+7]);
-
-            vec_float_min = _mm256_set_ps(tmp7, tmp6, tmp5, tmp4, tmp3, tmp2, tmp1, tmp);
-            _mm256_storeu_ps(dstBins+i, vec_float_min);
-
-            vec_float_min = _mm256_mul_ps(vec_float_min, vec_float_min);
-
-            // https://stackoverflow.com/questions/23189488/horizontal-sum-of-32-bit-floats-in-256-bit-avx-vector
-            const __m128 x128 = _mm_add_ps(_mm256_extractf128_ps(vec_float_min, 1), _mm256_castps256_ps128(vec_float_min));
-            const __m128 x64 = _mm_add_ps(x128, _mm_movehl_ps(x128, x128));
-            const __m128 x32 = _mm_add_ss(x64, _mm_shuffle_ps(x64, x64, 0x55));
-            sum_square += _mm_cvtss_f32(x32);
-            
-            inc_adds(8);
-            inc_mults(8);
+        for (int j = window->left; j <= window->right; j += 8) {
+            const __m256 cc = _mm256_add_ps(_mm256_set1_ps(j + window->d_kptc), lane_index);
+            const __m256 dist = _mm256_mul_ps(_mm256_fmadd_ps(cc, cc, rr2), vec_scale);
+            __m256 valid = _mm256_cmp_ps(dist, limit, _CMP_LT_OQ);
+            valid = _mm256_and_ps(valid, _mm256_cmp_ps(lane_index, _mm256_set1_ps((float) (window->right - j)), _CMP_LE_OQ));
+            inc_adds(16);
+            inc_mults(16);
+            int lanes = _mm256_movemask_ps(valid);
+            if (!lanes)
+                continue;
+            const __m256i load_mask = _mm256_castps_si256(valid);
+
+            const __m256 mag = _mm256_maskload_ps(grad_row + j, load_mask);
+            __m256 angle;
+            if (window->octant) {
+                const float *g = rot_row + j;
+                const __m256 dy = _mm256_sub_ps(_mm256_maskload_ps(g + w, load_mask), _mm256_maskload_ps(g - w, load_mask));
+                const __m256 dx = _mm256_sub_ps(_mm256_maskload_ps(g + 1, load_mask), _mm256_maskload_ps(g - 1, load_mask));
+                angle = eth_mm256_octant_angle_ps(dy, dx);
+                inc_read(32, float);
+                inc_adds(16);
+            } else {
+                angle = _mm256_maskload_ps(rot_row + j, load_mask);
+                inc_read(8, float);
+            }
+            _mm256_storeu_ps(cc_lanes, cc);
+            _mm256_storeu_ps(gm_lanes, _mm256_mul_ps(mag, eth_mm256_exp_ps(_mm256_mul_ps(dist, exp_scale))));
+            _mm256_storeu_ps(angle_lanes, angle);
             inc_read(8, float);
-            inc_write(8, float);
+            inc_mults(32);
+
+            // Pack the valid lanes.
+            while (lanes) {
+                const int l = __builtin_ctz(lanes);
+                samples->rr[count] = rr;
+                samples->cc[count] = cc_lanes[l];
+                samples->gm[count] = gm_lanes[l];
+                samples->angle[count] = angle_lanes[l];
+                inc_write(4, float);
+                count++;
+                lanes &= lanes - 1;
+            }
         }
+    }
+    samples->count = count;
+}
 
-        // Re-normalize
-        // The numbers are usually too small to store, so we use
-        // a constant factor to scale up the numbers.
-        float conv_f_to_char = ETHSIFT_INT_DESCR_FCTR;
-        float norm_factor = conv_f_to_char / sqrtf(sum_square);
+/// <summary> 
+/// Accumulate gathered window samples using AVX2, see sample_histogram_scalar and descriptor_histogram_avx2.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+void sample_histogram_avx2(const struct descriptor_samples *samples, float sin_t, float cos_t, float kpt_ori, float *histBin){
+    const int nHistBins = (ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_HIST_BINS + 2);
+    float lane_hist[8 * nHistBins];
+    memset(lane_hist, 0, sizeof(lane_hist));
+    inc_write(8 * nHistBins, float);
+
+    const __m256i lane_index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 vec_sin_t = _mm256_set1_ps(sin_t);
+    const __m256 vec_neg_sin_t = _mm256_set1_ps(-sin_t);
+    const __m256 vec_cos_t = _mm256_set1_ps(cos_t);
+    const __m256 vec_kpt_ori = _mm256_set1_ps(kpt_ori);
+    const __m256 half = _mm256_set1_ps(ETHSIFT_DESCR_WIDTH_PRECISE_HALF);
+    const __m256 minus_one = _mm256_set1_ps(-1.0f);
+    const __m256 subregions = _mm256_set1_ps((float) ETHSIFT_DESCR_WIDTH);
+    const __m256 twopi = _mm256_set1_ps(M_TWOPI);
+    const __m256 bins_per_degree = _mm256_set1_ps(ETHSIFT_DESCR_HIST_BINS_DEGREE);
+
+    for (uint32_t s = 0; s < samples->count; s += 8) {
+        const __m256i load_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(samples->count - s), lane_index);
+        const __m256 rr = _mm256_maskload_ps(samples->rr + s, load_mask);
+        const __m256 cc = _mm256_maskload_ps(samples->cc + s, load_mask);
+        const __m256 rbin = _mm256_add_ps(_mm256_fmadd_ps(vec_cos_t, cc, _mm256_mul_ps(vec_sin_t, rr)), half);
+        const __m256 cbin = _mm256_add_ps(_mm256_fmadd_ps(vec_neg_sin_t, cc, _mm256_mul_ps(vec_cos_t, rr)), half);
+        inc_read(16, float);
+        inc_adds(32);
+        inc_mults(32);
+
+        __m256 valid = _mm256_and_ps(_mm256_cmp_ps(rbin, minus_one, _CMP_GT_OQ), _mm256_cmp_ps(rbin, subregions, _CMP_LT_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(cbin, minus_one, _CMP_GT_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(cbin, subregions, _CMP_LT_OQ));
+        valid = _mm256_and_ps(valid, _mm256_castsi256_ps(load_mask));
+        const int lanes = _mm256_movemask_ps(valid);
+        if (!lanes)
+            continue;
+
+        __m256 angle = _mm256_sub_ps(_mm256_maskload_ps(samples->angle + s, load_mask), vec_kpt_ori);
+        // Adjust angle to [0, 2PI)
+        angle = _mm256_add_ps(angle, _mm256_and_ps(_mm256_cmp_ps(angle, _mm256_setzero_ps(), _CMP_LT_OQ), twopi));
+        const __m256 obin = _mm256_mul_ps(angle, bins_per_degree);
+        const __m256 gm = _mm256_maskload_ps(samples->gm + s, load_mask);
+        inc_read(16, float);
+        inc_adds(16);
+        inc_mults(8);
+
+        accumulate_lanes_avx2(lane_hist, rbin, cbin, obin, gm, lanes);
+    }
 
-        inc_div(1);
+    merge_lanes_avx2(lane_hist, histBin);
+}
 
-        __m256 vec_norm_factor;
-        vec_norm_factor = _mm256_set1_ps(norm_factor);
-        for (int i = 0; i < nBins; i+=8) {
-            vec_dstBins = _mm256_loadu_ps(dstBins+i);
-            vec_dstBins = _mm256_mul_ps(vec_dstBins, vec_norm_factor);
-            _mm256_storeu_ps(dstBins+i, vec_dstBins);
-            inc_mults(8);
-            inc_read(8, float);
-            inc_write(8, float);
+/// <summary> 
+/// Place the sample window of a keypoint in its gradient level.
+/// </summary>
+/// <param name="gradients"> IN: Gradients pyramid. </param>
+/// <param name="rotations"> IN: Rotation pyramid, or the Gaussian pyramid with ETHSIFT_ORIENTATION_OCTANT. </param>
+/// <param name="gaussian_count"> IN: Number of gaussian layers. </param> 
+/// <param name="kpt"> IN: Keypoint to describe. </param> 
+/// <param name="window"> OUT: Sample window of the keypoint. </param> 
+static void setup_window(struct ethsift_image gradients[], 
+                         struct ethsift_image rotations[], 
+                         uint32_t gaussian_count, 
+                         const struct ethsift_keypoint *kpt, 
+                         struct descriptor_window *window)
+{
+    // Number of subregions, default 4x4 subregions.
+    // The width of subregion is determined by the scale of the keypoint.
+    // Or, in Lowe's SIFT paper[2004], width of subregion is 16x16.
+    int nSubregion = ETHSIFT_DESCR_WIDTH;
+
+    // Keypoint information
+    int octave = kpt->octave;
+    int layer = kpt->layer;
+    inc_read(2, int32_t);
+
+    float kpt_ori = kpt->orientation;
+    float kptr = kpt->layer_pos.y;
+    float kptc = kpt->layer_pos.x;
+    float kpt_scale = kpt->layer_pos.scale;
+    inc_read(4, float);
+
+    // Nearest coordinate of keypoints
+    int kptr_i = (int)(kptr + 0.5f);
+    int kptc_i = (int)(kptc + 0.5f);
+    float d_kptr = kptr_i - kptr;
+    float d_kptc = kptc_i - kptc;
+    inc_adds(4);
+
+    int layer_index = octave * gaussian_count + layer;
+    int w = gradients[layer_index].width;
+    int h = gradients[layer_index].height;
+    inc_read(2, int32_t);
+
+    // Note for Gaussian weighting.
+    // OpenCV and vl_feat uses non-fixed size of subregion.
+    // But they all use (0.5 * 4) as the Gaussian weighting sigma.
+    // In Lowe's paper, he uses 16x16 sample region,
+    // partition 16x16 region into 16 4x4 subregion.
+    float size_desc = ETHSIFT_DESCR_SCL_FCTR;
+    float subregion_width = size_desc * kpt_scale;
+    int win_size =
+        (int)(M_SQRT2 * subregion_width * (nSubregion + 1) * 0.5f + 0.5f);
+
+    inc_mults(4);
+    inc_adds(1);
+
+    // Normalized cos() and sin() value.
+    float sin_t, cos_t;
+    eth_sincos_f(kpt_ori, &sin_t, &cos_t);
+    sin_t /= subregion_width;
+    cos_t /= subregion_width;
+
+    inc_div(2);
+
+    // Without a rotation pyramid the pixels are binned by pseudo angle, so the
+    // orientation has to be measured the same way.
+    const int octant = (g_orientation_mode == ETHSIFT_ORIENTATION_OCTANT);
+    if (octant)
+        kpt_ori = octant_angle_f(sin_t, cos_t);
+
+    *window = (struct descriptor_window){
+        gradients[layer_index].pixels, rotations[layer_index].pixels, w, kptr_i, kptc_i,
+        int_max(-win_size, 1 - kptr_i), int_min(win_size, h - 2 - kptr_i),
+        int_max(-win_size, 1 - kptc_i), int_min(win_size, w - 2 - kptc_i),
+        d_kptr, d_kptc, sin_t, cos_t, kpt_ori, octant};
+}
+
+/// <summary> 
+/// Turn the circular histogram of a keypoint into its normalized descriptor.
+/// </summary>
+/// <param name="histBin"> IN: Histogram of (ETHSIFT_DESCR_WIDTH + 2)^2 * (ETHSIFT_DESCR_HIST_BINS + 2) bins. </param>
+/// <param name="kpt"> OUT: Keypoint to store the descriptor in. </param> 
+static void finish_descriptor(float *histBin, struct ethsift_keypoint *kpt){
+    // In this implementation, histBin is a circular buffer.
+    // we expand the cube by 1 for each direction.
+    int nSubregion = ETHSIFT_DESCR_WIDTH;
+    int nBinsPerSubregion = ETHSIFT_DESCR_HIST_BINS;
+    int nBins = nSubregion * nSubregion * nBinsPerSubregion;
+    int nSliceStep = (nSubregion + 2) * (nBinsPerSubregion + 2);
+    int nRowStep = (nBinsPerSubregion + 2);
+
+    // Discard all the edges for row and column.
+    // Only retrieve edges for orientation bins.
+
+
+    // NB: mainly int operations - so no AVX on it for the time being
+    float dstBins[nBins];
+    for (int i = 1; i <= nSubregion; i++) // slice
+    {
+        for (int j = 1; j <= nSubregion; j+=4) // row
+        {
+            int idx = i * nSliceStep + j * nRowStep;
+            int idx1 = i * nSliceStep + (j+1) * nRowStep;
+            int idx2 = i * nSliceStep + (j+2) * nRowStep;
+            int idx3 = i * nSliceStep + (j+3) * nRowStep;
+            // comments: how this line works.
+            // Suppose you want to write w=width, y=1, due to circular
+            // buffer, we should write it to w=0, y=1; since we use a
+            // circular buffer, it is written into w=width, y=1. Now, we
+            // fectch the data back.
+            histBin[idx] = histBin[idx + nBinsPerSubregion];
+            histBin[idx1] = histBin[idx1 + nBinsPerSubregion];
+            histBin[idx2] = histBin[idx2 + nBinsPerSubregion];
+            histBin[idx3] = histBin[idx3 + nBinsPerSubregion];
+
+            inc_read(4, float);
+            inc_write(4, float);
+
+            // comments: how this line works.
+            // Suppose you want to write x=-1 y=1, due to circular, it
+            // should be at y=1, x=width-1; since we use circular buffer,
+            // the value goes to y=0, x=width, now, we need to get it back.
+            if (idx != 0) {
+                histBin[idx + nBinsPerSubregion + 1] = histBin[idx - 1];
+                inc_read(1, float);
+                inc_write(1, float);
+            }
+
+            if (idx1 != 0) {
+                histBin[idx1 + nBinsPerSubregion + 1] = histBin[idx1 - 1];
+                inc_read(1, float);
+                inc_write(1, float);
+            }
+
+            if (idx2 != 0) {
+                histBin[idx2 + nBinsPerSubregion + 1] = histBin[idx2 - 1];
+                inc_read(1, float);
+                inc_write(1, float);
+            }
+
+            if (idx3 != 0) {
+                histBin[idx3 + nBinsPerSubregion + 1] = histBin[idx3 - 1];
+                inc_read(1, float);
+                inc_write(1, float);
+            }
+
+            int idx4 = ((i - 1) * nSubregion + j - 1) * nBinsPerSubregion;
+            for (int k = 0; k < nBinsPerSubregion; k++) {
+                dstBins[idx4 + k] = histBin[idx + k];
+                inc_read(1, float);
+                inc_write(1, float);
+            }
+
+            int idx5 = ((i - 1) * nSubregion + (j+1) - 1) * nBinsPerSubregion;
+            for (int k = 0; k < nBinsPerSubregion; k++) {
+                dstBins[idx5 + k] = histBin[idx1 + k];
+                inc_read(1, float);
+                inc_write(1, float);
+            }
+
+            int idx6 = ((i - 1) * nSubregion + (j+2) - 1) * nBinsPerSubregion;
+            for (int k = 0; k < nBinsPerSubregion; k++) {
+                dstBins[idx6 + k] = histBin[idx2 + k];
+                inc_read(1, float);
+                inc_write(1, float);
+            }
+
+            int idx7 = ((i - 1) * nSubregion + (j+3) - 1) * nBinsPerSubregion;
+            for (int k = 0; k < nBinsPerSubregion; k++) {
+                dstBins[idx7 + k] = histBin[idx3 + k];
+                inc_read(1, float);
+                inc_write(1, float);
+            }
+        }
+    }
+
+    // Normalize the histogram
+    g_kernels.normalize_descriptor(dstBins);
+
+    memcpy(kpt->descriptors, dstBins, nBins * sizeof(float));
+    
+    inc_read(nBins, float);
+    inc_write(nBins, float);
+}
+
+/// <summary> 
+/// Extract the descriptor of a single keypoint.
+/// </summary>
+/// <param name="gradients"> IN: Gradients pyramid. </param>
+/// <param name="rotations"> IN: Rotation pyramid, or the Gaussian pyramid with ETHSIFT_ORIENTATION_OCTANT. </param>
+/// <param name="gaussian_count"> IN: Number of gaussian layers. </param> 
+/// <param name="kpt"> IN/OUT: Keypoint to describe. </param> 
+/// <param name="histBin"> IN: Scratch space of (ETHSIFT_DESCR_WIDTH + 2)^2 * (ETHSIFT_DESCR_HIST_BINS + 2) bins. </param>
+static void describe_keypoint(struct ethsift_image gradients[], 
+                              struct ethsift_image rotations[], 
+                              uint32_t gaussian_count, 
+                              struct ethsift_keypoint *kpt, 
+                              float *histBin)
+{
+    const int nHistBins = (ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_HIST_BINS + 2);
+    struct descriptor_window window;
+    setup_window(gradients, rotations, gaussian_count, kpt, &window);
+
+    // Re-init histBin
+    memset(histBin, 0, nHistBins * sizeof(float));
+    inc_write(nHistBins, float);
+
+    // Start to calculate the histogram in the sample region.
+    g_kernels.descriptor_histogram(&window, histBin);
+    finish_descriptor(histBin, kpt);
+}
+
+/// <summary> 
+/// Gather the samples of a window for all siblings, see window_samples_scalar.
+/// </summary>
+/// <param name="window"> IN: Sample window, only its orientation is ignored. </param>
+/// <param name="samples"> IN/OUT: Sample buffer, grown as needed. </param>
+/// <returns> 1 IF the samples could be gathered, ELSE 0. </returns>
+static int gather_window_samples(const struct descriptor_window *window, struct descriptor_samples *samples){
+    const int rows = window->bottom - window->top + 1;
+    const int cols = window->right - window->left + 1;
+    const uint32_t needed = (rows > 0 && cols > 0) ? (uint32_t) (rows * cols) : 0;
+    if (samples->capacity < needed) {
+        float *data = realloc(samples->rr, 4 * needed * sizeof(float));
+        if (!data)
+            return 0;
+        samples->rr = data;
+        samples->cc = data + needed;
+        samples->gm = data + 2 * needed;
+        samples->angle = data + 3 * needed;
+        samples->capacity = needed;
+    }
+
+    g_kernels.window_samples(window, samples);
+    return 1;
+}
+
+/// <summary> 
+/// Check whether two keypoints differ at most in their orientation.
+/// </summary>
+static inline int is_sibling(const struct ethsift_keypoint *a, const struct ethsift_keypoint *b){
+    return a->octave == b->octave && a->layer == b->layer
+        && a->layer_pos.x == b->layer_pos.x && a->layer_pos.y == b->layer_pos.y
+        && a->layer_pos.scale == b->layer_pos.scale;
+}
+
+/// <summary> 
+/// Extract the descriptors of keypoints that differ only in orientation from one gathered window.
+/// </summary>
+/// <param name="group"> IN/OUT: Keypoints to describe. </param> 
+/// <param name="group_count"> IN: Number of keypoints in the group. </param> 
+/// <param name="samples"> IN: Scratch space for the window samples. </param> 
+/// <returns> 1 IF the group was described, ELSE 0 and nothing was written. </returns>
+static int describe_siblings(struct ethsift_image gradients[], 
+                             struct ethsift_image rotations[], 
+                             uint32_t gaussian_count, 
+                             struct ethsift_keypoint *group[], 
+                             uint32_t group_count, 
+                             float *histBin, 
+                             struct descriptor_samples *samples)
+{
+    const int nHistBins = (ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_HIST_BINS + 2);
+    struct descriptor_window window;
+    setup_window(gradients, rotations, gaussian_count, group[0], &window);
+    if (!gather_window_samples(&window, samples))
+        return 0;
+
+    for (uint32_t k = 0; k < group_count; ++k) {
+        if (k > 0)
+            setup_window(gradients, rotations, gaussian_count, group[k], &window);
+        memset(histBin, 0, nHistBins * sizeof(float));
+        inc_write(nHistBins, float);
+        g_kernels.sample_histogram(samples, window.sin_t, window.cos_t, window.kpt_ori, histBin);
+        finish_descriptor(histBin, group[k]);
+    }
+    return 1;
+}
+
+/// <summary> 
+/// Extract the descriptors of a range of keypoints, sharing the window between consecutive siblings.
+/// </summary>
+/// <param name="keypoints"> IN/OUT: Array of keypoints. </param> 
+/// <param name="order"> IN: Indices of the keypoints to describe, or NULL for all of them in order. </param> 
+/// <param name="begin"> IN: First position in order. </param> 
+/// <param name="end"> IN: Position in order past the last keypoint. </param> 
+/// <param name="histBin"> IN: Scratch space of (ETHSIFT_DESCR_WIDTH + 2)^2 * (ETHSIFT_DESCR_HIST_BINS + 2) bins. </param>
+/// <param name="samples"> IN: Scratch space for the window samples. </param> 
+static void describe_keypoints(struct ethsift_image gradients[], 
+                               struct ethsift_image rotations[], 
+                               uint32_t gaussian_count, 
+                               struct ethsift_keypoint keypoints[], 
+                               const uint32_t *order, 
+                               uint32_t begin, 
+                               uint32_t end, 
+                               float *histBin, 
+                               struct descriptor_samples *samples)
+{
+    // The orientation assignment emits the siblings of a keypoint right after it, with at
+    // most one per orientation bin.
+    struct ethsift_keypoint *group[ETHSIFT_ORI_HIST_BINS];
+    uint32_t i = begin;
+    while (i < end) {
+        uint32_t group_count = 0;
+        group[group_count++] = &keypoints[order ? order[i] : i];
+        while (i + group_count < end && group_count < ETHSIFT_ORI_HIST_BINS) {
+            struct ethsift_keypoint *next = &keypoints[order ? order[i + group_count] : i + group_count];
+            if (!is_sibling(group[0], next))
+                break;
+            group[group_count++] = next;
         }
 
-        memcpy(kpt->descriptors, dstBins, nBins * sizeof(float));
-        
-        inc_read(nBins, float);
-        inc_write(nBins, float);
+        if (group_count == 1 || !describe_siblings(gradients, rotations, gaussian_count, group, group_count, histBin, samples)) {
+            for (uint32_t k = 0; k < group_count; ++k)
+                describe_keypoint(gradients, rotations, gaussian_count, group[k], histBin);
+        }
+        i += group_count;
+    }
+}
+
+// Keypoints handed to a worker of the thread pool at once.
+struct descriptor_job{
+  struct ethsift_image *gradients;
+  struct ethsift_image *rotations;
+  uint32_t gaussian_count;
+  struct ethsift_keypoint *keypoints;
+  const uint32_t *order;
+  uint32_t keypoint_count;
+};
+
+/// <summary> 
+/// Describe the keypoints of a chunk of the job, with scratch space owned by the worker.
+/// </summary>
+static void describe_chunk(void *arg, uint32_t chunk){
+    const struct descriptor_job *job = arg;
+    float histBin[(ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_HIST_BINS + 2)];
+    struct descriptor_samples samples = {0};
+    const struct ethsift_keypoint *keypoints = job->keypoints;
+    const uint32_t *order = job->order;
+    uint32_t begin = chunk * ETHSIFT_DESCR_CHUNK;
+    uint32_t end = internal_min(begin + ETHSIFT_DESCR_CHUNK, job->keypoint_count);
+    // Siblings cut by a chunk border belong to the chunk of the first one, so that the
+    // result is the same as in the serial case.
+    while (begin > 0 && begin < end && is_sibling(&keypoints[order[begin - 1]], &keypoints[order[begin]]))
+        begin++;
+    if (begin == end)
+        return;
+    while (end < job->keypoint_count && is_sibling(&keypoints[order[end - 1]], &keypoints[order[end]]))
+        end++;
+    describe_keypoints(job->gradients, job->rotations, job->gaussian_count, job->keypoints, order,
+                       begin, end, histBin, &samples);
+    free(samples.rr);
+}
+
+/// <summary> 
+/// Extract the keypoint descriptors.
+/// </summary>
+/// <param name="gradients"> IN: Gradients pyramid. </param>
+/// <param name="rotations"> IN: Rotation pyramid, or the Gaussian pyramid with ETHSIFT_ORIENTATION_OCTANT.  </param>
+/// <param name="octave_count"> IN: Number of Octaves. </param> 
+/// <param name="gaussian_count"> IN: Number of gaussian layers. </param> 
+/// <param name="keypoints"> OUT: Array of detected keypoints. </param> 
+/// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
+///                               OUT: Number of keypoints found. </param> 
+/// <returns> 1 IF computation was successful, ELSE 0. </returns>
+int ethsift_extract_descriptor(struct ethsift_image gradients[], 
+                              struct ethsift_image rotations[], 
+                              uint32_t octave_count, 
+                              uint32_t gaussian_count, 
+                              struct ethsift_keypoint keypoints[], 
+                              uint32_t keypoint_count)
+{
+    float histBin[(ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_WIDTH + 2) * (ETHSIFT_DESCR_HIST_BINS + 2)];
+    if (thread_pool_size() <= 1 || keypoint_count <= ETHSIFT_DESCR_CHUNK) {
+        struct descriptor_samples samples = {0};
+        describe_keypoints(gradients, rotations, gaussian_count, keypoints, NULL, 0, keypoint_count, histBin, &samples);
+        free(samples.rr);
+        return 1;
     }
 
-  return 1;
+    // Keypoints are independent, but neighbouring ones of the same level share their window
+    // pixels. Chunks are cut from the keypoints ordered by level, so each worker stays on few levels.
+    const uint32_t level_count = octave_count * gaussian_count;
+    uint32_t level_start[level_count + 1];
+    memset(level_start, 0, sizeof(level_start));
+    for (uint32_t k = 0; k < keypoint_count; ++k)
+        level_start[keypoints[k].octave * gaussian_count + keypoints[k].layer + 1]++;
+    for (uint32_t l = 0; l < level_count; ++l)
+        level_start[l + 1] += level_start[l];
+
+    uint32_t *order = malloc(keypoint_count * sizeof(uint32_t));
+    if (!order)
+        return 0;
+    for (uint32_t k = 0; k < keypoint_count; ++k)
+        order[level_start[keypoints[k].octave * gaussian_count + keypoints[k].layer]++] = k;
+
+    struct descriptor_job job = {gradients, rotations, gaussian_count, keypoints, order, keypoint_count};
+    thread_pool_run(describe_chunk, &job, (keypoint_count + ETHSIFT_DESCR_CHUNK - 1) / ETHSIFT_DESCR_CHUNK);
+    free(order);
+    return 1;
 }
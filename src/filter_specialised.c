@@ -0,0 +1,190 @@
+#include "internal.h"
+
+// Kernel radii that get a fully unrolled row filter. The sequential pyramid uses
+// radii 4 to 10, the direct schedule goes up to 15.
+#define ETHSIFT_FILTER_RADII(X) \
+  X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) \
+  X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16)
+
+/// <summary> 
+/// Finish the columns of a row that do not fill a whole vector.
+/// </summary>
+static inline void filter_row_tail(float * restrict output, const float * restrict src, int dst_ind, int c, int w, int h, const float * restrict kernel, int kernel_size) {
+  for (; c < w; ++c) {
+    float s_partialSum = 0.0f;
+    for (int i = 0; i < kernel_size; i++) {
+      s_partialSum += kernel[i] * src[c + i];
+      inc_adds(1);
+      inc_mults(1);
+      inc_read(2, float);
+    }
+    output[dst_ind] = s_partialSum;
+    inc_write(1, float);
+    dst_ind += h;
+  }
+}
+
+// AVX2 row filter for a fixed radius. The taps are broadcast once per row and the tap
+// loop has a constant trip count, so it is unrolled completely.
+#define ETHSIFT_DEFINE_FILTER_AVX2(RAD) \
+ETHSIFT_TARGET_AVX2 \
+static void filter_row_transpose_avx2_r##RAD(float * restrict output, const float * restrict src, int r, int w, int h, const float * restrict kernel) { \
+  __m256 d_kernel[2 * RAD + 1]; \
+  for (int i = 0; i < 2 * RAD + 1; ++i) \
+    d_kernel[i] = _mm256_broadcast_ss(kernel + i); \
+  float partialSum[8]; \
+  int dst_ind = r; \
+  int c; \
+  for (c = 0; c < w - 7; c += 8) { \
+    __m256 d_partialSum = _mm256_setzero_ps(); \
+    _Pragma("GCC unroll 33") \
+    for (int i = 0; i < 2 * RAD + 1; ++i) \
+      d_partialSum = _mm256_fmadd_ps(d_kernel[i], _mm256_loadu_ps(src + c + i), d_partialSum); \
+    inc_read((2 * RAD + 1) * 8, float); \
+    inc_adds((2 * RAD + 1) * 8); \
+    inc_mults((2 * RAD + 1) * 8); \
+    _mm256_storeu_ps(partialSum, d_partialSum); \
+    for (int i = 0; i < 8; ++i) { \
+      output[dst_ind] = partialSum[i]; \
+      dst_ind += h; \
+    } \
+    inc_write(8, float); \
+  } \
+  filter_row_tail(output, src, dst_ind, c, w, h, kernel, 2 * RAD + 1); \
+}
+
+// AVX2 row filter for a fixed radius and a symmetric kernel. Mirrored taps share a
+// coefficient, so the pixels are added first and multiplied once.
+#define ETHSIFT_DEFINE_FILTER_SYM_AVX2(RAD) \
+ETHSIFT_TARGET_AVX2 \
+static void filter_row_transpose_avx2_sym_r##RAD(float * restrict output, const float * restrict src, int r, int w, int h, const float * restrict kernel) { \
+  __m256 d_kernel[RAD + 1]; \
+  for (int i = 0; i <= RAD; ++i) \
+    d_kernel[i] = _mm256_broadcast_ss(kernel + i); \
+  float partialSum[8]; \
+  int dst_ind = r; \
+  int c; \
+  for (c = 0; c < w - 7; c += 8) { \
+    __m256 d_partialSum = _mm256_mul_ps(d_kernel[RAD], _mm256_loadu_ps(src + c + RAD)); \
+    _Pragma("GCC unroll 16") \
+    for (int i = 0; i < RAD; ++i) { \
+      __m256 d_pair = _mm256_add_ps(_mm256_loadu_ps(src + c + i), _mm256_loadu_ps(src + c + 2 * RAD - i)); \
+      d_partialSum = _mm256_fmadd_ps(d_kernel[i], d_pair, d_partialSum); \
+    } \
+    inc_read((2 * RAD + 1) * 8, float); \
+    inc_adds(2 * RAD * 8); \
+    inc_mults((RAD + 1) * 8); \
+    _mm256_storeu_ps(partialSum, d_partialSum); \
+    for (int i = 0; i < 8; ++i) { \
+      output[dst_ind] = partialSum[i]; \
+      dst_ind += h; \
+    } \
+    inc_write(8, float); \
+  } \
+  filter_row_tail(output, src, dst_ind, c, w, h, kernel, 2 * RAD + 1); \
+}
+
+// AVX-512 row filter for a fixed radius, the last block of the row is masked.
+#define ETHSIFT_DEFINE_FILTER_AVX512(RAD) \
+ETHSIFT_TARGET_AVX512 \
+static void filter_row_transpose_avx512_r##RAD(float * restrict output, const float * restrict src, int r, int w, int h, const float * restrict kernel) { \
+  const __m512i d_scatter = _mm512_mullo_epi32(_mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0), \
+                                               _mm512_set1_epi32(h)); \
+  __m512 d_kernel[2 * RAD + 1]; \
+  for (int i = 0; i < 2 * RAD + 1; ++i) \
+    d_kernel[i] = _mm512_set1_ps(kernel[i]); \
+  for (int c = 0; c < w; c += 16) { \
+    const int lanes = internal_min(16, w - c); \
+    const __mmask16 mask = (__mmask16)((1u << lanes) - 1); \
+    __m512 d_partialSum = _mm512_setzero_ps(); \
+    _Pragma("GCC unroll 33") \
+    for (int i = 0; i < 2 * RAD + 1; ++i) \
+      d_partialSum = _mm512_fmadd_ps(d_kernel[i], _mm512_maskz_loadu_ps(mask, src + c + i), d_partialSum); \
+    inc_read((2 * RAD + 1) * lanes, float); \
+    inc_adds((2 * RAD + 1) * lanes); \
+    inc_mults((2 * RAD + 1) * lanes); \
+    _mm512_mask_i32scatter_ps(output + r + c * h, mask, d_scatter, d_partialSum, sizeof(float)); \
+    inc_write(lanes, float); \
+  } \
+}
+
+// AVX-512 row filter for a fixed radius and a symmetric kernel.
+#define ETHSIFT_DEFINE_FILTER_SYM_AVX512(RAD) \
+ETHSIFT_TARGET_AVX512 \
+static void filter_row_transpose_avx512_sym_r##RAD(float * restrict output, const float * restrict src, int r, int w, int h, const float * restrict kernel) { \
+  const __m512i d_scatter = _mm512_mullo_epi32(_mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0), \
+                                               _mm512_set1_epi32(h)); \
+  __m512 d_kernel[RAD + 1]; \
+  for (int i = 0; i <= RAD; ++i) \
+    d_kernel[i] = _mm512_set1_ps(kernel[i]); \
+  for (int c = 0; c < w; c += 16) { \
+    const int lanes = internal_min(16, w - c); \
+    const __mmask16 mask = (__mmask16)((1u << lanes) - 1); \
+    __m512 d_partialSum = _mm512_mul_ps(d_kernel[RAD], _mm512_maskz_loadu_ps(mask, src + c + RAD)); \
+    _Pragma("GCC unroll 16") \
+    for (int i = 0; i < RAD; ++i) { \
+      __m512 d_pair = _mm512_add_ps(_mm512_maskz_loadu_ps(mask, src + c + i), _mm512_maskz_loadu_ps(mask, src + c + 2 * RAD - i)); \
+      d_partialSum = _mm512_fmadd_ps(d_kernel[i], d_pair, d_partialSum); \
+    } \
+    inc_read((2 * RAD + 1) * lanes, float); \
+    inc_adds(2 * RAD * lanes); \
+    inc_mults((RAD + 1) * lanes); \
+    _mm512_mask_i32scatter_ps(output + r + c * h, mask, d_scatter, d_partialSum, sizeof(float)); \
+    inc_write(lanes, float); \
+  } \
+}
+
+ETHSIFT_FILTER_RADII(ETHSIFT_DEFINE_FILTER_AVX2)
+ETHSIFT_FILTER_RADII(ETHSIFT_DEFINE_FILTER_SYM_AVX2)
+ETHSIFT_FILTER_RADII(ETHSIFT_DEFINE_FILTER_AVX512)
+ETHSIFT_FILTER_RADII(ETHSIFT_DEFINE_FILTER_SYM_AVX512)
+
+/// <summary> 
+/// Filter the padded row src and write it as column r of the transposed output.
+/// Picks the unrolled specialisation for the kernel radius, folding the taps of symmetric
+/// kernels, and falls back to filter_row_transpose_avx2_generic for other kernels.
+/// </summary>
+/// <param name="output"> OUT: Filtered image. </param>
+/// <param name="src"> IN: Row to filter, padded by kernel_rad on both sides. </param>
+/// <param name="r"> IN: Row that is held in src. </param>
+/// <param name="w"> IN: Width of image to filter. </param>
+/// <param name="h"> IN: Height of image to filter. </param>
+/// <param name="kernel"> IN: Kernel to filter with. </param>
+/// <param name="kernel_size"> IN: Size of the kernel. </param>
+/// <param name="kernel_rad"> IN: Radius of the kernel. </param>
+/// <param name="symmetric"> IN: Whether the taps are mirrored, see kernel_symmetric. </param>
+/// <remarks> (w * (2* kernel_size)) flops, (w * (kernel_size + 1)) for symmetric kernels </remarks>
+void filter_row_transpose_avx2(float * restrict output, const float * restrict src, int r, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int symmetric) {
+  if (kernel_size == 2 * kernel_rad + 1) {
+    switch (kernel_rad) {
+#define ETHSIFT_CASE_FILTER_AVX2(RAD) \
+    case RAD: \
+      if (symmetric) filter_row_transpose_avx2_sym_r##RAD(output, src, r, w, h, kernel); \
+      else filter_row_transpose_avx2_r##RAD(output, src, r, w, h, kernel); \
+      return;
+    ETHSIFT_FILTER_RADII(ETHSIFT_CASE_FILTER_AVX2)
+#undef ETHSIFT_CASE_FILTER_AVX2
+    }
+  }
+  filter_row_transpose_avx2_generic(output, src, r, w, h, kernel, kernel_size, kernel_rad);
+}
+
+/// <summary> 
+/// Filter the padded row src and write it as column r of the transposed output.
+/// AVX-512 counterpart of filter_row_transpose_avx2.
+/// </summary>
+/// <remarks> (w * (2* kernel_size)) flops, (w * (kernel_size + 1)) for symmetric kernels </remarks>
+void filter_row_transpose_avx512(float * restrict output, const float * restrict src, int r, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int symmetric) {
+  if (kernel_size == 2 * kernel_rad + 1) {
+    switch (kernel_rad) {
+#define ETHSIFT_CASE_FILTER_AVX512(RAD) \
+    case RAD: \
+      if (symmetric) filter_row_transpose_avx512_sym_r##RAD(output, src, r, w, h, kernel); \
+      else filter_row_transpose_avx512_r##RAD(output, src, r, w, h, kernel); \
+      return;
+    ETHSIFT_FILTER_RADII(ETHSIFT_CASE_FILTER_AVX512)
+#undef ETHSIFT_CASE_FILTER_AVX512
+    }
+  }
+  filter_row_transpose_avx512_generic(output, src, r, w, h, kernel, kernel_size, kernel_rad);
+}
@@ -0,0 +1,224 @@
+#include "internal.h"
+
+// Pixels of the fixed point pyramid are Q8.7: 8-bit input shifted left by
+// ETHSIFT_FIXED_FRAC_BITS, which leaves headroom for the signed differences.
+// Kernel taps are Q0.15, so _mm_mulhrs_epi16 yields a rounded Q8.7 product.
+
+/// <summary>
+/// Product of a Q8.7 pixel and a Q0.15 tap, rounded like _mm_mulhrs_epi16.
+/// </summary>
+static inline int16_t mulhrs_s16(int16_t a, int16_t b) {
+  return (int16_t) (((int32_t) a * b + 0x4000) >> 15);
+}
+
+/// <summary>
+/// Filter the padded fixed point row src and write it as column r of the transposed output.
+/// </summary>
+/// <param name="output"> OUT: Filtered image. </param>
+/// <param name="src"> IN: Row to filter, padded by the kernel radius on both sides. </param>
+/// <param name="r"> IN: Row that is held in src. </param>
+/// <param name="w"> IN: Width of image to filter. </param>
+/// <param name="h"> IN: Height of image to filter. </param>
+/// <param name="kernel"> IN: Q0.15 kernel to filter with. </param>
+/// <param name="kernel_size"> IN: Size of the kernel. </param>
+void filter_row_transpose_s16_scalar(int16_t * restrict output, const int16_t * restrict src, int r, int w, int h, const int16_t * restrict kernel, uint32_t kernel_size) {
+  int dst_ind = r;
+  for (int c = 0; c < w; ++c) {
+    int16_t sum = 0;
+    for (int i = 0; i < kernel_size; ++i) {
+      sum += mulhrs_s16(src[c + i], kernel[i]);
+    }
+    inc_read(2 * kernel_size, int16_t);
+    output[dst_ind] = sum;
+    inc_write(1, int16_t);
+    dst_ind += h;
+  }
+}
+
+/// <summary>
+/// Fixed point row filter for SSE, 8 pixels at a time.
+/// </summary>
+ETHSIFT_TARGET_SSE
+void filter_row_transpose_s16_sse(int16_t * restrict output, const int16_t * restrict src, int r, int w, int h, const int16_t * restrict kernel, uint32_t kernel_size) {
+  int16_t partialSum[8];
+  int dst_ind = r;
+  int c;
+  for (c = 0; c < w - 7; c += 8) {
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < kernel_size; ++i) {
+      __m128i pixels = _mm_loadu_si128((const __m128i *) (src + c + i));
+      sum = _mm_add_epi16(sum, _mm_mulhrs_epi16(pixels, _mm_set1_epi16(kernel[i])));
+    }
+    inc_read(kernel_size * 8, int16_t);
+    _mm_storeu_si128((__m128i *) partialSum, sum);
+    for (int i = 0; i < 8; ++i) {
+      output[dst_ind] = partialSum[i];
+      dst_ind += h;
+    }
+    inc_write(8, int16_t);
+  }
+  for (; c < w; ++c) {
+    int16_t s = 0;
+    for (int i = 0; i < kernel_size; ++i) {
+      s += mulhrs_s16(src[c + i], kernel[i]);
+    }
+    output[dst_ind] = s;
+    dst_ind += h;
+  }
+}
+
+/// <summary>
+/// Fixed point row filter for AVX2, 16 pixels at a time.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+void filter_row_transpose_s16_avx2(int16_t * restrict output, const int16_t * restrict src, int r, int w, int h, const int16_t * restrict kernel, uint32_t kernel_size) {
+  int16_t partialSum[16];
+  int dst_ind = r;
+  int c;
+  for (c = 0; c < w - 15; c += 16) {
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < kernel_size; ++i) {
+      __m256i pixels = _mm256_loadu_si256((const __m256i *) (src + c + i));
+      sum = _mm256_add_epi16(sum, _mm256_mulhrs_epi16(pixels, _mm256_set1_epi16(kernel[i])));
+    }
+    inc_read(kernel_size * 16, int16_t);
+    _mm256_storeu_si256((__m256i *) partialSum, sum);
+    for (int i = 0; i < 16; ++i) {
+      output[dst_ind] = partialSum[i];
+      dst_ind += h;
+    }
+    inc_write(16, int16_t);
+  }
+  for (; c < w; ++c) {
+    int16_t s = 0;
+    for (int i = 0; i < kernel_size; ++i) {
+      s += mulhrs_s16(src[c + i], kernel[i]);
+    }
+    output[dst_ind] = s;
+    dst_ind += h;
+  }
+}
+
+/// <summary>
+/// Replicate the first and last pixel of the fixed point row into the kernel padding.
+/// </summary>
+static inline void pad_row_s16(int16_t *row, int w, uint32_t kernel_rad) {
+  const int16_t first = row[kernel_rad];
+  const int16_t last = row[kernel_rad + w - 1];
+  for (int i = 0; i < kernel_rad; i++) {
+    row[i] = first;
+    row[i + w + kernel_rad] = last;
+  }
+}
+
+/// <summary>
+/// Blur a fixed point image with both passes of the separable filter.
+/// The first pass either reads 8-bit rows of view or fixed point rows of pixels.
+/// </summary>
+static void apply_kernel_s16(const struct ethsift_image_view *view, const int16_t * restrict pixels, int w, int h,
+                             const int16_t * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int16_t * restrict output) {
+  int16_t *row = (int16_t *) row_buf;
+  int16_t *transposed = (int16_t *) img_buf;
+
+  for (int r = 0; r < h; ++r) {
+    if (view) {
+      const uint8_t *src = (const uint8_t *) view->data + (size_t) r * view->stride;
+      for (int c = 0; c < w; ++c)
+        row[kernel_rad + c] = (int16_t) (src[c] << ETHSIFT_FIXED_FRAC_BITS);
+      inc_read(w, uint8_t);
+    } else {
+      memcpy(&row[kernel_rad], &pixels[(size_t) r * w], sizeof(int16_t) * w);
+      inc_read(w, int16_t);
+    }
+    pad_row_s16(row, w, kernel_rad);
+    g_kernels.filter_row_transpose_s16(transposed, row, r, w, h, kernel, kernel_size);
+  }
+
+  for (int r = 0; r < w; ++r) {
+    memcpy(&row[kernel_rad], &transposed[(size_t) r * h], sizeof(int16_t) * h);
+    inc_read(h, int16_t);
+    pad_row_s16(row, h, kernel_rad);
+    g_kernels.filter_row_transpose_s16(output, row, r, h, w, kernel, kernel_size);
+  }
+}
+
+/// <summary>
+/// Creates the Gaussian and Difference of Gaussian pyramids of an 8-bit image in fixed point.
+/// </summary>
+/// <param name="image"> IN: The 8-bit input image. </param>
+/// <param name="octave_count"> IN: Number of octaves. </param>
+/// <param name="gaussians"> OUT: Gaussian pyramid, converted to float.
+/// NOTE: Size = octave_count * gaussian_count. </param>
+/// <param name="gaussian_count"> IN: Number of gaussian blurred images per layer. </param>
+/// <param name="differences"> OUT: Difference of Gaussian pyramid, converted to float.
+/// NOTE: Size = octave_count * dog_count. </param>
+/// <param name="dog_count"> IN: Number of difference images per layer. </param>
+/// <returns> 1 IF generation was successful, ELSE 0. </returns>
+/// <remarks> 0 flops, all arithmetic is on integers. </remarks>
+int ethsift_generate_pyramids_fixed(struct ethsift_image_view image,
+                                    uint32_t octave_count,
+                                    struct ethsift_image gaussians[],
+                                    uint32_t gaussian_count,
+                                    struct ethsift_image differences[],
+                                    uint32_t dog_count){
+  if (image.format != ETHSIFT_FORMAT_U8 || gaussians[0].width != image.width || gaussians[0].height != image.height)
+    return 0;
+
+  const int layers_count = gaussian_count - 3;
+  const float scale = 1.0f / (1 << ETHSIFT_FIXED_FRAC_BITS);
+  const size_t base_size = (size_t) image.width * image.height;
+
+  // Only one octave is kept in fixed point at a time, the next base replaces level 0 once it is done.
+  int16_t *levels;
+  if (posix_memalign((void*)&levels, ETHSIFT_MEMALIGN, gaussian_count * base_size * sizeof(int16_t)))
+    return 0;
+
+  for (int i = 0; i < octave_count; ++i) {
+    const int w = gaussians[i * gaussian_count].width;
+    const int h = gaussians[i * gaussian_count].height;
+    const size_t size = (size_t) w * h;
+
+    if (i == 0) {
+      apply_kernel_s16(&image, NULL, w, h, g_fixed_kernel_ptrs[0], g_kernel_sizes[0], g_kernel_rads[0], levels);
+    }
+    for (int j = 1; j < gaussian_count; ++j) {
+      apply_kernel_s16(NULL, levels + (j - 1) * size, w, h, g_fixed_kernel_ptrs[j], g_kernel_sizes[j], g_kernel_rads[j],
+                       levels + j * size);
+    }
+
+    // Widen the octave to float, the differences are taken exactly on the integers.
+    for (int j = 0; j < gaussian_count; ++j) {
+      const int16_t *level = levels + j * size;
+      float *dst = gaussians[i * gaussian_count + j].pixels;
+      for (size_t idx = 0; idx < size; ++idx)
+        dst[idx] = level[idx] * scale;
+      inc_read(size, int16_t);
+      inc_write(size, float);
+    }
+    for (int j = 0; j < dog_count; ++j) {
+      const int16_t *low = levels + j * size;
+      const int16_t *high = levels + (j + 1) * size;
+      float *dif = differences[i * dog_count + j].pixels;
+      for (size_t idx = 0; idx < size; ++idx)
+        dif[idx] = (int16_t) (high[idx] - low[idx]) * scale;
+      inc_read(2 * size, int16_t);
+      inc_write(size, float);
+    }
+
+    if (i + 1 < octave_count) {
+      const int16_t *src = levels + layers_count * size;
+      const int half_w = gaussians[(i + 1) * gaussian_count].width;
+      const int half_h = gaussians[(i + 1) * gaussian_count].height;
+      for (int r = 0; r < half_h; ++r) {
+        for (int c = 0; c < half_w; ++c) {
+          levels[r * half_w + c] = src[(2 * r) * w + 2 * c];
+        }
+      }
+      inc_read(half_w * half_h, int16_t);
+      inc_write(half_w * half_h, int16_t);
+    }
+  }
+
+  free(levels);
+  return 1;
+}
@@ -19,7 +19,9 @@ int ethsift_generate_gaussian_kernel(float *kernel,
     float tmp;
     for (int j = 0; j < kernel_size; ++j) {
         tmp = (float)((j - kernel_rad) / sigma); //Float conversion 2 FLOP?
-        kernel[j] = expf(tmp * tmp * -0.5f) * (1 + j / 1000.0f); // 3 MULs + 1 ADDs + 1DIVs + 1EXPs = 
+        kernel[j] = expf(tmp * tmp * -0.5f); // 3 MULs + 1 ADDs + 1DIVs + 1EXPs = 
+        if (!g_symmetric_kernels) // Same skew as ezsift, see ethsift_set_symmetric_kernels.
+          kernel[j] *= (1 + j / 1000.0f);
         accu += kernel[j];
         inc_adds(2);
         inc_mults(3);
@@ -118,6 +120,80 @@ int ethsift_generate_all_kernels(int layers_count,
     return 1;
 }
 
+/// <summary> 
+/// Creates the gaussian kernels that blur the base of an octave directly to each of its levels.
+/// </summary>
+/// <param name="layers_count"> IN: Amount of layers. </param>
+/// <param name="gaussian_count"> IN: Amount of gaussian levels per octave. </param>
+/// <param name="kernel_ptrs"> OUT: Pointers to the kernels, the first one is NULL. </param>
+/// <param name="kernel_rads"> OUT: The radii of all the kernels stored in an array. </param> 
+/// <param name="kernel_sizes"> OUT: The sizes of all the kernels stored in an array. </param> 
+/// <returns> 1 IF generation was successful, ELSE 0. </returns>
+/// <remarks> (gaussian_count - 1) * (powf + sqrt + ceilf + 5 + ggk) </remarks>
+int ethsift_generate_direct_kernels(int layers_count, 
+                                    uint32_t gaussian_count, 
+                                    float **kernel_ptrs, 
+                                    int kernel_rads[], 
+                                    int kernel_sizes[]){
+    float sigma0 = ETHSIFT_SIGMA;
+    float k = powf(2.0f, 1.0f / layers_count);
+    inc_div(1);
+
+    // The base already carries sigma0, level i needs sigma0 * k^i in total.
+    kernel_ptrs[0] = NULL;
+    kernel_rads[0] = 0;
+    kernel_sizes[0] = 0;
+    for (int i = 1; i < gaussian_count; ++i) {
+        float sigma = powf(k, (float) i) * sigma0;
+        float sigma_i = sqrtf(sigma * sigma - sigma0 * sigma0);
+        inc_adds(1);
+        inc_mults(3);
+
+        kernel_rads[i] = (sigma_i * ETHSIFT_GAUSSIAN_FILTER_RADIUS > 1.0f)
+                ? (int)ceilf(sigma_i * ETHSIFT_GAUSSIAN_FILTER_RADIUS) : 1;
+        kernel_sizes[i] = kernel_rads[i] * 2 + 1;
+        inc_write(2, int);
+        inc_mults(2);
+
+        if(posix_memalign((void*)&kernel_ptrs[i], ETHSIFT_MEMALIGN, kernel_sizes[i]*sizeof(float)))
+          return 0;
+        
+        ethsift_generate_gaussian_kernel(kernel_ptrs[i], kernel_sizes[i], kernel_rads[i], sigma_i);
+        inc_read(1, float*);
+        inc_read(2, int);
+    }
+    return 1;
+}
+
+/// <summary> 
+/// Quantise gaussian kernels to Q0.15 for the fixed point pyramid.
+/// </summary>
+/// <param name="kernel_ptrs"> IN: Pointers to the float kernels. </param>
+/// <param name="kernel_sizes"> IN: The sizes of the kernels. </param> 
+/// <param name="gaussian_count"> IN: Amount of kernels. </param>
+/// <param name="fixed_ptrs"> OUT: Pointers to the quantised kernels. </param>
+/// <returns> 1 IF generation was successful, ELSE 0. </returns>
+/// <remarks> gaussian_count * kernel_size flops </remarks>
+int ethsift_generate_fixed_kernels(float **kernel_ptrs, 
+                                   int kernel_sizes[], 
+                                   uint32_t gaussian_count, 
+                                   int16_t **fixed_ptrs){
+    for (int i = 0; i < gaussian_count; ++i) {
+        const int size = kernel_sizes[i];
+        if(posix_memalign((void*)&fixed_ptrs[i], ETHSIFT_MEMALIGN, size*sizeof(int16_t)))
+          return 0;
+        // Round every tap and give the error to the centre tap, so that flat areas keep their value.
+        int sum = 0;
+        for (int j = 0; j < size; ++j) {
+            fixed_ptrs[i][j] = (int16_t) lrintf(kernel_ptrs[i][j] * 32768.0f);
+            sum += fixed_ptrs[i][j];
+            inc_mults(1);
+        }
+        fixed_ptrs[i][size / 2] += 32768 - sum;
+    }
+    return 1;
+}
+
 /// <summary> 
 /// Frees up the allocated memory of the kernels
 /// </summary>
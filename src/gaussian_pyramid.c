@@ -14,28 +14,64 @@ int ethsift_generate_gaussian_pyramid(struct ethsift_image image,
                             uint32_t octave_count, 
                             struct ethsift_image gaussians[], 
                             uint32_t gaussian_count){
+    struct ethsift_image_view view = {image.pixels, image.width, image.height, image.width * sizeof(float), ETHSIFT_FORMAT_F32};
+    return ethsift_generate_gaussian_pyramid_view(view, octave_count, gaussians, gaussian_count);
+}
+
+/// <summary> 
+/// Creates a pyramid of images containing blurred versions of a borrowed input image.
+/// </summary>
+/// <param name="image"> IN: The input image, converted to float during the first blur. </param>
+/// <param name="octave_count"> IN: Number of octaves. </param>
+/// <param name="gaussians"> IN/OUT: Struct of gaussians to compute. 
+/// NOTE: Size = octave_count * gaussian_count. </param>
+/// <param name="gaussian_count"> IN: Number of gaussian blurred images per layer. </param>
+/// <returns> 1 IF generation was successful, ELSE 0. </returns>
+/// <remarks> ggk + ((gaussian_count-1)*octave_count + 1) * ak </remarks>
+int ethsift_generate_gaussian_pyramid_view(struct ethsift_image_view image,
+                            uint32_t octave_count, 
+                            struct ethsift_image gaussians[], 
+                            uint32_t gaussian_count){
     int layers_count = gaussian_count - 3;
     
     // Calculate the gaussian pyramids!
-    ethsift_apply_kernel(image, g_kernel_ptrs[0], g_kernel_sizes[0], g_kernel_rads[0], 
-                         gaussians[0]);
+    if (gaussians[0].width == image.width * 2 && gaussians[0].height == image.height * 2) {
+      // Doubled first octave, the upsampled image starts out with twice the blur.
+      ethsift_apply_kernel_upsample(image, g_upsample_kernel, g_upsample_kernel_size, g_upsample_kernel_rad, 
+                                    gaussians[0]);
+    } else {
+      ethsift_apply_kernel_view(image, g_kernel_ptrs[0], g_kernel_sizes[0], g_kernel_rads[0], 
+                                gaussians[0]);
+    }
     inc_read(1, float*);
     inc_read(2, int);
     inc_read(1, struct ethsift_image);
-    for(int j = 1; j < gaussian_count; ++j){
-      ethsift_apply_kernel(gaussians[j - 1], g_kernel_ptrs[j], g_kernel_sizes[j], 
-                           g_kernel_rads[j], gaussians[j]);
-      inc_read(1, float*);
-      inc_read(2, int);
-      inc_read(2, struct ethsift_image);
+    if (g_pyramid_schedule == ETHSIFT_SCHEDULE_DIRECT) {
+      // Every level is blurred from the octave base, the next base is decimated from level layers_count.
+      for (int i = 0; i < octave_count; ++i) {
+        struct ethsift_image half = {0};
+        if (i + 1 < octave_count)
+          half = gaussians[(i + 1) * gaussian_count];
+        ethsift_apply_kernels_direct(gaussians[i * gaussian_count], g_direct_kernel_ptrs + 1, g_direct_kernel_sizes + 1,
+                                     g_direct_kernel_rads + 1, &gaussians[i * gaussian_count + 1], gaussian_count - 1,
+                                     layers_count - 1, half);
+        inc_read(gaussian_count + 1, struct ethsift_image);
+      }
+      return 1;
     }
-    for (int i = 1; i < octave_count; ++i) {
-      ethsift_downscale_half(gaussians[(i - 1) * gaussian_count + layers_count],
-                             gaussians[i * gaussian_count]);
-      inc_read(2, struct ethsift_image);
+
+    for (int i = 0; i < octave_count; ++i) {
       for (int j = 1; j < gaussian_count; ++j) {
-        ethsift_apply_kernel(gaussians[i * gaussian_count + j - 1], g_kernel_ptrs[j], g_kernel_sizes[j], 
-                             g_kernel_rads[j], gaussians[i * gaussian_count + j]);
+        // The base of the next octave is the decimated layer layers_count of this one,
+        // it is written while that layer is blurred.
+        if (j == layers_count && i + 1 < octave_count) {
+          ethsift_apply_kernel_decimate(gaussians[i * gaussian_count + j - 1], g_kernel_ptrs[j], g_kernel_sizes[j], 
+                                        g_kernel_rads[j], gaussians[i * gaussian_count + j], gaussians[(i + 1) * gaussian_count]);
+          inc_read(1, struct ethsift_image);
+        } else {
+          ethsift_apply_kernel(gaussians[i * gaussian_count + j - 1], g_kernel_ptrs[j], g_kernel_sizes[j], 
+                               g_kernel_rads[j], gaussians[i * gaussian_count + j]);
+        }
         inc_read(1, float*);
         inc_read(2, int);
         inc_read(2, struct ethsift_image);
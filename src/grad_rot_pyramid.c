@@ -7,7 +7,7 @@
 /// <param name="gaussians"> IN: The octaves of the input image. </param>
 /// <param name="gaussian_count"> IN: Number of octaves. </param>
 /// <param name="gradients"> OUT: Struct of gradients to compute. 
-/// <param name="rotations"> OUT: Struct of rotations to compute. 
+/// <param name="rotations"> OUT: Struct of rotations to compute, or NULL to only compute the gradients. 
 /// <param name="layers"> IN: Number of layers in the gradients and rotation pyramids. 
 /// <param name="octave_count"> IN: Number of octaves.  </param>
 /// <param name="gaussian_count"> IN: Number of gaussian blurred images per layer. </param> 
@@ -18,6 +18,170 @@ int ethsift_generate_gradient_pyramid(struct ethsift_image gaussians[],
                                       struct ethsift_image rotations[], 
                                       uint32_t layers,
                                       uint32_t octave_count){
+    if (rotations == NULL)
+      return g_kernels.magnitude_pyramid(gaussians, gaussian_count, gradients, layers, octave_count);
+    return g_kernels.gradient_pyramid(gaussians, gaussian_count, gradients, rotations, layers, octave_count);
+}
+
+/// <summary> 
+/// Compute gradient magnitude and orientation of a single pixel using clamped differences.
+/// </summary>
+static inline void gradient_pixel(const float *in_gaussian, float *out_grads, float *out_rots, int width, int height, int row, int column){
+    const int row_plus_one = internal_min(row + 1, height - 1) * width;
+    const int row_minus_one = internal_max(row - 1, 0) * width;
+    const int col_plus_one = internal_min(column + 1, width - 1);
+    const int col_minus_one = internal_max(column - 1, 0);
+
+    float d_row = in_gaussian[row_plus_one + column] - in_gaussian[row_minus_one + column];
+    float d_column = in_gaussian[row * width + col_plus_one] - in_gaussian[row * width + col_minus_one];
+    inc_read(4, float);
+    inc_adds(2);
+
+    out_grads[row * width + column] = sqrtf(d_row * d_row + d_column * d_column);
+    out_rots[row * width + column] = eth_atan2_f(d_row, d_column);
+    inc_adds(1);
+    inc_mults(2);
+    inc_write(2, float);
+}
+
+/// <summary> 
+/// Gradient pyramid kernel without vector instructions.
+/// </summary>
+int gradient_pyramid_scalar(struct ethsift_image gaussians[], 
+                            uint32_t gaussian_count, 
+                            struct ethsift_image gradients[], 
+                            struct ethsift_image rotations[], 
+                            uint32_t layers,
+                            uint32_t octave_count){
+    for(int i = 0; i < octave_count; i++){
+        const int width = (int) gaussians[i * gaussian_count].width;
+        const int height = (int) gaussians[i * gaussian_count].height;
+        inc_read(2, int32_t);
+
+        for(int j = 1; j <= layers; j++){
+            const int idx = i * gaussian_count + j;
+            for(int row = 0; row < height; ++row){
+                for(int column = 0; column < width; ++column){
+                    gradient_pixel(gaussians[idx].pixels, gradients[idx].pixels, rotations[idx].pixels, width, height, row, column);
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+/// <summary> 
+/// Gradient pyramid kernel for SSE, 4 pixels at a time.
+/// </summary>
+ETHSIFT_TARGET_SSE
+int gradient_pyramid_sse(struct ethsift_image gaussians[], 
+                         uint32_t gaussian_count, 
+                         struct ethsift_image gradients[], 
+                         struct ethsift_image rotations[], 
+                         uint32_t layers,
+                         uint32_t octave_count){
+    for(int i = 0; i < octave_count; i++){
+        const int width = (int) gaussians[i * gaussian_count].width;
+        const int height = (int) gaussians[i * gaussian_count].height;
+        inc_read(2, int32_t);
+
+        for(int j = 1; j <= layers; j++){
+            const int idx = i * gaussian_count + j;
+            const float *in_gaussian = gaussians[idx].pixels;
+            float *out_grads = gradients[idx].pixels;
+            float *out_rots = rotations[idx].pixels;
+
+            for(int row = 0; row < height; ++row){
+                const int row_plus_one = internal_min(row + 1, height - 1) * width;
+                const int row_minus_one = internal_max(row - 1, 0) * width;
+
+                // The border columns need clamped neighbours.
+                gradient_pixel(in_gaussian, out_grads, out_rots, width, height, row, 0);
+                int column = 1;
+                for(; column < width - 4; column += 4){
+                    __m128 d_row = _mm_sub_ps(_mm_loadu_ps(in_gaussian + row_plus_one + column),
+                                              _mm_loadu_ps(in_gaussian + row_minus_one + column));
+                    __m128 d_column = _mm_sub_ps(_mm_loadu_ps(in_gaussian + row * width + column + 1),
+                                                 _mm_loadu_ps(in_gaussian + row * width + column - 1));
+                    __m128 grad = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(d_row, d_row), _mm_mul_ps(d_column, d_column)));
+                    _mm_storeu_ps(out_grads + row * width + column, grad);
+                    _mm_storeu_ps(out_rots + row * width + column, eth_mm_atan2_ps(d_row, d_column));
+                    inc_read(16, float);
+                    inc_adds(12);
+                    inc_mults(8);
+                    inc_write(8, float);
+                }
+                for(; column < width; ++column){
+                    gradient_pixel(in_gaussian, out_grads, out_rots, width, height, row, column);
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+/// <summary> 
+/// Gradient pyramid kernel for AVX-512, 16 pixels at a time. The last block of
+/// every row is masked, only the image border is computed per pixel.
+/// </summary>
+ETHSIFT_TARGET_AVX512
+int gradient_pyramid_avx512(struct ethsift_image gaussians[], 
+                            uint32_t gaussian_count, 
+                            struct ethsift_image gradients[], 
+                            struct ethsift_image rotations[], 
+                            uint32_t layers,
+                            uint32_t octave_count){
+    for(int i = 0; i < octave_count; i++){
+        const int width = (int) gaussians[i * gaussian_count].width;
+        const int height = (int) gaussians[i * gaussian_count].height;
+        inc_read(2, int32_t);
+
+        for(int j = 1; j <= layers; j++){
+            const int idx = i * gaussian_count + j;
+            const float *in_gaussian = gaussians[idx].pixels;
+            float *out_grads = gradients[idx].pixels;
+            float *out_rots = rotations[idx].pixels;
+
+            for(int column = 0; column < width; ++column){
+                gradient_pixel(in_gaussian, out_grads, out_rots, width, height, 0, column);
+                gradient_pixel(in_gaussian, out_grads, out_rots, width, height, height - 1, column);
+            }
+
+            for(int row = 1; row < height - 1; ++row){
+                const int row_width = row * width;
+                gradient_pixel(in_gaussian, out_grads, out_rots, width, height, row, 0);
+                for(int column = 1; column < width - 1; column += 16){
+                    const int lanes = internal_min(16, width - 1 - column);
+                    const __mmask16 mask = (__mmask16)((1u << lanes) - 1);
+                    __m512 d_row = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, in_gaussian + row_width + width + column),
+                                                 _mm512_maskz_loadu_ps(mask, in_gaussian + row_width - width + column));
+                    __m512 d_column = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, in_gaussian + row_width + column + 1),
+                                                    _mm512_maskz_loadu_ps(mask, in_gaussian + row_width + column - 1));
+                    __m512 grad = _mm512_sqrt_ps(_mm512_fmadd_ps(d_column, d_column, _mm512_mul_ps(d_row, d_row)));
+                    _mm512_mask_storeu_ps(out_grads + row_width + column, mask, grad);
+                    _mm512_mask_storeu_ps(out_rots + row_width + column, mask, eth_mm512_atan2_ps(d_row, d_column));
+                    inc_read(4*lanes, float);
+                    inc_adds(3*lanes);
+                    inc_mults(2*lanes);
+                    inc_write(2*lanes, float);
+                }
+                gradient_pixel(in_gaussian, out_grads, out_rots, width, height, row, width - 1);
+            }
+        }
+    }
+    return 1;
+}
+
+/// <summary> 
+/// Gradient pyramid kernel for AVX2, 8 pixels of the three layers per iteration.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+int gradient_pyramid_avx2(struct ethsift_image gaussians[], 
+                                      uint32_t gaussian_count, 
+                                      struct ethsift_image gradients[], 
+                                      struct ethsift_image rotations[], 
+                                      uint32_t layers,
+                                      uint32_t octave_count){
     int width, height;
     int idx;
     int col_upper_offset = 8, col_lower_offset = 1;
@@ -137,9 +301,9 @@ int ethsift_generate_gradient_pyramid(struct ethsift_image gaussians[],
                 grad2 = _mm256_sqrt_ps(sqrt_input2);
 
 
-                eth_mm256_atan2_ps(&d_row_m256, &d_column_m256, &rot);
-                eth_mm256_atan2_ps(&d_row1_m256, &d_column1_m256, &rot1);
-                eth_mm256_atan2_ps(&d_row2_m256, &d_column2_m256, &rot2);
+                rot = eth_mm256_atan2_ps(d_row_m256, d_column_m256);
+                rot1 = eth_mm256_atan2_ps(d_row1_m256, d_column1_m256);
+                rot2 = eth_mm256_atan2_ps(d_row2_m256, d_column2_m256);
 
                 _mm256_storeu_ps(out_grads + write_index, grad);
                 _mm256_storeu_ps(out_rots + write_index, rot);
@@ -170,13 +334,13 @@ int ethsift_generate_gradient_pyramid(struct ethsift_image gaussians[],
                 inc_adds(6); // 2 Subtractions
                     
                 out_grads[row * width + column] = sqrtf(d_row * d_row + d_column * d_column);
-                out_rots[row * width + column] = fast_atan2_f(d_row, d_column); 
+                out_rots[row * width + column] = eth_atan2_f(d_row, d_column); 
                 
                 out_grads1[row * width + column] = sqrtf(d_row1 * d_row1 + d_column1 * d_column1);
-                out_rots1[row * width + column] = fast_atan2_f(d_row1, d_column1); 
+                out_rots1[row * width + column] = eth_atan2_f(d_row1, d_column1); 
                 
                 out_grads2[row * width + column] = sqrtf(d_row2 * d_row2 + d_column2 * d_column2);
-                out_rots2[row * width + column] = fast_atan2_f(d_row2, d_column2);
+                out_rots2[row * width + column] = eth_atan2_f(d_row2, d_column2);
                 inc_write(3*2, float);
             }
         }
@@ -207,13 +371,13 @@ int ethsift_generate_gradient_pyramid(struct ethsift_image gaussians[],
             inc_read(3*2*2, float);
                 
             out_grads[row1 * width + column] = sqrtf(d_row * d_row + d_column * d_column);
-            out_rots[row1 * width + column] = fast_atan2_f(d_row, d_column); 
+            out_rots[row1 * width + column] = eth_atan2_f(d_row, d_column); 
             
             out_grads1[row1 * width + column] = sqrtf(d_row1 * d_row1 + d_column1 * d_column1);
-            out_rots1[row1 * width + column] = fast_atan2_f(d_row1, d_column1); 
+            out_rots1[row1 * width + column] = eth_atan2_f(d_row1, d_column1); 
             
             out_grads2[row1 * width + column] = sqrtf(d_row2 * d_row2 + d_column2 * d_column2);
-            out_rots2[row1 * width + column] = fast_atan2_f(d_row2, d_column2); 
+            out_rots2[row1 * width + column] = eth_atan2_f(d_row2, d_column2); 
             inc_write(3*2, float);
 
             // LOWER ROW BORDER
@@ -230,13 +394,13 @@ int ethsift_generate_gradient_pyramid(struct ethsift_image gaussians[],
             inc_read(3*2*2, float);
                 
             out_grads[row2 * width + column] = sqrtf(d_row * d_row + d_column * d_column);
-            out_rots[row2 * width + column] = fast_atan2_f(d_row, d_column); 
+            out_rots[row2 * width + column] = eth_atan2_f(d_row, d_column); 
             
             out_grads1[row2 * width + column] = sqrtf(d_row1 * d_row1 + d_column1 * d_column1);
-            out_rots1[row2 * width + column] = fast_atan2_f(d_row1, d_column1); 
+            out_rots1[row2 * width + column] = eth_atan2_f(d_row1, d_column1); 
             
             out_grads2[row2 * width + column] = sqrtf(d_row2 * d_row2 + d_column2 * d_column2);
-            out_rots2[row2 * width + column] = fast_atan2_f(d_row2, d_column2);
+            out_rots2[row2 * width + column] = eth_atan2_f(d_row2, d_column2);
             inc_write(3*2, float);
         }
         //DO COLUMN BORDERS
@@ -259,13 +423,13 @@ int ethsift_generate_gradient_pyramid(struct ethsift_image gaussians[],
                 inc_read(3*2*2, float);
                     
                 out_grads[row * width] = sqrtf(d_row * d_row + d_column * d_column);
-                out_rots[row * width] = fast_atan2_f(d_row, d_column); 
+                out_rots[row * width] = eth_atan2_f(d_row, d_column); 
                 
                 out_grads1[row * width] = sqrtf(d_row1 * d_row1 + d_column1 * d_column1);
-                out_rots1[row * width] = fast_atan2_f(d_row1, d_column1); 
+                out_rots1[row * width] = eth_atan2_f(d_row1, d_column1); 
                 
                 out_grads2[row * width] = sqrtf(d_row2 * d_row2 + d_column2 * d_column2);
-                out_rots2[row * width] = fast_atan2_f(d_row2, d_column2);
+                out_rots2[row * width] = eth_atan2_f(d_row2, d_column2);
                 inc_write(3*2, float);
 
                 
@@ -286,13 +450,13 @@ int ethsift_generate_gradient_pyramid(struct ethsift_image gaussians[],
                 inc_read(3*2*2, float);
                     
                 out_grads[row * width + col_plus_one] = sqrtf(d_row * d_row + d_column * d_column);
-                out_rots[row * width + col_plus_one] = fast_atan2_f(d_row, d_column); 
+                out_rots[row * width + col_plus_one] = eth_atan2_f(d_row, d_column); 
                 
                 out_grads1[row * width + col_plus_one] = sqrtf(d_row1 * d_row1 + d_column1 * d_column1);
-                out_rots1[row * width + col_plus_one] = fast_atan2_f(d_row1, d_column1); 
+                out_rots1[row * width + col_plus_one] = eth_atan2_f(d_row1, d_column1); 
                 
                 out_grads2[row * width + col_plus_one] = sqrtf(d_row2 * d_row2 + d_column2 * d_column2);
-                out_rots2[row * width + col_plus_one] = fast_atan2_f(d_row2, d_column2);
+                out_rots2[row * width + col_plus_one] = eth_atan2_f(d_row2, d_column2);
                 inc_write(3*2, float);
             
         }
@@ -302,6 +466,7 @@ int ethsift_generate_gradient_pyramid(struct ethsift_image gaussians[],
     return 1;
 }
 
+ETHSIFT_TARGET_AVX2
 int ethsift_generate_gradient_pyramid_janleu(struct ethsift_image gaussians[], 
                                       uint32_t gaussian_count, 
                                       struct ethsift_image gradients[], 
@@ -366,7 +531,7 @@ int ethsift_generate_gradient_pyramid_janleu(struct ethsift_image gaussians[],
                     d_input_sqrt = _mm256_fmadd_ps(d_row, d_row, d_input_sqrt);
                     d_sqrt = _mm256_sqrt_ps(d_input_sqrt);
 
-                    eth_mm256_atan2_ps(&d_row, &d_col, &d_atan);
+                    d_atan = eth_mm256_atan2_ps(d_row, d_col);
 
                     _mm256_storeu_ps(out_grads + pos, d_sqrt);
                     _mm256_storeu_ps(out_rots + pos, d_atan);
@@ -384,7 +549,7 @@ int ethsift_generate_gradient_pyramid_janleu(struct ethsift_image gaussians[],
                     inc_read(2*2, float);
 
                     out_grads[r * width + c] = sqrtf(row * row + col * col);
-                    out_rots[r * width + c] = fast_atan2_f(row, col);
+                    out_rots[r * width + c] = eth_atan2_f(row, col);
                     inc_write(2, float);
                 }
             }
@@ -403,10 +568,10 @@ int ethsift_generate_gradient_pyramid_janleu(struct ethsift_image gaussians[],
                 inc_read(2*2, float);
 
                 out_grads[i] = sqrtf(row1 * row1 + col1 * col1);
-                out_rots[i] = fast_atan2_f(row1, col1); 
+                out_rots[i] = eth_atan2_f(row1, col1); 
 
                 out_grads[(height - 1) * width + i] = sqrtf(row2 * row2 + col2 * col2);
-                out_rots[(height - 1) * width + i] = fast_atan2_f(row2, col2); 
+                out_rots[(height - 1) * width + i] = eth_atan2_f(row2, col2); 
                 inc_write(2, float);
             }
 
@@ -422,7 +587,7 @@ int ethsift_generate_gradient_pyramid_janleu(struct ethsift_image gaussians[],
                 inc_read(2*2, float);
 
                 out_grads[i * width] = sqrtf(row1 * row1 + col1 * col1);
-                out_rots[i * width] = fast_atan2_f(row1, col1); 
+                out_rots[i * width] = eth_atan2_f(row1, col1); 
                 inc_write(2, float);
             }
         }      
@@ -430,3 +595,192 @@ int ethsift_generate_gradient_pyramid_janleu(struct ethsift_image gaussians[],
     return 1;
 }
 
+
+/// <summary> 
+/// Compute the gradient magnitude of a single pixel using clamped differences.
+/// </summary>
+static inline void magnitude_pixel(const float *in_gaussian, float *out_grads, int width, int height, int row, int column){
+    const int row_plus_one = internal_min(row + 1, height - 1) * width;
+    const int row_minus_one = internal_max(row - 1, 0) * width;
+    const int col_plus_one = internal_min(column + 1, width - 1);
+    const int col_minus_one = internal_max(column - 1, 0);
+
+    float d_row = in_gaussian[row_plus_one + column] - in_gaussian[row_minus_one + column];
+    float d_column = in_gaussian[row * width + col_plus_one] - in_gaussian[row * width + col_minus_one];
+    inc_read(4, float);
+    inc_adds(2);
+
+    out_grads[row * width + column] = sqrtf(d_row * d_row + d_column * d_column);
+    inc_adds(1);
+    inc_mults(2);
+    inc_write(1, float);
+}
+
+/// <summary> 
+/// Gradient magnitude pyramid kernel without vector instructions. Used instead of the gradient
+/// pyramid when orientations are binned from (dx, dy), see ethsift_set_orientation_mode.
+/// </summary>
+int magnitude_pyramid_scalar(struct ethsift_image gaussians[], 
+                             uint32_t gaussian_count, 
+                             struct ethsift_image gradients[], 
+                             uint32_t layers,
+                             uint32_t octave_count){
+    for(int i = 0; i < octave_count; i++){
+        const int width = (int) gaussians[i * gaussian_count].width;
+        const int height = (int) gaussians[i * gaussian_count].height;
+        inc_read(2, int32_t);
+
+        for(int j = 1; j <= layers; j++){
+            const int idx = i * gaussian_count + j;
+            for(int row = 0; row < height; ++row){
+                for(int column = 0; column < width; ++column){
+                    magnitude_pixel(gaussians[idx].pixels, gradients[idx].pixels, width, height, row, column);
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+/// <summary> 
+/// Gradient magnitude pyramid kernel for SSE, 4 pixels at a time.
+/// </summary>
+ETHSIFT_TARGET_SSE
+int magnitude_pyramid_sse(struct ethsift_image gaussians[], 
+                          uint32_t gaussian_count, 
+                          struct ethsift_image gradients[], 
+                          uint32_t layers,
+                          uint32_t octave_count){
+    for(int i = 0; i < octave_count; i++){
+        const int width = (int) gaussians[i * gaussian_count].width;
+        const int height = (int) gaussians[i * gaussian_count].height;
+        inc_read(2, int32_t);
+
+        for(int j = 1; j <= layers; j++){
+            const int idx = i * gaussian_count + j;
+            const float *in_gaussian = gaussians[idx].pixels;
+            float *out_grads = gradients[idx].pixels;
+
+            for(int column = 0; column < width; ++column){
+                magnitude_pixel(in_gaussian, out_grads, width, height, 0, column);
+                magnitude_pixel(in_gaussian, out_grads, width, height, height - 1, column);
+            }
+            for(int row = 1; row < height - 1; ++row){
+                const int row_width = row * width;
+                magnitude_pixel(in_gaussian, out_grads, width, height, row, 0);
+                int column = 1;
+                for(; column < width - 4; column += 4){
+                    __m128 d_row = _mm_sub_ps(_mm_loadu_ps(in_gaussian + row_width + width + column),
+                                              _mm_loadu_ps(in_gaussian + row_width - width + column));
+                    __m128 d_column = _mm_sub_ps(_mm_loadu_ps(in_gaussian + row_width + column + 1),
+                                                 _mm_loadu_ps(in_gaussian + row_width + column - 1));
+                    __m128 grad = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(d_row, d_row), _mm_mul_ps(d_column, d_column)));
+                    _mm_storeu_ps(out_grads + row_width + column, grad);
+                    inc_read(16, float);
+                    inc_adds(12);
+                    inc_mults(8);
+                    inc_write(4, float);
+                }
+                for(; column < width; ++column){
+                    magnitude_pixel(in_gaussian, out_grads, width, height, row, column);
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+/// <summary> 
+/// Gradient magnitude pyramid kernel for AVX2, 8 pixels at a time.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+int magnitude_pyramid_avx2(struct ethsift_image gaussians[], 
+                           uint32_t gaussian_count, 
+                           struct ethsift_image gradients[], 
+                           uint32_t layers,
+                           uint32_t octave_count){
+    for(int i = 0; i < octave_count; i++){
+        const int width = (int) gaussians[i * gaussian_count].width;
+        const int height = (int) gaussians[i * gaussian_count].height;
+        inc_read(2, int32_t);
+
+        for(int j = 1; j <= layers; j++){
+            const int idx = i * gaussian_count + j;
+            const float *in_gaussian = gaussians[idx].pixels;
+            float *out_grads = gradients[idx].pixels;
+
+            for(int column = 0; column < width; ++column){
+                magnitude_pixel(in_gaussian, out_grads, width, height, 0, column);
+                magnitude_pixel(in_gaussian, out_grads, width, height, height - 1, column);
+            }
+            for(int row = 1; row < height - 1; ++row){
+                const int row_width = row * width;
+                magnitude_pixel(in_gaussian, out_grads, width, height, row, 0);
+                int column = 1;
+                for(; column < width - 8; column += 8){
+                    __m256 d_row = _mm256_sub_ps(_mm256_loadu_ps(in_gaussian + row_width + width + column),
+                                                 _mm256_loadu_ps(in_gaussian + row_width - width + column));
+                    __m256 d_column = _mm256_sub_ps(_mm256_loadu_ps(in_gaussian + row_width + column + 1),
+                                                    _mm256_loadu_ps(in_gaussian + row_width + column - 1));
+                    __m256 grad = _mm256_sqrt_ps(_mm256_fmadd_ps(d_column, d_column, _mm256_mul_ps(d_row, d_row)));
+                    _mm256_storeu_ps(out_grads + row_width + column, grad);
+                    inc_read(32, float);
+                    inc_adds(24);
+                    inc_mults(16);
+                    inc_write(8, float);
+                }
+                for(; column < width; ++column){
+                    magnitude_pixel(in_gaussian, out_grads, width, height, row, column);
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+/// <summary> 
+/// Gradient magnitude pyramid kernel for AVX-512, 16 pixels at a time with a masked last block.
+/// </summary>
+ETHSIFT_TARGET_AVX512
+int magnitude_pyramid_avx512(struct ethsift_image gaussians[], 
+                             uint32_t gaussian_count, 
+                             struct ethsift_image gradients[], 
+                             uint32_t layers,
+                             uint32_t octave_count){
+    for(int i = 0; i < octave_count; i++){
+        const int width = (int) gaussians[i * gaussian_count].width;
+        const int height = (int) gaussians[i * gaussian_count].height;
+        inc_read(2, int32_t);
+
+        for(int j = 1; j <= layers; j++){
+            const int idx = i * gaussian_count + j;
+            const float *in_gaussian = gaussians[idx].pixels;
+            float *out_grads = gradients[idx].pixels;
+
+            for(int column = 0; column < width; ++column){
+                magnitude_pixel(in_gaussian, out_grads, width, height, 0, column);
+                magnitude_pixel(in_gaussian, out_grads, width, height, height - 1, column);
+            }
+            for(int row = 1; row < height - 1; ++row){
+                const int row_width = row * width;
+                magnitude_pixel(in_gaussian, out_grads, width, height, row, 0);
+                for(int column = 1; column < width - 1; column += 16){
+                    const int lanes = internal_min(16, width - 1 - column);
+                    const __mmask16 mask = (__mmask16)((1u << lanes) - 1);
+                    __m512 d_row = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, in_gaussian + row_width + width + column),
+                                                 _mm512_maskz_loadu_ps(mask, in_gaussian + row_width - width + column));
+                    __m512 d_column = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, in_gaussian + row_width + column + 1),
+                                                    _mm512_maskz_loadu_ps(mask, in_gaussian + row_width + column - 1));
+                    __m512 grad = _mm512_sqrt_ps(_mm512_fmadd_ps(d_column, d_column, _mm512_mul_ps(d_row, d_row)));
+                    _mm512_mask_storeu_ps(out_grads + row_width + column, mask, grad);
+                    inc_read(4*lanes, float);
+                    inc_adds(3*lanes);
+                    inc_mults(2*lanes);
+                    inc_write(lanes, float);
+                }
+                magnitude_pixel(in_gaussian, out_grads, width, height, row, width - 1);
+            }
+        }
+    }
+    return 1;
+}
@@ -1,14 +1,217 @@
 #include "internal.h"
 
+// Row stride of the lane private histograms. Bins 36 and 37 catch the neighbours of the
+// last bins and are folded back onto bins 0 and 1, which avoids a modulo per pixel.
+#define ORI_HIST_STRIDE 40
+
+/// <summary> 
+/// Sum the lane private histograms into the orientation histogram.
+/// </summary>
+/// <param name="private_hist"> IN: lanes histograms of ORI_HIST_STRIDE bins. </param>
+/// <param name="lanes"> IN: Number of private histograms. </param>
+/// <param name="hist"> OUT: Orientation histogram of ETHSIFT_ORI_HIST_BINS bins. </param>
+static inline void fold_private_histograms(const float *private_hist, int lanes, float *hist) {
+  for (int b = 0; b < ETHSIFT_ORI_HIST_BINS + 2; ++b) {
+    float sum = 0.0f;
+    for (int l = 0; l < lanes; ++l) {
+      sum += private_hist[l * ORI_HIST_STRIDE + b];
+    }
+    inc_adds(lanes);
+    inc_read(lanes, float);
+    if (b < ETHSIFT_ORI_HIST_BINS)
+      hist[b] = sum;
+    else
+      hist[b - ETHSIFT_ORI_HIST_BINS] += sum;
+    inc_write(1, float);
+  }
+}
+
+/// <summary> 
+/// Accumulate the weighted gradients of a window into the orientation histogram.
+/// </summary>
+/// <param name="gradient"> IN: Gradient magnitude of the top left pixel of the window. </param>
+/// <param name="rotation"> IN: Gradient orientation of the top left pixel of the window. </param>
+/// <param name="w"> IN: Width of the gradient image. </param>
+/// <param name="rotation_w"> IN: Row stride of the rotations. </param>
+/// <param name="rows"> IN: Height of the window. </param>
+/// <param name="cols"> IN: Width of the window. </param>
+/// <param name="row_weights"> IN: Gaussian weight of every row of the window. </param>
+/// <param name="col_weights"> IN: Gaussian weight of every column of the window. </param>
+/// <param name="hist"> OUT: Orientation histogram of ETHSIFT_ORI_HIST_BINS bins. </param>
+/// <remarks> rows * cols * 9 flops </remarks>
+void orientation_histogram_scalar(const float * restrict gradient, const float * restrict rotation, int w, int rotation_w, int rows, int cols,
+                                  const float * restrict row_weights, const float * restrict col_weights, float * restrict hist) {
+  float private_hist[ORI_HIST_STRIDE] = {0};
+  const float bin_scale = ETHSIFT_ORI_HIST_BINS * M_1_2PI;
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      const float fbin = rotation[i * rotation_w + j] * bin_scale - 0.5f;
+      const int bin = (int) fbin;
+      const float d_fbin = fbin - bin;
+      const float mw = row_weights[i] * col_weights[j] * gradient[i * w + j];
+      const float dmw = d_fbin * mw;
+      private_hist[bin] += mw - dmw;
+      private_hist[bin + 1] += dmw;
+      inc_read(4, float);
+      inc_mults(4);
+      inc_adds(5);
+    }
+  }
+  fold_private_histograms(private_hist, 1, hist);
+}
+
+/// <summary> 
+/// Orientation histogram accumulation for SSE. Four pixels are binned at a time and every
+/// lane adds into its own histogram, so neighbouring pixels never wait on the same bin.
+/// </summary>
+ETHSIFT_TARGET_SSE
+void orientation_histogram_sse(const float * restrict gradient, const float * restrict rotation, int w, int rotation_w, int rows, int cols,
+                               const float * restrict row_weights, const float * restrict col_weights, float * restrict hist) {
+  float private_hist[4 * ORI_HIST_STRIDE] = {0};
+  const float bin_scale = ETHSIFT_ORI_HIST_BINS * M_1_2PI;
+  const __m128 d_scale = _mm_set1_ps(bin_scale);
+  const __m128 d_half = _mm_set1_ps(0.5f);
+  int32_t bins[4];
+  float low[4], high[4];
+  for (int i = 0; i < rows; i++) {
+    const float *g = gradient + i * w;
+    const float *a = rotation + i * rotation_w;
+    const __m128 d_row_weight = _mm_set1_ps(row_weights[i]);
+    int j;
+    for (j = 0; j < cols - 3; j += 4) {
+      const __m128 fbin = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(a + j), d_scale), d_half);
+      const __m128i bin = _mm_cvttps_epi32(fbin);
+      const __m128 d_fbin = _mm_sub_ps(fbin, _mm_cvtepi32_ps(bin));
+      const __m128 mw = _mm_mul_ps(_mm_mul_ps(d_row_weight, _mm_loadu_ps(col_weights + j)), _mm_loadu_ps(g + j));
+      const __m128 dmw = _mm_mul_ps(d_fbin, mw);
+      _mm_storeu_si128((__m128i *) bins, bin);
+      _mm_storeu_ps(low, _mm_sub_ps(mw, dmw));
+      _mm_storeu_ps(high, dmw);
+      for (int l = 0; l < 4; ++l) {
+        private_hist[l * ORI_HIST_STRIDE + bins[l]] += low[l];
+        private_hist[l * ORI_HIST_STRIDE + bins[l] + 1] += high[l];
+      }
+      inc_read(12, float);
+      inc_mults(16);
+      inc_adds(20);
+    }
+    for (; j < cols; j++) {
+      const float fbin = a[j] * bin_scale - 0.5f;
+      const int bin = (int) fbin;
+      const float d_fbin = fbin - bin;
+      const float mw = row_weights[i] * col_weights[j] * g[j];
+      const float dmw = d_fbin * mw;
+      private_hist[bin] += mw - dmw;
+      private_hist[bin + 1] += dmw;
+      inc_read(3, float);
+      inc_mults(4);
+      inc_adds(5);
+    }
+  }
+  fold_private_histograms(private_hist, 4, hist);
+}
+
+/// <summary> 
+/// Orientation histogram accumulation for AVX2, eight pixels at a time into lane private histograms.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+void orientation_histogram_avx2(const float * restrict gradient, const float * restrict rotation, int w, int rotation_w, int rows, int cols,
+                                const float * restrict row_weights, const float * restrict col_weights, float * restrict hist) {
+  float private_hist[8 * ORI_HIST_STRIDE] = {0};
+  const float bin_scale = ETHSIFT_ORI_HIST_BINS * M_1_2PI;
+  const __m256 d_scale = _mm256_set1_ps(bin_scale);
+  const __m256 d_half = _mm256_set1_ps(0.5f);
+  int32_t bins[8];
+  float low[8], high[8];
+  for (int i = 0; i < rows; i++) {
+    const float *g = gradient + i * w;
+    const float *a = rotation + i * rotation_w;
+    const __m256 d_row_weight = _mm256_set1_ps(row_weights[i]);
+    int j;
+    for (j = 0; j < cols - 7; j += 8) {
+      const __m256 fbin = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(a + j), d_scale), d_half);
+      const __m256i bin = _mm256_cvttps_epi32(fbin);
+      const __m256 d_fbin = _mm256_sub_ps(fbin, _mm256_cvtepi32_ps(bin));
+      const __m256 mw = _mm256_mul_ps(_mm256_mul_ps(d_row_weight, _mm256_loadu_ps(col_weights + j)), _mm256_loadu_ps(g + j));
+      const __m256 dmw = _mm256_mul_ps(d_fbin, mw);
+      _mm256_storeu_si256((__m256i *) bins, bin);
+      _mm256_storeu_ps(low, _mm256_sub_ps(mw, dmw));
+      _mm256_storeu_ps(high, dmw);
+      for (int l = 0; l < 8; ++l) {
+        private_hist[l * ORI_HIST_STRIDE + bins[l]] += low[l];
+        private_hist[l * ORI_HIST_STRIDE + bins[l] + 1] += high[l];
+      }
+      inc_read(24, float);
+      inc_mults(32);
+      inc_adds(40);
+    }
+    for (; j < cols; j++) {
+      const float fbin = a[j] * bin_scale - 0.5f;
+      const int bin = (int) fbin;
+      const float d_fbin = fbin - bin;
+      const float mw = row_weights[i] * col_weights[j] * g[j];
+      const float dmw = d_fbin * mw;
+      private_hist[bin] += mw - dmw;
+      private_hist[bin + 1] += dmw;
+      inc_read(3, float);
+      inc_mults(4);
+      inc_adds(5);
+    }
+  }
+  fold_private_histograms(private_hist, 8, hist);
+}
+
+/// <summary> 
+/// Orientation histogram accumulation for AVX-512. The lane private histograms are updated
+/// with gather and scatter, the lanes never collide since each owns a histogram.
+/// </summary>
+ETHSIFT_TARGET_AVX512
+void orientation_histogram_avx512(const float * restrict gradient, const float * restrict rotation, int w, int rotation_w, int rows, int cols,
+                                  const float * restrict row_weights, const float * restrict col_weights, float * restrict hist) {
+  float private_hist[16 * ORI_HIST_STRIDE] = {0};
+  const __m512 d_scale = _mm512_set1_ps(ETHSIFT_ORI_HIST_BINS * M_1_2PI);
+  const __m512 d_half = _mm512_set1_ps(0.5f);
+  const __m512i d_lane = _mm512_mullo_epi32(_mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0),
+                                            _mm512_set1_epi32(ORI_HIST_STRIDE));
+  const __m512i d_one = _mm512_set1_epi32(1);
+  for (int i = 0; i < rows; i++) {
+    const float *g = gradient + i * w;
+    const float *a = rotation + i * rotation_w;
+    const __m512 d_row_weight = _mm512_set1_ps(row_weights[i]);
+    for (int j = 0; j < cols; j += 16) {
+      const int lanes = internal_min(16, cols - j);
+      const __mmask16 mask = (__mmask16)((1u << lanes) - 1);
+      const __m512 fbin = _mm512_sub_ps(_mm512_mul_ps(_mm512_maskz_loadu_ps(mask, a + j), d_scale), d_half);
+      const __m512i bin = _mm512_cvttps_epi32(fbin);
+      const __m512 d_fbin = _mm512_sub_ps(fbin, _mm512_cvtepi32_ps(bin));
+      const __m512 mw = _mm512_mul_ps(_mm512_mul_ps(d_row_weight, _mm512_maskz_loadu_ps(mask, col_weights + j)),
+                                      _mm512_maskz_loadu_ps(mask, g + j));
+      const __m512 dmw = _mm512_mul_ps(d_fbin, mw);
+      inc_read(3 * lanes, float);
+      inc_mults(4 * lanes);
+      inc_adds(3 * lanes);
+
+      const __m512i index = _mm512_add_epi32(d_lane, bin);
+      __m512 acc = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, index, private_hist, sizeof(float));
+      _mm512_mask_i32scatter_ps(private_hist, mask, index, _mm512_add_ps(acc, _mm512_sub_ps(mw, dmw)), sizeof(float));
+      const __m512i next = _mm512_add_epi32(index, d_one);
+      acc = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, next, private_hist, sizeof(float));
+      _mm512_mask_i32scatter_ps(private_hist, mask, next, _mm512_add_ps(acc, dmw), sizeof(float));
+      inc_adds(2 * lanes);
+    }
+  }
+  fold_private_histograms(private_hist, 16, hist);
+}
+
 /// <summary> 
 /// Compute the histogram for the given keypoints in the image.
 /// </summary>
 /// <param name="gradient"> IN: DOG pyramid. </param>
-/// <param name="rotation"> IN: Rotation pyramid. </param>
+/// <param name="rotation"> IN: Rotation pyramid, or the Gaussian level with ETHSIFT_ORIENTATION_OCTANT. </param>
 /// <param name="keypoint"> IN: Detected Keypoints.
 /// <param name="histogram"> OUT: Histogram of the detected keypoints. </param> 
 /// <returns> max value in the histogram IF computation was successful, ELSE 0. </returns>
-/// <remarks> 11 + (2*win_radius+1)^2 * (18 + EXP) + (bin_count * 10) FLOPs </remarks>
+/// <remarks> 11 + 2*(2*win_radius+1) * (3 + EXP) + (2*win_radius+1)^2 * 9 + (bin_count * 10) FLOPs </remarks>
 int ethsift_compute_orientation_histogram(struct ethsift_image gradient, 
                                           struct ethsift_image rotation, 
                                           struct ethsift_keypoint *keypoint, 
@@ -40,37 +243,46 @@ int ethsift_compute_orientation_histogram(struct ethsift_image gradient,
   const int ie = int_min(h-2, kptr_i+win_radius)-kptr_i;
   const int js = int_max(1, kptc_i-win_radius)-kptc_i;
   const int je = int_min(w-2, kptc_i+win_radius)-kptc_i;
-  // (2*win_radius+1)^2 * (18 + EXP)
-  for (int i = is; i <= ie; i++){
-    const int r = kptr_i + i;
-    for (int j = js; j <= je; j++){
-      const int c = kptc_i + j;
-      const float magnitude = gradient_pixels[r * w + c];
-      const float angle = rotation_pixels[r * w + c];
-      inc_read(2, float);
-
-      const float fbin = angle * bin_count * M_1_2PI;
-      const float w1 = i-d_kptr;
-      const float w2 = j-d_kptc;
-      const float weight = expf((w1*w1 + w2*w2) * exp_factor);
-
-      inc_mults(5);
-      inc_adds(3);
-      // 1 EXP
-
-      const int bin = (int)(fbin - 0.5f); // 1 SUB
-      const float d_fbin = fbin - 0.5f - bin; // 2 SUBs
-      inc_adds(3);
-
-      const float mw = weight * magnitude; // 1 MUL
-      const float dmw = d_fbin * mw;// 1 MUL
-      tmpHist[(bin + bin_count) % bin_count] += mw - dmw; // 1ADD + 1 SUB
-      tmpHist[(bin + 1) % bin_count] += dmw; // 1ADD
-      inc_write(2, float);
+  const int rows = ie - is + 1;
+  const int cols = je - js + 1;
 
+  if (0 < rows && 0 < cols) {
+    // The Gaussian weight is separable, exp(a+b) = exp(a)*exp(b), so only one
+    // exp per row and per column of the window is needed.
+    float row_weights[rows];
+    float col_weights[cols];
+    for (int i = 0; i < rows; i++) {
+      const float w1 = is + i - d_kptr;
+      row_weights[i] = eth_exp_f(w1 * w1 * exp_factor);
+      inc_mults(2);
+      inc_adds(1);
+      inc_write(1, float);
+    }
+    for (int j = 0; j < cols; j++) {
+      const float w2 = js + j - d_kptc;
+      col_weights[j] = eth_exp_f(w2 * w2 * exp_factor);
       inc_mults(2);
-      inc_adds(3);
+      inc_adds(1);
+      inc_write(1, float);
+    }
+    const float *angles = rotation_pixels + (kptr_i + is) * w + kptc_i + js;
+    int angles_w = w;
+    float window_angles[(g_orientation_mode == ETHSIFT_ORIENTATION_OCTANT) ? rows * cols : 1];
+    if (g_orientation_mode == ETHSIFT_ORIENTATION_OCTANT) {
+      // rotation is the Gaussian level, the angles come from its (dx, dy) in the window only.
+      for (int i = 0; i < rows; i++) {
+        const float *g = rotation_pixels + (kptr_i + is + i) * w + kptc_i + js;
+        for (int j = 0; j < cols; j++) {
+          window_angles[i * cols + j] = octant_angle_f(g[j + w] - g[j - w], g[j + 1] - g[j - 1]);
+          inc_read(4, float);
+          inc_adds(2);
+        }
+      }
+      angles = window_angles;
+      angles_w = cols;
     }
+    g_kernels.orientation_histogram(gradient_pixels + (kptr_i + is) * w + kptc_i + js, angles,
+                                    w, angles_w, rows, cols, row_weights, col_weights, tmpHist);
   }
 
   // bin_count * 10 FLOPs
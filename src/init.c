@@ -3,8 +3,91 @@
 float** g_kernel_ptrs;
 int* g_kernel_rads;
 int* g_kernel_sizes;
-float *row_buf;
-float *img_buf;
+uint8_t* g_kernel_symmetric;
+// Blur buffers of the calling thread, those of the thread that ran ethsift_init are kept for good.
+__thread float *row_buf;
+__thread float *img_buf;
+__thread size_t img_buf_size;
+static float *init_img_buf;
+static __thread struct ethsift_pyramids *workspace_pyrs[ETHSIFT_LANES + 1];
+uint32_t g_keypoint_budget = ETHSIFT_BUDGET_SCAN_ORDER;
+uint32_t g_grid_cell_size = 0;
+uint32_t g_grid_max_per_cell = 0;
+uint32_t g_upsample = 0;
+uint32_t g_pyramid_schedule = ETHSIFT_SCHEDULE_SEQUENTIAL;
+uint32_t g_batch_mode = ETHSIFT_BATCH_IMAGES;
+uint32_t g_symmetric_kernels = 0;
+uint32_t g_orientation_mode = ETHSIFT_ORIENTATION_ATAN2;
+uint32_t g_descriptor_mode = ETHSIFT_DESCRIPTOR_WINDOW;
+uint32_t g_math_accuracy = ETHSIFT_ACCURACY_FAST;
+float** g_direct_kernel_ptrs;
+int* g_direct_kernel_rads;
+int* g_direct_kernel_sizes;
+uint8_t* g_direct_kernel_symmetric;
+int16_t** g_fixed_kernel_ptrs;
+uint32_t g_fixed_point = 0;
+float *g_upsample_kernel;
+int g_upsample_kernel_rad;
+int g_upsample_kernel_size;
+int g_upsample_kernel_symmetric;
+uint32_t g_pipeline_count = 0;
+
+/// <summary> 
+/// Test whether kernel[i] == kernel[size - 1 - i] for all taps.
+/// </summary>
+static int taps_symmetric(const float *kernel, uint32_t kernel_size, uint32_t kernel_rad){
+  if(kernel_size != 2 * kernel_rad + 1)
+    return 0;
+  for(uint32_t i = 0; i < kernel_rad; ++i){
+    if(kernel[i] != kernel[2 * kernel_rad - i])
+      return 0;
+  }
+  return 1;
+}
+
+/// <summary> 
+/// Whether the row filters may fold the mirrored taps of the kernel. The kernels of generate_kernels
+/// carry the flag computed when they were generated, other kernels are checked tap by tap.
+/// </summary>
+/// <returns> 1 IF the kernel is symmetric, ELSE 0. </returns>
+int kernel_symmetric(const float *kernel, uint32_t kernel_size, uint32_t kernel_rad){
+  const int gaussian_count = ETHSIFT_INTVLS + 3;
+  for(int i = 0; i < gaussian_count; ++i){
+    if(kernel == g_kernel_ptrs[i]) return g_kernel_symmetric[i];
+    if(kernel == g_direct_kernel_ptrs[i]) return g_direct_kernel_symmetric[i];
+  }
+  if(kernel == g_upsample_kernel) return g_upsample_kernel_symmetric;
+  return taps_symmetric(kernel, kernel_size, kernel_rad);
+}
+
+/// <summary> 
+/// Generate the kernels of the sequential and direct schedules, their fixed point versions and the upsampling kernel.
+/// </summary>
+/// <returns> 1 IF generation was successful, ELSE 0. </returns>
+static int generate_kernels(int layers_count, uint32_t gaussian_count){
+  if(!ethsift_generate_all_kernels(layers_count, gaussian_count, g_kernel_ptrs, g_kernel_rads, g_kernel_sizes)
+     || !ethsift_generate_direct_kernels(layers_count, gaussian_count, g_direct_kernel_ptrs, g_direct_kernel_rads, g_direct_kernel_sizes)
+     || !ethsift_generate_fixed_kernels(g_kernel_ptrs, g_kernel_sizes, gaussian_count, g_fixed_kernel_ptrs))
+    return 0;
+
+  // The upsampled image is assumed to be blurred twice as much as the input already is.
+  const float sigma_pre = 2.0f * ETHSIFT_INIT_SIGMA;
+  const float sigma_i = sqrtf(ETHSIFT_SIGMA * ETHSIFT_SIGMA - sigma_pre * sigma_pre);
+  g_upsample_kernel_rad = (sigma_i * ETHSIFT_GAUSSIAN_FILTER_RADIUS > 1.0f)
+    ? (int)ceilf(sigma_i * ETHSIFT_GAUSSIAN_FILTER_RADIUS) : 1;
+  g_upsample_kernel_size = g_upsample_kernel_rad * 2 + 1;
+  if(posix_memalign((void*)&g_upsample_kernel, ETHSIFT_MEMALIGN, g_upsample_kernel_size*sizeof(float)))
+    return 0;
+  ethsift_generate_gaussian_kernel(g_upsample_kernel, g_upsample_kernel_size, g_upsample_kernel_rad, sigma_i);
+
+  // The row filters look these up instead of comparing the taps for every row.
+  for(uint32_t i = 0; i < gaussian_count; ++i){
+    g_kernel_symmetric[i] = taps_symmetric(g_kernel_ptrs[i], g_kernel_sizes[i], g_kernel_rads[i]);
+    g_direct_kernel_symmetric[i] = taps_symmetric(g_direct_kernel_ptrs[i], g_direct_kernel_sizes[i], g_direct_kernel_rads[i]);
+  }
+  g_upsample_kernel_symmetric = taps_symmetric(g_upsample_kernel, g_upsample_kernel_size, g_upsample_kernel_rad);
+  return 1;
+}
 
 /// <summary> 
 /// Initialize Gaussian Kernels globally.
@@ -22,6 +105,12 @@ int ethsift_init(){
   g_kernel_ptrs = (float**) malloc(sizeof(float*) * gaussian_count);
   g_kernel_rads = (int*) malloc(sizeof(int) * gaussian_count);
   g_kernel_sizes = (int*) malloc(sizeof(int) * gaussian_count);
+  g_kernel_symmetric = (uint8_t*) malloc(sizeof(uint8_t) * gaussian_count);
+  g_direct_kernel_ptrs = (float**) malloc(sizeof(float*) * gaussian_count);
+  g_direct_kernel_rads = (int*) malloc(sizeof(int) * gaussian_count);
+  g_direct_kernel_sizes = (int*) malloc(sizeof(int) * gaussian_count);
+  g_direct_kernel_symmetric = (uint8_t*) malloc(sizeof(uint8_t) * gaussian_count);
+  g_fixed_kernel_ptrs = (int16_t**) malloc(sizeof(int16_t*) * gaussian_count);
 
   // Make sure we fit up to 4K size images, with max kernel size 64.
   if(posix_memalign((void*)&row_buf, ETHSIFT_MEMALIGN, (7680+64)*sizeof(float))
@@ -29,8 +118,214 @@ int ethsift_init(){
     return 0;
   mlock((void*)row_buf, (7680+64)*sizeof(float));
   mlock((void*)img_buf, 7680*4320*sizeof(float));
+  img_buf_size = (size_t)7680*4320;
+  init_img_buf = img_buf;
   
-  ethsift_generate_all_kernels(layers_count, gaussian_count, g_kernel_ptrs, g_kernel_rads, g_kernel_sizes);
+  if(!generate_kernels(layers_count, gaussian_count))
+    return 0;
+
+  ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
   
   return 1;
 }
+
+/// <summary> 
+/// Make sure the blur buffers of the calling thread hold an image of the given number of pixels.
+/// </summary>
+/// <param name="pixels"> IN: Pixels of the largest level that will be blurred, at most 8K. </param>
+/// <returns> 1 IF the buffers are large enough, ELSE 0. </returns>
+int workspace_reserve(size_t pixels){
+  if(!row_buf && posix_memalign((void*)&row_buf, ETHSIFT_MEMALIGN, (7680+64)*sizeof(float))){
+    row_buf = NULL;
+    return 0;
+  }
+  if(pixels <= img_buf_size) return 1;
+  // The buffers of ethsift_init are fixed.
+  if(img_buf && img_buf == init_img_buf) return 0;
+  free(img_buf);
+  img_buf_size = 0;
+  if(posix_memalign((void*)&img_buf, ETHSIFT_MEMALIGN, pixels*sizeof(float))){
+    img_buf = NULL;
+    return 0;
+  }
+  img_buf_size = pixels;
+  return 1;
+}
+
+/// <summary> 
+/// The pyramids kept by the calling thread between images.
+/// </summary>
+/// <param name="slot"> IN: 0 for single images. lanes.c uses slots up to ETHSIFT_LANES, one per lane
+///                    and the last for the interleaved pyramids. </param>
+/// <returns> The pyramids, NULL IF they could not be allocated. </returns>
+struct ethsift_pyramids *workspace_pyramids(uint32_t slot){
+  if(!workspace_pyrs[slot])
+    workspace_pyrs[slot] = calloc(1, sizeof(struct ethsift_pyramids));
+  return workspace_pyrs[slot];
+}
+
+/// <summary> 
+/// Free the scratch memory of the calling thread, apart from the buffers of ethsift_init.
+/// </summary>
+void workspace_release(){
+  for(int i = 0; i <= ETHSIFT_LANES; ++i){
+    if(!workspace_pyrs[i]) continue;
+    pyramids_release(workspace_pyrs[i]);
+    free(workspace_pyrs[i]);
+    workspace_pyrs[i] = NULL;
+  }
+  if(img_buf == init_img_buf) return;
+  free(row_buf);
+  free(img_buf);
+  row_buf = NULL;
+  img_buf = NULL;
+  img_buf_size = 0;
+}
+
+/// <summary> 
+/// Select how keypoint detection behaves once the keypoint array is full.
+/// </summary>
+/// <param name="mode"> IN: One of the ETHSIFT_BUDGET_* modes. </param>
+/// <returns> 1 IF the mode is valid, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_set_keypoint_budget(uint32_t mode){
+  if(mode > ETHSIFT_BUDGET_STRONGEST)
+    return 0;
+  g_keypoint_budget = mode;
+  return 1;
+}
+
+/// <summary> 
+/// Limit the number of keypoints per grid cell to spread keypoints across the image.
+/// </summary>
+/// <param name="cell_size"> IN: Edge length of a grid cell in pixels of the input image. 0 disables the grid. </param>
+/// <param name="max_per_cell"> IN: How many keypoints a cell keeps at most, strongest extrema first. </param>
+/// <returns> 1 IF the grid is valid, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_set_keypoint_grid(uint32_t cell_size, uint32_t max_per_cell){
+  if(cell_size != 0 && max_per_cell == 0)
+    return 0;
+  g_grid_cell_size = cell_size;
+  g_grid_max_per_cell = max_per_cell;
+  return 1;
+}
+
+/// <summary> 
+/// Double the size of the first octave, like ezsift's SIFT_IMG_DBL.
+/// </summary>
+/// <param name="enable"> IN: 1 to upsample the input by 2x before blurring, 0 to disable. </param>
+/// <returns> 1 IF the setting is valid, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_set_upsample(uint32_t enable){
+  if(enable > 1)
+    return 0;
+  g_upsample = enable;
+  return 1;
+}
+
+/// <summary> 
+/// Select how the levels of an octave of the Gaussian pyramid are computed.
+/// </summary>
+/// <param name="schedule"> IN: One of the ETHSIFT_SCHEDULE_* values. </param>
+/// <returns> 1 IF the schedule is valid, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_set_pyramid_schedule(uint32_t schedule){
+  if(schedule > ETHSIFT_SCHEDULE_DIRECT)
+    return 0;
+  g_pyramid_schedule = schedule;
+  return 1;
+}
+
+/// <summary> 
+/// Build the Gaussian and DoG pyramids of 8-bit images in int16 fixed point.
+/// </summary>
+/// <param name="enable"> IN: 1 to use the fixed point pyramid for 8-bit images, 0 to disable. </param>
+/// <returns> 1 IF the setting is valid, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_set_fixed_point(uint32_t enable){
+  if(enable > 1)
+    return 0;
+  g_fixed_point = enable;
+  return 1;
+}
+
+/// <summary> 
+/// Select how gradient orientations are computed for the orientation histogram and descriptors.
+/// </summary>
+/// <param name="mode"> IN: One of the ETHSIFT_ORIENTATION_* values. </param>
+/// <returns> 1 IF the mode is valid, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_set_orientation_mode(uint32_t mode){
+  if(mode > ETHSIFT_ORIENTATION_OCTANT)
+    return 0;
+  g_orientation_mode = mode;
+  return 1;
+}
+
+/// <summary> 
+/// Select how the descriptors of the keypoints are sampled.
+/// </summary>
+/// <param name="mode"> IN: One of the ETHSIFT_DESCRIPTOR_* values. </param>
+/// <returns> 1 IF the mode is valid, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_set_descriptor_mode(uint32_t mode){
+  if(mode > ETHSIFT_DESCRIPTOR_PATCH)
+    return 0;
+  g_descriptor_mode = mode;
+  return 1;
+}
+
+/// <summary> 
+/// Select how ethsift_compute_keypoints_batch spreads its images.
+/// </summary>
+/// <param name="mode"> IN: One of the ETHSIFT_BATCH_* modes. </param>
+/// <returns> 1 IF the mode is valid, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_set_batch_mode(uint32_t mode){
+  if(mode > ETHSIFT_BATCH_LANES)
+    return 0;
+  g_batch_mode = mode;
+  return 1;
+}
+
+/// <summary> 
+/// Select the accuracy tier of the math approximations.
+/// </summary>
+/// <param name="accuracy"> IN: One of the ETHSIFT_ACCURACY_* values. </param>
+/// <returns> 1 IF the tier is valid, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_set_math_accuracy(uint32_t accuracy){
+  if(accuracy > ETHSIFT_ACCURACY_EXACT)
+    return 0;
+  g_math_accuracy = accuracy;
+  return 1;
+}
+
+/// <summary> 
+/// Generate exactly symmetric Gaussian kernels instead of ezsift compatible ones.
+/// </summary>
+/// <param name="enable"> IN: 1 for symmetric kernels, 0 for ezsift compatible ones. </param>
+/// <returns> 1 IF the kernels were regenerated, ELSE 0 IF the setting is invalid or a pipeline exists. </returns>
+/// <remarks> Regenerates all kernels </remarks>
+int ethsift_set_symmetric_kernels(uint32_t enable){
+  if(enable > 1)
+    return 0;
+  if(enable == g_symmetric_kernels)
+    return 1;
+  // The kernels are freed and replaced without locking. Pool workers only read them within a call on
+  // the calling thread, but the stage threads of a pipeline do so at any time.
+  if(__atomic_load_n(&g_pipeline_count, __ATOMIC_ACQUIRE))
+    return 0;
+  const int layers_count = ETHSIFT_INTVLS;
+  const int gaussian_count = layers_count + 3;
+
+  free(g_kernel_ptrs[0]);
+  ethsift_free_kernels(g_kernel_ptrs, gaussian_count);
+  ethsift_free_kernels(g_direct_kernel_ptrs, gaussian_count);
+  for(int i = 0; i < gaussian_count; ++i)
+    free(g_fixed_kernel_ptrs[i]);
+  free(g_upsample_kernel);
+
+  g_symmetric_kernels = enable;
+  return generate_kernels(layers_count, gaussian_count);
+}
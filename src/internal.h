@@ -9,16 +9,223 @@
 #include "flop_counters.h"
 #include <immintrin.h>
 
+// Instruction set targets for kernels that are selected at runtime.
+#define ETHSIFT_TARGET_SSE __attribute__((target("sse4.2")))
+#define ETHSIFT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define ETHSIFT_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#define ETHSIFT_TARGET_F16C __attribute__((target("f16c,avx")))
+
+// Sample window of a keypoint for the descriptor histogram, rows top..bottom and columns
+// left..right relative to the nearest pixel of the keypoint.
+struct descriptor_window{
+  const float *gradient;
+  // Rotation level, or the Gaussian level with ETHSIFT_ORIENTATION_OCTANT.
+  const float *rotation;
+  int w;
+  int kptr_i, kptc_i;
+  int top, bottom, left, right;
+  float d_kptr, d_kptc;
+  // Keypoint orientation, sin and cos are scaled by the inverse subregion width.
+  float sin_t, cos_t;
+  float kpt_ori;
+  int octant;
+};
+
+// Placement of the resampled patch of a keypoint, see ethsift_extract_descriptor_patch.
+struct descriptor_patch{
+  // Position of the first border sample in the Gaussian level.
+  float r0, c0;
+  // Offset in the level from one patch row, and from one patch column, to the next.
+  float row_step_r, row_step_c;
+  float col_step_r, col_step_c;
+  // Gaussian weight, histogram cell and offset within the cell of the samples along either axis.
+  const float *weights;
+  const int *cells;
+  const float *fracs;
+};
+
+// Window samples gathered once for keypoints that differ only in orientation, relative to the
+// keypoint position, with the Gaussian-weighted magnitude and the unrotated angle of each.
+struct descriptor_samples{
+  float *rr, *cc;
+  float *gm, *angle;
+  uint32_t count;
+  uint32_t capacity;
+};
+
+// Kernels that exist in one variant per backend, see dispatch.c.
+struct ethsift_kernels{
+  uint32_t backend;
+  void (*filter_row_transpose)(float * restrict output, const float * restrict src, int r, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int symmetric);
+  void (*convert_row)(float * restrict dst, const void * restrict row, int w, uint32_t format, float range);
+  int (*difference_pyramid)(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image differences[], uint32_t layers, uint32_t octave_count);
+  int (*gradient_pyramid)(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image gradients[], struct ethsift_image rotations[], uint32_t layers, uint32_t octave_count);
+  int (*magnitude_pyramid)(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image gradients[], uint32_t layers, uint32_t octave_count);
+  void (*normalize_descriptor)(float *bins);
+  void (*downscale_half)(const float * restrict src, int src_w, float * restrict dst, int dst_w, int dst_h);
+  void (*orientation_histogram)(const float * restrict gradient, const float * restrict rotation, int w, int rotation_w, int rows, int cols, const float * restrict row_weights, const float * restrict col_weights, float * restrict hist);
+  void (*filter_row_transpose_s16)(int16_t * restrict output, const int16_t * restrict src, int r, int w, int h, const int16_t * restrict kernel, uint32_t kernel_size);
+  void (*descriptor_histogram)(const struct descriptor_window *window, float *histBin);
+  void (*descriptor_patch)(const float *image, int w, int h, const struct descriptor_patch *patch, float *hist);
+  void (*window_samples)(const struct descriptor_window *window, struct descriptor_samples *samples);
+  void (*sample_histogram)(const struct descriptor_samples *samples, float sin_t, float cos_t, float kpt_ori, float *histBin);
+  void (*math_array)(uint32_t function, const float *x, const float *y, float *out, uint32_t count);
+  float (*row_sad)(const void * restrict a, const void * restrict b, int w, uint32_t format);
+};
+
+extern struct ethsift_kernels g_kernels;
+
+void filter_row_transpose_scalar(float * restrict output, const float * restrict src, int r, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int symmetric);
+void filter_row_transpose_sse(float * restrict output, const float * restrict src, int r, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int symmetric);
+void filter_row_transpose_avx2(float * restrict output, const float * restrict src, int r, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int symmetric);
+void filter_row_transpose_avx512(float * restrict output, const float * restrict src, int r, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad, int symmetric);
+void filter_row_transpose_avx2_generic(float * restrict output, const float * restrict src, int r, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad);
+void filter_row_transpose_avx512_generic(float * restrict output, const float * restrict src, int r, int w, int h, float * restrict kernel, uint32_t kernel_size, uint32_t kernel_rad);
+void convert_row_scalar(float * restrict dst, const void * restrict row, int w, uint32_t format, float range);
+void convert_row_sse(float * restrict dst, const void * restrict row, int w, uint32_t format, float range);
+void convert_row_avx2(float * restrict dst, const void * restrict row, int w, uint32_t format, float range);
+int difference_pyramid_scalar(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image differences[], uint32_t layers, uint32_t octave_count);
+int difference_pyramid_sse(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image differences[], uint32_t layers, uint32_t octave_count);
+int difference_pyramid_avx2(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image differences[], uint32_t layers, uint32_t octave_count);
+int difference_pyramid_avx512(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image differences[], uint32_t layers, uint32_t octave_count);
+int gradient_pyramid_scalar(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image gradients[], struct ethsift_image rotations[], uint32_t layers, uint32_t octave_count);
+int gradient_pyramid_sse(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image gradients[], struct ethsift_image rotations[], uint32_t layers, uint32_t octave_count);
+int gradient_pyramid_avx2(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image gradients[], struct ethsift_image rotations[], uint32_t layers, uint32_t octave_count);
+int gradient_pyramid_avx512(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image gradients[], struct ethsift_image rotations[], uint32_t layers, uint32_t octave_count);
+int magnitude_pyramid_scalar(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image gradients[], uint32_t layers, uint32_t octave_count);
+int magnitude_pyramid_sse(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image gradients[], uint32_t layers, uint32_t octave_count);
+int magnitude_pyramid_avx2(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image gradients[], uint32_t layers, uint32_t octave_count);
+int magnitude_pyramid_avx512(struct ethsift_image gaussians[], uint32_t gaussian_count, struct ethsift_image gradients[], uint32_t layers, uint32_t octave_count);
+void normalize_descriptor_scalar(float *bins);
+void normalize_descriptor_sse(float *bins);
+void normalize_descriptor_avx2(float *bins);
+void normalize_descriptor_avx512(float *bins);
+void downscale_half_scalar(const float * restrict src, int src_w, float * restrict dst, int dst_w, int dst_h);
+void downscale_half_sse(const float * restrict src, int src_w, float * restrict dst, int dst_w, int dst_h);
+void downscale_half_avx2(const float * restrict src, int src_w, float * restrict dst, int dst_w, int dst_h);
+void orientation_histogram_scalar(const float * restrict gradient, const float * restrict rotation, int w, int rotation_w, int rows, int cols, const float * restrict row_weights, const float * restrict col_weights, float * restrict hist);
+void orientation_histogram_sse(const float * restrict gradient, const float * restrict rotation, int w, int rotation_w, int rows, int cols, const float * restrict row_weights, const float * restrict col_weights, float * restrict hist);
+void orientation_histogram_avx2(const float * restrict gradient, const float * restrict rotation, int w, int rotation_w, int rows, int cols, const float * restrict row_weights, const float * restrict col_weights, float * restrict hist);
+void orientation_histogram_avx512(const float * restrict gradient, const float * restrict rotation, int w, int rotation_w, int rows, int cols, const float * restrict row_weights, const float * restrict col_weights, float * restrict hist);
+void filter_row_transpose_s16_scalar(int16_t * restrict output, const int16_t * restrict src, int r, int w, int h, const int16_t * restrict kernel, uint32_t kernel_size);
+void filter_row_transpose_s16_sse(int16_t * restrict output, const int16_t * restrict src, int r, int w, int h, const int16_t * restrict kernel, uint32_t kernel_size);
+void filter_row_transpose_s16_avx2(int16_t * restrict output, const int16_t * restrict src, int r, int w, int h, const int16_t * restrict kernel, uint32_t kernel_size);
+void descriptor_histogram_scalar(const struct descriptor_window *window, float *histBin);
+void descriptor_histogram_avx2(const struct descriptor_window *window, float *histBin);
+void descriptor_patch_scalar(const float *image, int w, int h, const struct descriptor_patch *patch, float *hist);
+void descriptor_patch_avx2(const float *image, int w, int h, const struct descriptor_patch *patch, float *hist);
+void window_samples_scalar(const struct descriptor_window *window, struct descriptor_samples *samples);
+void window_samples_avx2(const struct descriptor_window *window, struct descriptor_samples *samples);
+void sample_histogram_scalar(const struct descriptor_samples *samples, float sin_t, float cos_t, float kpt_ori, float *histBin);
+void sample_histogram_avx2(const struct descriptor_samples *samples, float sin_t, float cos_t, float kpt_ori, float *histBin);
+void math_array_scalar(uint32_t function, const float *x, const float *y, float *out, uint32_t count);
+void math_array_avx2(uint32_t function, const float *x, const float *y, float *out, uint32_t count);
+void math_array_avx512(uint32_t function, const float *x, const float *y, float *out, uint32_t count);
+float row_sad_scalar(const void * restrict a, const void * restrict b, int w, uint32_t format);
+float row_sad_sse(const void * restrict a, const void * restrict b, int w, uint32_t format);
+float row_sad_avx2(const void * restrict a, const void * restrict b, int w, uint32_t format);
+
 extern float** g_kernel_ptrs;
 extern int* g_kernel_rads;
 extern int* g_kernel_sizes;
-extern float *row_buf;
-extern float *img_buf;
+extern uint8_t* g_kernel_symmetric;
+extern __thread float *row_buf;
+extern __thread float *img_buf;
+extern __thread size_t img_buf_size;
+extern uint32_t g_keypoint_budget;
+extern uint32_t g_grid_cell_size;
+extern uint32_t g_grid_max_per_cell;
+extern uint32_t g_upsample;
+extern uint32_t g_symmetric_kernels;
+extern uint32_t g_orientation_mode;
+extern uint32_t g_descriptor_mode;
+extern uint32_t g_math_accuracy;
+extern uint32_t g_pyramid_schedule;
+extern uint32_t g_batch_mode;
+extern float** g_direct_kernel_ptrs;
+extern int* g_direct_kernel_rads;
+extern int* g_direct_kernel_sizes;
+extern uint8_t* g_direct_kernel_symmetric;
+extern int16_t** g_fixed_kernel_ptrs;
+extern uint32_t g_fixed_point;
+extern float *g_upsample_kernel;
+extern int g_upsample_kernel_rad;
+extern int g_upsample_kernel_size;
+extern int g_upsample_kernel_symmetric;
+// Pipelines that exist, their stage threads read the kernels at any time.
+extern uint32_t g_pipeline_count;
+// Whether the row filters may fold the mirrored taps of a kernel, see init.c.
+int kernel_symmetric(const float *kernel, uint32_t kernel_size, uint32_t kernel_rad);
+
+
+// Run task(arg, index) for every index below count on the thread pool, see thread_pool.c.
+void thread_pool_run(void (*task)(void *arg, uint32_t index), void *arg, uint32_t count);
+uint32_t thread_pool_size();
+void thread_pool_keep_serial();
+
+// Restricts keypoint detection to a region of the input image.
+struct detect_region{
+  // Position of the pyramid base image within the input image.
+  uint32_t offset_x, offset_y;
+  // Accepted rectangle in input image coordinates, end exclusive.
+  uint32_t x0, y0, x1, y1;
+  // Optional mask over the input image, extrema on zero entries are skipped.
+  const uint8_t *mask;
+  uint32_t mask_stride;
+};
 
+int ethsift_detect_keypoints_region(struct ethsift_image differences[], struct ethsift_image gradients[], struct ethsift_image rotations[], uint32_t octave_count, uint32_t gaussian_count, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count, const struct detect_region *region);
+
+// Pyramids of one image. The levels of all of them share one block, which is kept and laid out
+// again for the next image as long as that fits.
+struct ethsift_pyramids{
+  struct ethsift_image gaussians[ETHSIFT_MAX_OCTAVES * (ETHSIFT_INTVLS + 3)];
+  struct ethsift_image differences[ETHSIFT_MAX_OCTAVES * (ETHSIFT_INTVLS + 2)];
+  struct ethsift_image gradients[ETHSIFT_MAX_OCTAVES * (ETHSIFT_INTVLS + 3)];
+  struct ethsift_image rotations[ETHSIFT_MAX_OCTAVES * (ETHSIFT_INTVLS + 3)];
+  float *pixels;
+  size_t capacity;
+};
+
+size_t pyramid_size(uint32_t ref_width, uint32_t ref_height, uint32_t layer_count, uint32_t image_per_layer_count);
+float *layout_pyramid(struct ethsift_image pyramid[], float *pixels, uint32_t ref_width, uint32_t ref_height, uint32_t layer_count, uint32_t image_per_layer_count, uint32_t lanes);
+int pyramids_reserve(struct ethsift_pyramids *pyramids, uint32_t ref_width, uint32_t ref_height, uint32_t octave_count, uint32_t rotations, uint32_t lanes);
+void pyramids_release(struct ethsift_pyramids *pyramids);
+
+// Scratch memory of the calling thread, see init.c. The blur buffers are allocated by ethsift_init
+// for the thread that calls it, and on first use for any other thread.
+int workspace_reserve(size_t pixels);
+struct ethsift_pyramids *workspace_pyramids(uint32_t slot);
+void workspace_release();
+
+// Interleaved pyramids of ETHSIFT_LANES images of the same size, see lanes.c.
+int lanes_supported(const struct ethsift_image_view images[]);
+int compute_keypoints_lanes(const struct ethsift_image_view images[], struct ethsift_keypoint *keypoints[], uint32_t keypoint_counts[]);
+
+// Build all pyramids of the image like ethsift_compute_keypoints does, rotations may be NULL.
+int ethsift_build_pyramids(struct ethsift_image_view image, uint32_t octave_count, struct ethsift_image gaussians[], struct ethsift_image differences[], struct ethsift_image gradients[], struct ethsift_image rotations[]);
+int build_image_pyramids(struct ethsift_image_view image, struct ethsift_pyramids *pyramids, uint32_t *octave_count);
+void ethsift_describe_pyramids(struct ethsift_pyramids *pyramids, uint32_t octave_count, const struct detect_region *region, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count);
+
+// Upsample the image by 2x bilinearly while blurring it, output is twice the size of the image.
+int ethsift_apply_kernel_upsample(struct ethsift_image_view image, float *kernel, uint32_t kernel_size, uint32_t kernel_rad, struct ethsift_image output);
+
+// Blur the image with each of the kernels in a single pass over its rows. If half.pixels is set, the
+// result of the kernel at index decimate is also written decimated to half.
+int ethsift_apply_kernels_direct(struct ethsift_image image, float **kernels, int kernel_sizes[], int kernel_rads[], struct ethsift_image outputs[], uint32_t count, uint32_t decimate, struct ethsift_image half);
+
+// Quantise the float kernels to Q0.15 for the fixed point pyramid.
+int ethsift_generate_fixed_kernels(float **kernel_ptrs, int kernel_sizes[], uint32_t gaussian_count, int16_t **fixed_ptrs);
+
+// Blur the image and additionally write every second pixel of every second row of the result to half.
+int ethsift_apply_kernel_decimate(struct ethsift_image image, float *kernel, uint32_t kernel_size, uint32_t kernel_rad, struct ethsift_image output, struct ethsift_image half);
 
 #define internal_max(a,b) (((a) > (b)) ? (a) : (b))
 #define internal_min(a,b) (((a) < (b)) ? (a) : (b))
 
+// Scale pyramid coordinates of an octave to input image coordinates.
+#define octave_to_input(v, octave) (((v) << (octave)) >> g_upsample)
+
 // Wrap image pixel access. Note this does not handle border conditions!
 static inline float pixel(struct ethsift_image image, uint32_t x, uint32_t y){
   return image.pixels[image.width*y+x];
@@ -42,172 +249,44 @@ static inline float get_pixel_f(float *imageData, int w, int h, int r, int c)
     return imageData[r_mod * w + c_mod];
 }
 
-// MATH
-#define M_TWOPI 6.283185307179586f
-#define M_1_2PI 0.15915494309189535f
-#define M_PI_FRAC4 0.785398163397448f
-#define M_THREEPI_FRAC4 2.356194490192345f
-//#define M_SQRT2 1.414213562373095f
-#define EPSILON_F 1.19209290E-07F
-
-/// <summary> 
-/// Calculates atan2 "in a fast" manner
-/// </summary>
-/// <param name="y"> IN: first input val. </param>
-/// <param name="x"> IN: second input val. </param> 
-/// <returns> atan2 value of y and x. </returns>
-static inline float fast_atan2_f(float y, float x)
-{
-    //PT1
-    float angle, r;
-    float const c3 = 0.1821F;
-    float const c1 = 0.9675F;
-    float abs_y = fabsf(y) + EPSILON_F;
-    inc_adds(1);
-    //PT2
-    if (x >= 0) {
-        r = (x - abs_y) / (x + abs_y);
-        angle = M_PI_FRAC4;
-        inc_adds(2);
-        inc_div(1);
-    }
-    else {
-        r = (x + abs_y) / (abs_y - x);
-        angle = M_THREEPI_FRAC4;
-        inc_adds(2);
-        inc_div(1);
-    }
-    angle += (c3 * r * r - c1) * r;
-    inc_adds(2);
-    inc_mults(3);
-    //PT3
-    if (y < 0) {
-        inc_adds(1);
-        return M_TWOPI - angle;
-    } else {
-        return angle;
-    }
-    // return (y < 0) ? M_TWOPI - angle : angle;
+static inline int int_max(int a, int b) {
+  return a >= b ? a : b;
 }
 
+static inline int int_min(int a, int b) {
+  return a <= b ? a : b;
+}
 
-/// <summary> 
-/// Calculates atan2 with intel intrinsics
-/// </summary>
-/// <param name="y"> IN: first input vector. </param>
-/// <param name="x"> IN: second input vector. </param> 
-/// <returns> __mm256 float vector which is the atan2 value of y and x. </returns>
-static inline void eth_mm256_atan2_ps(__m256* y, __m256* x, __m256* dst)
-{
-    //PT1
-    __m256 angle, r;
-    __m256 c3 = _mm256_set1_ps(0.1821f);
-    __m256 c1 = _mm256_set1_ps(-0.9675f);
-    __m256 zeros = _mm256_set1_ps(-0.000001);
-    __m256 ones = _mm256_set1_ps(1.0);
-    __m256 twos = _mm256_set1_ps(2.0);
-    __m256 threes = _mm256_set1_ps(3.0);
-    __m256 minus_ones = _mm256_set1_ps(-1.0);
-    __m256 pi_frac4 = _mm256_set1_ps(M_PI_FRAC4);
-    __m256 twopi = _mm256_set1_ps(M_TWOPI);
-
-    // vars leading up to abs_mask
-    __m256 mask_geq_y = _mm256_cmp_ps(*y, zeros, _CMP_GE_OQ);    
-    __m256 mask_lt_y = _mm256_cmp_ps(*y, zeros, _CMP_LE_OQ);
-    __m256 zero_or_one = _mm256_and_ps(mask_geq_y, ones);
-    __m256 zero_or_minusone = _mm256_and_ps(mask_lt_y, minus_ones);
-
-
-    __m256 abs_mask_y = _mm256_add_ps(zero_or_one, zero_or_minusone);
-    __m256 epsilon = _mm256_set1_ps(EPSILON_F);
-    __m256 abs_y = _mm256_fmadd_ps(abs_mask_y, *y, epsilon);
-    inc_adds(8);
-        
-    //PT2
-    __m256 mask_geq = _mm256_cmp_ps(*x, zeros, _CMP_GE_OQ);    
-    __m256 mask_lt = _mm256_cmp_ps(*x, zeros, _CMP_LE_OQ);
-    zero_or_one = _mm256_and_ps(mask_lt, ones);
-    zero_or_minusone = _mm256_and_ps(mask_geq, minus_ones);
-
-    __m256 dividend_mask = _mm256_add_ps(zero_or_one, zero_or_minusone);
-    __m256 divisor_mask = _mm256_mul_ps(dividend_mask, minus_ones);
-
-    __m256 angle_zero_or_one = _mm256_and_ps(mask_geq, ones);
-    __m256 angle_zero_or_three = _mm256_and_ps(mask_lt, threes);
-    __m256 angle_mask = _mm256_add_ps(angle_zero_or_one, angle_zero_or_three);
-
-    __m256 x_lt_zero = _mm256_add_ps(zero_or_one, zero_or_minusone); //TODO: write -1.f where x >= 0, 1.f where x < 0
-
-    __m256 dividend = _mm256_fmadd_ps(dividend_mask, abs_y, *x);
-    __m256 divisor = _mm256_fmadd_ps(divisor_mask, *x, abs_y);
-    r = _mm256_div_ps(dividend, divisor);
-    angle = _mm256_mul_ps(angle_mask, pi_frac4);
-    
-    inc_adds(16);
-    inc_div(8);
-
-    __m256 r_squared = _mm256_mul_ps(r, r);
-    __m256 t_ang = _mm256_fmadd_ps(c3, r_squared, c1);
-    angle = _mm256_fmadd_ps(t_ang, r, angle);
-    
-    inc_adds(16);
-    inc_mults(24);
-    
-    //PT3
-    __m256 twoangle = _mm256_mul_ps(twos, angle);
-    __m256 return_mask_twopi = _mm256_and_ps(mask_lt_y, twopi);
-    __m256 return_mask_twoangle = _mm256_and_ps(mask_geq_y, twoangle);
-    __m256 return_mask = _mm256_add_ps(return_mask_twopi, return_mask_twoangle);
-    inc_adds(8);
-    *dst = _mm256_sub_ps(return_mask, angle);
+static inline float float_min(float a, float b) {
+  return a < b ? a : b;
 }
 
+static inline float float_max(float a, float b) {
+  return a > b ? a : b;
+}
 
 /// <summary> 
-/// Calculates the inverted square-root of x ( 1/sqrt(x) ).
+/// Largest sample value of a borrowed image, which convert_row maps to 255.
 /// </summary>
-/// <param name="x"> IN: Value to get the inverted square-root of. </param>
-/// <returns> The inverted square-root of x. </returns>
-static inline float fast_resqrt_f(float x)
-{
-    // 32-bit version
-    union {
-        float x;
-        int i;
-    } u;
-
-    float xhalf = (float)0.5 * x;
-
-    // convert floating point value in RAW integer
-    u.x = x;
-
-    // gives initial guess y0
-    u.i = 0x5f3759df - (u.i >> 1);
-
-    // two Newton steps
-    u.x = u.x * ((float)1.5 - xhalf * u.x * u.x);
-    u.x = u.x * ((float)1.5 - xhalf * u.x * u.x);
-    return u.x;
+/// <param name="view"> IN: The image. </param>
+/// <returns> 2^bits - 1 for ETHSIFT_FORMAT_U16, ELSE 255. </returns>
+static inline float view_range(struct ethsift_image_view view) {
+  const uint32_t bits = (view.bits == 0 || 16 < view.bits) ? 16 : view.bits;
+  return (view.format == ETHSIFT_FORMAT_U16) ? (float) ((1u << bits) - 1) : 255.0f;
 }
 
 /// <summary> 
-/// Calculate the squareroot of x.
+/// Test whether an image fits the blur buffers, which are sized for 8K images, once its first
+/// octave is doubled by g_upsample. The column pass copies whole columns into row_buf, so the
+/// height is bounded like the width. Checked in size_t so that huge sizes cannot wrap around.
 /// </summary>
-/// <param name="x"> IN: Value to get the square root of. </param>
-/// <returns> The square-root of x. </returns>
-static inline float fast_sqrt_f(float x)
-{
-    return (x < 1e-8) ? 0 : x * fast_resqrt_f(x);
-}
-
-static inline int int_max(int a, int b) {
-  return a >= b ? a : b;
+/// <param name="width"> IN: Width of the input image. </param>
+/// <param name="height"> IN: Height of the input image. </param>
+/// <returns> 1 IF the pyramids of the image can be built, ELSE 0. </returns>
+static inline int fits_blur_buffers(uint32_t width, uint32_t height) {
+  const size_t wide_width = (size_t) width << g_upsample;
+  const size_t wide_height = (size_t) height << g_upsample;
+  return wide_width <= 7680 && wide_height <= 7680 && wide_width * wide_height <= (size_t) 7680*4320;
 }
 
-static inline int int_min(int a, int b) {
-  return a <= b ? a : b;
-}
-
-static inline float float_min(float a, float b) {
-  return a < b ? a : b;
-}
+#include "vector_math.h"
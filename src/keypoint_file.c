@@ -0,0 +1,337 @@
+#include "internal.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Layout of a keypoint file, all little-endian:
+//   header       64 bytes, see struct file_header
+//   geometry     one array per field of the keypoints, in the order of struct ethsift_keypoint,
+//                each padded to ETHSIFT_KEYPOINT_FILE_ALIGN bytes
+//   descriptors  keypoint_count descriptors of DESCRIPTORS values in the stored format
+// All blocks start on ETHSIFT_KEYPOINT_FILE_ALIGN bytes, so a mapped descriptor block can go to
+// vector code as it is.
+
+#define GEOMETRY_FIELDS 11
+
+struct file_header{
+  char magic[8];
+  uint32_t version;
+  uint32_t format;
+  uint64_t keypoint_count;
+  uint32_t descriptor_length;
+  uint32_t geometry_fields;
+  uint64_t geometry_offset;
+  uint64_t descriptor_offset;
+  uint8_t reserved[16];
+};
+
+static const char file_magic[8] = "ETHSKPT";
+
+static uint64_t align_up(uint64_t size){
+  return (size + ETHSIFT_KEYPOINT_FILE_ALIGN - 1) & ~(uint64_t) (ETHSIFT_KEYPOINT_FILE_ALIGN - 1);
+}
+
+static uint32_t descriptor_size(uint32_t format){
+  return DESCRIPTORS * ((format == ETHSIFT_STORE_U8) ? 1 : (format == ETHSIFT_STORE_F16) ? 2 : 4);
+}
+
+/// <summary>
+/// Convert a float to half precision, rounding to nearest even like F16C does.
+/// </summary>
+static uint16_t float_to_half(float value){
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const uint32_t sign = (bits >> 16) & 0x8000;
+  const uint32_t abs = bits & 0x7fffffff;
+  // Infinity and NaN, keeping NaNs quiet.
+  if (0x7f800000 <= abs)
+    return sign | 0x7c00 | ((0x7f800000 < abs) ? 0x200 : 0);
+  // 65520 and above round to infinity.
+  if (0x477ff000 <= abs)
+    return sign | 0x7c00;
+  // Below 2^-14 the result is subnormal, at most half of the smallest one rounds to zero.
+  if (abs < 0x38800000) {
+    if (abs <= 0x33000000)
+      return sign;
+    const uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+    const uint32_t shift = 126 - (abs >> 23);
+    uint32_t half = mantissa >> shift;
+    const uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+    if (halfway < rest || (rest == halfway && (half & 1)))
+      half++;
+    return sign | half;
+  }
+  // Rebias the exponent, a carry out of the mantissa moves into it.
+  uint32_t half = (abs >> 13) - ((127 - 15) << 10);
+  const uint32_t rest = abs & 0x1fff;
+  if (0x1000 < rest || (rest == 0x1000 && (half & 1)))
+    half++;
+  return sign | half;
+}
+
+static float half_to_float(uint16_t half){
+  const uint32_t sign = (uint32_t) (half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1f, mantissa = half & 0x3ff, bits;
+  if (exponent == 0x1f) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent) {
+    bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  } else if (mantissa) {
+    // Subnormal, normalise it for single precision.
+    exponent = 127 - 14;
+    while (!(mantissa & 0x400)) {
+      mantissa <<= 1;
+      exponent--;
+    }
+    bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+  } else {
+    bits = sign;
+  }
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+ETHSIFT_TARGET_F16C
+static void descriptor_to_half_f16c(const float *descriptor, uint16_t *out){
+  for (int i = 0; i < DESCRIPTORS; i += 8)
+    _mm_storeu_si128((__m128i *) (out + i), _mm256_cvtps_ph(_mm256_loadu_ps(descriptor + i), _MM_FROUND_TO_NEAREST_INT));
+}
+
+ETHSIFT_TARGET_F16C
+static void descriptor_from_half_f16c(const uint16_t *in, float *descriptor){
+  for (int i = 0; i < DESCRIPTORS; i += 8)
+    _mm256_storeu_ps(descriptor + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (in + i))));
+}
+
+/// <summary>
+/// Whether the half precision conversions can use F16C. It comes with every AVX2 CPU, the scalar
+/// backend keeps to the portable code.
+/// </summary>
+static int use_f16c(){
+  return ETHSIFT_BACKEND_AVX2 <= ethsift_get_backend() && __builtin_cpu_supports("f16c");
+}
+
+/// <summary>
+/// Store a descriptor in the format of a keypoint file.
+/// </summary>
+static void encode_descriptor(const float *descriptor, uint32_t format, int f16c, void *out){
+  if (format == ETHSIFT_STORE_F32) {
+    memcpy(out, descriptor, DESCRIPTORS * sizeof(float));
+  } else if (format == ETHSIFT_STORE_U8) {
+    // The bins are already scaled to the integer range, see ETHSIFT_INT_DESCR_FCTR.
+    uint8_t *bytes = out;
+    for (int i = 0; i < DESCRIPTORS; ++i)
+      bytes[i] = (uint8_t) float_min(255.0f, float_max(0.0f, descriptor[i] + 0.5f));
+  } else if (f16c) {
+    descriptor_to_half_f16c(descriptor, out);
+  } else {
+    uint16_t *halves = out;
+    for (int i = 0; i < DESCRIPTORS; ++i)
+      halves[i] = float_to_half(descriptor[i]);
+  }
+}
+
+static void decode_descriptor(const void *in, uint32_t format, int f16c, float *descriptor){
+  if (format == ETHSIFT_STORE_F32) {
+    memcpy(descriptor, in, DESCRIPTORS * sizeof(float));
+  } else if (format == ETHSIFT_STORE_U8) {
+    const uint8_t *bytes = in;
+    for (int i = 0; i < DESCRIPTORS; ++i)
+      descriptor[i] = bytes[i];
+  } else if (f16c) {
+    descriptor_from_half_f16c(in, descriptor);
+  } else {
+    const uint16_t *halves = in;
+    for (int i = 0; i < DESCRIPTORS; ++i)
+      descriptor[i] = half_to_float(halves[i]);
+  }
+}
+
+/// <summary>
+/// Value of one geometry field of a keypoint, as the 4 bytes stored in the file.
+/// </summary>
+static uint32_t geometry_field(const struct ethsift_keypoint *keypoint, uint32_t field){
+  float value;
+  uint32_t bits;
+  switch (field) {
+  case 0: return keypoint->octave;
+  case 1: return keypoint->layer;
+  case 2: value = keypoint->global_pos.x; break;
+  case 3: value = keypoint->global_pos.y; break;
+  case 4: value = keypoint->global_pos.scale; break;
+  case 5: value = keypoint->layer_pos.x; break;
+  case 6: value = keypoint->layer_pos.y; break;
+  case 7: value = keypoint->layer_pos.scale; break;
+  case 8: value = keypoint->orientation; break;
+  case 9: value = keypoint->magnitude; break;
+  default: value = keypoint->response; break;
+  }
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+/// <summary>
+/// Write keypoints to a binary keypoint file.
+/// </summary>
+/// <param name="path"> IN: Path of the file, replaced if it exists. </param>
+/// <param name="keypoints"> IN: Keypoints to write. </param>
+/// <param name="keypoint_count"> IN: Number of keypoints. </param>
+/// <param name="format"> IN: One of the ETHSIFT_STORE_* formats for the descriptors. </param>
+/// <returns> 1 IF the file could be written, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_write_keypoints(const char *path, const struct ethsift_keypoint keypoints[], uint32_t keypoint_count, uint32_t format){
+  if (ETHSIFT_STORE_F16 < format)
+    return 0;
+  const uint64_t field_size = align_up((uint64_t) keypoint_count * sizeof(uint32_t));
+  struct file_header header = {{0}};
+  memcpy(header.magic, file_magic, sizeof(header.magic));
+  header.version = ETHSIFT_KEYPOINT_FILE_VERSION;
+  header.format = format;
+  header.keypoint_count = keypoint_count;
+  header.descriptor_length = DESCRIPTORS;
+  header.geometry_fields = GEOMETRY_FIELDS;
+  header.geometry_offset = sizeof(struct file_header);
+  header.descriptor_offset = header.geometry_offset + GEOMETRY_FIELDS * field_size;
+
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return 0;
+  int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+  // Fields and descriptors go through a buffer of BATCH keypoints at a time.
+  enum { BATCH = 64 };
+  uint8_t buffer[BATCH * DESCRIPTORS * sizeof(float)];
+  for (uint32_t field = 0; ok && field < GEOMETRY_FIELDS; ++field) {
+    for (uint32_t begin = 0; ok && begin < keypoint_count; begin += BATCH) {
+      const uint32_t count = internal_min(BATCH, keypoint_count - begin);
+      uint32_t *values = (uint32_t *) buffer;
+      for (uint32_t k = 0; k < count; ++k)
+        values[k] = geometry_field(&keypoints[begin + k], field);
+      ok = fwrite(values, sizeof(uint32_t), count, file) == count;
+    }
+    const size_t padding = field_size - (size_t) keypoint_count * sizeof(uint32_t);
+    memset(buffer, 0, padding);
+    ok = ok && fwrite(buffer, 1, padding, file) == padding;
+  }
+  const uint32_t size = descriptor_size(format);
+  const int f16c = use_f16c();
+  for (uint32_t begin = 0; ok && begin < keypoint_count; begin += BATCH) {
+    const uint32_t count = internal_min(BATCH, keypoint_count - begin);
+    for (uint32_t k = 0; k < count; ++k)
+      encode_descriptor(keypoints[begin + k].descriptors, format, f16c, buffer + (size_t) k * size);
+    ok = fwrite(buffer, size, count, file) == count;
+  }
+  return !fclose(file) && ok;
+}
+
+/// <summary>
+/// Map a keypoint file into memory and check its header, without reading the keypoints.
+/// </summary>
+/// <param name="path"> IN: Path of the file. </param>
+/// <param name="file"> OUT: The mapped file, release it with ethsift_unmap_keypoints. </param>
+/// <returns> 1 IF the file could be mapped and is a complete keypoint file of a known version, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_map_keypoints(const char *path, struct ethsift_keypoint_file *file){
+  memset(file, 0, sizeof(struct ethsift_keypoint_file));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  struct stat info;
+  if (fstat(fd, &info) || (size_t) info.st_size < sizeof(struct file_header)) {
+    close(fd);
+    return 0;
+  }
+  const uint64_t size = (uint64_t) info.st_size;
+  void *mapping = mmap(NULL, (size_t) size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return 0;
+  file->mapping = mapping;
+  file->mapping_size = size;
+
+  // The header has to describe exactly the layout a writer of this version produces. The geometry
+  // ends at the descriptor offset, so both blocks fit once the descriptors fit behind that offset.
+  const struct file_header *header = mapping;
+  const uint64_t count = header->keypoint_count;
+  const uint64_t field_size = align_up(count * sizeof(uint32_t));
+  if (memcmp(header->magic, file_magic, sizeof(header->magic))
+      || header->version != ETHSIFT_KEYPOINT_FILE_VERSION
+      || ETHSIFT_STORE_F16 < header->format
+      || header->descriptor_length != DESCRIPTORS
+      || header->geometry_fields != GEOMETRY_FIELDS
+      || header->geometry_offset != sizeof(struct file_header)
+      || size / (GEOMETRY_FIELDS * sizeof(uint32_t) + descriptor_size(header->format)) < count
+      || header->descriptor_offset != header->geometry_offset + GEOMETRY_FIELDS * field_size
+      || size < header->descriptor_offset
+      || (size - header->descriptor_offset) / descriptor_size(header->format) < count) {
+    ethsift_unmap_keypoints(file);
+    return 0;
+  }
+
+  const uint8_t *geometry = (const uint8_t *) mapping + header->geometry_offset;
+  const void *fields[GEOMETRY_FIELDS];
+  for (uint32_t field = 0; field < GEOMETRY_FIELDS; ++field)
+    fields[field] = geometry + field * field_size;
+  file->keypoint_count = count;
+  file->format = header->format;
+  file->descriptor_size = descriptor_size(header->format);
+  file->octaves = fields[0];
+  file->layers = fields[1];
+  file->x = fields[2];
+  file->y = fields[3];
+  file->scales = fields[4];
+  file->layer_x = fields[5];
+  file->layer_y = fields[6];
+  file->layer_scales = fields[7];
+  file->orientations = fields[8];
+  file->magnitudes = fields[9];
+  file->responses = fields[10];
+  file->descriptors = (const uint8_t *) mapping + header->descriptor_offset;
+  return 1;
+}
+
+/// <summary>
+/// Unmap a keypoint file. Pointers into it are invalid afterwards.
+/// </summary>
+/// <param name="file"> IN/OUT: The mapped file, may be all zero. </param>
+/// <returns> 1 </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_unmap_keypoints(struct ethsift_keypoint_file *file){
+  if (file->mapping)
+    munmap(file->mapping, (size_t) file->mapping_size);
+  memset(file, 0, sizeof(struct ethsift_keypoint_file));
+  return 1;
+}
+
+/// <summary>
+/// Unpack a range of the keypoints of a mapped file into keypoint structs.
+/// </summary>
+/// <param name="file"> IN: File mapped by ethsift_map_keypoints. </param>
+/// <param name="first"> IN: Index of the first keypoint to unpack. </param>
+/// <param name="keypoints"> OUT: The keypoints. </param>
+/// <param name="count"> IN: Number of keypoints to unpack. </param>
+/// <returns> 1 IF the range lies within the file, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_load_keypoints(const struct ethsift_keypoint_file *file, uint64_t first, struct ethsift_keypoint keypoints[], uint32_t count){
+  if (file->keypoint_count < first || file->keypoint_count - first < count)
+    return 0;
+  const int f16c = use_f16c();
+  for (uint32_t k = 0; k < count; ++k) {
+    const uint64_t i = first + k;
+    struct ethsift_keypoint *keypoint = &keypoints[k];
+    keypoint->octave = file->octaves[i];
+    keypoint->layer = file->layers[i];
+    keypoint->global_pos.x = file->x[i];
+    keypoint->global_pos.y = file->y[i];
+    keypoint->global_pos.scale = file->scales[i];
+    keypoint->layer_pos.x = file->layer_x[i];
+    keypoint->layer_pos.y = file->layer_y[i];
+    keypoint->layer_pos.scale = file->layer_scales[i];
+    keypoint->orientation = file->orientations[i];
+    keypoint->magnitude = file->magnitudes[i];
+    keypoint->response = file->responses[i];
+    decode_descriptor((const uint8_t *) file->descriptors + i * file->descriptor_size, file->format, f16c, keypoint->descriptors);
+  }
+  return 1;
+}
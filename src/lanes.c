@@ -0,0 +1,375 @@
+#include "internal.h"
+
+// The pyramids of ETHSIFT_LANES images of the same size are built with their pixels interleaved:
+// pixel p of image i is pixels[p * ETHSIFT_LANES + i]. One AVX2 vector holds the same pixel of
+// every image, so the blur, DoG and gradients run on whole vectors however small the images are.
+// Only the Gaussians stay interleaved, DoG and gradients are transposed into the pyramids of the
+// single images as they are stored, which detection and descriptors then run on.
+
+/// <summary>
+/// Test whether the row filters fold the mirrored taps of the kernel, see filter_row_transpose_avx2.
+/// </summary>
+static inline int folds_taps(const float *kernel, int kernel_size, int kernel_rad) {
+  return kernel_size == 2 * kernel_rad + 1 && kernel_rad <= 16 && kernel_symmetric(kernel, kernel_size, kernel_rad);
+}
+
+/// <summary>
+/// Filter a row of w interleaved pixels. The arithmetic is that of the vector body of
+/// filter_row_transpose_avx2, so every lane gets the blur of the single image path. Four pixels
+/// are summed at once to hide the latency of the chained multiply-adds.
+/// </summary>
+/// <param name="taps"> IN: Row under each tap of the kernel, pixel c of the output sums taps[i][c]. </param>
+/// <param name="dst"> OUT: Filtered row. </param>
+/// <param name="kernel"> IN: Kernel taps, broadcast. </param>
+/// <param name="fold"> IN: 1 to fold mirrored taps, see folds_taps. </param>
+ETHSIFT_TARGET_AVX2
+static inline void filter_lanes(const float *const taps[], float *dst, int w, const __m256 kernel[], int kernel_size, int kernel_rad, int fold) {
+  int c = 0;
+  for (; c + 4 <= w; c += 4) {
+    const size_t at = (size_t) c * ETHSIFT_LANES;
+    __m256 sum[4];
+    if (fold) {
+      for (int k = 0; k < 4; ++k)
+        sum[k] = _mm256_mul_ps(kernel[kernel_rad], _mm256_loadu_ps(taps[kernel_rad] + at + k * ETHSIFT_LANES));
+      for (int i = 0; i < kernel_rad; ++i) {
+        for (int k = 0; k < 4; ++k) {
+          __m256 pair = _mm256_add_ps(_mm256_loadu_ps(taps[i] + at + k * ETHSIFT_LANES),
+                                      _mm256_loadu_ps(taps[2 * kernel_rad - i] + at + k * ETHSIFT_LANES));
+          sum[k] = _mm256_fmadd_ps(kernel[i], pair, sum[k]);
+        }
+      }
+    } else {
+      for (int k = 0; k < 4; ++k)
+        sum[k] = _mm256_setzero_ps();
+      for (int i = 0; i < kernel_size; ++i) {
+        for (int k = 0; k < 4; ++k)
+          sum[k] = _mm256_fmadd_ps(kernel[i], _mm256_loadu_ps(taps[i] + at + k * ETHSIFT_LANES), sum[k]);
+      }
+    }
+    for (int k = 0; k < 4; ++k)
+      _mm256_storeu_ps(dst + at + k * ETHSIFT_LANES, sum[k]);
+  }
+
+  for (; c < w; ++c) {
+    const size_t at = (size_t) c * ETHSIFT_LANES;
+    __m256 sum;
+    if (fold) {
+      sum = _mm256_mul_ps(kernel[kernel_rad], _mm256_loadu_ps(taps[kernel_rad] + at));
+      for (int i = 0; i < kernel_rad; ++i)
+        sum = _mm256_fmadd_ps(kernel[i], _mm256_add_ps(_mm256_loadu_ps(taps[i] + at), _mm256_loadu_ps(taps[2 * kernel_rad - i] + at)), sum);
+    } else {
+      sum = _mm256_setzero_ps();
+      for (int i = 0; i < kernel_size; ++i)
+        sum = _mm256_fmadd_ps(kernel[i], _mm256_loadu_ps(taps[i] + at), sum);
+    }
+    _mm256_storeu_ps(dst + at, sum);
+  }
+  inc_read((size_t) w * kernel_size * ETHSIFT_LANES, float);
+  inc_adds(w * kernel_size * ETHSIFT_LANES);
+  inc_mults(w * kernel_size * ETHSIFT_LANES);
+  inc_write(w * ETHSIFT_LANES, float);
+}
+
+/// <summary>
+/// Copy row r of every image into row_buf interleaved, converted to float, and replicate the
+/// border pixels into the kernel padding like pad_row.
+/// </summary>
+/// <param name="images"> IN: The images to interleave, or NULL to copy from src. </param>
+/// <param name="src"> IN: Interleaved image to copy from if images is NULL. </param>
+/// <param name="line"> IN: Scratch for one converted row of w floats. </param>
+static void load_row_lanes(const struct ethsift_image_view *images, const float *src, float *line, int r, int w, int kernel_rad) {
+  float *row = row_buf + kernel_rad * ETHSIFT_LANES;
+  if (images) {
+    for (int i = 0; i < ETHSIFT_LANES; ++i) {
+      g_kernels.convert_row(line, (const uint8_t *) images[i].data + (size_t) r * images[i].stride, w, images[i].format, view_range(images[i]));
+      for (int c = 0; c < w; ++c)
+        row[c * ETHSIFT_LANES + i] = line[c];
+    }
+  } else {
+    memcpy(row, src + (size_t) r * w * ETHSIFT_LANES, sizeof(float) * w * ETHSIFT_LANES);
+  }
+  inc_read(w * ETHSIFT_LANES, float);
+  inc_write(w * ETHSIFT_LANES, float);
+
+  for (int i = 0; i < kernel_rad; ++i) {
+    memcpy(row_buf + i * ETHSIFT_LANES, row, sizeof(float) * ETHSIFT_LANES);
+    memcpy(row + (w + i) * ETHSIFT_LANES, row + (w - 1) * ETHSIFT_LANES, sizeof(float) * ETHSIFT_LANES);
+  }
+  inc_write(2 * kernel_rad * ETHSIFT_LANES, float);
+}
+
+/// <summary>
+/// Blur interleaved images with the kernel, rows first and then columns.
+/// </summary>
+/// <param name="images"> IN: Images to blur, or NULL to blur src. </param>
+/// <param name="src"> IN: Interleaved images to blur if images is NULL. </param>
+/// <param name="dst"> OUT: Interleaved blurred images. </param>
+/// <remarks> 2 * (h * w * (2 * kernel_size)) * ETHSIFT_LANES flops </remarks>
+ETHSIFT_TARGET_AVX2
+static void blur_lanes(const struct ethsift_image_view *images, const float *src, float *dst, int w, int h, const float *kernel, int kernel_size, int kernel_rad) {
+  const int fold = folds_taps(kernel, kernel_size, kernel_rad);
+  const size_t row_size = (size_t) w * ETHSIFT_LANES;
+  // The column pass reads kernel_size rows at once. A cache line of padding keeps rows of
+  // power of two widths from falling into the same few sets of the L1 cache.
+  const size_t row_stride = row_size + 16;
+  float *rows = img_buf;
+  float *line = img_buf + row_stride * h;
+  const float *taps[kernel_size];
+  __m256 d_kernel[kernel_size];
+
+  for (int i = 0; i < kernel_size; ++i)
+    d_kernel[i] = _mm256_set1_ps(kernel[i]);
+
+  // The rows are padded in row_buf, so tap i starts i pixels further in.
+  for (int i = 0; i < kernel_size; ++i)
+    taps[i] = row_buf + i * ETHSIFT_LANES;
+  for (int r = 0; r < h; ++r) {
+    load_row_lanes(images, src, line, r, w, kernel_rad);
+    filter_lanes(taps, rows + r * row_stride, w, d_kernel, kernel_size, kernel_rad, fold);
+  }
+
+  // The columns clamp at the first and last row instead of padding.
+  for (int r = 0; r < h; ++r) {
+    for (int i = 0; i < kernel_size; ++i)
+      taps[i] = rows + int_min(int_max(r + i - kernel_rad, 0), h - 1) * row_stride;
+    filter_lanes(taps, dst + r * row_size, w, d_kernel, kernel_size, kernel_rad, fold);
+  }
+}
+
+/// <summary>
+/// Transpose eight vectors, so that vector k holds lane k of every input.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+static inline void transpose_lanes(__m256 r[8]) {
+  __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpackhi_ps(r[0], r[1]);
+  __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]), t3 = _mm256_unpackhi_ps(r[2], r[3]);
+  __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]), t5 = _mm256_unpackhi_ps(r[4], r[5]);
+  __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]), t7 = _mm256_unpackhi_ps(r[6], r[7]);
+  __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)), s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)), s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0)), s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0)), s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+  r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+  r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+  r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+  r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+  r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+  r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+  r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+  r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+/// <summary>
+/// Store count interleaved pixels into one image per lane, starting at pixel p of each.
+/// </summary>
+/// <param name="pixels"> IN: count pixels, at most 8. Transposed in place if count is 8. </param>
+ETHSIFT_TARGET_AVX2
+static inline void store_lanes(__m256 pixels[8], float *const dst[], size_t p, int count) {
+  if (count == 8) {
+    transpose_lanes(pixels);
+    for (int i = 0; i < ETHSIFT_LANES; ++i)
+      _mm256_storeu_ps(dst[i] + p, pixels[i]);
+  } else {
+    float lanes[ETHSIFT_LANES];
+    for (int k = 0; k < count; ++k) {
+      _mm256_storeu_ps(lanes, pixels[k]);
+      for (int i = 0; i < ETHSIFT_LANES; ++i)
+        dst[i][p + k] = lanes[i];
+    }
+  }
+  inc_write(count * ETHSIFT_LANES, float);
+}
+
+/// <summary>
+/// Copy the pixels of interleaved images out into one image per lane.
+/// </summary>
+/// <param name="src"> IN: size interleaved pixels. </param>
+/// <param name="dst"> OUT: One array of size pixels per lane. </param>
+ETHSIFT_TARGET_AVX2
+static void deinterleave_lanes(const float *src, float *const dst[], size_t size) {
+  __m256 block[8];
+  for (size_t p = 0; p < size; p += 8) {
+    const int count = (int) internal_min(8, size - p);
+    for (int k = 0; k < count; ++k)
+      block[k] = _mm256_loadu_ps(src + (p + k) * ETHSIFT_LANES);
+    store_lanes(block, dst, p, count);
+  }
+  inc_read(size * ETHSIFT_LANES, float);
+}
+
+/// <summary>
+/// Take every second pixel of every second row of interleaved images, see ethsift_downscale_half.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+static void downscale_half_lanes(const float *src, int src_w, float *dst, int dst_w, int dst_h) {
+  for (int r = 0; r < dst_h; ++r) {
+    for (int c = 0; c < dst_w; ++c)
+      _mm256_storeu_ps(dst + (r * dst_w + c) * ETHSIFT_LANES, _mm256_loadu_ps(src + (2 * r * src_w + 2 * c) * ETHSIFT_LANES));
+    inc_read(dst_w * ETHSIFT_LANES, float);
+    inc_write(dst_w * ETHSIFT_LANES, float);
+  }
+}
+
+/// <summary>
+/// Subtract two interleaved Gaussian levels, the differences go to one image per lane.
+/// </summary>
+/// <param name="dif"> OUT: One DoG level of size pixels per lane. </param>
+ETHSIFT_TARGET_AVX2
+static void difference_lanes(const float *low, const float *high, float *const dif[], size_t size) {
+  __m256 block[8];
+  for (size_t p = 0; p < size; p += 8) {
+    const int count = (int) internal_min(8, size - p);
+    for (int k = 0; k < count; ++k) {
+      const size_t at = (p + k) * ETHSIFT_LANES;
+      block[k] = _mm256_sub_ps(_mm256_loadu_ps(high + at), _mm256_loadu_ps(low + at));
+    }
+    store_lanes(block, dif, p, count);
+  }
+  inc_read(2 * size * ETHSIFT_LANES, float);
+  inc_adds(size * ETHSIFT_LANES);
+}
+
+/// <summary>
+/// Gradient magnitude and orientation of interleaved images with clamped differences, with the
+/// arithmetic of gradient_pyramid_avx2 on every pixel including the border. The results go to
+/// one image per lane.
+/// </summary>
+/// <param name="grads"> OUT: One gradient level per lane. </param>
+/// <param name="rots"> OUT: One orientation level per lane, or NULL to only compute the magnitudes. </param>
+ETHSIFT_TARGET_AVX2
+static void gradient_lanes(const float *gaussian, float *const grads[], float *const rots[], int w, int h) {
+  const size_t row_size = (size_t) w * ETHSIFT_LANES;
+  __m256 grad[8], rot[8];
+  for (int r = 0; r < h; ++r) {
+    const float *up = gaussian + int_max(r - 1, 0) * row_size;
+    const float *down = gaussian + int_min(r + 1, h - 1) * row_size;
+    const float *row = gaussian + r * row_size;
+    for (int c = 0; c < w; c += 8) {
+      const int count = int_min(8, w - c);
+      for (int k = 0; k < count; ++k) {
+        const int left = int_max(c + k - 1, 0) * ETHSIFT_LANES;
+        const int right = int_min(c + k + 1, w - 1) * ETHSIFT_LANES;
+        const int at = (c + k) * ETHSIFT_LANES;
+        __m256 d_row = _mm256_sub_ps(_mm256_loadu_ps(down + at), _mm256_loadu_ps(up + at));
+        __m256 d_column = _mm256_sub_ps(_mm256_loadu_ps(row + right), _mm256_loadu_ps(row + left));
+        grad[k] = _mm256_sqrt_ps(_mm256_fmadd_ps(d_column, d_column, _mm256_mul_ps(d_row, d_row)));
+        if (rots)
+          rot[k] = eth_mm256_atan2_ps(d_row, d_column);
+      }
+      store_lanes(grad, grads, (size_t) r * w + c, count);
+      if (rots)
+        store_lanes(rot, rots, (size_t) r * w + c, count);
+    }
+    inc_read(4 * row_size, float);
+    inc_adds(3 * row_size);
+    inc_mults(2 * row_size);
+  }
+}
+
+/// <summary>
+/// Test whether a group of ETHSIFT_LANES images can be processed interleaved with the current settings.
+/// </summary>
+/// <param name="images"> IN: ETHSIFT_LANES images. </param>
+/// <returns> 1 IF compute_keypoints_lanes can process them, ELSE 0. </returns>
+int lanes_supported(const struct ethsift_image_view images[]) {
+  const int gaussian_count = ETHSIFT_INTVLS + 3;
+  const uint32_t w = images[0].width;
+  const uint32_t h = images[0].height;
+
+  if (ethsift_get_backend() < ETHSIFT_BACKEND_AVX2 || g_upsample || g_pyramid_schedule != ETHSIFT_SCHEDULE_SEQUENTIAL)
+    return 0;
+  for (int i = 0; i < ETHSIFT_LANES; ++i) {
+    if (images[i].width != w || images[i].height != h)
+      return 0;
+    if (ETHSIFT_FORMAT_U16 < images[i].format || (g_fixed_point && images[i].format == ETHSIFT_FORMAT_U8))
+      return 0;
+  }
+  const int octave_count = (int)log2f((float)int_min((int) w, (int) h)) - 3;
+  if (octave_count < 1 || ETHSIFT_MAX_OCTAVES < octave_count)
+    return 0;
+
+  // A padded row of all lanes has to fit into row_buf, the rows of one level into img_buf.
+  int kernel_rad = 0;
+  for (int j = 0; j < gaussian_count; ++j)
+    kernel_rad = int_max(kernel_rad, g_kernel_rads[j]);
+  if (7680 + 64 < (w + 2 * kernel_rad) * ETHSIFT_LANES)
+    return 0;
+  if ((size_t) 7680 * 4320 < ((size_t) (w + 2) * h + w) * ETHSIFT_LANES)
+    return 0;
+  return 1;
+}
+
+/// <summary>
+/// Run the SIFT pipeline on ETHSIFT_LANES images of the same size at once, one image per vector lane.
+/// </summary>
+/// <param name="images"> IN: ETHSIFT_LANES borrowed images accepted by lanes_supported. </param>
+/// <param name="keypoints"> OUT: One array of detected keypoints per image. </param>
+/// <param name="keypoint_counts"> IN: How many keypoints each array can store at most.
+///                                OUT: Number of keypoints found per image. </param>
+/// <returns> 1 IF computation was successful, ELSE 0. </returns>
+int compute_keypoints_lanes(const struct ethsift_image_view images[], struct ethsift_keypoint *keypoints[], uint32_t keypoint_counts[]) {
+  const int layers = ETHSIFT_INTVLS;
+  const int gaussian_count = layers + 3;
+  const int dog_count = layers + 2;
+  const uint32_t w = images[0].width;
+  const uint32_t h = images[0].height;
+  const int octave_count = (int)log2f((float)int_min((int) w, (int) h)) - 3;
+  const int octant = (g_orientation_mode == ETHSIFT_ORIENTATION_OCTANT);
+
+  // Every lane gets a set of single pyramids, the interleaved set comes after them. It only
+  // holds Gaussians, the rest of its layout is never touched.
+  struct ethsift_pyramids *lanes = workspace_pyramids(ETHSIFT_LANES);
+  struct ethsift_pyramids *singles[ETHSIFT_LANES];
+  if (!lanes || !pyramids_reserve(lanes, w, h, octave_count, !octant, ETHSIFT_LANES))
+    return 0;
+  for (int i = 0; i < ETHSIFT_LANES; ++i) {
+    singles[i] = workspace_pyramids(i);
+    if (!singles[i] || !pyramids_reserve(singles[i], w, h, octave_count, !octant, 1))
+      return 0;
+  }
+  if (!workspace_reserve(((size_t) (w + 2) * h + w) * ETHSIFT_LANES))
+    return 0;
+  struct ethsift_image *gaussians = lanes->gaussians;
+
+  // Gaussians, with the base of the next octave decimated from level layers. The differences
+  // and gradients are written to the pyramids of the single images directly.
+  blur_lanes(images, NULL, gaussians[0].pixels, w, h, g_kernel_ptrs[0], g_kernel_sizes[0], g_kernel_rads[0]);
+  for (int i = 0; i < octave_count; ++i) {
+    const int octave_w = gaussians[i * gaussian_count].width;
+    const int octave_h = gaussians[i * gaussian_count].height;
+    for (int j = 1; j < gaussian_count; ++j) {
+      blur_lanes(NULL, gaussians[i * gaussian_count + j - 1].pixels, gaussians[i * gaussian_count + j].pixels,
+                 octave_w, octave_h, g_kernel_ptrs[j], g_kernel_sizes[j], g_kernel_rads[j]);
+      if (j == layers && i + 1 < octave_count) {
+        struct ethsift_image half = gaussians[(i + 1) * gaussian_count];
+        downscale_half_lanes(gaussians[i * gaussian_count + j].pixels, octave_w, half.pixels, half.width, half.height);
+      }
+    }
+
+    float *outputs[ETHSIFT_LANES], *rotations[ETHSIFT_LANES];
+    const size_t size = (size_t) octave_w * octave_h;
+    for (int j = 0; j < dog_count; ++j) {
+      for (int k = 0; k < ETHSIFT_LANES; ++k)
+        outputs[k] = singles[k]->differences[i * dog_count + j].pixels;
+      difference_lanes(gaussians[i * gaussian_count + j].pixels, gaussians[i * gaussian_count + j + 1].pixels, outputs, size);
+    }
+    for (int j = 1; j <= layers; ++j) {
+      for (int k = 0; k < ETHSIFT_LANES; ++k) {
+        outputs[k] = singles[k]->gradients[i * gaussian_count + j].pixels;
+        rotations[k] = singles[k]->rotations[i * gaussian_count + j].pixels;
+      }
+      gradient_lanes(gaussians[i * gaussian_count + j].pixels, outputs, octant ? NULL : rotations, octave_w, octave_h);
+    }
+  }
+
+  // Only the octant orientations and the patch descriptors read the Gaussians themselves.
+  if (octant || g_descriptor_mode == ETHSIFT_DESCRIPTOR_PATCH) {
+    float *outputs[ETHSIFT_LANES];
+    for (int k = 0; k < ETHSIFT_LANES; ++k)
+      outputs[k] = singles[k]->gaussians[0].pixels;
+    deinterleave_lanes(gaussians[0].pixels, outputs, pyramid_size(w, h, octave_count, gaussian_count));
+  }
+  for (int i = 0; i < ETHSIFT_LANES; ++i)
+    ethsift_describe_pyramids(singles[i], octave_count, NULL, keypoints[i], &keypoint_counts[i]);
+  return 1;
+}
@@ -21,20 +21,21 @@ int ethsift_generate_octaves(struct ethsift_image image,
     
     // DIFF NOTE to EZSift: 
     // Original implementation in EZSift contained some upsampling cases which 
-    // were used if it was enabled in the settings. Our implementation does not support upsampling
-    // of the original image before processing.
+    // were used if it was enabled in the settings. Our implementation upsamples the doubled first
+    // octave while blurring it instead, see ethsift_set_upsample.
     // Also some (seemingly) irrelevant divisions were left out in our implementation. 
 
 
-    for (int i = 0; i < octave_count; i++) {
-        if (i == 0) {
-            memcpy(octaves[i].pixels, image.pixels, image.width * image.height * sizeof(float));
-            inc_read(image.width*image.height, float);
-            inc_write(image.width*image.height, float);
-        }
-        else {
-            ethsift_downscale_half(octaves[i-1], octaves[i]);
-        }
+    // The first octave is the input itself. Callers that let octaves[0] share the input's
+    // pixels skip the copy entirely.
+    if (octave_count > 0 && octaves[0].pixels != image.pixels) {
+        memcpy(octaves[0].pixels, image.pixels, image.width * image.height * sizeof(float));
+        inc_read(image.width*image.height, float);
+        inc_write(image.width*image.height, float);
+    }
+    for (int i = 1; i < octave_count; i++) {
+        // Decimate straight from the input for the second octave, so it does not wait on the copy.
+        ethsift_downscale_half((i == 1) ? image : octaves[i-1], octaves[i]);
     }
     return 1;
 }
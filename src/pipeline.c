@@ -0,0 +1,338 @@
+#include "internal.h"
+#include <pthread.h>
+
+// Two stage threads work on the frames of a pipeline. The build stage lays out and builds the pyramids
+// of a frame while the describe stage detects and describes the keypoints of the frame before it.
+// Frames, pyramids and results are passed around as slot indices over single producer, single consumer
+// rings, so handing over a slot takes no lock. The lock and condition only park a thread on an empty ring.
+
+// Capacity of a ring, a power of two above every slot count.
+#define RING_SIZE 32
+// Pyramids being built and waiting for the describe stage.
+#define PYRAMID_SLOTS 2
+
+struct ring{
+  // Next item to pop, only written by the consumer.
+  uint32_t head;
+  // Keep the indices of the two sides on separate cache lines.
+  char pad_head[60];
+  // Next item to push, only written by the producer.
+  uint32_t tail;
+  char pad_tail[60];
+  uint32_t items[RING_SIZE];
+};
+
+struct pipeline_frame{
+  // Copy of the submitted frame, data points to pixels.
+  struct ethsift_image_view view;
+  uint8_t *pixels;
+  uint32_t index;
+};
+
+struct pipeline_pyramids{
+  struct ethsift_pyramids pyramids;
+  uint32_t octave_count;
+  uint32_t index;
+  int built;
+};
+
+struct pipeline_result{
+  struct ethsift_keypoint *keypoints;
+  uint32_t keypoint_count;
+  uint32_t index;
+};
+
+struct ethsift_pipeline{
+  uint32_t width, height;
+  uint32_t keypoint_capacity;
+  uint32_t backpressure;
+  struct pipeline_frame *frames;
+  uint32_t frame_count;
+  struct pipeline_pyramids pyramids[PYRAMID_SLOTS];
+  struct pipeline_result *results;
+  uint32_t result_count;
+  // Frames accepted by submit and results taken by poll, only touched by the caller.
+  uint32_t submitted, polled;
+  // Caller -> build -> describe -> caller, and the free slots back the other way.
+  struct ring queued, free_frames;
+  struct ring built, free_pyramids;
+  struct ring done, free_results;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  int stopping;
+  pthread_t threads[2];
+  uint32_t thread_count;
+};
+
+static int ring_empty(struct ring *ring){
+  return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+}
+
+static uint32_t ring_count(struct ring *ring){
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - head;
+}
+
+/// <summary>
+/// Append an item, called by the producer only. The rings hold more items than there are slots,
+/// so there is always room.
+/// </summary>
+static void ring_push(struct ring *ring, uint32_t item){
+  uint32_t tail = ring->tail;
+  ring->items[tail % RING_SIZE] = item;
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/// <summary>
+/// Take the oldest item, called by the consumer only.
+/// </summary>
+/// <returns> 1 IF there was an item, ELSE 0. </returns>
+static int ring_pop(struct ring *ring, uint32_t *item){
+  uint32_t head = ring->head;
+  if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head)
+    return 0;
+  *item = ring->items[head % RING_SIZE];
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+/// <summary>
+/// Push an item and wake whoever waits on the pipeline.
+/// </summary>
+static void pipeline_push(struct ethsift_pipeline *pipeline, struct ring *ring, uint32_t item){
+  ring_push(ring, item);
+  pthread_mutex_lock(&pipeline->lock);
+  pthread_cond_broadcast(&pipeline->wake);
+  pthread_mutex_unlock(&pipeline->lock);
+}
+
+/// <summary>
+/// Pop an item, waiting for one if the ring is empty.
+/// </summary>
+/// <returns> 1 IF an item was taken, ELSE 0 when the pipeline stops. </returns>
+static int pipeline_pop(struct ethsift_pipeline *pipeline, struct ring *ring, uint32_t *item){
+  while (!ring_pop(ring, item)) {
+    pthread_mutex_lock(&pipeline->lock);
+    while (ring_empty(ring) && !pipeline->stopping)
+      pthread_cond_wait(&pipeline->wake, &pipeline->lock);
+    int stopping = pipeline->stopping;
+    pthread_mutex_unlock(&pipeline->lock);
+    if (stopping)
+      return 0;
+  }
+  return 1;
+}
+
+/// <summary>
+/// Whether no frame slot can become free before the caller polls. All results are waiting to be polled,
+/// so the describe stage holds none and cannot take the built pyramids, which leaves the build stage
+/// without a free set of pyramids.
+/// </summary>
+static int pipeline_stalled(struct ethsift_pipeline *pipeline){
+  return ring_count(&pipeline->done) == pipeline->result_count
+      && ring_count(&pipeline->built) == PYRAMID_SLOTS;
+}
+
+static void *build_main(void *arg){
+  struct ethsift_pipeline *pipeline = arg;
+  uint32_t frame, slot;
+  thread_pool_keep_serial();
+  while (pipeline_pop(pipeline, &pipeline->queued, &frame)
+      && pipeline_pop(pipeline, &pipeline->free_pyramids, &slot)) {
+    struct pipeline_pyramids *pyramids = &pipeline->pyramids[slot];
+    pyramids->built = build_image_pyramids(pipeline->frames[frame].view, &pyramids->pyramids, &pyramids->octave_count);
+    pyramids->index = pipeline->frames[frame].index;
+    pipeline_push(pipeline, &pipeline->free_frames, frame);
+    pipeline_push(pipeline, &pipeline->built, slot);
+  }
+  workspace_release();
+  return NULL;
+}
+
+static void *describe_main(void *arg){
+  struct ethsift_pipeline *pipeline = arg;
+  uint32_t result_slot, slot;
+  thread_pool_keep_serial();
+  // Claim the result first, see pipeline_stalled.
+  while (pipeline_pop(pipeline, &pipeline->free_results, &result_slot)
+      && pipeline_pop(pipeline, &pipeline->built, &slot)) {
+    struct pipeline_pyramids *pyramids = &pipeline->pyramids[slot];
+    struct pipeline_result *result = &pipeline->results[result_slot];
+    result->keypoint_count = 0;
+    if (pyramids->built) {
+      result->keypoint_count = pipeline->keypoint_capacity;
+      ethsift_describe_pyramids(&pyramids->pyramids, pyramids->octave_count, NULL, result->keypoints, &result->keypoint_count);
+    }
+    result->index = pyramids->index;
+    pipeline_push(pipeline, &pipeline->free_pyramids, slot);
+    pipeline_push(pipeline, &pipeline->done, result_slot);
+  }
+  workspace_release();
+  return NULL;
+}
+
+/// <summary>
+/// Create a pipeline that computes the keypoints of a stream of frames on two threads of its own.
+/// </summary>
+/// <param name="width"> IN: Width of the frames. </param>
+/// <param name="height"> IN: Height of the frames. </param>
+/// <param name="depth"> IN: Number of frames that can wait for the pyramid stage, 1 to ETHSIFT_PIPELINE_MAX_DEPTH. </param>
+/// <param name="keypoint_capacity"> IN: How many keypoints are kept per frame. </param>
+/// <param name="backpressure"> IN: One of the ETHSIFT_BACKPRESSURE_* modes. </param>
+/// <param name="pipeline"> OUT: The new pipeline, release it with ethsift_pipeline_free. </param>
+/// <returns> 1 IF the pipeline could be allocated and started, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_pipeline_create(uint32_t width, uint32_t height, uint32_t depth, uint32_t keypoint_capacity, uint32_t backpressure, struct ethsift_pipeline **pipeline){
+  if (depth < 1 || ETHSIFT_PIPELINE_MAX_DEPTH < depth || ETHSIFT_BACKPRESSURE_REJECT < backpressure)
+    return 0;
+
+  struct ethsift_pipeline *p = calloc(1, sizeof(struct ethsift_pipeline));
+  if (!p)
+    return 0;
+  p->width = width;
+  p->height = height;
+  p->keypoint_capacity = keypoint_capacity;
+  p->backpressure = backpressure;
+  p->frame_count = depth;
+  p->result_count = depth + PYRAMID_SLOTS;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->wake, NULL);
+  *pipeline = p;
+  // Counted until ethsift_pipeline_free, which also cleans up after a failed start.
+  __atomic_add_fetch(&g_pipeline_count, 1, __ATOMIC_ACQ_REL);
+
+  p->frames = calloc(p->frame_count, sizeof(struct pipeline_frame));
+  p->results = calloc(p->result_count, sizeof(struct pipeline_result));
+  if (!p->frames || !p->results)
+    goto fail;
+  // Room for the widest pixel format.
+  for (uint32_t i = 0; i < p->frame_count; ++i) {
+    p->frames[i].pixels = malloc((size_t) width * height * sizeof(float));
+    if (!p->frames[i].pixels)
+      goto fail;
+    ring_push(&p->free_frames, i);
+  }
+  for (uint32_t i = 0; i < p->result_count; ++i) {
+    p->results[i].keypoints = malloc((keypoint_capacity ? keypoint_capacity : 1) * sizeof(struct ethsift_keypoint));
+    if (!p->results[i].keypoints)
+      goto fail;
+    ring_push(&p->free_results, i);
+  }
+  for (uint32_t i = 0; i < PYRAMID_SLOTS; ++i)
+    ring_push(&p->free_pyramids, i);
+
+  if (pthread_create(&p->threads[0], NULL, build_main, p))
+    goto fail;
+  p->thread_count++;
+  if (pthread_create(&p->threads[1], NULL, describe_main, p))
+    goto fail;
+  p->thread_count++;
+  return 1;
+
+ fail:
+  ethsift_pipeline_free(p);
+  *pipeline = NULL;
+  return 0;
+}
+
+/// <summary>
+/// Stop the threads of a pipeline and release it. Frames that were not polled yet are dropped.
+/// </summary>
+/// <param name="pipeline"> IN: Pipeline created by ethsift_pipeline_create, may be NULL. </param>
+/// <returns> 1 </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_pipeline_free(struct ethsift_pipeline *pipeline){
+  if (!pipeline)
+    return 1;
+  pthread_mutex_lock(&pipeline->lock);
+  pipeline->stopping = 1;
+  pthread_cond_broadcast(&pipeline->wake);
+  pthread_mutex_unlock(&pipeline->lock);
+  for (uint32_t i = 0; i < pipeline->thread_count; ++i)
+    pthread_join(pipeline->threads[i], NULL);
+
+  for (uint32_t i = 0; i < PYRAMID_SLOTS; ++i)
+    pyramids_release(&pipeline->pyramids[i].pyramids);
+  if (pipeline->frames) {
+    for (uint32_t i = 0; i < pipeline->frame_count; ++i)
+      free(pipeline->frames[i].pixels);
+    free(pipeline->frames);
+  }
+  if (pipeline->results) {
+    for (uint32_t i = 0; i < pipeline->result_count; ++i)
+      free(pipeline->results[i].keypoints);
+    free(pipeline->results);
+  }
+  pthread_cond_destroy(&pipeline->wake);
+  pthread_mutex_destroy(&pipeline->lock);
+  __atomic_sub_fetch(&g_pipeline_count, 1, __ATOMIC_ACQ_REL);
+  free(pipeline);
+  return 1;
+}
+
+/// <summary>
+/// Queue a frame for the pipeline. The frame is copied, the caller may reuse it right away.
+/// </summary>
+/// <param name="pipeline"> IN/OUT: The pipeline. </param>
+/// <param name="frame"> IN: The frame, of the size the pipeline was created with. </param>
+/// <returns> 1 IF the frame was queued, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_pipeline_submit(struct ethsift_pipeline *pipeline, struct ethsift_image_view frame){
+  if (frame.width != pipeline->width || frame.height != pipeline->height || ETHSIFT_FORMAT_U16 < frame.format)
+    return 0;
+
+  uint32_t slot;
+  while (!ring_pop(&pipeline->free_frames, &slot)) {
+    if (pipeline->backpressure == ETHSIFT_BACKPRESSURE_REJECT)
+      return 0;
+    // Waiting on a pipeline that only the caller can drain would never return.
+    pthread_mutex_lock(&pipeline->lock);
+    while (ring_empty(&pipeline->free_frames) && !pipeline_stalled(pipeline))
+      pthread_cond_wait(&pipeline->wake, &pipeline->lock);
+    pthread_mutex_unlock(&pipeline->lock);
+    if (ring_empty(&pipeline->free_frames))
+      return 0;
+  }
+
+  struct pipeline_frame *copy = &pipeline->frames[slot];
+  const uint32_t pixel_size = (frame.format == ETHSIFT_FORMAT_U8) ? 1 : (frame.format == ETHSIFT_FORMAT_U16) ? 2 : 4;
+  const size_t row_size = (size_t) frame.width * pixel_size;
+  for (uint32_t y = 0; y < frame.height; ++y)
+    memcpy(copy->pixels + y * row_size, (const uint8_t *) frame.data + (size_t) y * frame.stride, row_size);
+  copy->view = frame;
+  copy->view.data = copy->pixels;
+  copy->view.stride = row_size;
+  copy->index = pipeline->submitted++;
+  pipeline_push(pipeline, &pipeline->queued, slot);
+  return 1;
+}
+
+/// <summary>
+/// Take the keypoints of the oldest frame the pipeline has finished.
+/// </summary>
+/// <param name="pipeline"> IN/OUT: The pipeline. </param>
+/// <param name="keypoints"> OUT: Keypoints of the frame. </param>
+/// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
+///                               OUT: Number of keypoints found in the frame. </param>
+/// <param name="frame_index"> OUT: Number of frames submitted before this one. </param>
+/// <param name="wait"> IN: Whether to wait for a frame still in flight. </param>
+/// <returns> 1 IF a frame was taken, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_pipeline_poll(struct ethsift_pipeline *pipeline, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count, uint32_t *frame_index, int wait){
+  uint32_t slot;
+  if (!ring_pop(&pipeline->done, &slot)) {
+    if (!wait || pipeline->polled == pipeline->submitted)
+      return 0;
+    if (!pipeline_pop(pipeline, &pipeline->done, &slot))
+      return 0;
+  }
+
+  struct pipeline_result *result = &pipeline->results[slot];
+  const uint32_t stored = internal_min(internal_min(result->keypoint_count, pipeline->keypoint_capacity), *keypoint_count);
+  memcpy(keypoints, result->keypoints, stored * sizeof(struct ethsift_keypoint));
+  *keypoint_count = result->keypoint_count;
+  *frame_index = result->index;
+  pipeline->polled++;
+  pipeline_push(pipeline, &pipeline->free_results, slot);
+  return 1;
+}
@@ -0,0 +1,181 @@
+#include "internal.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/// <summary>
+/// Skip whitespace and comments in the header of a PNM file.
+/// </summary>
+/// <param name="data"> IN: The mapped file. </param>
+/// <param name="size"> IN: Size of the file. </param>
+/// <param name="pos"> IN/OUT: Position in the file. </param>
+static void skip_space(const uint8_t *data, size_t size, size_t *pos){
+  while (*pos < size) {
+    if (data[*pos] == '#') {
+      while (*pos < size && data[*pos] != '\n')
+        (*pos)++;
+    } else if (data[*pos] == ' ' || data[*pos] == '\t' || data[*pos] == '\r' || data[*pos] == '\n') {
+      (*pos)++;
+    } else {
+      return;
+    }
+  }
+}
+
+/// <summary>
+/// Parse a decimal number of the header of a PNM file.
+/// </summary>
+/// <returns> 1 IF there was a number that fits into 32 bits, ELSE 0. </returns>
+static int parse_number(const uint8_t *data, size_t size, size_t *pos, uint32_t *value){
+  uint64_t number = 0;
+  size_t start;
+  skip_space(data, size, pos);
+  start = *pos;
+  while (*pos < size && '0' <= data[*pos] && data[*pos] <= '9' && number <= UINT32_MAX)
+    number = number * 10 + (data[(*pos)++] - '0');
+  if (*pos == start || UINT32_MAX < number)
+    return 0;
+  *value = (uint32_t) number;
+  return 1;
+}
+
+/// <summary>
+/// Map a binary PGM (P5) or PPM (P6) file into memory and parse its header, without reading the pixels.
+/// </summary>
+/// <param name="path"> IN: Path of the file. </param>
+/// <param name="pnm"> OUT: The mapped file, release it with ethsift_unmap_pnm. </param>
+/// <returns> 1 IF the file could be mapped and is a valid binary PGM or PPM, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_map_pnm(const char *path, struct ethsift_pnm *pnm){
+  memset(pnm, 0, sizeof(struct ethsift_pnm));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  struct stat info;
+  if (fstat(fd, &info) || info.st_size < 3) {
+    close(fd);
+    return 0;
+  }
+  const size_t size = (size_t) info.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file alive on its own.
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return 0;
+  pnm->mapping = mapping;
+  pnm->mapping_size = size;
+
+  const uint8_t *data = mapping;
+  size_t pos = 2;
+  uint32_t width, height, maxval;
+  if (data[0] != 'P' || (data[1] != '5' && data[1] != '6')
+      || !parse_number(data, size, &pos, &width)
+      || !parse_number(data, size, &pos, &height)
+      || !parse_number(data, size, &pos, &maxval)
+      || width == 0 || height == 0 || maxval == 0 || 65535 < maxval
+      // A single whitespace character separates the header from the pixels.
+      || size <= pos) {
+    ethsift_unmap_pnm(pnm);
+    return 0;
+  }
+  pos++;
+
+  const uint32_t channels = (data[1] == '6') ? 3 : 1;
+  const uint32_t sample_size = (maxval < 256) ? 1 : 2;
+  const size_t row_size = (size_t) width * channels * sample_size;
+  if (UINT32_MAX < row_size || (size - pos) / row_size < height) {
+    ethsift_unmap_pnm(pnm);
+    return 0;
+  }
+  pnm->pixels = data + pos;
+  pnm->width = width;
+  pnm->height = height;
+  pnm->stride = (uint32_t) row_size;
+  pnm->channels = channels;
+  pnm->maxval = maxval;
+
+  // 8-bit gray pixels can be used in place, everything else has to go through ethsift_pnm_to_float.
+  if (channels == 1 && sample_size == 1) {
+    struct ethsift_image_view view = {pnm->pixels, width, height, (uint32_t) row_size, ETHSIFT_FORMAT_U8};
+    pnm->view = view;
+  }
+  madvise(mapping, size, MADV_SEQUENTIAL);
+  return 1;
+}
+
+/// <summary>
+/// Unmap a file mapped by ethsift_map_pnm. Views into it are invalid afterwards.
+/// </summary>
+/// <param name="pnm"> IN/OUT: The mapped file, may be all zero. </param>
+/// <returns> 1 </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_unmap_pnm(struct ethsift_pnm *pnm){
+  if (pnm->mapping)
+    munmap(pnm->mapping, (size_t) pnm->mapping_size);
+  memset(pnm, 0, sizeof(struct ethsift_pnm));
+  return 1;
+}
+
+struct pnm_job{
+  const struct ethsift_pnm *pnm;
+  struct ethsift_image image;
+};
+
+/// <summary>
+/// Convert a chunk of ETHSIFT_PNM_CHUNK_ROWS rows of a mapped file to float.
+/// </summary>
+static void convert_chunk(void *arg, uint32_t chunk){
+  const struct pnm_job *job = arg;
+  const struct ethsift_pnm *pnm = job->pnm;
+  const uint32_t w = pnm->width;
+  const uint32_t begin = chunk * ETHSIFT_PNM_CHUNK_ROWS;
+  const uint32_t end = internal_min(begin + ETHSIFT_PNM_CHUNK_ROWS, pnm->height);
+
+  for (uint32_t y = begin; y < end; ++y) {
+    const uint8_t *row = pnm->pixels + (size_t) y * pnm->stride;
+    float *out = job->image.pixels + (size_t) y * w;
+    if (pnm->channels == 1 && pnm->maxval < 256) {
+      for (uint32_t x = 0; x < w; ++x)
+        out[x] = (float) row[x];
+      inc_read(w, uint8_t);
+    } else if (pnm->channels == 1) {
+      // Samples above 8 bits are stored big-endian.
+      for (uint32_t x = 0; x < w; ++x)
+        out[x] = (float) ((row[2 * x] << 8) | row[2 * x + 1]);
+      inc_read(2 * w, uint8_t);
+    } else {
+      // ITU-R BT.601 luma, like the gray conversions of most image tools.
+      const uint32_t sample_size = (pnm->maxval < 256) ? 1 : 2;
+      for (uint32_t x = 0; x < w; ++x) {
+        const uint8_t *rgb = row + (size_t) x * 3 * sample_size;
+        float r = rgb[0], g = rgb[sample_size], b = rgb[2 * sample_size];
+        if (sample_size == 2) {
+          r = (float) ((rgb[0] << 8) | rgb[1]);
+          g = (float) ((rgb[2] << 8) | rgb[3]);
+          b = (float) ((rgb[4] << 8) | rgb[5]);
+        }
+        out[x] = 0.299f * r + 0.587f * g + 0.114f * b;
+      }
+      inc_read(3 * sample_size * w, uint8_t);
+      inc_mults(3 * w);
+      inc_adds(2 * w);
+    }
+    inc_write(w, float);
+  }
+}
+
+/// <summary>
+/// Convert the pixels of a mapped file to float, in chunks of rows spread over the threads of
+/// ethsift_set_thread_count. Colour is converted to gray.
+/// </summary>
+/// <param name="pnm"> IN: File mapped by ethsift_map_pnm. </param>
+/// <param name="image"> OUT: Image with allocated pixels, of the size of the file. </param>
+/// <returns> 1 IF the sizes match, ELSE 0. </returns>
+/// <remarks> 5 * w * h flops for PPM files, ELSE 0 </remarks>
+int ethsift_pnm_to_float(const struct ethsift_pnm *pnm, struct ethsift_image image){
+  if (!pnm->mapping || image.width != pnm->width || image.height != pnm->height)
+    return 0;
+  struct pnm_job job = {pnm, image};
+  thread_pool_run(convert_chunk, &job, (pnm->height + ETHSIFT_PNM_CHUNK_ROWS - 1) / ETHSIFT_PNM_CHUNK_ROWS);
+  return 1;
+}
@@ -235,8 +235,8 @@ int ethsift_refine_local_extrema(struct ethsift_image differences[], uint32_t oc
     inc_read(3+3*8, float);
 
     xc_xr_xs = _mm_mul_ps(xc_xr_xs, vec_t1);
-    xc_xr_xs = _mm_fmadd_ps(col1, vec_t2, xc_xr_xs);
-    xc_xr_xs = _mm_fmadd_ps(col2, vec_t3, xc_xr_xs);
+    xc_xr_xs = _mm_add_ps(_mm_mul_ps(col1, vec_t2), xc_xr_xs);
+    xc_xr_xs = _mm_add_ps(_mm_mul_ps(col2, vec_t3), xc_xr_xs);
 
     inc_adds(8);
     inc_mults(12);
@@ -318,6 +318,9 @@ int ethsift_refine_local_extrema(struct ethsift_image differences[], uint32_t oc
   if (detH <= 0 || (trH * trH / detH) >= response) // 1 MUL + 1 DIV
     return 0;
   
+  keypoint->response = fabsf(value);
+  inc_write(1, float);
+
   keypoint->layer_pos.y = temp[1];
   keypoint->layer_pos.x = temp[0];
   keypoint->layer_pos.scale = sigma * powf(2.0f, temp[2] * inverse_intvls); // 2 MUL + 1 POW
@@ -326,7 +329,8 @@ int ethsift_refine_local_extrema(struct ethsift_image differences[], uint32_t oc
   inc_read(3, float);
   inc_write(3, float);
 
-  float norm = (float)(1 << octave); // 1 POW
+  // A doubled first octave is half the scale of the input image.
+  float norm = ldexpf(1.0f, octave - (int) g_upsample); // 1 POW
 
   // Coordinates in the normalized format (compared to the original image).
   keypoint->global_pos.y = temp[1] * norm; // 1 MUL
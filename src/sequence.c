@@ -0,0 +1,278 @@
+#include "internal.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// An uncompressed video file, mapped as a whole. Frames are handed out as views of their luma
+// plane in the mapping, and the pages of frames already read are dropped again.
+struct ethsift_sequence{
+  const uint8_t *data;
+  size_t size;
+  uint32_t width, height;
+  uint32_t sample_size;
+  // Significant bits of a sample.
+  uint32_t depth;
+  // Bytes of the chroma and alpha planes following the luma plane of a frame. The luma plane
+  // is checked to fit the file on opening, so frame sizes do not wrap around.
+  size_t extra_size;
+  uint32_t fps_num, fps_den;
+  uint32_t y4m;
+  // Position of the first frame, the next frame and the frame handed out last.
+  size_t first, next, last;
+  uint32_t frame_count;
+};
+
+/// <summary>
+/// Parse the decimal number at the start of a header token.
+/// </summary>
+static uint32_t token_number(const uint8_t *token, const uint8_t *end, const uint8_t **after){
+  uint64_t number = 0;
+  while (token < end && '0' <= *token && *token <= '9' && number <= UINT32_MAX)
+    number = number * 10 + (*token++ - '0');
+  *after = token;
+  return (UINT32_MAX < number) ? 0 : (uint32_t) number;
+}
+
+/// <summary>
+/// Whether the token of the given length starts with the prefix.
+/// </summary>
+static int token_is(const uint8_t *token, size_t length, const char *prefix){
+  size_t n = strlen(prefix);
+  return n <= length && !memcmp(token, prefix, n);
+}
+
+/// <summary>
+/// Parse the stream header of a Y4M file, see https://wiki.multimedia.cx/index.php/YUV4MPEG2.
+/// </summary>
+/// <returns> 1 IF the header is complete and describes a supported colour space, ELSE 0. </returns>
+static int parse_y4m_header(struct ethsift_sequence *sequence){
+  const uint8_t *end = memchr(sequence->data, '\n', sequence->size);
+  if (!end)
+    return 0;
+  // 4:2:0 with 8 bits is the default colour space.
+  uint32_t chroma = 420, depth = 8, alpha = 0;
+  sequence->fps_num = 25;
+  sequence->fps_den = 1;
+  const uint8_t *token = sequence->data + 9;
+  while (token < end) {
+    while (token < end && *token == ' ')
+      token++;
+    const uint8_t *token_end = token, *after;
+    while (token_end < end && *token_end != ' ')
+      token_end++;
+    const size_t length = token_end - token;
+    switch (length ? *token : 0) {
+    case 'W':
+      sequence->width = token_number(token + 1, token_end, &after);
+      break;
+    case 'H':
+      sequence->height = token_number(token + 1, token_end, &after);
+      break;
+    case 'F':
+      sequence->fps_num = token_number(token + 1, token_end, &after);
+      if (after < token_end && *after == ':')
+        sequence->fps_den = token_number(after + 1, token_end, &after);
+      break;
+    case 'C':
+      if (token_is(token + 1, length - 1, "mono")) {
+        chroma = 400;
+        after = token + 5;
+      } else {
+        chroma = token_number(token + 1, token_end, &after);
+      }
+      // Deeper samples are spelt p10, p12, p16 or mono16.
+      if (after < token_end && *after == 'p')
+        after++;
+      if (after < token_end && '0' <= *after && *after <= '9')
+        depth = token_number(after, token_end, &after);
+      alpha = token_is(after, token_end - after, "alpha");
+      break;
+    }
+    token = token_end;
+  }
+
+  if (sequence->width == 0 || sequence->height == 0 || depth < 8 || 16 < depth)
+    return 0;
+  const size_t w = sequence->width, h = sequence->height;
+  sequence->sample_size = (depth == 8) ? 1 : 2;
+  sequence->depth = depth;
+  // Refuse luma planes larger than the whole file before multiplying the sizes out, the frame
+  // size is then a small multiple of the file size and cannot wrap around.
+  if (sequence->size / sequence->sample_size / w < h)
+    return 0;
+  switch (chroma) {
+  case 400: sequence->extra_size = 0; break;
+  case 420: sequence->extra_size = 2 * ((w + 1) / 2) * ((h + 1) / 2); break;
+  case 422: sequence->extra_size = 2 * ((w + 1) / 2) * h; break;
+  case 444: sequence->extra_size = 2 * w * h; break;
+  default: return 0;
+  }
+  if (alpha)
+    sequence->extra_size += w * h;
+  sequence->extra_size *= sequence->sample_size;
+  sequence->first = end + 1 - sequence->data;
+  return 1;
+}
+
+/// <summary>
+/// Find the luma plane of the frame at the position.
+/// </summary>
+/// <param name="sequence"> IN: The sequence. </param>
+/// <param name="pos"> IN: Start of the frame, with its header for Y4M files. </param>
+/// <param name="luma"> OUT: Start of the luma plane. </param>
+/// <returns> Start of the frame after it, or 0 IF the file has no complete frame there. </returns>
+static size_t locate_frame(const struct ethsift_sequence *sequence, size_t pos, size_t *luma){
+  if (sequence->y4m) {
+    if (sequence->size - pos < 6 || memcmp(sequence->data + pos, "FRAME", 5))
+      return 0;
+    const uint8_t *end = memchr(sequence->data + pos, '\n', sequence->size - pos);
+    if (!end)
+      return 0;
+    pos = end + 1 - sequence->data;
+  }
+  const size_t frame_size = (size_t) sequence->width * sequence->height * sequence->sample_size + sequence->extra_size;
+  if (sequence->size - pos < frame_size)
+    return 0;
+  *luma = pos;
+  return pos + frame_size;
+}
+
+/// <summary>
+/// Open an uncompressed video file for streaming, either Y4M or raw 8-bit luma frames.
+/// </summary>
+/// <param name="path"> IN: Path of the file. </param>
+/// <param name="width"> IN: Width of the frames of a raw file, ignored for Y4M. </param>
+/// <param name="height"> IN: Height of the frames of a raw file, ignored for Y4M. </param>
+/// <param name="sequence"> OUT: The opened sequence, close it with ethsift_sequence_close. </param>
+/// <returns> 1 IF the file could be mapped and holds at least one frame, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_sequence_open(const char *path, uint32_t width, uint32_t height, struct ethsift_sequence **sequence){
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  struct stat info;
+  if (fstat(fd, &info) || info.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+  void *mapping = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return 0;
+
+  struct ethsift_sequence *s = calloc(1, sizeof(struct ethsift_sequence));
+  if (!s) {
+    munmap(mapping, (size_t) info.st_size);
+    return 0;
+  }
+  s->data = mapping;
+  s->size = (size_t) info.st_size;
+  *sequence = s;
+
+  if (10 <= s->size && !memcmp(s->data, "YUV4MPEG2 ", 10)) {
+    s->y4m = 1;
+    if (!parse_y4m_header(s))
+      goto fail;
+  } else {
+    s->width = width;
+    s->height = height;
+    s->sample_size = 1;
+    s->depth = 8;
+    s->fps_num = 25;
+    s->fps_den = 1;
+    if (width == 0 || height == 0 || s->size / width < height)
+      goto fail;
+  }
+  if (UINT32_MAX < (size_t) s->width * s->sample_size || s->fps_num == 0 || s->fps_den == 0)
+    goto fail;
+
+  // Frames of Y4M files may carry parameters of their own, count them by walking the headers.
+  size_t pos = s->first, luma;
+  while ((pos = locate_frame(s, pos, &luma)))
+    s->frame_count++;
+  if (s->frame_count == 0)
+    goto fail;
+  s->next = s->last = s->first;
+  madvise(mapping, s->size, MADV_SEQUENTIAL);
+  return 1;
+
+ fail:
+  ethsift_sequence_close(s);
+  *sequence = NULL;
+  return 0;
+}
+
+/// <summary>
+/// Close a sequence and unmap its file. Frames read from it are invalid afterwards.
+/// </summary>
+/// <param name="sequence"> IN: Sequence opened by ethsift_sequence_open, may be NULL. </param>
+/// <returns> 1 </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_sequence_close(struct ethsift_sequence *sequence){
+  if (!sequence)
+    return 1;
+  munmap((void *) sequence->data, sequence->size);
+  free(sequence);
+  return 1;
+}
+
+/// <summary>
+/// Describe the frames of a sequence.
+/// </summary>
+/// <param name="sequence"> IN: The sequence. </param>
+/// <param name="width"> OUT: Width of the frames. </param>
+/// <param name="height"> OUT: Height of the frames. </param>
+/// <param name="frame_count"> OUT: Number of complete frames in the file. </param>
+/// <param name="fps"> OUT: Frame rate of the file, 25 for raw files. </param>
+/// <returns> 1 </returns>
+/// <remarks> 1 flop </remarks>
+int ethsift_sequence_info(const struct ethsift_sequence *sequence, uint32_t *width, uint32_t *height, uint32_t *frame_count, float *fps){
+  *width = sequence->width;
+  *height = sequence->height;
+  *frame_count = sequence->frame_count;
+  *fps = (float) sequence->fps_num / (float) sequence->fps_den;
+  return 1;
+}
+
+/// <summary>
+/// Hand out the luma plane of the next frame as a view into the mapped file.
+/// </summary>
+/// <param name="sequence"> IN/OUT: The sequence. </param>
+/// <param name="frame"> OUT: The frame, valid until the next call. ETHSIFT_FORMAT_U8, or ETHSIFT_FORMAT_U16
+///                      with the sample values of the file and bits set to its depth for more than 8 bits. </param>
+/// <returns> 1 IF there was another frame, ELSE 0 at the end of the file. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_sequence_read(struct ethsift_sequence *sequence, struct ethsift_image_view *frame){
+  size_t luma;
+  size_t next = locate_frame(sequence, sequence->next, &luma);
+  if (!next)
+    return 0;
+
+  // The previous frame has been used up, keep the page cache but drop it from the mapping.
+  const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+  const size_t drop_begin = (sequence->last + page - 1) & ~(page - 1);
+  const size_t drop_end = sequence->next & ~(page - 1);
+  if (drop_begin < drop_end)
+    madvise((void *) (sequence->data + drop_begin), drop_end - drop_begin, MADV_DONTNEED);
+
+  frame->data = sequence->data + luma;
+  frame->width = sequence->width;
+  frame->height = sequence->height;
+  frame->stride = sequence->width * sequence->sample_size;
+  frame->format = (sequence->sample_size == 1) ? ETHSIFT_FORMAT_U8 : ETHSIFT_FORMAT_U16;
+  frame->bits = sequence->depth;
+  sequence->last = sequence->next;
+  sequence->next = next;
+  return 1;
+}
+
+/// <summary>
+/// Start reading the sequence from its first frame again.
+/// </summary>
+/// <param name="sequence"> IN/OUT: The sequence. </param>
+/// <returns> 1 </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_sequence_rewind(struct ethsift_sequence *sequence){
+  sequence->next = sequence->last = sequence->first;
+  return 1;
+}
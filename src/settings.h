@@ -52,6 +52,45 @@
 // factor used to convert floating-point descriptor to unsigned char
 #define ETHSIFT_INT_DESCR_FCTR 512.f;
 
+// Keypoints described by a thread at once when descriptors are extracted in parallel.
+#define ETHSIFT_DESCR_CHUNK 32
+
+// Samples per edge of the resampled patch of ETHSIFT_DESCRIPTOR_PATCH.
+#define ETHSIFT_DESCR_PATCH_SIZE 16
+
+// Fractional bits of the int16 pixels of the fixed point pyramid, 8-bit input keeps one bit of headroom.
+#define ETHSIFT_FIXED_FRAC_BITS 7
+
+// Context in pixels kept around a region of interest when building its pyramids. The top Gaussian of
+// octave o blurs across about 16 << o input pixels, so this covers the first two octaves; keypoints of
+// coarser octaves near the border of the region see less context than in the whole image.
+#define ETHSIFT_ROI_HALO 32
+
+// Images per group of ETHSIFT_BATCH_LANES, one per float lane of an AVX2 vector.
+#define ETHSIFT_LANES 8
+
+// Rows of a mapped PGM or PPM file a thread converts to float at once.
+#define ETHSIFT_PNM_CHUNK_ROWS 64
+
+// Version written into keypoint files, readers refuse any other.
+#define ETHSIFT_KEYPOINT_FILE_VERSION 1
+
+// Alignment of the blocks of a keypoint file, one cache line.
+#define ETHSIFT_KEYPOINT_FILE_ALIGN 64
+
+// Most frames ethsift_pipeline_submit can queue ahead of the pyramid stage.
+#define ETHSIFT_PIPELINE_MAX_DEPTH 16
+
+// Most octaves a pyramid can have, an 8K image with a doubled first octave has 10.
+#define ETHSIFT_MAX_OCTAVES 10
+
+// Edge length in input pixels of the tiles a video frame is compared and rebuilt in.
+#define ETHSIFT_VIDEO_TILE 64
+
+// Context in pixels kept around the rebuilt tiles of a video frame. Wider than ETHSIFT_ROI_HALO, as the
+// rebuilt pyramids are merged with the kept ones, but like it exact only for the first octaves.
+#define ETHSIFT_VIDEO_HALO 128
+
 // Maximum amount of Keypoints we want to be able to track.
 #define ETHSIFT_MAX_TRACKABLE_KEYPOINTS 1000
 
@@ -1,4 +1,5 @@
 #include "tester.h"
+#include <float.h>
 
 struct ethsift_image allocate_image(uint32_t width, uint32_t height){
   struct ethsift_image output = {0};
@@ -63,14 +64,22 @@ int convert_image(const ezsift::Image<float> &input,
 }
 
 int load_image(const char *file, struct ethsift_image &image, ezsift::Image<unsigned char> *out){
-  ezsift::Image<unsigned char> img;
-  if(img.read_pgm(file) != 0) return 0;
-  if(!convert_image(img, &image)) return 0;
-  if(out != 0){
-    out->init(img.w, img.h);
-    memcpy(out->data, img.data, img.w * img.h * sizeof(unsigned char));
+  // Convert straight out of the mapped file instead of reading it into a buffer first.
+  struct ethsift_pnm pnm;
+  if(!ethsift_map_pnm(file, &pnm)) return 0;
+  image = allocate_image(pnm.width, pnm.height);
+  int ok = image.pixels != 0 && ethsift_pnm_to_float(&pnm, image);
+  if(ok && out != 0){
+    if(pnm.view.data == 0){
+      ok = 0;
+    }else{
+      out->init(pnm.width, pnm.height);
+      for(uint32_t y=0; y<pnm.height; ++y)
+        memcpy(out->data + y * pnm.width, pnm.pixels + y * pnm.stride, pnm.width);
+    }
   }
-  return 1;
+  ethsift_unmap_pnm(&pnm);
+  return ok;
 }
 
 int compare_image(const ezsift::Image<unsigned char> &ez_img,
@@ -157,6 +166,40 @@ int compare_descriptor(float* ez_descriptors, float* eth_descriptors) {
   return 1;
 }
 
+double math_error(uint32_t function, const float *x, const float *y, uint32_t count){
+  std::vector<float> out(count);
+  if (!ethsift_evaluate_math(function, x, y, out.data(), count))
+    return INFINITY;
+  double worst = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    double expected, unit = FLT_EPSILON;
+    switch (function) {
+    case ETHSIFT_MATH_EXP: expected = exp((double) x[i]); break;
+    case ETHSIFT_MATH_ATAN2:
+      // The pipeline works with angles in [0, 2PI].
+      expected = atan2((double) y[i], (double) x[i]);
+      if (expected < out[i] - M_PI) expected += 2 * M_PI;
+      if (expected > out[i] + M_PI) expected -= 2 * M_PI;
+      break;
+    case ETHSIFT_MATH_SIN: expected = sin((double) x[i]); break;
+    case ETHSIFT_MATH_COS: expected = cos((double) x[i]); break;
+    case ETHSIFT_MATH_FLOOR: expected = floor((double) x[i]); unit = 1; break;
+    default: expected = 1 / sqrt((double) x[i]); break;
+    }
+    if (function == ETHSIFT_MATH_EXP || function == ETHSIFT_MATH_RSQRT) {
+      int e;
+      frexp(expected, &e);
+      unit = ldexp(1.0, e - 24);
+    }
+    double error = fabs(out[i] - expected) / unit;
+    if (std::isnan(error))
+      return INFINITY;
+    if (worst < error)
+      worst = error;
+  }
+  return worst;
+}
+
 int write_image(struct ethsift_image image, const char* filename){
 
   unsigned char* pixels_to_write = (unsigned char *)malloc( image.width * image.height *sizeof(unsigned char));
@@ -41,6 +41,10 @@ int compare_kernel(std::vector<float> ez_kernel, float* eth_kernel, int eth_kern
 // Compare an ezsift descriptor with an ethsift descriptor for correctness
 int compare_descriptor(float* ez_descriptors, float* eth_descriptors);
 
+// Evaluate a math function with ethsift_evaluate_math and return its largest error against double precision.
+// exp and rsqrt are measured in ulp of the result, atan2, sin and cos in ulp of 1 and floor in absolute units.
+double math_error(uint32_t function, const float *x, const float *y, uint32_t count);
+
 // Write an eth_sift image to pgm format
 int write_image(struct ethsift_image image, const char* filename);
 
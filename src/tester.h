@@ -73,7 +73,7 @@ int register_measurement();
 // Return an absolute path to a file within the project root's data/ directory.
 static char* data_file(const char* file) {
     const char* data = ETHSIFT_DATA;
-    char* path = (char*)calloc(sizeof(char), strlen(data) + strlen(file) + 1);
+    char* path = (char*)calloc(sizeof(char), strlen(data) + strlen(file) + 2);
     path = strcat(path, data);
     path = strcat(path, "/");
     path = strcat(path, file);
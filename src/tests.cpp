@@ -95,6 +95,97 @@ define_test(TestDownscale, 0, {
   })
 
 
+define_test(TestDownscaleBackends, 0, {
+    char const *file = data_file("lena.pgm");
+    //init files 
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(ez_img.read_pgm(file) != 0)
+      fail("Failed to read image");
+    if(!convert_image(ez_img, &eth_img))
+      fail("Failed to convert image");
+
+    // Odd widths exercise the tails of the vector loops.
+    for(uint32_t width : {eth_img.width, eth_img.width - 1, 37u}){
+      struct ethsift_image src = {eth_img.pixels, width, eth_img.height};
+      struct ethsift_image ref = allocate_image(width >> 1, eth_img.height >> 1);
+      struct ethsift_image out = allocate_image(width >> 1, eth_img.height >> 1);
+      ethsift_set_backend(ETHSIFT_BACKEND_SCALAR);
+      ethsift_downscale_half(src, ref);
+      for(uint32_t backend = ETHSIFT_BACKEND_SSE; backend <= ETHSIFT_BACKEND_AVX512; ++backend){
+        if(!ethsift_set_backend(backend))
+          continue;
+        ethsift_downscale_half(src, out);
+        if(memcmp(ref.pixels, out.pixels, ref.width * ref.height * sizeof(float)) != 0)
+          fail("Backend %d downscaled width %d differently", backend, width);
+      }
+      free(ref.pixels);
+      free(out.pixels);
+    }
+    ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+    return 1;
+  })
+
+define_test(TestConvolutionRadii, 0, {
+    char const *file = data_file("lena.pgm");
+    //init files 
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(ez_img.read_pgm(file) != 0)
+      fail("Failed to read image");
+    if(!convert_image(ez_img, &eth_img))
+      fail("Failed to convert image");
+
+    // Covers every unrolled radius, the generic fallback past them and symmetric kernels
+    // whose taps are folded. Odd widths exercise the tails of the vector loops.
+    float kernel[2 * 17 + 1];
+    for(uint32_t width : {eth_img.width, 37u}){
+      struct ethsift_image src = {eth_img.pixels, width, eth_img.height};
+      struct ethsift_image ref = allocate_image(width, eth_img.height);
+      struct ethsift_image out = allocate_image(width, eth_img.height);
+      for(int rad = 1; rad <= 17; ++rad){
+        for(int symmetric = 0; symmetric <= 1; ++symmetric){
+          ethsift_generate_gaussian_kernel(kernel, 2 * rad + 1, rad, rad / 3.0f + 0.5f);
+          for(int i = 0; symmetric && i < rad; ++i)
+            kernel[i] = kernel[2 * rad - i] = (kernel[i] + kernel[2 * rad - i]) / 2;
+          ethsift_set_backend(ETHSIFT_BACKEND_SCALAR);
+          ethsift_apply_kernel(src, kernel, 2 * rad + 1, rad, ref);
+          for(uint32_t backend = ETHSIFT_BACKEND_SSE; backend <= ETHSIFT_BACKEND_AVX512; ++backend){
+            if(!ethsift_set_backend(backend))
+              continue;
+            ethsift_apply_kernel(src, kernel, 2 * rad + 1, rad, out);
+            for(uint32_t i = 0; i < width * eth_img.height; ++i){
+              if(0.01f < fabsf(ref.pixels[i] - out.pixels[i]))
+                fail("Backend %d filtered radius %d (symmetric %d) differently at pixel %d", backend, rad, symmetric, i);
+            }
+          }
+        }
+      }
+      free(ref.pixels);
+      free(out.pixels);
+    }
+    ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+
+    // Symmetric kernels shift results slightly, but should still find the same features.
+    struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+    uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    // The kernels must not change under the stage threads of a pipeline.
+    struct ethsift_pipeline *pipeline = NULL;
+    if(!ethsift_pipeline_create(64, 64, 1, 16, ETHSIFT_BACKPRESSURE_BLOCK, &pipeline))
+      fail("Failed to create a pipeline");
+    const int switched = ethsift_set_symmetric_kernels(1);
+    ethsift_pipeline_free(pipeline);
+    if(switched)
+      fail("Regenerated the kernels while a pipeline exists");
+    if(!ethsift_set_symmetric_kernels(1))
+      fail("Failed to generate symmetric kernels");
+    ethsift_compute_keypoints(eth_img, kpts, &count);
+    ethsift_set_symmetric_kernels(0);
+    if(count * 10 < LENA_KEYPOINTS * 9 || LENA_KEYPOINTS * 11 < count * 10)
+      fail("Symmetric kernels found %d keypoints instead of about %d", count, LENA_KEYPOINTS);
+    return 1;
+  })
+
 define_test(TestConvolution, 0, {
     char const *file = data_file("lena.pgm");
     // init files 
@@ -224,6 +315,53 @@ define_test(TestGaussianPyramid, 0, {
   })
 
 
+define_test(TestGaussianPyramidDirect, 0, {
+    char const *file = data_file("lena.pgm");
+    //init files 
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(ez_img.read_pgm(file) != 0)
+      fail("Failed to read image");
+    if(!convert_image(ez_img, &eth_img))
+      fail("Failed to convert image");
+
+    struct ethsift_image sequential[OCTAVE_COUNT * GAUSSIAN_COUNT];
+    struct ethsift_image direct[OCTAVE_COUNT * GAUSSIAN_COUNT];
+    ethsift_allocate_pyramid(sequential, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_allocate_pyramid(direct, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+
+    ethsift_generate_gaussian_pyramid(eth_img, OCTAVE_COUNT, sequential, GAUSSIAN_COUNT);
+    ethsift_set_pyramid_schedule(ETHSIFT_SCHEDULE_DIRECT);
+    ethsift_generate_gaussian_pyramid(eth_img, OCTAVE_COUNT, direct, GAUSSIAN_COUNT);
+    ethsift_set_pyramid_schedule(ETHSIFT_SCHEDULE_SEQUENTIAL);
+
+    // Both schedules approximate the same sigmas. They differ by kernel truncation and
+    // at the border, where the sequential schedule replicates already blurred pixels.
+    const int border = 16;
+    float max_error = 0.0f;
+    for(int i = 0; i < OCTAVE_COUNT * GAUSSIAN_COUNT; ++i){
+      const int w = direct[i].width, h = direct[i].height;
+      for(int r = border; r < h - border; ++r){
+        for(int c = border; c < w - border; ++c){
+          max_error = std::max(max_error, fabsf(direct[i].pixels[r * w + c] - sequential[i].pixels[r * w + c]));
+        }
+      }
+    }
+    ethsift_free_pyramid(sequential);
+    ethsift_free_pyramid(direct);
+    if(0.5f < max_error)
+      fail("Direct schedule differs by %f", max_error);
+
+    struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+    uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    ethsift_set_pyramid_schedule(ETHSIFT_SCHEDULE_DIRECT);
+    ethsift_compute_keypoints(eth_img, kpts, &count);
+    ethsift_set_pyramid_schedule(ETHSIFT_SCHEDULE_SEQUENTIAL);
+    if(count * 10 < LENA_KEYPOINTS * 9 || LENA_KEYPOINTS * 11 < count * 10)
+      fail("Direct schedule found %d keypoints instead of about %d", count, LENA_KEYPOINTS);
+    return 1;
+  })
+
 define_test(TestDOGPyramid, 0, {
     char const *file = data_file("lena.pgm");
     //init files 
@@ -454,6 +592,55 @@ define_test(TestHistograms, 0, {
   })
 
 
+define_test(TestHistogramBackends, 0, {
+    char const *file = data_file("lena.pgm");
+    //init files 
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(ez_img.read_pgm(file) != 0)
+      fail("Failed to read image");
+    if(!convert_image(ez_img, &eth_img))
+      fail("Failed to convert image");
+
+    struct ethsift_image gaussians[OCTAVE_COUNT * GAUSSIAN_COUNT];
+    struct ethsift_image gradients[OCTAVE_COUNT * GAUSSIAN_COUNT];
+    struct ethsift_image rotations[OCTAVE_COUNT * GAUSSIAN_COUNT];
+    ethsift_allocate_pyramid(gaussians, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_allocate_pyramid(gradients, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_allocate_pyramid(rotations, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_generate_gaussian_pyramid(eth_img, OCTAVE_COUNT, gaussians, GAUSSIAN_COUNT);
+    ethsift_generate_gradient_pyramid(gaussians, GAUSSIAN_COUNT, gradients, rotations, GRAD_ROT_LAYERS, OCTAVE_COUNT);
+
+    struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+    uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    ethsift_compute_keypoints(eth_img, kpts, &count);
+
+    // The lanes sum the window in a different order, so only rounding may differ.
+    float ref_hist[ETHSIFT_ORI_HIST_BINS];
+    float hist[ETHSIFT_ORI_HIST_BINS];
+    for(uint32_t k = 0; k < count; ++k){
+      struct ethsift_keypoint kpt = kpts[k];
+      const int level = kpt.octave * GAUSSIAN_COUNT + kpt.layer;
+      float ref_max = 0.f, max = 0.f;
+      ethsift_set_backend(ETHSIFT_BACKEND_SCALAR);
+      ethsift_compute_orientation_histogram(gradients[level], rotations[level], &kpt, ref_hist, &ref_max);
+      for(uint32_t backend = ETHSIFT_BACKEND_SSE; backend <= ETHSIFT_BACKEND_AVX512; ++backend){
+        if(!ethsift_set_backend(backend))
+          continue;
+        ethsift_compute_orientation_histogram(gradients[level], rotations[level], &kpt, hist, &max);
+        for(int i = 0; i < ETHSIFT_ORI_HIST_BINS; ++i){
+          if(1e-4f * (1.0f + ref_max) < fabsf(hist[i] - ref_hist[i]))
+            fail("Backend %d differs by %f in bin %d of keypoint %d", backend, fabsf(hist[i] - ref_hist[i]), i, k);
+        }
+      }
+    }
+    ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+    ethsift_free_pyramid(gaussians);
+    ethsift_free_pyramid(gradients);
+    ethsift_free_pyramid(rotations);
+    return 1;
+  })
+
 define_test(TestExtremaRefinement, 0, {
     char const *file = data_file("lena.pgm");
     //init files 
@@ -716,6 +903,104 @@ define_test(TestExtractDescriptor, 0, {
     }
   })
 
+define_test(TestDescriptorBackends, 0, {
+    char const *file = data_file("lena.pgm");
+    //init files 
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(ez_img.read_pgm(file) != 0)
+      fail("Failed to read image");
+    if(!convert_image(ez_img, &eth_img))
+      fail("Failed to convert image");
+
+    struct ethsift_image gaussians[OCTAVE_COUNT * GAUSSIAN_COUNT];
+    struct ethsift_image gradients[OCTAVE_COUNT * GAUSSIAN_COUNT];
+    struct ethsift_image rotations[OCTAVE_COUNT * GAUSSIAN_COUNT];
+    ethsift_allocate_pyramid(gaussians, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_allocate_pyramid(gradients, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_allocate_pyramid(rotations, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_generate_gaussian_pyramid(eth_img, OCTAVE_COUNT, gaussians, GAUSSIAN_COUNT);
+    ethsift_generate_gradient_pyramid(gaussians, GAUSSIAN_COUNT, gradients, rotations, GRAD_ROT_LAYERS, OCTAVE_COUNT);
+
+    struct ethsift_keypoint ref_kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+    struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+    uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    ethsift_compute_keypoints(eth_img, ref_kpts, &count);
+
+    // The vector exp and the lane-private histograms only change the rounding.
+    ethsift_set_backend(ETHSIFT_BACKEND_SCALAR);
+    ethsift_extract_descriptor(gradients, rotations, OCTAVE_COUNT, GAUSSIAN_COUNT, ref_kpts, count);
+    for(uint32_t backend = ETHSIFT_BACKEND_SSE; backend <= ETHSIFT_BACKEND_AVX512; ++backend){
+      if(!ethsift_set_backend(backend))
+        continue;
+      memcpy(kpts, ref_kpts, count * sizeof(struct ethsift_keypoint));
+      ethsift_extract_descriptor(gradients, rotations, OCTAVE_COUNT, GAUSSIAN_COUNT, kpts, count);
+      for(uint32_t k = 0; k < count; ++k){
+        if(!compare_descriptor(ref_kpts[k].descriptors, kpts[k].descriptors))
+          fail("Backend %d differs in descriptor of keypoint %d", backend, k);
+      }
+    }
+    ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+    ethsift_free_pyramid(gaussians);
+    ethsift_free_pyramid(gradients);
+    ethsift_free_pyramid(rotations);
+    return 1;
+  })
+
+define_test(TestDescriptorSiblings, 0, {
+    char const *file = data_file("lena.pgm");
+    //init files 
+    ezsift::Image<unsigned char> ez_img;
+    struct ethsift_image eth_img = {0};
+    if(ez_img.read_pgm(file) != 0)
+      fail("Failed to read image");
+    if(!convert_image(ez_img, &eth_img))
+      fail("Failed to convert image");
+
+    struct ethsift_image gaussians[OCTAVE_COUNT * GAUSSIAN_COUNT];
+    struct ethsift_image gradients[OCTAVE_COUNT * GAUSSIAN_COUNT];
+    struct ethsift_image rotations[OCTAVE_COUNT * GAUSSIAN_COUNT];
+    ethsift_allocate_pyramid(gaussians, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_allocate_pyramid(gradients, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_allocate_pyramid(rotations, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+    ethsift_generate_gaussian_pyramid(eth_img, OCTAVE_COUNT, gaussians, GAUSSIAN_COUNT);
+    ethsift_generate_gradient_pyramid(gaussians, GAUSSIAN_COUNT, gradients, rotations, GRAD_ROT_LAYERS, OCTAVE_COUNT);
+
+    struct ethsift_keypoint ref_kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+    struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+    uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    ethsift_compute_keypoints(eth_img, kpts, &count);
+
+    uint32_t siblings = 0;
+    for(uint32_t k = 1; k < count; ++k){
+      if(kpts[k].layer_pos.x == kpts[k-1].layer_pos.x && kpts[k].layer_pos.y == kpts[k-1].layer_pos.y
+         && kpts[k].octave == kpts[k-1].octave && kpts[k].layer == kpts[k-1].layer)
+        siblings++;
+    }
+    if(siblings == 0)
+      fail("No keypoints that differ only in orientation");
+    printf("%d of %d keypoints share the window of the previous one\n", siblings, count);
+
+    // Described one at a time every keypoint gathers its own window, which only changes the rounding.
+    for(uint32_t backend = ETHSIFT_BACKEND_SCALAR; backend <= ETHSIFT_BACKEND_AVX512; ++backend){
+      if(!ethsift_set_backend(backend))
+        continue;
+      memcpy(ref_kpts, kpts, count * sizeof(struct ethsift_keypoint));
+      for(uint32_t k = 0; k < count; ++k)
+        ethsift_extract_descriptor(gradients, rotations, OCTAVE_COUNT, GAUSSIAN_COUNT, &ref_kpts[k], 1);
+      ethsift_extract_descriptor(gradients, rotations, OCTAVE_COUNT, GAUSSIAN_COUNT, kpts, count);
+      for(uint32_t k = 0; k < count; ++k){
+        if(!compare_descriptor(ref_kpts[k].descriptors, kpts[k].descriptors))
+          fail("Backend %d differs in descriptor of sibling keypoint %d", backend, k);
+      }
+    }
+    ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+    ethsift_free_pyramid(gaussians);
+    ethsift_free_pyramid(gradients);
+    ethsift_free_pyramid(rotations);
+    return 1;
+  })
+
 define_test(TestComputeKeypoints, 0, {
   char const *file = data_file("lena.pgm");
   //init files 
@@ -733,3 +1018,1295 @@ define_test(TestComputeKeypoints, 0, {
 
   if(keypoints_tracked != LENA_KEYPOINTS) fail("Keypoints tracked mismatched: %d != %d", keypoints_tracked, ETHSIFT_MAX_TRACKABLE_KEYPOINTS);
   })
+
+define_test(TestKeypointBudget, 0, {
+  char const *file = data_file("lena.pgm");
+  //init files 
+  ezsift::Image<unsigned char> ez_img;
+  struct ethsift_image eth_img = {0};
+  if (ez_img.read_pgm(file) != 0)
+    fail("Failed to read image");
+  if (!convert_image(ez_img, &eth_img))
+    fail("Failed to convert image");
+
+  const uint32_t budget = 40;
+  struct ethsift_keypoint all_kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  struct ethsift_keypoint kpts[budget];
+  uint32_t all_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  uint32_t count = budget;
+
+  // Reference run that keeps everything
+  ethsift_set_keypoint_budget(ETHSIFT_BUDGET_SCAN_ORDER);
+  ethsift_compute_keypoints(eth_img, all_kpts, &all_count);
+  if (all_count != LENA_KEYPOINTS)
+    fail("Keypoints tracked mismatched: %d != %d", all_count, LENA_KEYPOINTS);
+
+  // Without counting we get exactly the first keypoints in scan order
+  ethsift_set_keypoint_budget(ETHSIFT_BUDGET_SCAN_ORDER_NO_COUNT);
+  ethsift_compute_keypoints(eth_img, kpts, &count);
+  if (count != budget)
+    fail("Scan order budget returned %d keypoints instead of %d", count, budget);
+  for (uint32_t i = 0; i < budget; ++i) {
+    if (fabs(kpts[i].global_pos.x - all_kpts[i].global_pos.x) > EPS ||
+        fabs(kpts[i].global_pos.y - all_kpts[i].global_pos.y) > EPS ||
+        fabs(kpts[i].orientation - all_kpts[i].orientation) > EPS)
+      fail("Scan order keypoint %d mismatched", i);
+  }
+
+  // The strongest keypoints must be the top of the full run by response
+  count = budget;
+  ethsift_set_keypoint_budget(ETHSIFT_BUDGET_STRONGEST);
+  ethsift_compute_keypoints(eth_img, kpts, &count);
+  ethsift_set_keypoint_budget(ETHSIFT_BUDGET_SCAN_ORDER);
+  if (count != budget)
+    fail("Strongest budget returned %d keypoints instead of %d", count, budget);
+
+  std::vector<float> responses;
+  for (uint32_t i = 0; i < all_count; ++i)
+    responses.push_back(all_kpts[i].response);
+  std::sort(responses.begin(), responses.end(), std::greater<float>());
+  for (uint32_t i = 0; i < budget; ++i) {
+    if (fabs(kpts[i].response - responses[i]) > EPS)
+      fail("Strongest keypoint %d has response %f, expected %f", i, kpts[i].response, responses[i]);
+  }
+
+  // Without capacity the strongest budget keeps nothing and must not touch the array
+  count = 0;
+  ethsift_set_keypoint_budget(ETHSIFT_BUDGET_STRONGEST);
+  int ok = ethsift_compute_keypoints(eth_img, NULL, &count);
+  ethsift_set_keypoint_budget(ETHSIFT_BUDGET_SCAN_ORDER);
+  if (!ok || count != 0)
+    fail("Strongest budget without capacity returned %d keypoints", count);
+  })
+
+define_test(TestKeypointGrid, 0, {
+  char const *file = data_file("lena.pgm");
+  //init files 
+  ezsift::Image<unsigned char> ez_img;
+  struct ethsift_image eth_img = {0};
+  if (ez_img.read_pgm(file) != 0)
+    fail("Failed to read image");
+  if (!convert_image(ez_img, &eth_img))
+    fail("Failed to convert image");
+
+  const uint32_t cell_size = 128;
+  const uint32_t cells = ((eth_img.width + cell_size - 1) / cell_size) * ((eth_img.height + cell_size - 1) / cell_size);
+  struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+
+  // A cell limit nothing reaches must not change the result
+  ethsift_set_keypoint_grid(cell_size, ETHSIFT_MAX_TRACKABLE_KEYPOINTS);
+  ethsift_compute_keypoints(eth_img, kpts, &count);
+  if (count != LENA_KEYPOINTS)
+    fail("Keypoints tracked mismatched: %d != %d", count, LENA_KEYPOINTS);
+
+  // Keypoints per cell of the input image, orientation siblings included.
+  const uint32_t cols = (eth_img.width + cell_size - 1) / cell_size;
+  auto bucket = [&](uint32_t n) {
+    std::vector<uint32_t> in_cell(cells, 0);
+    for (uint32_t i = 0; i < n; ++i) {
+      const uint32_t col = std::min((uint32_t) std::max(kpts[i].global_pos.x, 0.0f) / cell_size, cols - 1);
+      const uint32_t row = std::min((uint32_t) std::max(kpts[i].global_pos.y, 0.0f) / cell_size, cells / cols - 1);
+      ++in_cell[row * cols + col];
+    }
+    return in_cell;
+  };
+  const std::vector<uint32_t> all_cells = bucket(count);
+
+  const uint32_t max_per_cell = 2;
+  count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  if (!ethsift_set_keypoint_grid(cell_size, max_per_cell))
+    fail("Failed to set keypoint grid");
+  ethsift_compute_keypoints(eth_img, kpts, &count);
+  std::vector<uint32_t> grid_cells = bucket(count);
+  for (uint32_t k = 0; k < cells; ++k) {
+    if (max_per_cell < grid_cells[k])
+      fail("Grid kept %d keypoints in cell %d", grid_cells[k], k);
+    if (all_cells[k] != 0 && grid_cells[k] == 0)
+      fail("Grid left cell %d empty, it has %d keypoints without the grid", k, all_cells[k]);
+  }
+
+  // With a region of interest the grid stays anchored to the input image, not to the crop.
+  count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  struct ethsift_image_view view = {eth_img.pixels, eth_img.width, eth_img.height, eth_img.width * (uint32_t) sizeof(float), ETHSIFT_FORMAT_F32};
+  struct ethsift_roi roi = {100, 60, 300, 300};
+  ethsift_compute_keypoints_view(view, roi, NULL, kpts, &count);
+  ethsift_set_keypoint_grid(0, 0);
+  grid_cells = bucket(count);
+  for (uint32_t k = 0; k < cells; ++k) {
+    if (max_per_cell < grid_cells[k])
+      fail("Grid kept %d keypoints in cell %d of the region", grid_cells[k], k);
+  }
+  if (count == 0)
+    fail("Grid kept no keypoints in the region");
+  })
+
+define_test(TestComputeKeypointsROI, 0, {
+  char const *file = data_file("lena.pgm");
+  //init files 
+  ezsift::Image<unsigned char> ez_img;
+  struct ethsift_image eth_img = {0};
+  if (ez_img.read_pgm(file) != 0)
+    fail("Failed to read image");
+  if (!convert_image(ez_img, &eth_img))
+    fail("Failed to convert image");
+
+  struct ethsift_keypoint all_kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  uint32_t all_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  struct ethsift_roi roi = {400, 120, 440, 420};
+
+  // Only allow keypoints in the right three quarters of the ROI
+  std::vector<uint8_t> mask(eth_img.width * eth_img.height, 0);
+  for (uint32_t y = roi.y; y < roi.y + roi.height; ++y)
+    for (uint32_t x = roi.x + roi.width / 4; x < roi.x + roi.width; ++x)
+      mask[y * eth_img.width + x] = 1;
+
+  ethsift_compute_keypoints(eth_img, all_kpts, &all_count);
+  if (!ethsift_compute_keypoints_roi(eth_img, roi, mask.data(), kpts, &count))
+    fail("ROI computation failed");
+  if (count == 0)
+    fail("No keypoints found in ROI");
+
+  // Keypoints are tested before refinement, which may move them by up to 1.5 octave pixels.
+  uint32_t matched = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    const float slack = 1.5f * (1 << kpts[i].octave);
+    if (kpts[i].global_pos.x < roi.x + roi.width / 4 - slack || roi.x + roi.width + slack < kpts[i].global_pos.x ||
+        kpts[i].global_pos.y < roi.y - slack || roi.y + roi.height + slack < kpts[i].global_pos.y)
+      fail("Keypoint %d at %f,%f outside of the ROI", i, kpts[i].global_pos.x, kpts[i].global_pos.y);
+    for (uint32_t j = 0; j < all_count; ++j) {
+      if (fabs(kpts[i].global_pos.x - all_kpts[j].global_pos.x) < EPS &&
+          fabs(kpts[i].global_pos.y - all_kpts[j].global_pos.y) < EPS &&
+          fabs(kpts[i].orientation - all_kpts[j].orientation) < EPS &&
+          compare_descriptor(kpts[i].descriptors, all_kpts[j].descriptors)) {
+        ++matched;
+        break;
+      }
+    }
+  }
+  // Keypoints close to the crop edge see less context than in the full image.
+  if (matched * 2 < count)
+    fail("Only %d of %d ROI keypoints match the full image", matched, count);
+
+  // Regions reaching past the image are refused, also when their end wraps around in 32 bits.
+  struct ethsift_image_view view = {eth_img.pixels, eth_img.width, eth_img.height, eth_img.width * (uint32_t) sizeof(float), ETHSIFT_FORMAT_F32};
+  const struct ethsift_roi outside[3] = {{100, 0, UINT32_MAX - 50, 10}, {0, 100, 10, UINT32_MAX - 50}, {eth_img.width + 1, 0, 1, 1}};
+  for (uint32_t i = 0; i < 3; ++i) {
+    count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    if (ethsift_compute_keypoints_view(view, outside[i], NULL, kpts, &count))
+      fail("Accepted region %d outside of the image", i);
+  }
+  // So are pixel formats the library does not know.
+  count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  view.format = ETHSIFT_FORMAT_U16 + 1;
+  if (ethsift_compute_keypoints_view(view, roi, NULL, kpts, &count))
+    fail("Accepted an unknown pixel format");
+  })
+
+define_test(TestComputeKeypointsView, 0, {
+  char const *file = data_file("lena.pgm");
+  //init files 
+  ezsift::Image<unsigned char> ez_img;
+  struct ethsift_image eth_img = {0};
+  if (ez_img.read_pgm(file) != 0)
+    fail("Failed to read image");
+  if (!convert_image(ez_img, &eth_img))
+    fail("Failed to convert image");
+
+  struct ethsift_keypoint ref_kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  uint32_t ref_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  ethsift_compute_keypoints(eth_img, ref_kpts, &ref_count);
+
+  // Padded 8 and 16 bit copies of the image, as a camera driver would hand them out. 16-bit samples
+  // are scaled to the 8-bit range, so the full range copy and the one declaring 8 significant bits
+  // have to agree with the 8-bit one.
+  const uint32_t stride = eth_img.width + 40;
+  std::vector<uint8_t> u8(stride * eth_img.height);
+  std::vector<uint16_t> u16(stride * eth_img.height), u16_low(stride * eth_img.height);
+  for (uint32_t y = 0; y < eth_img.height; ++y) {
+    for (uint32_t x = 0; x < eth_img.width; ++x) {
+      u8[y * stride + x] = ez_img.data[y * eth_img.width + x];
+      u16[y * stride + x] = ez_img.data[y * eth_img.width + x] * 257;
+      u16_low[y * stride + x] = ez_img.data[y * eth_img.width + x];
+    }
+  }
+  struct ethsift_image_view views[3] = {
+    {u8.data(), eth_img.width, eth_img.height, stride, ETHSIFT_FORMAT_U8},
+    {u16.data(), eth_img.width, eth_img.height, stride * 2, ETHSIFT_FORMAT_U16},
+    {u16_low.data(), eth_img.width, eth_img.height, stride * 2, ETHSIFT_FORMAT_U16, 8}};
+  struct ethsift_roi full = {0};
+
+  for (auto view : views) {
+    uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    if (!ethsift_compute_keypoints_view(view, full, NULL, kpts, &count))
+      fail("View computation failed");
+    if (count != ref_count)
+      fail("Keypoints tracked mismatched: %d != %d", count, ref_count);
+    for (uint32_t i = 0; i < count; ++i) {
+      if (fabs(kpts[i].global_pos.x - ref_kpts[i].global_pos.x) > EPS ||
+          fabs(kpts[i].global_pos.y - ref_kpts[i].global_pos.y) > EPS ||
+          fabs(kpts[i].orientation - ref_kpts[i].orientation) > EPS ||
+          !compare_descriptor(kpts[i].descriptors, ref_kpts[i].descriptors))
+        fail("Keypoint %d mismatched for format %d with %d bits", i, view.format, view.bits);
+    }
+  }
+  })
+
+define_test(TestBackends, 0, {
+  char const *file = data_file("lena.pgm");
+  //init files 
+  ezsift::Image<unsigned char> ez_img;
+  struct ethsift_image eth_img = {0};
+  if (ez_img.read_pgm(file) != 0)
+    fail("Failed to read image");
+  if (!convert_image(ez_img, &eth_img))
+    fail("Failed to convert image");
+
+  struct ethsift_keypoint ref_kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  uint32_t ref_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  if (!ethsift_set_backend(ETHSIFT_BACKEND_AUTO))
+    fail("Failed to select the automatic backend");
+  uint32_t best = ethsift_get_backend();
+  ethsift_compute_keypoints(eth_img, ref_kpts, &ref_count);
+
+  // Rounding differs between backends, so we only require the same keypoints to be found.
+  for (uint32_t backend = ETHSIFT_BACKEND_SCALAR; backend <= best; ++backend) {
+    if (!ethsift_set_backend(backend))
+      fail("Backend %d is supported by the CPU but could not be selected", backend);
+    uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    ethsift_compute_keypoints(eth_img, kpts, &count);
+    uint32_t matched = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      for (uint32_t j = 0; j < ref_count; ++j) {
+        if (fabs(kpts[i].global_pos.x - ref_kpts[j].global_pos.x) < 0.5 &&
+            fabs(kpts[i].global_pos.y - ref_kpts[j].global_pos.y) < 0.5 &&
+            fabs(kpts[i].orientation - ref_kpts[j].orientation) < 0.01) {
+          ++matched;
+          break;
+        }
+      }
+    }
+    if (matched * 10 < ref_count * 9)
+      fail("Backend %d matched only %d of %d keypoints", backend, matched, ref_count);
+  }
+  ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+  })
+
+define_test(TestUpsample, 0, {
+  char const *file = data_file("lena.pgm");
+  //init files 
+  ezsift::Image<unsigned char> ez_img;
+  struct ethsift_image eth_img = {0};
+  if (ez_img.read_pgm(file) != 0)
+    fail("Failed to read image");
+  if (!convert_image(ez_img, &eth_img))
+    fail("Failed to convert image");
+
+  struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  ethsift_set_upsample(1);
+  int ok = ethsift_compute_keypoints(eth_img, kpts, &count);
+  ethsift_set_upsample(0);
+  if (!ok)
+    fail("Upsampled computation failed");
+
+  // 7680 * 559241 pixels wrap around to 3584 in 32 bits, they have to be refused before anything is read.
+  struct ethsift_image_view huge = {eth_img.pixels, 7680, 559241, 7680, ETHSIFT_FORMAT_U8};
+  uint32_t huge_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  if (ethsift_compute_keypoints_view(huge, {0, 0, 0, 0}, NULL, kpts, &huge_count))
+    fail("Accepted an image larger than 8K");
+
+  // Tall images are as small as 8K in area, but their columns do not fit row_buf.
+  std::vector<uint8_t> tall_pixels(64 * 16000);
+  struct ethsift_image_view tall = {tall_pixels.data(), 64, 16000, 64, ETHSIFT_FORMAT_U8};
+  huge_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  if (ethsift_compute_keypoints_view(tall, {0, 0, 0, 0}, NULL, kpts, &huge_count))
+    fail("Accepted an image taller than 8K");
+  struct ethsift_video *video = NULL;
+  if (ethsift_video_create(64, 16000, 1.0f, &video)) {
+    ethsift_video_free(video);
+    fail("Accepted a video taller than 8K");
+  }
+
+  std::list<ezsift::SiftKeypoint> ez_kpt_list;
+  ezsift::double_original_image(true);
+  ezsift::sift_cpu(ez_img, ez_kpt_list, true);
+  ezsift::double_original_image(false);
+
+  // ezsift rounds the upsampled octave to 8 bit, so only require most keypoints to agree.
+  uint32_t matched = 0;
+  for (auto &ez_kpt : ez_kpt_list) {
+    for (uint32_t i = 0; i < std::min<uint32_t>(count, ETHSIFT_MAX_TRACKABLE_KEYPOINTS); ++i) {
+      if (fabs(kpts[i].global_pos.x - ez_kpt.c) < 1.0 &&
+          fabs(kpts[i].global_pos.y - ez_kpt.r) < 1.0 &&
+          fabs(kpts[i].global_pos.scale - ez_kpt.scale) < 0.1) {
+        ++matched;
+        break;
+      }
+    }
+  }
+  if (count <= LENA_KEYPOINTS)
+    fail("Upsampling found no additional keypoints: %d", count);
+  if (matched * 10 < ez_kpt_list.size() * 9)
+    fail("Only %d of %d ezsift keypoints matched", matched, (int) ez_kpt_list.size());
+  })
+
+define_test(TestFixedPoint, 0, {
+  char const *file = data_file("lena.pgm");
+  //init files 
+  ezsift::Image<unsigned char> ez_img;
+  struct ethsift_image eth_img = {0};
+  if (ez_img.read_pgm(file) != 0)
+    fail("Failed to read image");
+  if (!convert_image(ez_img, &eth_img))
+    fail("Failed to convert image");
+  struct ethsift_image_view view = {ez_img.data, eth_img.width, eth_img.height, eth_img.width, ETHSIFT_FORMAT_U8};
+  struct ethsift_roi full = {0};
+
+  // Integer arithmetic rounds the same on every backend, so the pyramids must be identical.
+  struct ethsift_image ref_gaussians[OCTAVE_COUNT * GAUSSIAN_COUNT];
+  struct ethsift_image ref_differences[OCTAVE_COUNT * DOG_COUNT];
+  struct ethsift_image gaussians[OCTAVE_COUNT * GAUSSIAN_COUNT];
+  struct ethsift_image differences[OCTAVE_COUNT * DOG_COUNT];
+  ethsift_allocate_pyramid(ref_gaussians, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+  ethsift_allocate_pyramid(ref_differences, eth_img.width, eth_img.height, OCTAVE_COUNT, DOG_COUNT);
+  ethsift_allocate_pyramid(gaussians, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+  ethsift_allocate_pyramid(differences, eth_img.width, eth_img.height, OCTAVE_COUNT, DOG_COUNT);
+  ethsift_set_backend(ETHSIFT_BACKEND_SCALAR);
+  if (!ethsift_generate_pyramids_fixed(view, OCTAVE_COUNT, ref_gaussians, GAUSSIAN_COUNT, ref_differences, DOG_COUNT))
+    fail("Failed to generate the fixed point pyramids");
+  for (uint32_t backend = ETHSIFT_BACKEND_SSE; backend <= ETHSIFT_BACKEND_AVX512; ++backend) {
+    if (!ethsift_set_backend(backend))
+      continue;
+    ethsift_generate_pyramids_fixed(view, OCTAVE_COUNT, gaussians, GAUSSIAN_COUNT, differences, DOG_COUNT);
+    for (int i = 0; i < OCTAVE_COUNT * GAUSSIAN_COUNT; ++i) {
+      if (memcmp(ref_gaussians[i].pixels, gaussians[i].pixels, gaussians[i].width * gaussians[i].height * sizeof(float)) != 0)
+        fail("Backend %d computed gaussian %d differently", backend, i);
+    }
+  }
+  ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+  ethsift_free_pyramid(ref_gaussians);
+  ethsift_free_pyramid(ref_differences);
+  ethsift_free_pyramid(gaussians);
+  ethsift_free_pyramid(differences);
+
+  // Measure how many of the float pipeline's keypoints the fixed point one finds as well.
+  struct ethsift_keypoint ref_kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  uint32_t ref_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  ethsift_compute_keypoints_view(view, full, NULL, ref_kpts, &ref_count);
+  ethsift_set_fixed_point(1);
+  ethsift_compute_keypoints_view(view, full, NULL, kpts, &count);
+  ethsift_set_fixed_point(0);
+
+  uint32_t matched = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    for (uint32_t j = 0; j < ref_count; ++j) {
+      if (fabs(kpts[i].global_pos.x - ref_kpts[j].global_pos.x) < 0.5 &&
+          fabs(kpts[i].global_pos.y - ref_kpts[j].global_pos.y) < 0.5 &&
+          fabs(kpts[i].orientation - ref_kpts[j].orientation) < 0.05) {
+        ++matched;
+        break;
+      }
+    }
+  }
+  printf("Fixed point matched %d of %d float keypoints (%d found)\n", matched, ref_count, count);
+  if (matched * 10 < ref_count * 9 || count * 10 < ref_count * 9 || ref_count * 11 < count * 10)
+    fail("Fixed point matched only %d of %d keypoints, found %d", matched, ref_count, count);
+  })
+
+define_test(TestOrientationOctant, 0, {
+  char const *file = data_file("lena.pgm");
+  //init files 
+  ezsift::Image<unsigned char> ez_img;
+  struct ethsift_image eth_img = {0};
+  if (ez_img.read_pgm(file) != 0)
+    fail("Failed to read image");
+  if (!convert_image(ez_img, &eth_img))
+    fail("Failed to convert image");
+
+  // Without rotations only the gradient magnitudes are written, they must not change.
+  struct ethsift_image gaussians[OCTAVE_COUNT * GAUSSIAN_COUNT];
+  struct ethsift_image ref_gradients[OCTAVE_COUNT * GAUSSIAN_COUNT];
+  struct ethsift_image rotations[OCTAVE_COUNT * GAUSSIAN_COUNT];
+  struct ethsift_image gradients[OCTAVE_COUNT * GAUSSIAN_COUNT];
+  ethsift_allocate_pyramid(gaussians, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+  ethsift_allocate_pyramid(ref_gradients, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+  ethsift_allocate_pyramid(rotations, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+  ethsift_allocate_pyramid(gradients, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+  ethsift_generate_gaussian_pyramid(eth_img, OCTAVE_COUNT, gaussians, GAUSSIAN_COUNT);
+  for (uint32_t backend = ETHSIFT_BACKEND_SCALAR; backend <= ETHSIFT_BACKEND_AVX512; ++backend) {
+    if (!ethsift_set_backend(backend))
+      continue;
+    ethsift_generate_gradient_pyramid(gaussians, GAUSSIAN_COUNT, ref_gradients, rotations, GRAD_ROT_LAYERS, OCTAVE_COUNT);
+    ethsift_generate_gradient_pyramid(gaussians, GAUSSIAN_COUNT, gradients, NULL, GRAD_ROT_LAYERS, OCTAVE_COUNT);
+    for (int i = 0; i < OCTAVE_COUNT; ++i) {
+      for (int j = 1; j <= GRAD_ROT_LAYERS; ++j) {
+        const struct ethsift_image ref = ref_gradients[i * GAUSSIAN_COUNT + j];
+        const struct ethsift_image out = gradients[i * GAUSSIAN_COUNT + j];
+        for (uint32_t p = 0; p < ref.width * ref.height; ++p) {
+          if (1e-4f * (1.0f + ref.pixels[p]) < fabsf(ref.pixels[p] - out.pixels[p]))
+            fail("Backend %d magnitude differs at pixel %d of level %d", backend, p, i * GAUSSIAN_COUNT + j);
+        }
+      }
+    }
+  }
+  ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+  ethsift_free_pyramid(gaussians);
+  ethsift_free_pyramid(ref_gradients);
+  ethsift_free_pyramid(rotations);
+  ethsift_free_pyramid(gradients);
+
+  // Pseudo angles move the bins slightly, most keypoints and descriptors should survive that.
+  struct ethsift_keypoint ref_kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  uint32_t ref_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  ethsift_compute_keypoints(eth_img, ref_kpts, &ref_count);
+  if (!ethsift_set_orientation_mode(ETHSIFT_ORIENTATION_OCTANT))
+    fail("Failed to select octant orientations");
+  ethsift_compute_keypoints(eth_img, kpts, &count);
+  ethsift_set_orientation_mode(ETHSIFT_ORIENTATION_ATAN2);
+
+  uint32_t matched = 0;
+  float similarity = 0.0f;
+  for (uint32_t i = 0; i < count; ++i) {
+    for (uint32_t j = 0; j < ref_count; ++j) {
+      if (fabs(kpts[i].global_pos.x - ref_kpts[j].global_pos.x) < 0.5 &&
+          fabs(kpts[i].global_pos.y - ref_kpts[j].global_pos.y) < 0.5 &&
+          fabs(kpts[i].orientation - ref_kpts[j].orientation) < 0.1) {
+        float dot = 0.0f, norm_a = 0.0f, norm_b = 0.0f;
+        for (int k = 0; k < 128; ++k) {
+          dot += kpts[i].descriptors[k] * ref_kpts[j].descriptors[k];
+          norm_a += kpts[i].descriptors[k] * kpts[i].descriptors[k];
+          norm_b += ref_kpts[j].descriptors[k] * ref_kpts[j].descriptors[k];
+        }
+        similarity += dot / sqrtf(norm_a * norm_b);
+        ++matched;
+        break;
+      }
+    }
+  }
+  printf("Octant orientations matched %d of %d keypoints, mean descriptor similarity %f\n", matched, ref_count, similarity / matched);
+  if (matched * 10 < ref_count * 8)
+    fail("Octant orientations matched only %d of %d keypoints", matched, ref_count);
+  if (similarity < 0.95f * matched)
+    fail("Octant descriptors are too dissimilar: %f", similarity / matched);
+  })
+
+define_test(TestDescriptorPatch, 0, {
+  char const *file = data_file("lena.pgm");
+  //init files 
+  ezsift::Image<unsigned char> ez_img;
+  struct ethsift_image eth_img = {0};
+  if (ez_img.read_pgm(file) != 0)
+    fail("Failed to read image");
+  if (!convert_image(ez_img, &eth_img))
+    fail("Failed to convert image");
+
+  struct ethsift_image gaussians[OCTAVE_COUNT * GAUSSIAN_COUNT];
+  ethsift_allocate_pyramid(gaussians, eth_img.width, eth_img.height, OCTAVE_COUNT, GAUSSIAN_COUNT);
+  ethsift_generate_gaussian_pyramid(eth_img, OCTAVE_COUNT, gaussians, GAUSSIAN_COUNT);
+
+  struct ethsift_keypoint ref_kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  struct ethsift_keypoint backend_kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  ethsift_compute_keypoints(eth_img, ref_kpts, &count);
+  memcpy(kpts, ref_kpts, count * sizeof(struct ethsift_keypoint));
+  ethsift_set_backend(ETHSIFT_BACKEND_SCALAR);
+  ethsift_extract_descriptor_patch(gaussians, OCTAVE_COUNT, GAUSSIAN_COUNT, kpts, count);
+
+  // The backends only differ in rounding.
+  for (uint32_t backend = ETHSIFT_BACKEND_SSE; backend <= ETHSIFT_BACKEND_AVX512; ++backend) {
+    if (!ethsift_set_backend(backend))
+      continue;
+    memcpy(backend_kpts, ref_kpts, count * sizeof(struct ethsift_keypoint));
+    ethsift_extract_descriptor_patch(gaussians, OCTAVE_COUNT, GAUSSIAN_COUNT, backend_kpts, count);
+    for (uint32_t k = 0; k < count; ++k) {
+      for (int i = 0; i < 128; ++i) {
+        if (0.01f < fabsf(kpts[k].descriptors[i] - backend_kpts[k].descriptors[i]))
+          fail("Backend %d differs in patch descriptor of keypoint %d", backend, k);
+      }
+    }
+  }
+  ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+  ethsift_free_pyramid(gaussians);
+
+  // Accuracy against the window descriptors, both are normalized to the same length.
+  float similarity = 0.0f, distance = 0.0f;
+  for (uint32_t k = 0; k < count; ++k) {
+    float dot = 0.0f, norm_a = 0.0f, norm_b = 0.0f, dist = 0.0f;
+    for (int i = 0; i < 128; ++i) {
+      const float a = kpts[k].descriptors[i], b = ref_kpts[k].descriptors[i];
+      dot += a * b;
+      norm_a += a * a;
+      norm_b += b * b;
+      dist += (a - b) * (a - b);
+    }
+    similarity += dot / sqrtf(norm_a * norm_b);
+    distance += sqrtf(dist / norm_b);
+  }
+  printf("Patch descriptors of %d keypoints: mean similarity %f, mean relative distance %f\n", count, similarity / count, distance / count);
+
+  // The mode has to reach ethsift_compute_keypoints as well.
+  uint32_t patch_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  if (!ethsift_set_descriptor_mode(ETHSIFT_DESCRIPTOR_PATCH))
+    fail("Failed to select patch descriptors");
+  ethsift_compute_keypoints(eth_img, backend_kpts, &patch_count);
+  ethsift_set_descriptor_mode(ETHSIFT_DESCRIPTOR_WINDOW);
+  if (patch_count != count)
+    fail("Patch descriptors changed the keypoints: %d != %d", patch_count, count);
+  for (uint32_t k = 0; k < count; ++k) {
+    for (int i = 0; i < 128; ++i) {
+      if (0.01f < fabsf(kpts[k].descriptors[i] - backend_kpts[k].descriptors[i]))
+        fail("Patch descriptor of keypoint %d differs in ethsift_compute_keypoints", k);
+    }
+  }
+  if (similarity < 0.9f * count)
+    fail("Patch descriptors are too dissimilar: %f", similarity / count);
+  })
+
+define_test(TestParallelDescriptors, 0, {
+  char const *file = data_file("lena.pgm");
+  //init files 
+  ezsift::Image<unsigned char> ez_img;
+  struct ethsift_image eth_img = {0};
+  if (ez_img.read_pgm(file) != 0)
+    fail("Failed to read image");
+  if (!convert_image(ez_img, &eth_img))
+    fail("Failed to convert image");
+
+  struct ethsift_keypoint ref_kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  uint32_t ref_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  ethsift_compute_keypoints(eth_img, ref_kpts, &ref_count);
+
+  // Every keypoint is described the same way on any thread, the results have to be identical.
+  for (uint32_t threads = 2; threads <= 4; threads += 2) {
+    if (!ethsift_set_thread_count(threads))
+      fail("Failed to start %d threads", threads);
+    uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    ethsift_compute_keypoints(eth_img, kpts, &count);
+    if (count != ref_count)
+      fail("Keypoints tracked mismatched: %d != %d", count, ref_count);
+    for (uint32_t k = 0; k < count; ++k) {
+      if (memcmp(kpts[k].descriptors, ref_kpts[k].descriptors, sizeof(kpts[k].descriptors)))
+        fail("Descriptor of keypoint %d differs with %d threads", k, threads);
+    }
+  }
+  ethsift_set_thread_count(1);
+  })
+
+// Check the error of a math function in every accuracy tier on every backend against its bound
+// from the table in src/vector_math.h. On failure the offending tier, backend and error are returned.
+static int math_within_bounds(uint32_t function, const std::vector<float> &x, const std::vector<float> &y,
+                              const double bounds[3], uint32_t *tier, uint32_t *backend, double *error){
+  ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+  uint32_t best = ethsift_get_backend();
+  int ok = 1;
+  for (*tier = ETHSIFT_ACCURACY_FAST; ok && *tier <= ETHSIFT_ACCURACY_EXACT; ++*tier) {
+    ethsift_set_math_accuracy(*tier);
+    double worst = 0;
+    for (*backend = ETHSIFT_BACKEND_SCALAR; *backend <= best; ++*backend) {
+      if (!ethsift_set_backend(*backend))
+        continue;
+      *error = math_error(function, x.data(), y.data(), (uint32_t) x.size());
+      if (worst < *error)
+        worst = *error;
+      if (!(*error <= bounds[*tier])) {
+        ok = 0;
+        break;
+      }
+    }
+    if (ok)
+      printf("Math function %d, tier %d: max error %g (bound %g)\n", function, *tier, worst, bounds[*tier]);
+  }
+  if (!ok)
+    --*tier;
+  ethsift_set_math_accuracy(ETHSIFT_ACCURACY_FAST);
+  ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+  return ok;
+}
+
+define_test(TestMathExp, 0, {
+  std::vector<float> x;
+  for (float v = -87.0f; v <= 88.0f; v += 0.000171f)
+    x.push_back(v);
+  const double bounds[3] = {48, 2, 1};
+  uint32_t tier, backend;
+  double error;
+  if (!math_within_bounds(ETHSIFT_MATH_EXP, x, x, bounds, &tier, &backend, &error))
+    fail("exp at tier %d on backend %d is off by %g ulp", tier, backend, error);
+  })
+
+define_test(TestMathAtan2, 0, {
+  std::vector<float> x, y;
+  for (int i = -500; i <= 500; ++i) {
+    for (int j = -500; j <= 500; ++j) {
+      x.push_back(i * 0.2f);
+      y.push_back(j * 0.2f + 0.01f);
+    }
+  }
+  const double bounds[3] = {51480, 5, 5};
+  uint32_t tier, backend;
+  double error;
+  if (!math_within_bounds(ETHSIFT_MATH_ATAN2, x, y, bounds, &tier, &backend, &error))
+    fail("atan2 at tier %d on backend %d is off by %g ulp", tier, backend, error);
+  })
+
+define_test(TestMathSinCos, 0, {
+  std::vector<float> x, wide;
+  for (float v = -8 * M_PI; v <= 8 * M_PI; v += 0.0000517f)
+    x.push_back(v);
+  for (float v = -8192; v <= 8192; v += 0.0173f)
+    wide.push_back(v);
+  const double bounds[3] = {1, 1, 1};
+  const double wide_bounds[3] = {2, 1, 1};
+  uint32_t tier, backend;
+  double error;
+  if (!math_within_bounds(ETHSIFT_MATH_SIN, x, x, bounds, &tier, &backend, &error))
+    fail("sin at tier %d on backend %d is off by %g ulp", tier, backend, error);
+  if (!math_within_bounds(ETHSIFT_MATH_COS, x, x, bounds, &tier, &backend, &error))
+    fail("cos at tier %d on backend %d is off by %g ulp", tier, backend, error);
+  if (!math_within_bounds(ETHSIFT_MATH_SIN, wide, wide, wide_bounds, &tier, &backend, &error))
+    fail("sin of large arguments at tier %d on backend %d is off by %g ulp", tier, backend, error);
+  })
+
+define_test(TestMathFloor, 0, {
+  std::vector<float> x;
+  for (int i = -1000000; i <= 1000000; i += 7) {
+    x.push_back((float) i);
+    x.push_back(nextafterf((float) i, -INFINITY));
+    x.push_back(i + 0.5f);
+  }
+  const double bounds[3] = {0, 0, 0};
+  uint32_t tier, backend;
+  double error;
+  if (!math_within_bounds(ETHSIFT_MATH_FLOOR, x, x, bounds, &tier, &backend, &error))
+    fail("floor at tier %d on backend %d is off by %g", tier, backend, error);
+  })
+
+define_test(TestMathRsqrt, 0, {
+  std::vector<float> x;
+  for (float v = 1e-30f; v <= 1e30f; v *= 1.0000713f)
+    x.push_back(v);
+  const double bounds[3] = {4, 2, 1};
+  uint32_t tier, backend;
+  double error;
+  if (!math_within_bounds(ETHSIFT_MATH_RSQRT, x, x, bounds, &tier, &backend, &error))
+    fail("rsqrt at tier %d on backend %d is off by %g ulp", tier, backend, error);
+  })
+
+define_test(TestVideo, 0, {
+  char const *file = data_file("lena.pgm");
+  //init files 
+  ezsift::Image<unsigned char> ez_img;
+  struct ethsift_image eth_img = {0};
+  if (ez_img.read_pgm(file) != 0)
+    fail("Failed to read image");
+  if (!convert_image(ez_img, &eth_img))
+    fail("Failed to convert image");
+
+  struct ethsift_keypoint ref_kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  struct ethsift_keypoint kpts[ETHSIFT_MAX_TRACKABLE_KEYPOINTS];
+  uint32_t ref_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  ethsift_compute_keypoints(eth_img, ref_kpts, &ref_count);
+
+  struct ethsift_video *video = NULL;
+  if (!ethsift_video_create(eth_img.width, eth_img.height, 1.0f, &video))
+    fail("Failed to create the video state");
+  std::vector<float> pixels(eth_img.pixels, eth_img.pixels + eth_img.width * eth_img.height);
+  struct ethsift_image_view frame = {pixels.data(), eth_img.width, eth_img.height, eth_img.width * (uint32_t) sizeof(float), ETHSIFT_FORMAT_F32};
+  uint32_t recomputed, tiles;
+
+  // The first frame is built whole, exactly like a single image.
+  uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  if (!ethsift_video_process(video, frame, kpts, &count))
+    fail("Failed to process the first frame");
+  if (count != ref_count)
+    fail("Keypoints tracked mismatched: %d != %d", count, ref_count);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (memcmp(&kpts[i], &ref_kpts[i], sizeof(struct ethsift_keypoint)))
+      fail("Keypoint %d of the first frame differs", i);
+  }
+
+  // An unchanged frame rebuilds nothing and keeps every keypoint.
+  count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  ethsift_video_process(video, frame, kpts, &count);
+  ethsift_video_stats(video, &recomputed, &tiles);
+  if (recomputed != 0 || count != ref_count)
+    fail("Static frame rebuilt %d tiles and kept %d of %d keypoints", recomputed, count, ref_count);
+
+  // A bright square changes a few tiles, the rest of the frame has to agree with a full computation.
+  for (uint32_t y = 300; y < 340; ++y)
+    for (uint32_t x = 600; x < 640; ++x)
+      pixels[y * eth_img.width + x] = 255.0f;
+  struct ethsift_image changed = {pixels.data(), eth_img.width, eth_img.height};
+  ref_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  ethsift_compute_keypoints(changed, ref_kpts, &ref_count);
+  count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  ethsift_video_process(video, frame, kpts, &count);
+  ethsift_video_stats(video, &recomputed, &tiles);
+  printf("Changed frame rebuilt %d of %d tiles\n", recomputed, tiles);
+  if (recomputed == 0 || tiles < recomputed * 8)
+    fail("Changed frame rebuilt %d of %d tiles", recomputed, tiles);
+  const uint32_t changed_tiles = recomputed;
+
+  uint32_t matched = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    for (uint32_t j = 0; j < ref_count; ++j) {
+      if (fabs(kpts[i].global_pos.x - ref_kpts[j].global_pos.x) < 0.5 &&
+          fabs(kpts[i].global_pos.y - ref_kpts[j].global_pos.y) < 0.5 &&
+          fabs(kpts[i].orientation - ref_kpts[j].orientation) < 0.01) {
+        ++matched;
+        break;
+      }
+    }
+  }
+  printf("Changed frame matched %d of %d keypoints, %d reference keypoints\n", matched, count, ref_count);
+  if (matched * 10 < ref_count * 9 || matched * 10 < count * 9)
+    fail("Changed frame matched only %d of %d keypoints, %d reference keypoints", matched, count, ref_count);
+
+  // 8-bit frames go through the byte SAD of each backend and have to find the same tiles.
+  std::vector<uint8_t> u8(ez_img.data, ez_img.data + eth_img.width * eth_img.height);
+  struct ethsift_image_view u8_frame = {u8.data(), eth_img.width, eth_img.height, eth_img.width, ETHSIFT_FORMAT_U8};
+  ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+  uint32_t best = ethsift_get_backend();
+  for (uint32_t backend = ETHSIFT_BACKEND_SCALAR; backend <= best; ++backend) {
+    ethsift_set_backend(backend);
+    for (uint32_t y = 300; y < 340; ++y)
+      for (uint32_t x = 600; x < 640; ++x)
+        u8[y * eth_img.width + x] = ez_img.data[y * eth_img.width + x];
+    // Every call needs the full capacity again, count holds the keypoints of the previous frame.
+    for (int i = 0; i < 2; ++i) {
+      count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+      if (!ethsift_video_process(video, u8_frame, kpts, &count))
+        fail("Failed to process a static 8-bit frame on backend %d", backend);
+    }
+    ethsift_video_stats(video, &recomputed, &tiles);
+    if (recomputed != 0)
+      fail("Static 8-bit frame rebuilt %d tiles on backend %d", recomputed, backend);
+    for (uint32_t y = 300; y < 340; ++y)
+      for (uint32_t x = 600; x < 640; ++x)
+        u8[y * eth_img.width + x] = 255;
+    count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    if (!ethsift_video_process(video, u8_frame, kpts, &count))
+      fail("Failed to process a changed 8-bit frame on backend %d", backend);
+    ethsift_video_stats(video, &recomputed, &tiles);
+    if (recomputed != changed_tiles)
+      fail("Changed 8-bit frame rebuilt %d tiles on backend %d", recomputed, backend);
+  }
+  ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+
+  // Frames of a pixel format the library does not know are refused.
+  u8_frame.format = ETHSIFT_FORMAT_U16 + 1;
+  count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  if (ethsift_video_process(video, u8_frame, kpts, &count))
+    fail("Processed a frame of an unknown pixel format");
+  ethsift_video_free(video);
+  })
+
+define_test(TestComputeKeypointsBatch, 0, {
+  const char *names[] = {"auto-240p.pgm", "auto-360p.pgm", "lena.pgm", "auto-240p.pgm"};
+  const uint32_t image_count = 5;
+  struct ethsift_image images[4] = {0};
+  for (uint32_t i = 0; i < 4; ++i) {
+    if (!load_image(data_file(names[i]), images[i]))
+      fail("Failed to load %s", names[i]);
+  }
+  // The last image is too small for a single octave and fails on its own.
+  std::vector<float> tiny(8 * 8, 0.0f);
+  struct ethsift_image_view views[image_count];
+  for (uint32_t i = 0; i < 4; ++i)
+    views[i] = {images[i].pixels, images[i].width, images[i].height, images[i].width * (uint32_t) sizeof(float), ETHSIFT_FORMAT_F32};
+  views[4] = {tiny.data(), 8, 8, 8 * sizeof(float), ETHSIFT_FORMAT_F32};
+
+  std::vector<std::vector<struct ethsift_keypoint>> ref_kpts(image_count), kpts(image_count);
+  uint32_t ref_counts[image_count];
+  for (uint32_t i = 0; i < image_count; ++i) {
+    ref_kpts[i].resize(ETHSIFT_MAX_TRACKABLE_KEYPOINTS);
+    kpts[i].resize(ETHSIFT_MAX_TRACKABLE_KEYPOINTS);
+    ref_counts[i] = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    if (ethsift_compute_keypoints_view(views[i], {0, 0, 0, 0}, NULL, ref_kpts[i].data(), &ref_counts[i]) != (i < 4))
+      fail("Single image %d did not give the expected result", i);
+  }
+  if (ref_counts[0] == 0 || ref_counts[2] == 0)
+    fail("No keypoints found in the reference images");
+
+  // Each image runs whole on one thread with the same code, the results have to be identical.
+  for (uint32_t threads = 1; threads <= 3; threads += 2) {
+    if (!ethsift_set_thread_count(threads))
+      fail("Failed to start %d threads", threads);
+    // Run twice, the second batch reuses the pyramids of the first.
+    for (uint32_t run = 0; run < 2; ++run) {
+      struct ethsift_keypoint *outputs[image_count];
+      uint32_t counts[image_count];
+      for (uint32_t i = 0; i < image_count; ++i) {
+        outputs[i] = kpts[i].data();
+        counts[i] = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+      }
+      if (ethsift_compute_keypoints_batch(views, image_count, outputs, counts))
+        fail("Batch with a failing image reported success");
+      for (uint32_t i = 0; i < image_count; ++i) {
+        if (counts[i] != ((i < 4) ? ref_counts[i] : 0))
+          fail("Keypoints of image %d mismatched with %d threads: %d != %d", i, threads, counts[i], ref_counts[i]);
+        for (uint32_t k = 0; k < counts[i]; ++k) {
+          if (memcmp(&kpts[i][k], &ref_kpts[i][k], sizeof(struct ethsift_keypoint)))
+            fail("Keypoint %d of image %d differs with %d threads", k, i, threads);
+        }
+      }
+    }
+    uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    struct ethsift_keypoint *output = kpts[0].data();
+    if (!ethsift_compute_keypoints_batch(views, 1, &output, &count) || count != ref_counts[0])
+      fail("Batch of a single image failed with %d threads", threads);
+  }
+  ethsift_set_thread_count(1);
+  for (uint32_t i = 0; i < 4; ++i)
+    free(images[i].pixels);
+  })
+
+define_test(TestBatchLanes, 0, {
+  char const *file = data_file("lena.pgm");
+  //init files 
+  ezsift::Image<unsigned char> ez_img;
+  if (ez_img.read_pgm(file) != 0)
+    fail("Failed to read image");
+
+  // Two groups of 8 patches of 128x128 and 64x64 from the 8-bit image, views into it. The last
+  // group is one short and runs one image at a time.
+  const uint32_t image_count = 8 + 8 + 7;
+  struct ethsift_image_view views[image_count];
+  for (uint32_t i = 0; i < image_count; ++i) {
+    const uint32_t size = (i < 8) ? 128 : 64;
+    const uint32_t x = 40 + 131 * (i % 8), y = 60 + 170 * (i / 8);
+    views[i] = {ez_img.data + y * ez_img.w + x, size, size, (uint32_t) ez_img.w, ETHSIFT_FORMAT_U8};
+  }
+
+  // Single images on the vector backend the lanes mirror.
+  uint32_t backend = ETHSIFT_BACKEND_AVX512;
+  if (!ethsift_set_backend(backend)) {
+    backend = ETHSIFT_BACKEND_AVX2;
+    if (!ethsift_set_backend(backend))
+      return 1;
+  }
+  std::vector<std::vector<struct ethsift_keypoint>> ref_kpts(image_count), kpts(image_count);
+  uint32_t ref_counts[image_count];
+  for (uint32_t i = 0; i < image_count; ++i) {
+    ref_kpts[i].resize(ETHSIFT_MAX_TRACKABLE_KEYPOINTS);
+    kpts[i].resize(ETHSIFT_MAX_TRACKABLE_KEYPOINTS);
+  }
+
+  // The second pass reads orientations and descriptors from the Gaussians.
+  for (uint32_t threads = 1; threads <= 2; ++threads) {
+    ethsift_set_orientation_mode(threads == 1 ? ETHSIFT_ORIENTATION_ATAN2 : ETHSIFT_ORIENTATION_OCTANT);
+    ethsift_set_descriptor_mode(threads == 1 ? ETHSIFT_DESCRIPTOR_WINDOW : ETHSIFT_DESCRIPTOR_PATCH);
+    ethsift_set_batch_mode(ETHSIFT_BATCH_IMAGES);
+    for (uint32_t i = 0; i < image_count; ++i) {
+      ref_counts[i] = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+      ethsift_compute_keypoints_view(views[i], {0, 0, 0, 0}, NULL, ref_kpts[i].data(), &ref_counts[i]);
+    }
+    ethsift_set_batch_mode(ETHSIFT_BATCH_LANES);
+
+    if (!ethsift_set_thread_count(threads))
+      fail("Failed to start %d threads", threads);
+    struct ethsift_keypoint *outputs[image_count];
+    uint32_t counts[image_count];
+    for (uint32_t i = 0; i < image_count; ++i) {
+      outputs[i] = kpts[i].data();
+      counts[i] = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    }
+    if (!ethsift_compute_keypoints_batch(views, image_count, outputs, counts))
+      fail("Lane batch failed with %d threads", threads);
+
+    // The blur is the same, only gradients on the border of a patch may differ in the last bits.
+    uint32_t total = 0, same = 0;
+    for (uint32_t i = 0; i < image_count; ++i) {
+      if (counts[i] != ref_counts[i])
+        fail("Keypoints of image %d mismatched with %d threads: %d != %d", i, threads, counts[i], ref_counts[i]);
+      for (uint32_t k = 0; k < counts[i]; ++k) {
+        struct ethsift_keypoint a = kpts[i][k], b = ref_kpts[i][k];
+        if (a.octave != b.octave || a.layer != b.layer || a.global_pos.x != b.global_pos.x || a.global_pos.y != b.global_pos.y)
+          fail("Keypoint %d of image %d moved with %d threads", k, i, threads);
+        if (!memcmp(&a, &b, sizeof(a)))
+          ++same;
+        ++total;
+      }
+    }
+    printf("Lane batch: %d of %d keypoints identical on backend %d\n", same, total, backend);
+    if (same * 10 < total * 9)
+      fail("Only %d of %d keypoints identical", same, total);
+  }
+  ethsift_set_thread_count(1);
+  ethsift_set_batch_mode(ETHSIFT_BATCH_IMAGES);
+  ethsift_set_orientation_mode(ETHSIFT_ORIENTATION_ATAN2);
+  ethsift_set_descriptor_mode(ETHSIFT_DESCRIPTOR_WINDOW);
+  ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+  })
+
+define_test(TestPipeline, 0, {
+  ezsift::Image<unsigned char> ez_img;
+  if (ez_img.read_pgm(data_file("lena.pgm")) != 0)
+    fail("Failed to read image");
+  const uint32_t w = ez_img.w, h = ez_img.h;
+  // Frames alternate between the 8-bit image and a mirrored float copy.
+  std::vector<float> mirrored(w * h);
+  for (uint32_t y = 0; y < h; ++y)
+    for (uint32_t x = 0; x < w; ++x)
+      mirrored[y * w + x] = ez_img.data[y * w + (w - 1 - x)];
+  struct ethsift_image_view frames[2] = {{ez_img.data, w, h, w, ETHSIFT_FORMAT_U8},
+                                         {mirrored.data(), w, h, w * (uint32_t) sizeof(float), ETHSIFT_FORMAT_F32}};
+
+  std::vector<struct ethsift_keypoint> ref_kpts[2], kpts(ETHSIFT_MAX_TRACKABLE_KEYPOINTS);
+  uint32_t ref_counts[2];
+  for (uint32_t i = 0; i < 2; ++i) {
+    ref_kpts[i].resize(ETHSIFT_MAX_TRACKABLE_KEYPOINTS);
+    ref_counts[i] = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    if (!ethsift_compute_keypoints_view(frames[i], {0, 0, 0, 0}, NULL, ref_kpts[i].data(), &ref_counts[i]) || ref_counts[i] == 0)
+      fail("No reference keypoints for frame %d", i);
+  }
+
+  // Results have to come out in order and equal the ones of a single call.
+  uint32_t expected = 0;
+  auto check = [&](uint32_t count, uint32_t index) {
+    if (index != expected)
+      fail("Got frame %d, expected %d", index, expected);
+    const uint32_t frame = index % 2;
+    if (count != ref_counts[frame])
+      fail("Keypoints of frame %d mismatched: %d != %d", index, count, ref_counts[frame]);
+    for (uint32_t k = 0; k < count; ++k) {
+      if (memcmp(&kpts[k], &ref_kpts[frame][k], sizeof(struct ethsift_keypoint)))
+        fail("Keypoint %d of frame %d differs", k, index);
+    }
+    ++expected;
+    return 1;
+  };
+  auto drain = [&](struct ethsift_pipeline *pipeline) {
+    uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS, index;
+    while (ethsift_pipeline_poll(pipeline, kpts.data(), &count, &index, 1)) {
+      if (!check(count, index))
+        return 0;
+      count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+    }
+    return 1;
+  };
+
+  struct ethsift_pipeline *pipeline = NULL;
+  if (!ethsift_pipeline_create(w, h, 2, ETHSIFT_MAX_TRACKABLE_KEYPOINTS, ETHSIFT_BACKPRESSURE_BLOCK, &pipeline))
+    fail("Failed to create the pipeline");
+  struct ethsift_image_view small = {ez_img.data, w / 2, h, w, ETHSIFT_FORMAT_U8};
+  if (ethsift_pipeline_submit(pipeline, small))
+    fail("Accepted a frame of the wrong size");
+  for (uint32_t i = 0; i < 5; ++i) {
+    if (!ethsift_pipeline_submit(pipeline, frames[i % 2]))
+      fail("Failed to submit frame %d", i);
+    uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS, index;
+    if (ethsift_pipeline_poll(pipeline, kpts.data(), &count, &index, 0) && !check(count, index))
+      return 0;
+  }
+  if (!drain(pipeline))
+    return 0;
+  if (expected != 5)
+    fail("Got %d of 5 frames", expected);
+
+  // Without polling, a blocking submit has to give up once the results back up instead of hanging.
+  // One waiting frame, two sets of pyramids and three results fit into a pipeline of depth one.
+  ethsift_pipeline_free(pipeline);
+  if (!ethsift_pipeline_create(w, h, 1, ETHSIFT_MAX_TRACKABLE_KEYPOINTS, ETHSIFT_BACKPRESSURE_BLOCK, &pipeline))
+    fail("Failed to create the pipeline");
+  uint32_t accepted = 0;
+  while (accepted < 10 && ethsift_pipeline_submit(pipeline, frames[accepted % 2]))
+    ++accepted;
+  if (accepted != 6)
+    fail("Blocking pipeline accepted %d frames without polling", accepted);
+  expected = 0;
+  if (!drain(pipeline))
+    return 0;
+  if (expected != accepted)
+    fail("Got %d of %d frames", expected, accepted);
+
+  // Rejecting never waits, how many frames fit depends on how fast the stages are.
+  ethsift_pipeline_free(pipeline);
+  if (!ethsift_pipeline_create(w, h, 1, ETHSIFT_MAX_TRACKABLE_KEYPOINTS, ETHSIFT_BACKPRESSURE_REJECT, &pipeline))
+    fail("Failed to create the pipeline");
+  accepted = 0;
+  while (accepted < 10 && ethsift_pipeline_submit(pipeline, frames[accepted % 2]))
+    ++accepted;
+  if (accepted < 1 || 6 < accepted)
+    fail("Rejecting pipeline accepted %d frames without polling", accepted);
+  expected = 0;
+  if (!drain(pipeline))
+    return 0;
+  if (expected != accepted)
+    fail("Got %d of %d frames", expected, accepted);
+  ethsift_pipeline_free(pipeline);
+  })
+
+define_test(TestMapPnm, 0, {
+  char const *file = data_file("lena.pgm");
+  ezsift::Image<unsigned char> ez_img;
+  if (ez_img.read_pgm(file) != 0)
+    fail("Failed to read image");
+  struct ethsift_image ref = {0};
+  if (!convert_image(ez_img, &ref))
+    fail("Failed to convert image");
+
+  struct ethsift_pnm pnm;
+  if (!ethsift_map_pnm(file, &pnm))
+    fail("Failed to map %s", file);
+  if (pnm.width != (uint32_t) ez_img.w || pnm.height != (uint32_t) ez_img.h || pnm.channels != 1 || !pnm.view.data)
+    fail("Wrong header of the mapped image");
+  for (uint32_t y = 0; y < pnm.height; ++y) {
+    if (memcmp((const uint8_t *) pnm.view.data + y * pnm.view.stride, ez_img.data + y * ez_img.w, ez_img.w))
+      fail("Mapped row %d differs", y);
+  }
+  // The conversion is split over the threads, it has to give the same pixels either way.
+  struct ethsift_image image = allocate_image(pnm.width, pnm.height);
+  for (uint32_t threads = 1; threads <= 3; threads += 2) {
+    ethsift_set_thread_count(threads);
+    std::fill(image.pixels, image.pixels + image.width * image.height, -1.0f);
+    if (!ethsift_pnm_to_float(&pnm, image) || !compare_image(image, ref))
+      fail("Converted image differs with %d threads", threads);
+  }
+  ethsift_set_thread_count(1);
+  ethsift_unmap_pnm(&pnm);
+  if (pnm.mapping || pnm.view.data)
+    fail("Unmapping did not clear the file");
+
+  // A 16-bit PGM and a PPM with comments in the header, as written by other tools.
+  char path[] = "/tmp/ethsift-pnm-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0)
+    fail("Failed to create a temporary file");
+  FILE *out = fdopen(fd, "wb");
+  fprintf(out, "P5\n# 16 bit\n3 2\n# max\n1000\n");
+  const uint16_t samples[6] = {0, 1, 255, 256, 999, 1000};
+  for (uint32_t i = 0; i < 6; ++i) {
+    fputc(samples[i] >> 8, out);
+    fputc(samples[i] & 0xff, out);
+  }
+  fclose(out);
+  struct ethsift_image small = allocate_image(3, 2);
+  if (!ethsift_map_pnm(path, &pnm) || pnm.maxval != 1000 || pnm.view.data || !ethsift_pnm_to_float(&pnm, small))
+    fail("Failed to map the 16-bit file");
+  for (uint32_t i = 0; i < 6; ++i) {
+    if (small.pixels[i] != samples[i])
+      fail("16-bit sample %d read as %f", i, small.pixels[i]);
+  }
+  ethsift_unmap_pnm(&pnm);
+
+  out = fopen(path, "wb");
+  fprintf(out, "P6 3 2 255\n");
+  const uint8_t rgb[18] = {255, 0, 0,  0, 255, 0,  0, 0, 255,  10, 10, 10,  0, 0, 0,  255, 255, 255};
+  fwrite(rgb, 1, sizeof(rgb), out);
+  fclose(out);
+  if (!ethsift_map_pnm(path, &pnm) || pnm.channels != 3 || pnm.view.data || !ethsift_pnm_to_float(&pnm, small))
+    fail("Failed to map the colour file");
+  const float gray[6] = {0.299f * 255, 0.587f * 255, 0.114f * 255, 10, 0, 255};
+  for (uint32_t i = 0; i < 6; ++i) {
+    if (fabsf(small.pixels[i] - gray[i]) > 0.01f)
+      fail("Colour pixel %d read as %f instead of %f", i, small.pixels[i], gray[i]);
+  }
+  ethsift_unmap_pnm(&pnm);
+
+  // Files that end before the last pixel are refused.
+  out = fopen(path, "wb");
+  fprintf(out, "P5 4 4 255\n");
+  fwrite(rgb, 1, 15, out);
+  fclose(out);
+  if (ethsift_map_pnm(path, &pnm))
+    fail("Mapped a truncated file");
+  unlink(path);
+  free(small.pixels);
+  free(image.pixels);
+  free(ref.pixels);
+  })
+
+define_test(TestSequence, 0, {
+  ezsift::Image<unsigned char> ez_img;
+  if (ez_img.read_pgm(data_file("lena.pgm")) != 0)
+    fail("Failed to read image");
+  const uint32_t w = ez_img.w, h = ez_img.h;
+  std::vector<uint8_t> inverted(ez_img.data, ez_img.data + w * h);
+  for (auto &p : inverted)
+    p = 255 - p;
+  const uint8_t *luma[3] = {ez_img.data, inverted.data(), ez_img.data};
+  std::vector<uint8_t> chroma(2 * ((w + 1) / 2) * ((h + 1) / 2), 128);
+
+  // Three 4:2:0 frames, one with frame parameters, and a last one that is cut off.
+  char path[] = "/tmp/ethsift-y4m-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0)
+    fail("Failed to create a temporary file");
+  FILE *out = fdopen(fd, "wb");
+  fprintf(out, "YUV4MPEG2 W%d H%d F30000:1001 Ip A1:1 C420jpeg XYSCSS=420JPEG\n", w, h);
+  for (uint32_t i = 0; i < 3; ++i) {
+    fprintf(out, (i == 1) ? "FRAME Ip\n" : "FRAME\n");
+    fwrite(luma[i], 1, w * h, out);
+    fwrite(chroma.data(), 1, chroma.size(), out);
+  }
+  fprintf(out, "FRAME\n");
+  fwrite(luma[0], 1, w * h / 2, out);
+  fclose(out);
+
+  struct ethsift_sequence *sequence = NULL;
+  uint32_t width, height, frame_count;
+  float fps;
+  if (!ethsift_sequence_open(path, 0, 0, &sequence))
+    fail("Failed to open the Y4M file");
+  ethsift_sequence_info(sequence, &width, &height, &frame_count, &fps);
+  if (width != w || height != h || frame_count != 3 || fabsf(fps - 29.97f) > 0.01f)
+    fail("Wrong Y4M header: %d x %d, %d frames at %f fps", width, height, frame_count, fps);
+  // Read it twice, the second time after rewinding.
+  for (uint32_t pass = 0; pass < 2; ++pass) {
+    struct ethsift_image_view frame;
+    for (uint32_t i = 0; i < 3; ++i) {
+      if (!ethsift_sequence_read(sequence, &frame) || frame.format != ETHSIFT_FORMAT_U8 || frame.stride != w)
+        fail("Failed to read frame %d", i);
+      if (memcmp(frame.data, luma[i], w * h))
+        fail("Luma of frame %d differs", i);
+    }
+    if (ethsift_sequence_read(sequence, &frame))
+      fail("Read past the last complete frame");
+    ethsift_sequence_rewind(sequence);
+  }
+  ethsift_sequence_close(sequence);
+
+  // 10-bit monochrome samples are little-endian and come out as they are, with their depth.
+  out = fopen(path, "wb");
+  fprintf(out, "YUV4MPEG2 W%d H%d F25:1 Cmono10\nFRAME\n", w, h);
+  std::vector<uint16_t> deep(w * h);
+  for (uint32_t i = 0; i < w * h; ++i)
+    deep[i] = ez_img.data[i] * 4 + 3;
+  fwrite(deep.data(), 2, w * h, out);
+  fclose(out);
+  if (!ethsift_sequence_open(path, 0, 0, &sequence))
+    fail("Failed to open the 10-bit file");
+  struct ethsift_image_view frame;
+  if (!ethsift_sequence_read(sequence, &frame) || frame.format != ETHSIFT_FORMAT_U16 || frame.bits != 10
+      || frame.stride != 2 * w || memcmp(frame.data, deep.data(), 2 * w * h))
+    fail("Wrong 10-bit frame");
+  ethsift_sequence_close(sequence);
+
+  // Four planes of 2^31 by 2^31 samples wrap around to empty frames in 64 bits.
+  out = fopen(path, "wb");
+  fprintf(out, "YUV4MPEG2 W2147483648 H2147483648 C444alpha\nFRAME\nFRAME\n");
+  fclose(out);
+  if (ethsift_sequence_open(path, 0, 0, &sequence))
+    fail("Opened frames larger than the file");
+
+  // Raw luma frames need their size, a trailing partial frame is ignored.
+  out = fopen(path, "wb");
+  fwrite(luma[1], 1, w * h, out);
+  fwrite(luma[0], 1, w * h, out);
+  fwrite(luma[1], 1, 100, out);
+  fclose(out);
+  if (ethsift_sequence_open(path, 0, 0, &sequence))
+    fail("Opened a raw file without a frame size");
+  if (!ethsift_sequence_open(path, w, h, &sequence))
+    fail("Failed to open the raw file");
+  ethsift_sequence_info(sequence, &width, &height, &frame_count, &fps);
+  if (frame_count != 2)
+    fail("Raw file has %d frames instead of 2", frame_count);
+  for (uint32_t i = 0; i < 2; ++i) {
+    if (!ethsift_sequence_read(sequence, &frame) || memcmp(frame.data, luma[1 - i], w * h))
+      fail("Wrong raw frame %d", i);
+  }
+  // The keypoints of a frame in the mapping are those of the image.
+  uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS, ref_count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  std::vector<struct ethsift_keypoint> kpts(count), ref_kpts(count);
+  struct ethsift_image_view image = {ez_img.data, w, h, w, ETHSIFT_FORMAT_U8};
+  if (!ethsift_compute_keypoints_view(frame, {0, 0, 0, 0}, NULL, kpts.data(), &count)
+      || !ethsift_compute_keypoints_view(image, {0, 0, 0, 0}, NULL, ref_kpts.data(), &ref_count)
+      || count != ref_count || memcmp(kpts.data(), ref_kpts.data(), count * sizeof(struct ethsift_keypoint)))
+    fail("Keypoints of the mapped frame differ");
+  ethsift_sequence_close(sequence);
+  unlink(path);
+  })
+
+define_test(TestKeypointFile, 0, {
+  struct ethsift_image image = {0};
+  if (!load_image(data_file("lena.pgm"), image))
+    fail("Failed to load image");
+  uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  std::vector<struct ethsift_keypoint> kpts(count), loaded(count);
+  if (!ethsift_compute_keypoints(image, kpts.data(), &count) || count == 0)
+    fail("No keypoints to write");
+
+  char path[] = "/tmp/ethsift-kpt-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0)
+    fail("Failed to create a temporary file");
+  close(fd);
+
+  // Half precision has 11 significant bits down to 2^-14 and steps of 2^-24 below,
+  // bytes are rounded to the nearest integer.
+  const uint32_t formats[3] = {ETHSIFT_STORE_F32, ETHSIFT_STORE_U8, ETHSIFT_STORE_F16};
+  const uint32_t sizes[3] = {DESCRIPTORS * 4, DESCRIPTORS, DESCRIPTORS * 2};
+  for (uint32_t f = 0; f < 3; ++f) {
+    if (!ethsift_write_keypoints(path, kpts.data(), count, formats[f]))
+      fail("Failed to write format %d", formats[f]);
+    struct ethsift_keypoint_file file;
+    if (!ethsift_map_keypoints(path, &file))
+      fail("Failed to map format %d", formats[f]);
+    if (file.keypoint_count != count || file.format != formats[f] || file.descriptor_size != sizes[f]
+        || ((uintptr_t) file.descriptors % 64) || ((uintptr_t) file.responses % 64))
+      fail("Wrong layout of format %d", formats[f]);
+    // The arrays can be used in place.
+    for (uint32_t k = 0; k < count; ++k) {
+      if (file.octaves[k] != kpts[k].octave || file.x[k] != kpts[k].global_pos.x || file.responses[k] != kpts[k].response)
+        fail("Geometry of keypoint %d differs in place", k);
+    }
+    if (ethsift_load_keypoints(&file, 1, loaded.data(), count))
+      fail("Loaded past the end of the file");
+    if (!ethsift_load_keypoints(&file, 0, loaded.data(), count))
+      fail("Failed to load format %d", formats[f]);
+    for (uint32_t k = 0; k < count; ++k) {
+      if (memcmp(&loaded[k], &kpts[k], offsetof(struct ethsift_keypoint, descriptors)))
+        fail("Geometry of keypoint %d differs after loading", k);
+      for (uint32_t i = 0; i < DESCRIPTORS; ++i) {
+        const float a = loaded[k].descriptors[i], b = kpts[k].descriptors[i];
+        const float tolerance = (f == 0) ? 0.0f : (f == 1) ? 0.5f : fabsf(b) / 2048.0f + 0x1p-25f;
+        if (fabsf(a - b) > tolerance)
+          fail("Descriptor %d of keypoint %d is %f instead of %f in format %d", i, k, a, b, formats[f]);
+      }
+    }
+    ethsift_unmap_keypoints(&file);
+  }
+
+  // The half precision conversion of the scalar backend has to match F16C bit for bit.
+  std::vector<uint8_t> halves[2];
+  for (uint32_t b = 0; b < 2; ++b) {
+    if (!ethsift_set_backend(b ? ETHSIFT_BACKEND_SCALAR : ETHSIFT_BACKEND_AUTO))
+      fail("Failed to select a backend");
+    ethsift_write_keypoints(path, kpts.data(), count, ETHSIFT_STORE_F16);
+    std::ifstream in(path, std::ios::binary);
+    halves[b].assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  ethsift_set_backend(ETHSIFT_BACKEND_AUTO);
+  if (halves[0] != halves[1])
+    fail("Half precision descriptors depend on the backend");
+
+  // Files of an unknown version or cut short are refused.
+  struct ethsift_keypoint_file file;
+  halves[0][8] = 2;
+  std::ofstream(path, std::ios::binary).write((const char *) halves[0].data(), halves[0].size());
+  if (ethsift_map_keypoints(path, &file))
+    fail("Mapped a file of another version");
+  halves[1].resize(halves[1].size() - 1);
+  std::ofstream(path, std::ios::binary).write((const char *) halves[1].data(), halves[1].size());
+  if (ethsift_map_keypoints(path, &file))
+    fail("Mapped a truncated file");
+  // A single keypoint puts its descriptors at 768 of 1280 bytes, a cut before them must not wrap around.
+  ethsift_write_keypoints(path, kpts.data(), 1, ETHSIFT_STORE_F32);
+  if (truncate(path, 600) || ethsift_map_keypoints(path, &file))
+    fail("Mapped a file cut before its descriptors");
+  unlink(path);
+  free(image.pixels);
+  })
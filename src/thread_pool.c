@@ -0,0 +1,150 @@
+#include "internal.h"
+#include <pthread.h>
+#include <unistd.h>
+
+// A fixed set of workers that sleep until thread_pool_run hands them a job. The calling thread
+// works on the job as well, so a pool of size n has n - 1 workers.
+static pthread_t *workers = NULL;
+static uint32_t worker_count = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static uint64_t pool_generation = 0;
+static uint32_t pool_active = 0;
+static int pool_stopping = 0;
+
+static void (*job_task)(void *arg, uint32_t index);
+static void *job_arg;
+static uint32_t job_count;
+static uint32_t job_next;
+// Set while the thread works on a job, nested parallel sections then run serially.
+static __thread int in_job = 0;
+
+/// <summary>
+/// Claim indices of the current job until all of them are taken.
+/// </summary>
+static void run_job(){
+  uint32_t index;
+  in_job = 1;
+  while ((index = __atomic_fetch_add(&job_next, 1, __ATOMIC_RELAXED)) < job_count)
+    job_task(job_arg, index);
+  in_job = 0;
+}
+
+/// <summary>
+/// Wait for jobs newer than the generation the worker was started at.
+/// </summary>
+/// <param name="start"> IN: pool_generation when the worker was created. A worker that only gets to
+///                      run after the first job was posted must still take part in that job. </param>
+static void *worker_main(void *start){
+  uint64_t seen = (uintptr_t) start;
+  pthread_mutex_lock(&pool_lock);
+  for (;;) {
+    while (pool_generation == seen && !pool_stopping)
+      pthread_cond_wait(&pool_wake, &pool_lock);
+    if (pool_stopping)
+      break;
+    seen = pool_generation;
+    pthread_mutex_unlock(&pool_lock);
+
+    run_job();
+
+    pthread_mutex_lock(&pool_lock);
+    if (--pool_active == 0)
+      pthread_cond_signal(&pool_done);
+  }
+  pthread_mutex_unlock(&pool_lock);
+  workspace_release();
+  return NULL;
+}
+
+/// <summary>
+/// Stop and join all workers of the pool.
+/// </summary>
+static void stop_workers(){
+  pthread_mutex_lock(&pool_lock);
+  pool_stopping = 1;
+  pthread_cond_broadcast(&pool_wake);
+  pthread_mutex_unlock(&pool_lock);
+  for (uint32_t i = 0; i < worker_count; ++i)
+    pthread_join(workers[i], NULL);
+  free(workers);
+  workers = NULL;
+  worker_count = 0;
+  pool_stopping = 0;
+}
+
+/// <summary>
+/// Number of threads that work on a job of thread_pool_run, including the calling thread.
+/// </summary>
+uint32_t thread_pool_size(){
+  if (in_job)
+    return 1;
+  return worker_count + 1;
+}
+
+/// <summary>
+/// Run all parallel sections of the calling thread serially from now on. For threads the library
+/// starts outside of the pool, which must not post jobs while the caller may use the pool.
+/// </summary>
+void thread_pool_keep_serial(){
+  in_job = 1;
+}
+
+/// <summary>
+/// Run task(arg, index) for every index below count on the threads of the pool and wait for all of them.
+/// Indices are claimed one at a time, so tasks should be coarse enough to amortise that.
+/// </summary>
+/// <param name="task"> IN: Function to run, called concurrently from different threads. </param>
+/// <param name="arg"> IN: Argument passed to every call of task. </param>
+/// <param name="count"> IN: Number of indices. </param>
+void thread_pool_run(void (*task)(void *arg, uint32_t index), void *arg, uint32_t count){
+  if (worker_count == 0 || count <= 1 || in_job) {
+    for (uint32_t i = 0; i < count; ++i)
+      task(arg, i);
+    return;
+  }
+
+  pthread_mutex_lock(&pool_lock);
+  job_task = task;
+  job_arg = arg;
+  job_count = count;
+  job_next = 0;
+  pool_active = worker_count;
+  pool_generation++;
+  pthread_cond_broadcast(&pool_wake);
+  pthread_mutex_unlock(&pool_lock);
+
+  run_job();
+
+  pthread_mutex_lock(&pool_lock);
+  while (pool_active)
+    pthread_cond_wait(&pool_done, &pool_lock);
+  pthread_mutex_unlock(&pool_lock);
+}
+
+/// <summary>
+/// Set the number of threads that work on the independent parts of the pipeline.
+/// </summary>
+/// <param name="count"> IN: Number of threads including the calling one, 0 for one per online CPU. </param>
+/// <returns> 1 IF all threads could be started, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_set_thread_count(uint32_t count){
+  if (count == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    count = (cpus < 1) ? 1 : (uint32_t) cpus;
+  }
+  stop_workers();
+  if (count == 1)
+    return 1;
+
+  workers = calloc(count - 1, sizeof(pthread_t));
+  if (!workers)
+    return 0;
+  for (uint32_t i = 0; i < count - 1; ++i) {
+    if (pthread_create(&workers[i], NULL, worker_main, (void *)(uintptr_t) pool_generation))
+      return 0;
+    worker_count++;
+  }
+  return 1;
+}
@@ -0,0 +1,110 @@
+#include "internal.h"
+
+/// <summary>
+/// Evaluate a math function over an array with the scalar approximations.
+/// </summary>
+/// <param name="function"> IN: One of the ETHSIFT_MATH_* values. </param>
+/// <param name="x"> IN: Arguments, the x of atan2(y, x). </param>
+/// <param name="y"> IN: The y of atan2(y, x). </param>
+/// <param name="out"> OUT: Results. </param>
+/// <param name="count"> IN: Number of values. </param>
+void math_array_scalar(uint32_t function, const float *x, const float *y, float *out, uint32_t count){
+  float s, c;
+  switch (function) {
+  case ETHSIFT_MATH_EXP:
+    for (uint32_t i = 0; i < count; ++i)
+      out[i] = eth_exp_f(x[i]);
+    break;
+  case ETHSIFT_MATH_ATAN2:
+    for (uint32_t i = 0; i < count; ++i)
+      out[i] = eth_atan2_f(y[i], x[i]);
+    break;
+  case ETHSIFT_MATH_SIN:
+    for (uint32_t i = 0; i < count; ++i) {
+      eth_sincos_f(x[i], &s, &c);
+      out[i] = s;
+    }
+    break;
+  case ETHSIFT_MATH_COS:
+    for (uint32_t i = 0; i < count; ++i) {
+      eth_sincos_f(x[i], &s, &c);
+      out[i] = c;
+    }
+    break;
+  case ETHSIFT_MATH_FLOOR:
+    for (uint32_t i = 0; i < count; ++i)
+      out[i] = eth_floor_f(x[i]);
+    break;
+  case ETHSIFT_MATH_RSQRT:
+    for (uint32_t i = 0; i < count; ++i)
+      out[i] = eth_rsqrt_f(x[i]);
+    break;
+  }
+  inc_read(count, float);
+  inc_write(count, float);
+}
+
+/// <summary>
+/// Evaluate a math function over an array using AVX2, see math_array_scalar.
+/// The tail is loaded masked, its inactive lanes compute on zeros.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+void math_array_avx2(uint32_t function, const float *x, const float *y, float *out, uint32_t count){
+  const __m256i lane_index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256 s, c, r;
+  for (uint32_t i = 0; i < count; i += 8) {
+    const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - i), lane_index);
+    const __m256 vx = _mm256_maskload_ps(x + i, mask);
+    switch (function) {
+    case ETHSIFT_MATH_EXP: r = eth_mm256_exp_ps(vx); break;
+    case ETHSIFT_MATH_ATAN2: r = eth_mm256_atan2_ps(_mm256_maskload_ps(y + i, mask), vx); break;
+    case ETHSIFT_MATH_SIN: eth_mm256_sincos_ps(vx, &s, &c); r = s; break;
+    case ETHSIFT_MATH_COS: eth_mm256_sincos_ps(vx, &s, &c); r = c; break;
+    case ETHSIFT_MATH_FLOOR: r = eth_mm256_floor_ps(vx); break;
+    default: r = eth_mm256_rsqrt_ps(vx); break;
+    }
+    _mm256_maskstore_ps(out + i, mask, r);
+  }
+  inc_read(count, float);
+  inc_write(count, float);
+}
+
+/// <summary>
+/// Evaluate a math function over an array using AVX-512, see math_array_scalar.
+/// </summary>
+ETHSIFT_TARGET_AVX512
+void math_array_avx512(uint32_t function, const float *x, const float *y, float *out, uint32_t count){
+  __m512 s, c, r;
+  for (uint32_t i = 0; i < count; i += 16) {
+    const __mmask16 mask = (count - i >= 16) ? 0xFFFF : (__mmask16) ((1u << (count - i)) - 1);
+    const __m512 vx = _mm512_maskz_loadu_ps(mask, x + i);
+    switch (function) {
+    case ETHSIFT_MATH_EXP: r = eth_mm512_exp_ps(vx); break;
+    case ETHSIFT_MATH_ATAN2: r = eth_mm512_atan2_ps(_mm512_maskz_loadu_ps(mask, y + i), vx); break;
+    case ETHSIFT_MATH_SIN: eth_mm512_sincos_ps(vx, &s, &c); r = s; break;
+    case ETHSIFT_MATH_COS: eth_mm512_sincos_ps(vx, &s, &c); r = c; break;
+    case ETHSIFT_MATH_FLOOR: r = eth_mm512_floor_ps(vx); break;
+    default: r = eth_mm512_rsqrt_ps(vx); break;
+    }
+    _mm512_mask_storeu_ps(out + i, mask, r);
+  }
+  inc_read(count, float);
+  inc_write(count, float);
+}
+
+/// <summary>
+/// Evaluate one of the math functions of the pipeline over an array.
+/// </summary>
+/// <param name="function"> IN: One of the ETHSIFT_MATH_* values. </param>
+/// <param name="x"> IN: Arguments, the x of atan2(y, x). </param>
+/// <param name="y"> IN: The y of atan2(y, x), ignored by the other functions. </param>
+/// <param name="out"> OUT: Results. </param>
+/// <param name="count"> IN: Number of values. </param>
+/// <returns> 1 IF the function is valid, ELSE 0. </returns>
+/// <remarks> count * (function) flops </remarks>
+int ethsift_evaluate_math(uint32_t function, const float *x, const float *y, float *out, uint32_t count){
+  if (function > ETHSIFT_MATH_RSQRT || (function == ETHSIFT_MATH_ATAN2 && !y))
+    return 0;
+  g_kernels.math_array(function, x, y, out, count);
+  return 1;
+}
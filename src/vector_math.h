@@ -0,0 +1,1044 @@
+#ifndef ETHSIFT_VECTOR_MATH_H
+#define ETHSIFT_VECTOR_MATH_H 1
+// Scalar and vector approximations of the math functions used by the pipeline.
+// Included at the end of internal.h, which provides the headers and the target macros.
+#define M_TWOPI 6.283185307179586f
+#define M_1_2PI 0.15915494309189535f
+#define M_PI_FRAC4 0.785398163397448f
+#define M_THREEPI_FRAC4 2.356194490192345f
+//#define M_SQRT2 1.414213562373095f
+#define EPSILON_F 1.19209290E-07F
+
+/// <summary> 
+/// Calculates atan2 "in a fast" manner
+/// </summary>
+/// <param name="y"> IN: first input val. </param>
+/// <param name="x"> IN: second input val. </param> 
+/// <returns> atan2 value of y and x. </returns>
+static inline float fast_atan2_f(float y, float x)
+{
+    //PT1
+    float angle, r;
+    float const c3 = 0.1821F;
+    float const c1 = 0.9675F;
+    float abs_y = fabsf(y) + EPSILON_F;
+    inc_adds(1);
+    //PT2
+    if (x >= 0) {
+        r = (x - abs_y) / (x + abs_y);
+        angle = M_PI_FRAC4;
+        inc_adds(2);
+        inc_div(1);
+    }
+    else {
+        r = (x + abs_y) / (abs_y - x);
+        angle = M_THREEPI_FRAC4;
+        inc_adds(2);
+        inc_div(1);
+    }
+    angle += (c3 * r * r - c1) * r;
+    inc_adds(2);
+    inc_mults(3);
+    //PT3
+    if (y < 0) {
+        inc_adds(1);
+        return M_TWOPI - angle;
+    } else {
+        return angle;
+    }
+    // return (y < 0) ? M_TWOPI - angle : angle;
+}
+
+
+/// <summary> 
+/// Pseudo angle of the vector (x, y) in [0, 2PI) without atan2. The octant is picked by comparing
+/// the components, within it the angle grows linearly with the ratio of the smaller to the larger one.
+/// </summary>
+/// <param name="y"> IN: first input val. </param>
+/// <param name="x"> IN: second input val. </param> 
+/// <returns> Pseudo angle of y and x, monotonic in the true angle. </returns>
+static inline float octant_angle_f(float y, float x)
+{
+    const float abs_x = fabsf(x);
+    const float abs_y = fabsf(y);
+    // Position within the first quadrant in [0, 2], one unit per octant.
+    float t = (abs_x >= abs_y) ? abs_y / (abs_x + EPSILON_F) : 2.0f - abs_x / abs_y;
+    if (x < 0)
+        t = 4.0f - t;
+    if (y < 0)
+        t = 8.0f - t;
+    inc_adds(3);
+    inc_div(1);
+    inc_mults(1);
+    return t * M_PI_FRAC4;
+}
+
+/// <summary> 
+/// Convert a pseudo angle of octant_angle_f back to the true angle.
+/// </summary>
+/// <param name="angle"> IN: Pseudo angle in [0, 2PI). </param>
+/// <returns> True angle in [0, 2PI). </returns>
+static inline float octant_to_angle_f(float angle)
+{
+    const float u = angle * (1.0f / M_PI_FRAC4);
+    const int quadrant = internal_min((int) (u * 0.5f), 3);
+    const float t = (quadrant & 1) ? 2.0f * (quadrant + 1) - u : u - 2.0f * quadrant;
+    const float a = (t <= 1.0f) ? atanf(t) : 2.0f * M_PI_FRAC4 - atanf(2.0f - t);
+    inc_adds(3);
+    inc_mults(3);
+    return (quadrant & 1) ? (quadrant + 1) * 2.0f * M_PI_FRAC4 - a : quadrant * 2.0f * M_PI_FRAC4 + a;
+}
+
+/// <summary> 
+/// Calculates octant_angle_f with AVX2 intrinsics.
+/// </summary>
+/// <param name="y"> IN: first input vector. </param>
+/// <param name="x"> IN: second input vector. </param> 
+/// <returns> Pseudo angles of y and x in [0, 2PI). </returns>
+ETHSIFT_TARGET_AVX2
+static inline __m256 eth_mm256_octant_angle_ps(__m256 y, __m256 x)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 zeros = _mm256_setzero_ps();
+    const __m256 abs_x = _mm256_andnot_ps(sign, x);
+    const __m256 abs_y = _mm256_andnot_ps(sign, y);
+    const __m256 x_major = _mm256_cmp_ps(abs_x, abs_y, _CMP_GE_OQ);
+    __m256 t = _mm256_blendv_ps(
+        _mm256_sub_ps(_mm256_set1_ps(2.0f), _mm256_div_ps(abs_x, abs_y)),
+        _mm256_div_ps(abs_y, _mm256_add_ps(abs_x, _mm256_set1_ps(EPSILON_F))), x_major);
+    t = _mm256_blendv_ps(t, _mm256_sub_ps(_mm256_set1_ps(4.0f), t), _mm256_cmp_ps(x, zeros, _CMP_LT_OQ));
+    t = _mm256_blendv_ps(t, _mm256_sub_ps(_mm256_set1_ps(8.0f), t), _mm256_cmp_ps(y, zeros, _CMP_LT_OQ));
+    inc_adds(24);
+    inc_div(8);
+    inc_mults(8);
+    return _mm256_mul_ps(t, _mm256_set1_ps(M_PI_FRAC4));
+}
+
+/// <summary> 
+/// Calculates exp with AVX2 intrinsics at ETHSIFT_ACCURACY_MEDIUM.
+/// The argument is split into n * ln(2) + r, exp(r) is a polynomial and 2^n is built in the exponent bits.
+/// </summary>
+/// <param name="x"> IN: input vector. </param>
+/// <returns> exp(x) of every lane. </returns>
+ETHSIFT_TARGET_AVX2
+static inline __m256 eth_mm256_exp_medium_ps(__m256 x)
+{
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3f)), _mm256_set1_ps(88.3f));
+    const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)),
+                                      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    // ln(2) in two parts, so that r stays exact for large n.
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+
+    __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+    p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+    const __m256i pow2n = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    inc_adds(64);
+    inc_mults(72);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(pow2n));
+}
+
+/// <summary> 
+/// Calculates atan2 with SSE intrinsics, same approximation as fast_atan2_f.
+/// </summary>
+/// <param name="y"> IN: first input vector. </param>
+/// <param name="x"> IN: second input vector. </param> 
+/// <returns> __m128 float vector which is the atan2 value of y and x. </returns>
+ETHSIFT_TARGET_SSE
+static inline __m128 eth_mm_atan2_fast_ps(__m128 y, __m128 x)
+{
+    const __m128 zeros = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 abs_y = _mm_add_ps(_mm_andnot_ps(sign, y), _mm_set1_ps(EPSILON_F));
+    const __m128 x_lt = _mm_cmplt_ps(x, zeros);
+
+    // x >= 0: r = (x - |y|) / (x + |y|), x < 0: r = (x + |y|) / (|y| - x)
+    __m128 dividend = _mm_blendv_ps(_mm_sub_ps(x, abs_y), _mm_add_ps(x, abs_y), x_lt);
+    __m128 divisor = _mm_blendv_ps(_mm_add_ps(x, abs_y), _mm_sub_ps(abs_y, x), x_lt);
+    __m128 r = _mm_div_ps(dividend, divisor);
+    __m128 angle = _mm_blendv_ps(_mm_set1_ps(M_PI_FRAC4), _mm_set1_ps(M_THREEPI_FRAC4), x_lt);
+    inc_adds(12);
+    inc_div(4);
+
+    __m128 poly = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.1821f), r), r), _mm_set1_ps(0.9675f));
+    angle = _mm_add_ps(angle, _mm_mul_ps(poly, r));
+    inc_adds(8);
+    inc_mults(12);
+
+    // y < 0: 2PI - angle
+    __m128 y_lt = _mm_cmplt_ps(y, zeros);
+    inc_adds(4);
+    return _mm_blendv_ps(angle, _mm_sub_ps(_mm_set1_ps(M_TWOPI), angle), y_lt);
+}
+
+/// <summary> 
+/// Calculates atan2 with AVX2 intrinsics, same approximation as fast_atan2_f.
+/// </summary>
+/// <param name="y"> IN: first input vector. </param>
+/// <param name="x"> IN: second input vector. </param> 
+/// <returns> __mm256 float vector which is the atan2 value of y and x. </returns>
+ETHSIFT_TARGET_AVX2
+static inline __m256 eth_mm256_atan2_fast_ps(__m256 y, __m256 x)
+{
+    //PT1
+    __m256 angle, r;
+    __m256 c3 = _mm256_set1_ps(0.1821f);
+    __m256 c1 = _mm256_set1_ps(-0.9675f);
+    __m256 zeros = _mm256_set1_ps(-0.000001);
+    __m256 ones = _mm256_set1_ps(1.0);
+    __m256 twos = _mm256_set1_ps(2.0);
+    __m256 threes = _mm256_set1_ps(3.0);
+    __m256 minus_ones = _mm256_set1_ps(-1.0);
+    __m256 pi_frac4 = _mm256_set1_ps(M_PI_FRAC4);
+    __m256 twopi = _mm256_set1_ps(M_TWOPI);
+
+    // vars leading up to abs_mask
+    __m256 mask_geq_y = _mm256_cmp_ps(y, zeros, _CMP_GE_OQ);    
+    __m256 mask_lt_y = _mm256_cmp_ps(y, zeros, _CMP_LE_OQ);
+    __m256 zero_or_one = _mm256_and_ps(mask_geq_y, ones);
+    __m256 zero_or_minusone = _mm256_and_ps(mask_lt_y, minus_ones);
+
+
+    __m256 abs_mask_y = _mm256_add_ps(zero_or_one, zero_or_minusone);
+    __m256 epsilon = _mm256_set1_ps(EPSILON_F);
+    __m256 abs_y = _mm256_fmadd_ps(abs_mask_y, y, epsilon);
+    inc_adds(8);
+        
+    //PT2
+    __m256 mask_geq = _mm256_cmp_ps(x, zeros, _CMP_GE_OQ);    
+    __m256 mask_lt = _mm256_cmp_ps(x, zeros, _CMP_LE_OQ);
+    zero_or_one = _mm256_and_ps(mask_lt, ones);
+    zero_or_minusone = _mm256_and_ps(mask_geq, minus_ones);
+
+    __m256 dividend_mask = _mm256_add_ps(zero_or_one, zero_or_minusone);
+    __m256 divisor_mask = _mm256_mul_ps(dividend_mask, minus_ones);
+
+    __m256 angle_zero_or_one = _mm256_and_ps(mask_geq, ones);
+    __m256 angle_zero_or_three = _mm256_and_ps(mask_lt, threes);
+    __m256 angle_mask = _mm256_add_ps(angle_zero_or_one, angle_zero_or_three);
+
+    __m256 x_lt_zero = _mm256_add_ps(zero_or_one, zero_or_minusone); //TODO: write -1.f where x >= 0, 1.f where x < 0
+
+    __m256 dividend = _mm256_fmadd_ps(dividend_mask, abs_y, x);
+    __m256 divisor = _mm256_fmadd_ps(divisor_mask, x, abs_y);
+    r = _mm256_div_ps(dividend, divisor);
+    angle = _mm256_mul_ps(angle_mask, pi_frac4);
+    
+    inc_adds(16);
+    inc_div(8);
+
+    __m256 r_squared = _mm256_mul_ps(r, r);
+    __m256 t_ang = _mm256_fmadd_ps(c3, r_squared, c1);
+    angle = _mm256_fmadd_ps(t_ang, r, angle);
+    
+    inc_adds(16);
+    inc_mults(24);
+    
+    //PT3
+    __m256 twoangle = _mm256_mul_ps(twos, angle);
+    __m256 return_mask_twopi = _mm256_and_ps(mask_lt_y, twopi);
+    __m256 return_mask_twoangle = _mm256_and_ps(mask_geq_y, twoangle);
+    __m256 return_mask = _mm256_add_ps(return_mask_twopi, return_mask_twoangle);
+    inc_adds(8);
+    return _mm256_sub_ps(return_mask, angle);
+}
+
+/// <summary> 
+/// Calculates atan2 with AVX-512 intrinsics, same approximation as fast_atan2_f.
+/// </summary>
+/// <param name="y"> IN: first input vector. </param>
+/// <param name="x"> IN: second input vector. </param> 
+/// <returns> __m512 float vector which is the atan2 value of y and x. </returns>
+ETHSIFT_TARGET_AVX512
+static inline __m512 eth_mm512_atan2_fast_ps(__m512 y, __m512 x)
+{
+    const __m512 zeros = _mm512_setzero_ps();
+    const __m512 abs_y = _mm512_add_ps(_mm512_abs_ps(y), _mm512_set1_ps(EPSILON_F));
+    const __mmask16 x_lt = _mm512_cmp_ps_mask(x, zeros, _CMP_LT_OQ);
+
+    // x >= 0: r = (x - |y|) / (x + |y|), x < 0: r = (x + |y|) / (|y| - x)
+    __m512 dividend = _mm512_mask_blend_ps(x_lt, _mm512_sub_ps(x, abs_y), _mm512_add_ps(x, abs_y));
+    __m512 divisor = _mm512_mask_blend_ps(x_lt, _mm512_add_ps(x, abs_y), _mm512_sub_ps(abs_y, x));
+    __m512 r = _mm512_div_ps(dividend, divisor);
+    __m512 angle = _mm512_mask_blend_ps(x_lt, _mm512_set1_ps(M_PI_FRAC4), _mm512_set1_ps(M_THREEPI_FRAC4));
+    inc_adds(48);
+    inc_div(16);
+
+    __m512 poly = _mm512_fmadd_ps(_mm512_mul_ps(r, r), _mm512_set1_ps(0.1821f), _mm512_set1_ps(-0.9675f));
+    angle = _mm512_fmadd_ps(poly, r, angle);
+    inc_adds(32);
+    inc_mults(48);
+
+    // y < 0: 2PI - angle
+    const __mmask16 y_lt = _mm512_cmp_ps_mask(y, zeros, _CMP_LT_OQ);
+    inc_adds(16);
+    return _mm512_mask_sub_ps(angle, y_lt, _mm512_set1_ps(M_TWOPI), angle);
+}
+
+
+/// <summary> 
+/// Calculates the inverted square-root of x ( 1/sqrt(x) ).
+/// </summary>
+/// <param name="x"> IN: Value to get the inverted square-root of. </param>
+/// <returns> The inverted square-root of x. </returns>
+static inline float fast_resqrt_f(float x)
+{
+    // 32-bit version
+    union {
+        float x;
+        int i;
+    } u;
+
+    float xhalf = (float)0.5 * x;
+
+    // convert floating point value in RAW integer
+    u.x = x;
+
+    // gives initial guess y0
+    u.i = 0x5f3759df - (u.i >> 1);
+
+    // two Newton steps
+    u.x = u.x * ((float)1.5 - xhalf * u.x * u.x);
+    u.x = u.x * ((float)1.5 - xhalf * u.x * u.x);
+    return u.x;
+}
+
+/// <summary> 
+/// Calculate the squareroot of x.
+/// </summary>
+/// <param name="x"> IN: Value to get the square root of. </param>
+/// <returns> The square-root of x. </returns>
+static inline float fast_sqrt_f(float x)
+{
+    return (x < 1e-8) ? 0 : x * fast_resqrt_f(x);
+}
+
+//// Accuracy tiers
+// Every function below exists per accuracy tier, see ethsift_set_math_accuracy. The
+// dispatching variant without a suffix picks one by g_math_accuracy. Errors are measured
+// against double precision: exp and rsqrt in ulp of the result, atan2, sin and cos in ulp
+// of 1 (FLT_EPSILON) since their results are bounded.
+//
+//           FAST                         MEDIUM                   EXACT
+// exp       48 ulp, degree 5             2 ulp, Cephes            libm, 1 ulp
+// atan2     51480 ulp, ezsift's cubic    5 ulp, Cephes            libm, 5 ulp
+// sin, cos  1 ulp for |x| < 8 PI,        1 ulp for |x| < 8192     libm, 1 ulp
+//           2 ulp for |x| < 8192
+// floor     exact for |x| < 2^31         exact                    exact
+// rsqrt     4 ulp, one Newton step       2 ulp, 1 / sqrtf         1 ulp, rounded once
+//
+// The atan2 bounds include rounding the result into [0, 2PI], which alone costs up to 4 ulp
+// of 1 near 2PI. The cubic of ezsift is off by at most 0.0061361 rad, or 51474 ulp of 1, and
+// rounding adds at most 6 ulp. FAST sin and cos subtract the last two parts of PI/4 as one
+// constant, whose product with j is rounded once more without fused multiply-adds: at most
+// 1 ulp for |x| < 8192. TestMath* in the tester checks all of these bounds on every backend.
+//
+// FAST keeps the atan2 of ezsift, so gradient orientations match it, but also replaces the
+// libm exp, sin, cos and 1 / sqrtf that earlier versions used, so descriptors differ from
+// ezsift and from those versions in the last bits. No tier reproduces them exactly.
+
+#define M_PI_FRAC2 1.5707963267948966f
+#define M_PI_F 3.141592653589793f
+#define M_4_PI_F 1.2732395447351628f
+#define M_TAN_PI_FRAC8 0.41421356237309503f
+#define M_LOG2E_F 1.44269504088896341f
+
+// Constants of the exp polynomial and its range reduction, ln(2) is split in two parts
+// so that the reduced argument stays exact for large exponents.
+#define EXP_MIN -87.3f
+#define EXP_MAX 88.3f
+#define EXP_LN2_HI 0.693359375f
+#define EXP_LN2_LO -2.12194440e-4f
+
+// Range reduction to [-PI/4, PI/4] for sin and cos, PI/4 is split in three parts. DP1 has 8
+// significant bits, so j * DP1 is exact for every j below 2^16 with or without fused multiply-adds.
+// The fast tier subtracts DP2 + DP3 as one constant.
+#define SINCOS_DP1 0.78515625f
+#define SINCOS_DP2 2.4187564849853515625e-4f
+#define SINCOS_DP3 3.77489497744594108e-8f
+#define SINCOS_DP23 2.4191339616663754e-4f
+
+/// <summary> 
+/// Build 2^n in the exponent bits of a float.
+/// </summary>
+/// <param name="n"> IN: Exponent in [-126, 127]. </param>
+/// <returns> 2^n. </returns>
+static inline float exp2i_f(int n)
+{
+    union {
+        float f;
+        int32_t i;
+    } u;
+    u.i = (n + 127) << 23;
+    return u.f;
+}
+
+/// <summary> 
+/// Calculates exp at ETHSIFT_ACCURACY_FAST, the reduced argument goes through a degree 5 Taylor polynomial.
+/// </summary>
+/// <param name="x"> IN: input val. </param>
+/// <returns> exp(x). </returns>
+static inline float exp_fast_f(float x)
+{
+    x = float_min(float_max(x, EXP_MIN), EXP_MAX);
+    const int n = (int) (x * M_LOG2E_F + ((x < 0) ? -0.5f : 0.5f));
+    float r = x - n * EXP_LN2_HI;
+    r = r - n * EXP_LN2_LO;
+    float p = 8.3333333333e-3f;
+    p = p * r + 4.1666666667e-2f;
+    p = p * r + 1.6666666667e-1f;
+    p = p * r + 0.5f;
+    p = p * r * r + r + 1.0f;
+    inc_adds(9);
+    inc_mults(9);
+    return p * exp2i_f(n);
+}
+
+/// <summary> 
+/// Calculates exp at ETHSIFT_ACCURACY_MEDIUM, the polynomial of eth_mm256_exp_medium_ps.
+/// </summary>
+/// <param name="x"> IN: input val. </param>
+/// <returns> exp(x). </returns>
+static inline float exp_medium_f(float x)
+{
+    x = float_min(float_max(x, EXP_MIN), EXP_MAX);
+    const int n = (int) (x * M_LOG2E_F + ((x < 0) ? -0.5f : 0.5f));
+    float r = x - n * EXP_LN2_HI;
+    r = r - n * EXP_LN2_LO;
+    float p = 1.9875691500e-4f;
+    p = p * r + 1.3981999507e-3f;
+    p = p * r + 8.3334519073e-3f;
+    p = p * r + 4.1665795894e-2f;
+    p = p * r + 1.6666665459e-1f;
+    p = p * r + 5.0000001201e-1f;
+    p = p * r * r + r + 1.0f;
+    inc_adds(11);
+    inc_mults(11);
+    return p * exp2i_f(n);
+}
+
+/// <summary> 
+/// Calculates atan2 at ETHSIFT_ACCURACY_MEDIUM. The smaller component is divided by the larger
+/// one, ratios above tan(PI/8) are moved below it around PI/4, and the arctangent of the
+/// remainder is an odd polynomial.
+/// </summary>
+/// <param name="y"> IN: first input val. </param>
+/// <param name="x"> IN: second input val. </param> 
+/// <returns> atan2 value of y and x in [0, 2PI]. </returns>
+static inline float atan2_medium_f(float y, float x)
+{
+    const float abs_x = fabsf(x);
+    const float abs_y = fabsf(y);
+    const float mx = float_max(abs_x, abs_y);
+    const float mn = float_min(abs_x, abs_y);
+    float t, a = 0.0f;
+    if (mn > M_TAN_PI_FRAC8 * mx) {
+        // atan(t) = PI/4 + atan((t - 1) / (t + 1))
+        t = (mn - mx) / (mn + mx);
+        a = M_PI_FRAC4;
+        inc_adds(2);
+    } else {
+        t = (mx > 0) ? mn / mx : 0.0f;
+    }
+    const float z = t * t;
+    float p = 8.05374449538e-2f;
+    p = p * z - 1.38776856032e-1f;
+    p = p * z + 1.99777106478e-1f;
+    p = p * z - 3.33329491539e-1f;
+    a += p * z * t + t;
+    if (abs_y > abs_x)
+        a = M_PI_FRAC2 - a;
+    if (x < 0)
+        a = M_PI_F - a;
+    if (y < 0)
+        a = M_TWOPI - a;
+    inc_adds(9);
+    inc_mults(7);
+    inc_div(1);
+    return a;
+}
+
+/// <summary> 
+/// Calculates atan2 at ETHSIFT_ACCURACY_EXACT, moved to [0, 2PI] like the approximations.
+/// </summary>
+static inline float atan2_exact_f(float y, float x)
+{
+    const float a = atan2f(y, x);
+    return (a < 0) ? a + M_TWOPI : a;
+}
+
+/// <summary> 
+/// Calculates sin and cos at ETHSIFT_ACCURACY_FAST or ETHSIFT_ACCURACY_MEDIUM. The argument is
+/// reduced to [-PI/4, PI/4] around the nearest multiple j of PI/4 with even j, and j picks the
+/// polynomial and the signs.
+/// </summary>
+/// <param name="x"> IN: input val. </param>
+/// <param name="precise"> IN: 1 to subtract j * PI/4 in three parts, 0 in two. </param>
+/// <param name="s"> OUT: sin(x). </param>
+/// <param name="c"> OUT: cos(x). </param>
+static inline void sincos_poly_f(float x, int precise, float *s, float *c)
+{
+    const float abs_x = fabsf(x);
+    const int j = ((int) (abs_x * M_4_PI_F) + 1) & ~1;
+    const float y = (float) j;
+    const float r = precise
+        ? ((abs_x - y * SINCOS_DP1) - y * SINCOS_DP2) - y * SINCOS_DP3
+        : (abs_x - y * SINCOS_DP1) - y * SINCOS_DP23;
+    const float z = r * r;
+    const float ps = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * r + r;
+    const float pc = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+    float sv = (j & 2) ? pc : ps;
+    float cv = (j & 2) ? ps : pc;
+    if (((j & 4) != 0) != (x < 0))
+        sv = -sv;
+    if (((j - 2) & 4) == 0)
+        cv = -cv;
+    *s = sv;
+    *c = cv;
+    inc_adds(precise ? 13 : 12);
+    inc_mults(precise ? 17 : 16);
+}
+
+/// <summary> 
+/// Calculates 1/sqrt(x) at ETHSIFT_ACCURACY_FAST, the 12 bit hardware estimate refined with one Newton step.
+/// </summary>
+static inline float rsqrt_fast_f(float x)
+{
+    const float r = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+    inc_adds(1);
+    inc_mults(4);
+    return r * (1.5f - 0.5f * x * r * r);
+}
+
+/// <summary> 
+/// Calculates 1/sqrt(x) at ETHSIFT_ACCURACY_EXACT, rounded once.
+/// </summary>
+static inline float rsqrt_exact_f(float x)
+{
+    return (float) (1.0 / sqrt((double) x));
+}
+
+/// <summary> 
+/// Calculates exp at the accuracy of ethsift_set_math_accuracy.
+/// </summary>
+/// <param name="x"> IN: input val. </param>
+/// <returns> exp(x). </returns>
+static inline float eth_exp_f(float x)
+{
+    switch (g_math_accuracy) {
+    case ETHSIFT_ACCURACY_FAST: return exp_fast_f(x);
+    case ETHSIFT_ACCURACY_MEDIUM: return exp_medium_f(x);
+    default: return expf(x);
+    }
+}
+
+/// <summary> 
+/// Calculates atan2 at the accuracy of ethsift_set_math_accuracy.
+/// </summary>
+/// <param name="y"> IN: first input val. </param>
+/// <param name="x"> IN: second input val. </param> 
+/// <returns> atan2 value of y and x in [0, 2PI]. </returns>
+static inline float eth_atan2_f(float y, float x)
+{
+    switch (g_math_accuracy) {
+    case ETHSIFT_ACCURACY_FAST: return fast_atan2_f(y, x);
+    case ETHSIFT_ACCURACY_MEDIUM: return atan2_medium_f(y, x);
+    default: return atan2_exact_f(y, x);
+    }
+}
+
+/// <summary> 
+/// Calculates sin and cos at the accuracy of ethsift_set_math_accuracy.
+/// </summary>
+/// <param name="x"> IN: input val. </param>
+/// <param name="s"> OUT: sin(x). </param>
+/// <param name="c"> OUT: cos(x). </param>
+static inline void eth_sincos_f(float x, float *s, float *c)
+{
+    switch (g_math_accuracy) {
+    case ETHSIFT_ACCURACY_FAST: sincos_poly_f(x, 0, s, c); break;
+    case ETHSIFT_ACCURACY_MEDIUM: sincos_poly_f(x, 1, s, c); break;
+    default: *s = sinf(x); *c = cosf(x); break;
+    }
+}
+
+/// <summary> 
+/// Calculates floor without a call to libm, exact in every tier for |x| < 2^31.
+/// </summary>
+/// <param name="x"> IN: input val. </param>
+/// <returns> The largest integer not greater than x. </returns>
+static inline float eth_floor_f(float x)
+{
+    const float t = (float) (int) x;
+    return (t > x) ? t - 1.0f : t;
+}
+
+/// <summary> 
+/// Calculates 1/sqrt(x) at the accuracy of ethsift_set_math_accuracy.
+/// </summary>
+/// <param name="x"> IN: Value to get the inverted square-root of. </param>
+/// <returns> The inverted square-root of x. </returns>
+static inline float eth_rsqrt_f(float x)
+{
+    switch (g_math_accuracy) {
+    case ETHSIFT_ACCURACY_FAST: return rsqrt_fast_f(x);
+    case ETHSIFT_ACCURACY_MEDIUM: inc_div(1); return 1.0f / sqrtf(x);
+    default: inc_div(1); return rsqrt_exact_f(x);
+    }
+}
+
+/// <summary> 
+/// Calculates atan2 with SSE intrinsics at the accuracy of ethsift_set_math_accuracy. Only
+/// ETHSIFT_ACCURACY_FAST has a vector variant, the other tiers go lane by lane.
+/// </summary>
+/// <param name="y"> IN: first input vector. </param>
+/// <param name="x"> IN: second input vector. </param> 
+/// <returns> atan2 value of y and x in [0, 2PI]. </returns>
+ETHSIFT_TARGET_SSE
+static inline __m128 eth_mm_atan2_ps(__m128 y, __m128 x)
+{
+    if (g_math_accuracy == ETHSIFT_ACCURACY_FAST)
+        return eth_mm_atan2_fast_ps(y, x);
+    float ys[4], xs[4];
+    _mm_storeu_ps(ys, y);
+    _mm_storeu_ps(xs, x);
+    for (int i = 0; i < 4; ++i)
+        ys[i] = eth_atan2_f(ys[i], xs[i]);
+    return _mm_loadu_ps(ys);
+}
+
+/// <summary> 
+/// Apply a scalar function to every lane of an AVX2 vector, for ETHSIFT_ACCURACY_EXACT.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+static inline __m256 eth_mm256_map_ps(__m256 x, float (*f)(float))
+{
+    float v[8];
+    _mm256_storeu_ps(v, x);
+    for (int i = 0; i < 8; ++i)
+        v[i] = f(v[i]);
+    return _mm256_loadu_ps(v);
+}
+
+/// <summary> 
+/// Calculates exp with AVX2 intrinsics at ETHSIFT_ACCURACY_FAST, see exp_fast_f.
+/// </summary>
+/// <param name="x"> IN: input vector. </param>
+/// <returns> exp(x) of every lane. </returns>
+ETHSIFT_TARGET_AVX2
+static inline __m256 eth_mm256_exp_fast_ps(__m256 x)
+{
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(EXP_MIN)), _mm256_set1_ps(EXP_MAX));
+    const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(M_LOG2E_F)),
+                                      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(EXP_LN2_HI), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(EXP_LN2_LO), r);
+
+    __m256 p = _mm256_set1_ps(8.3333333333e-3f);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1666666667e-2f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666666667e-1f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(0.5f));
+    p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+    const __m256i pow2n = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    inc_adds(48);
+    inc_mults(56);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(pow2n));
+}
+
+/// <summary> 
+/// Calculates exp with AVX2 intrinsics at the accuracy of ethsift_set_math_accuracy.
+/// </summary>
+/// <param name="x"> IN: input vector. </param>
+/// <returns> exp(x) of every lane. </returns>
+ETHSIFT_TARGET_AVX2
+static inline __m256 eth_mm256_exp_ps(__m256 x)
+{
+    switch (g_math_accuracy) {
+    case ETHSIFT_ACCURACY_FAST: return eth_mm256_exp_fast_ps(x);
+    case ETHSIFT_ACCURACY_MEDIUM: return eth_mm256_exp_medium_ps(x);
+    default: return eth_mm256_map_ps(x, expf);
+    }
+}
+
+/// <summary> 
+/// Calculates atan2 with AVX2 intrinsics at ETHSIFT_ACCURACY_MEDIUM, see atan2_medium_f.
+/// </summary>
+/// <param name="y"> IN: first input vector. </param>
+/// <param name="x"> IN: second input vector. </param> 
+/// <returns> atan2 value of y and x in [0, 2PI]. </returns>
+ETHSIFT_TARGET_AVX2
+static inline __m256 eth_mm256_atan2_medium_ps(__m256 y, __m256 x)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 zeros = _mm256_setzero_ps();
+    const __m256 abs_x = _mm256_andnot_ps(sign, x);
+    const __m256 abs_y = _mm256_andnot_ps(sign, y);
+    const __m256 mx = _mm256_max_ps(abs_x, abs_y);
+    const __m256 mn = _mm256_min_ps(abs_x, abs_y);
+
+    // atan(t) = PI/4 + atan((t - 1) / (t + 1)) above tan(PI/8), a single division for both cases.
+    const __m256 big = _mm256_cmp_ps(mn, _mm256_mul_ps(mx, _mm256_set1_ps(M_TAN_PI_FRAC8)), _CMP_GT_OQ);
+    const __m256 dividend = _mm256_blendv_ps(mn, _mm256_sub_ps(mn, mx), big);
+    const __m256 divisor = _mm256_blendv_ps(_mm256_max_ps(mx, _mm256_set1_ps(FLT_MIN)), _mm256_add_ps(mn, mx), big);
+    const __m256 t = _mm256_div_ps(dividend, divisor);
+    const __m256 z = _mm256_mul_ps(t, t);
+
+    __m256 p = _mm256_set1_ps(8.05374449538e-2f);
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(-1.38776856032e-1f));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(1.99777106478e-1f));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(-3.33329491539e-1f));
+    __m256 a = _mm256_fmadd_ps(_mm256_mul_ps(p, z), t, t);
+    a = _mm256_add_ps(a, _mm256_and_ps(big, _mm256_set1_ps(M_PI_FRAC4)));
+
+    a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps(M_PI_FRAC2), a), _mm256_cmp_ps(abs_y, abs_x, _CMP_GT_OQ));
+    a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps(M_PI_F), a), _mm256_cmp_ps(x, zeros, _CMP_LT_OQ));
+    a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps(M_TWOPI), a), _mm256_cmp_ps(y, zeros, _CMP_LT_OQ));
+    inc_adds(96);
+    inc_mults(64);
+    inc_div(8);
+    return a;
+}
+
+/// <summary> 
+/// Calculates atan2 with AVX2 intrinsics at the accuracy of ethsift_set_math_accuracy.
+/// </summary>
+/// <param name="y"> IN: first input vector. </param>
+/// <param name="x"> IN: second input vector. </param> 
+/// <returns> atan2 value of y and x in [0, 2PI]. </returns>
+ETHSIFT_TARGET_AVX2
+static inline __m256 eth_mm256_atan2_ps(__m256 y, __m256 x)
+{
+    switch (g_math_accuracy) {
+    case ETHSIFT_ACCURACY_FAST: return eth_mm256_atan2_fast_ps(y, x);
+    case ETHSIFT_ACCURACY_MEDIUM: return eth_mm256_atan2_medium_ps(y, x);
+    default: {
+        float ys[8], xs[8];
+        _mm256_storeu_ps(ys, y);
+        _mm256_storeu_ps(xs, x);
+        for (int i = 0; i < 8; ++i)
+            ys[i] = atan2_exact_f(ys[i], xs[i]);
+        return _mm256_loadu_ps(ys);
+    }
+    }
+}
+
+/// <summary> 
+/// Calculates sin and cos with AVX2 intrinsics at ETHSIFT_ACCURACY_FAST or ETHSIFT_ACCURACY_MEDIUM, see sincos_poly_f.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+static inline void eth_mm256_sincos_poly_ps(__m256 x, int precise, __m256 *s, __m256 *c)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 abs_x = _mm256_andnot_ps(sign, x);
+    __m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(abs_x, _mm256_set1_ps(M_4_PI_F)));
+    j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+    const __m256 y = _mm256_cvtepi32_ps(j);
+    __m256 r;
+    if (precise) {
+        r = _mm256_fnmadd_ps(y, _mm256_set1_ps(SINCOS_DP1), abs_x);
+        r = _mm256_fnmadd_ps(y, _mm256_set1_ps(SINCOS_DP2), r);
+        r = _mm256_fnmadd_ps(y, _mm256_set1_ps(SINCOS_DP3), r);
+    } else {
+        r = _mm256_fnmadd_ps(y, _mm256_set1_ps(SINCOS_DP1), abs_x);
+        r = _mm256_fnmadd_ps(y, _mm256_set1_ps(SINCOS_DP23), r);
+    }
+    const __m256 z = _mm256_mul_ps(r, r);
+
+    __m256 ps = _mm256_set1_ps(-1.9515295891e-4f);
+    ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(8.3321608736e-3f));
+    ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(-1.6666654611e-1f));
+    ps = _mm256_fmadd_ps(_mm256_mul_ps(ps, z), r, r);
+    __m256 pc = _mm256_set1_ps(2.443315711809948e-5f);
+    pc = _mm256_fmadd_ps(pc, z, _mm256_set1_ps(-1.388731625493765e-3f));
+    pc = _mm256_fmadd_ps(pc, z, _mm256_set1_ps(4.166664568298827e-2f));
+    pc = _mm256_fmadd_ps(pc, _mm256_mul_ps(z, z), _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, _mm256_set1_ps(1.0f)));
+
+    const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(2)));
+    const __m256 sin_sign = _mm256_xor_ps(_mm256_and_ps(x, sign),
+        _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29)));
+    const __m256 cos_sign = _mm256_castsi256_ps(_mm256_slli_epi32(
+        _mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+    *s = _mm256_xor_ps(_mm256_blendv_ps(ps, pc, swap), sin_sign);
+    *c = _mm256_xor_ps(_mm256_blendv_ps(pc, ps, swap), cos_sign);
+    inc_adds(precise ? 104 : 96);
+    inc_mults(precise ? 136 : 128);
+}
+
+/// <summary> 
+/// Calculates sin and cos with AVX2 intrinsics at the accuracy of ethsift_set_math_accuracy.
+/// </summary>
+/// <param name="x"> IN: input vector. </param>
+/// <param name="s"> OUT: sin(x) of every lane. </param>
+/// <param name="c"> OUT: cos(x) of every lane. </param>
+ETHSIFT_TARGET_AVX2
+static inline void eth_mm256_sincos_ps(__m256 x, __m256 *s, __m256 *c)
+{
+    switch (g_math_accuracy) {
+    case ETHSIFT_ACCURACY_FAST: eth_mm256_sincos_poly_ps(x, 0, s, c); break;
+    case ETHSIFT_ACCURACY_MEDIUM: eth_mm256_sincos_poly_ps(x, 1, s, c); break;
+    default:
+        *s = eth_mm256_map_ps(x, sinf);
+        *c = eth_mm256_map_ps(x, cosf);
+        break;
+    }
+}
+
+/// <summary> 
+/// Calculates floor with AVX2 intrinsics, exact in every tier.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+static inline __m256 eth_mm256_floor_ps(__m256 x)
+{
+    return _mm256_floor_ps(x);
+}
+
+/// <summary> 
+/// Calculates 1/sqrt(x) with AVX2 intrinsics at the accuracy of ethsift_set_math_accuracy.
+/// ETHSIFT_ACCURACY_FAST refines the hardware estimate with one Newton step.
+/// </summary>
+/// <param name="x"> IN: input vector. </param>
+/// <returns> 1/sqrt(x) of every lane. </returns>
+ETHSIFT_TARGET_AVX2
+static inline __m256 eth_mm256_rsqrt_ps(__m256 x)
+{
+    switch (g_math_accuracy) {
+    case ETHSIFT_ACCURACY_FAST: {
+        const __m256 r = _mm256_rsqrt_ps(x);
+        const __m256 half_xr = _mm256_mul_ps(_mm256_mul_ps(x, _mm256_set1_ps(0.5f)), r);
+        inc_adds(8);
+        inc_mults(32);
+        return _mm256_mul_ps(r, _mm256_fnmadd_ps(half_xr, r, _mm256_set1_ps(1.5f)));
+    }
+    case ETHSIFT_ACCURACY_MEDIUM:
+        inc_div(16);
+        return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(x));
+    default:
+        inc_div(8);
+        return eth_mm256_map_ps(x, rsqrt_exact_f);
+    }
+}
+
+/// <summary> 
+/// Apply a scalar function to every lane of an AVX-512 vector, for ETHSIFT_ACCURACY_EXACT.
+/// </summary>
+ETHSIFT_TARGET_AVX512
+static inline __m512 eth_mm512_map_ps(__m512 x, float (*f)(float))
+{
+    float v[16];
+    _mm512_storeu_ps(v, x);
+    for (int i = 0; i < 16; ++i)
+        v[i] = f(v[i]);
+    return _mm512_loadu_ps(v);
+}
+
+/// <summary> 
+/// Calculates exp with AVX-512 intrinsics, with the polynomial of exp_fast_f or exp_medium_f.
+/// </summary>
+ETHSIFT_TARGET_AVX512
+static inline __m512 eth_mm512_exp_poly_ps(__m512 x, int medium)
+{
+    x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(EXP_MIN)), _mm512_set1_ps(EXP_MAX));
+    const __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(M_LOG2E_F)),
+                                          _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(EXP_LN2_HI), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(EXP_LN2_LO), r);
+
+    __m512 p;
+    if (medium) {
+        p = _mm512_set1_ps(1.9875691500e-4f);
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.3981999507e-3f));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(8.3334519073e-3f));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(4.1665795894e-2f));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.6666665459e-1f));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(5.0000001201e-1f));
+    } else {
+        p = _mm512_set1_ps(8.3333333333e-3f);
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(4.1666666667e-2f));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.6666666667e-1f));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(0.5f));
+    }
+    p = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+    inc_adds(medium ? 128 : 96);
+    inc_mults(medium ? 144 : 112);
+    return _mm512_scalef_ps(p, n);
+}
+
+/// <summary> 
+/// Calculates exp with AVX-512 intrinsics at the accuracy of ethsift_set_math_accuracy.
+/// </summary>
+/// <param name="x"> IN: input vector. </param>
+/// <returns> exp(x) of every lane. </returns>
+ETHSIFT_TARGET_AVX512
+static inline __m512 eth_mm512_exp_ps(__m512 x)
+{
+    switch (g_math_accuracy) {
+    case ETHSIFT_ACCURACY_FAST: return eth_mm512_exp_poly_ps(x, 0);
+    case ETHSIFT_ACCURACY_MEDIUM: return eth_mm512_exp_poly_ps(x, 1);
+    default: return eth_mm512_map_ps(x, expf);
+    }
+}
+
+/// <summary> 
+/// Calculates atan2 with AVX-512 intrinsics at ETHSIFT_ACCURACY_MEDIUM, see atan2_medium_f.
+/// </summary>
+/// <param name="y"> IN: first input vector. </param>
+/// <param name="x"> IN: second input vector. </param> 
+/// <returns> atan2 value of y and x in [0, 2PI]. </returns>
+ETHSIFT_TARGET_AVX512
+static inline __m512 eth_mm512_atan2_medium_ps(__m512 y, __m512 x)
+{
+    const __m512 zeros = _mm512_setzero_ps();
+    const __m512 abs_x = _mm512_abs_ps(x);
+    const __m512 abs_y = _mm512_abs_ps(y);
+    const __m512 mx = _mm512_max_ps(abs_x, abs_y);
+    const __m512 mn = _mm512_min_ps(abs_x, abs_y);
+
+    const __mmask16 big = _mm512_cmp_ps_mask(mn, _mm512_mul_ps(mx, _mm512_set1_ps(M_TAN_PI_FRAC8)), _CMP_GT_OQ);
+    const __m512 dividend = _mm512_mask_sub_ps(mn, big, mn, mx);
+    const __m512 divisor = _mm512_mask_add_ps(_mm512_max_ps(mx, _mm512_set1_ps(FLT_MIN)), big, mn, mx);
+    const __m512 t = _mm512_div_ps(dividend, divisor);
+    const __m512 z = _mm512_mul_ps(t, t);
+
+    __m512 p = _mm512_set1_ps(8.05374449538e-2f);
+    p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(-1.38776856032e-1f));
+    p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(1.99777106478e-1f));
+    p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(-3.33329491539e-1f));
+    __m512 a = _mm512_fmadd_ps(_mm512_mul_ps(p, z), t, t);
+    a = _mm512_mask_add_ps(a, big, a, _mm512_set1_ps(M_PI_FRAC4));
+
+    a = _mm512_mask_sub_ps(a, _mm512_cmp_ps_mask(abs_y, abs_x, _CMP_GT_OQ), _mm512_set1_ps(M_PI_FRAC2), a);
+    a = _mm512_mask_sub_ps(a, _mm512_cmp_ps_mask(x, zeros, _CMP_LT_OQ), _mm512_set1_ps(M_PI_F), a);
+    a = _mm512_mask_sub_ps(a, _mm512_cmp_ps_mask(y, zeros, _CMP_LT_OQ), _mm512_set1_ps(M_TWOPI), a);
+    inc_adds(192);
+    inc_mults(128);
+    inc_div(16);
+    return a;
+}
+
+/// <summary> 
+/// Calculates atan2 with AVX-512 intrinsics at the accuracy of ethsift_set_math_accuracy.
+/// </summary>
+/// <param name="y"> IN: first input vector. </param>
+/// <param name="x"> IN: second input vector. </param> 
+/// <returns> atan2 value of y and x in [0, 2PI]. </returns>
+ETHSIFT_TARGET_AVX512
+static inline __m512 eth_mm512_atan2_ps(__m512 y, __m512 x)
+{
+    switch (g_math_accuracy) {
+    case ETHSIFT_ACCURACY_FAST: return eth_mm512_atan2_fast_ps(y, x);
+    case ETHSIFT_ACCURACY_MEDIUM: return eth_mm512_atan2_medium_ps(y, x);
+    default: {
+        float ys[16], xs[16];
+        _mm512_storeu_ps(ys, y);
+        _mm512_storeu_ps(xs, x);
+        for (int i = 0; i < 16; ++i)
+            ys[i] = atan2_exact_f(ys[i], xs[i]);
+        return _mm512_loadu_ps(ys);
+    }
+    }
+}
+
+/// <summary> 
+/// Calculates sin and cos with AVX-512 intrinsics at ETHSIFT_ACCURACY_FAST or ETHSIFT_ACCURACY_MEDIUM, see sincos_poly_f.
+/// </summary>
+ETHSIFT_TARGET_AVX512
+static inline void eth_mm512_sincos_poly_ps(__m512 x, int precise, __m512 *s, __m512 *c)
+{
+    const __m512i sign = _mm512_set1_epi32(0x80000000);
+    const __m512 abs_x = _mm512_abs_ps(x);
+    __m512i j = _mm512_cvttps_epi32(_mm512_mul_ps(abs_x, _mm512_set1_ps(M_4_PI_F)));
+    j = _mm512_and_si512(_mm512_add_epi32(j, _mm512_set1_epi32(1)), _mm512_set1_epi32(~1));
+    const __m512 y = _mm512_cvtepi32_ps(j);
+    __m512 r;
+    if (precise) {
+        r = _mm512_fnmadd_ps(y, _mm512_set1_ps(SINCOS_DP1), abs_x);
+        r = _mm512_fnmadd_ps(y, _mm512_set1_ps(SINCOS_DP2), r);
+        r = _mm512_fnmadd_ps(y, _mm512_set1_ps(SINCOS_DP3), r);
+    } else {
+        r = _mm512_fnmadd_ps(y, _mm512_set1_ps(SINCOS_DP1), abs_x);
+        r = _mm512_fnmadd_ps(y, _mm512_set1_ps(SINCOS_DP23), r);
+    }
+    const __m512 z = _mm512_mul_ps(r, r);
+
+    __m512 ps = _mm512_set1_ps(-1.9515295891e-4f);
+    ps = _mm512_fmadd_ps(ps, z, _mm512_set1_ps(8.3321608736e-3f));
+    ps = _mm512_fmadd_ps(ps, z, _mm512_set1_ps(-1.6666654611e-1f));
+    ps = _mm512_fmadd_ps(_mm512_mul_ps(ps, z), r, r);
+    __m512 pc = _mm512_set1_ps(2.443315711809948e-5f);
+    pc = _mm512_fmadd_ps(pc, z, _mm512_set1_ps(-1.388731625493765e-3f));
+    pc = _mm512_fmadd_ps(pc, z, _mm512_set1_ps(4.166664568298827e-2f));
+    pc = _mm512_fmadd_ps(pc, _mm512_mul_ps(z, z), _mm512_fnmadd_ps(_mm512_set1_ps(0.5f), z, _mm512_set1_ps(1.0f)));
+
+    const __mmask16 swap = _mm512_test_epi32_mask(j, _mm512_set1_epi32(2));
+    const __m512i sin_sign = _mm512_xor_si512(_mm512_and_si512(_mm512_castps_si512(x), sign),
+        _mm512_slli_epi32(_mm512_and_si512(j, _mm512_set1_epi32(4)), 29));
+    const __m512i cos_sign = _mm512_slli_epi32(
+        _mm512_andnot_si512(_mm512_sub_epi32(j, _mm512_set1_epi32(2)), _mm512_set1_epi32(4)), 29);
+    *s = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_mask_blend_ps(swap, ps, pc)), sin_sign));
+    *c = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_mask_blend_ps(swap, pc, ps)), cos_sign));
+    inc_adds(precise ? 208 : 192);
+    inc_mults(precise ? 272 : 256);
+}
+
+/// <summary> 
+/// Calculates sin and cos with AVX-512 intrinsics at the accuracy of ethsift_set_math_accuracy.
+/// </summary>
+/// <param name="x"> IN: input vector. </param>
+/// <param name="s"> OUT: sin(x) of every lane. </param>
+/// <param name="c"> OUT: cos(x) of every lane. </param>
+ETHSIFT_TARGET_AVX512
+static inline void eth_mm512_sincos_ps(__m512 x, __m512 *s, __m512 *c)
+{
+    switch (g_math_accuracy) {
+    case ETHSIFT_ACCURACY_FAST: eth_mm512_sincos_poly_ps(x, 0, s, c); break;
+    case ETHSIFT_ACCURACY_MEDIUM: eth_mm512_sincos_poly_ps(x, 1, s, c); break;
+    default:
+        *s = eth_mm512_map_ps(x, sinf);
+        *c = eth_mm512_map_ps(x, cosf);
+        break;
+    }
+}
+
+/// <summary> 
+/// Calculates floor with AVX-512 intrinsics, exact in every tier.
+/// </summary>
+ETHSIFT_TARGET_AVX512
+static inline __m512 eth_mm512_floor_ps(__m512 x)
+{
+    return _mm512_roundscale_ps(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+}
+
+/// <summary> 
+/// Calculates 1/sqrt(x) with AVX-512 intrinsics at the accuracy of ethsift_set_math_accuracy.
+/// ETHSIFT_ACCURACY_FAST refines the 14 bit hardware estimate with one Newton step.
+/// </summary>
+/// <param name="x"> IN: input vector. </param>
+/// <returns> 1/sqrt(x) of every lane. </returns>
+ETHSIFT_TARGET_AVX512
+static inline __m512 eth_mm512_rsqrt_ps(__m512 x)
+{
+    switch (g_math_accuracy) {
+    case ETHSIFT_ACCURACY_FAST: {
+        const __m512 r = _mm512_rsqrt14_ps(x);
+        const __m512 half_xr = _mm512_mul_ps(_mm512_mul_ps(x, _mm512_set1_ps(0.5f)), r);
+        inc_adds(16);
+        inc_mults(64);
+        return _mm512_mul_ps(r, _mm512_fnmadd_ps(half_xr, r, _mm512_set1_ps(1.5f)));
+    }
+    case ETHSIFT_ACCURACY_MEDIUM:
+        inc_div(32);
+        return _mm512_div_ps(_mm512_set1_ps(1.0f), _mm512_sqrt_ps(x));
+    default:
+        inc_div(16);
+        return eth_mm512_map_ps(x, rsqrt_exact_f);
+    }
+}
+
+#endif
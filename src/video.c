@@ -0,0 +1,610 @@
+#include "internal.h"
+
+// Tile states of the change mask.
+#define TILE_CLEAN 0
+#define TILE_CHANGED 1
+#define TILE_RECOMPUTE 2
+#define TILE_ASSIGNED 3
+
+// Pyramids of one image, levels laid out like in ethsift_compute_keypoints.
+struct video_pyramids{
+  struct ethsift_image *gaussians;
+  struct ethsift_image *differences;
+  struct ethsift_image *gradients;
+  // NULL with ETHSIFT_ORIENTATION_OCTANT.
+  struct ethsift_image *rotations;
+};
+
+struct ethsift_video{
+  uint32_t width, height;
+  uint32_t octave_count;
+  uint32_t upsample;
+  uint32_t octant;
+  float threshold;
+  // Pyramids of the whole frame, updated tile by tile.
+  struct video_pyramids pyramids;
+  // The pixels the pyramids were built from, in the format of the frames.
+  uint8_t *reference;
+  // ETHSIFT_FORMAT_* of the reference, UINT32_MAX until the first frame, and its view_range.
+  uint32_t format;
+  float range;
+  // Change mask over tiles of ETHSIFT_VIDEO_TILE input pixels.
+  uint32_t tiles_x, tiles_y;
+  uint8_t *tile_state;
+  float *tile_sad;
+  uint32_t recomputed_tiles;
+  // Rectangles of tiles recomputed by the current frame, in input pixels.
+  struct ethsift_roi *rects;
+  // Keypoints of the last frame and room to detect new ones in.
+  struct ethsift_keypoint *keypoints;
+  uint32_t keypoint_count, keypoint_capacity;
+  struct ethsift_keypoint *detected;
+};
+
+static uint32_t format_size(uint32_t format){
+  return (format == ETHSIFT_FORMAT_U8) ? 1 : (format == ETHSIFT_FORMAT_U16) ? 2 : 4;
+}
+
+/// <summary>
+/// Sum of absolute differences between two rows of a borrowed image.
+/// </summary>
+/// <param name="a"> IN: Start of the first row. </param>
+/// <param name="b"> IN: Start of the second row. </param>
+/// <param name="w"> IN: Number of pixels in the rows. </param>
+/// <param name="format"> IN: One of the ETHSIFT_FORMAT_* pixel formats. </param>
+/// <returns> The sum in units of the pixel format. </returns>
+/// <remarks> 3 * w flops </remarks>
+float row_sad_scalar(const void * restrict a, const void * restrict b, int w, uint32_t format){
+  float sum = 0;
+  switch (format) {
+  case ETHSIFT_FORMAT_U8: {
+    const uint8_t *x = a, *y = b;
+    uint32_t total = 0;
+    for (int c = 0; c < w; ++c)
+      total += abs((int) x[c] - (int) y[c]);
+    sum = (float) total;
+    inc_read(2 * w, uint8_t);
+    break;
+  }
+  case ETHSIFT_FORMAT_U16: {
+    const uint16_t *x = a, *y = b;
+    uint64_t total = 0;
+    for (int c = 0; c < w; ++c)
+      total += abs((int) x[c] - (int) y[c]);
+    sum = (float) total;
+    inc_read(2 * w, uint16_t);
+    break;
+  }
+  default: {
+    const float *x = a, *y = b;
+    for (int c = 0; c < w; ++c)
+      sum += fabsf(x[c] - y[c]);
+    inc_read(2 * w, float);
+    break;
+  }
+  }
+  inc_adds(3 * w);
+  return sum;
+}
+
+/// <summary>
+/// Sum of absolute differences between two rows, see row_sad_scalar.
+/// SSE variant, 8-bit rows go through psadbw. 16-bit rows stay scalar.
+/// </summary>
+ETHSIFT_TARGET_SSE
+float row_sad_sse(const void * restrict a, const void * restrict b, int w, uint32_t format){
+  int c = 0;
+  float sum = 0;
+  switch (format) {
+  case ETHSIFT_FORMAT_U8: {
+    const uint8_t *x = a, *y = b;
+    __m128i total = _mm_setzero_si128();
+    for (; c < w - 15; c += 16)
+      total = _mm_add_epi64(total, _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (x + c)),
+                                                _mm_loadu_si128((const __m128i *) (y + c))));
+    sum = (float) (uint64_t) (_mm_cvtsi128_si64(total) + _mm_extract_epi64(total, 1));
+    inc_read(2 * c, uint8_t);
+    break;
+  }
+  case ETHSIFT_FORMAT_F32: {
+    const float *x = a, *y = b;
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 total = _mm_setzero_ps();
+    for (; c < w - 3; c += 4)
+      total = _mm_add_ps(total, _mm_andnot_ps(sign, _mm_sub_ps(_mm_loadu_ps(x + c), _mm_loadu_ps(y + c))));
+    total = _mm_add_ps(total, _mm_movehl_ps(total, total));
+    total = _mm_add_ss(total, _mm_shuffle_ps(total, total, 1));
+    sum = _mm_cvtss_f32(total);
+    inc_read(2 * c, float);
+    break;
+  }
+  }
+  inc_adds(3 * c);
+  const uint32_t offset = c * format_size(format);
+  return sum + row_sad_scalar((const uint8_t *) a + offset, (const uint8_t *) b + offset, w - c, format);
+}
+
+/// <summary>
+/// Sum of absolute differences between two rows, see row_sad_scalar.
+/// AVX2 variant, 8-bit rows go through vpsadbw. 16-bit rows stay scalar.
+/// </summary>
+ETHSIFT_TARGET_AVX2
+float row_sad_avx2(const void * restrict a, const void * restrict b, int w, uint32_t format){
+  int c = 0;
+  float sum = 0;
+  switch (format) {
+  case ETHSIFT_FORMAT_U8: {
+    const uint8_t *x = a, *y = b;
+    __m256i total = _mm256_setzero_si256();
+    for (; c < w - 31; c += 32)
+      total = _mm256_add_epi64(total, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *) (x + c)),
+                                                      _mm256_loadu_si256((const __m256i *) (y + c))));
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    sum = (float) (uint64_t) (_mm_cvtsi128_si64(half) + _mm_extract_epi64(half, 1));
+    inc_read(2 * c, uint8_t);
+    break;
+  }
+  case ETHSIFT_FORMAT_F32: {
+    const float *x = a, *y = b;
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 total = _mm256_setzero_ps();
+    for (; c < w - 7; c += 8)
+      total = _mm256_add_ps(total, _mm256_andnot_ps(sign, _mm256_sub_ps(_mm256_loadu_ps(x + c), _mm256_loadu_ps(y + c))));
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(total), _mm256_extractf128_ps(total, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    sum = _mm_cvtss_f32(half);
+    inc_read(2 * c, float);
+    break;
+  }
+  }
+  inc_adds(3 * c);
+  const uint32_t offset = c * format_size(format);
+  return sum + row_sad_scalar((const uint8_t *) a + offset, (const uint8_t *) b + offset, w - c, format);
+}
+
+static void free_pyramids(struct video_pyramids *pyramids){
+  if (pyramids->gaussians && pyramids->gaussians[0].pixels)
+    ethsift_free_pyramid(pyramids->gaussians);
+  if (pyramids->differences && pyramids->differences[0].pixels)
+    ethsift_free_pyramid(pyramids->differences);
+  if (pyramids->gradients && pyramids->gradients[0].pixels)
+    ethsift_free_pyramid(pyramids->gradients);
+  if (pyramids->rotations && pyramids->rotations[0].pixels)
+    ethsift_free_pyramid(pyramids->rotations);
+  free(pyramids->gaussians);
+  free(pyramids->differences);
+  free(pyramids->gradients);
+  free(pyramids->rotations);
+  memset(pyramids, 0, sizeof(struct video_pyramids));
+}
+
+/// <summary>
+/// Allocate the pyramids of an image of the given input size.
+/// </summary>
+/// <returns> 1 IF all pyramids could be allocated, ELSE 0. </returns>
+static int allocate_pyramids(struct video_pyramids *pyramids, uint32_t width, uint32_t height, uint32_t octave_count, uint32_t octant){
+  const uint32_t gaussian_count = ETHSIFT_INTVLS + 3;
+  const uint32_t dog_count = ETHSIFT_INTVLS + 2;
+  const uint32_t base_width = width << g_upsample;
+  const uint32_t base_height = height << g_upsample;
+
+  pyramids->gaussians = calloc(octave_count * gaussian_count, sizeof(struct ethsift_image));
+  pyramids->differences = calloc(octave_count * dog_count, sizeof(struct ethsift_image));
+  pyramids->gradients = calloc(octave_count * gaussian_count, sizeof(struct ethsift_image));
+  pyramids->rotations = octant ? NULL : calloc(octave_count * gaussian_count, sizeof(struct ethsift_image));
+  if (!pyramids->gaussians || !pyramids->differences || !pyramids->gradients || (!octant && !pyramids->rotations)
+      || !ethsift_allocate_pyramid(pyramids->gaussians, base_width, base_height, octave_count, gaussian_count)
+      || !ethsift_allocate_pyramid(pyramids->differences, base_width, base_height, octave_count, dog_count)
+      || !ethsift_allocate_pyramid(pyramids->gradients, base_width, base_height, octave_count, gaussian_count)
+      || (!octant && !ethsift_allocate_pyramid(pyramids->rotations, base_width, base_height, octave_count, gaussian_count))) {
+    free_pyramids(pyramids);
+    return 0;
+  }
+  return 1;
+}
+
+/// <summary>
+/// Copy the part of every level that covers rect in the input image from the pyramid of a crop into
+/// the pyramid of the whole frame.
+/// </summary>
+/// <param name="dst"> OUT: Levels of the whole frame. </param>
+/// <param name="src"> IN: Levels of the crop. </param>
+/// <param name="level_count"> IN: Levels per octave. </param>
+/// <param name="octave_count"> IN: Number of octaves. </param>
+/// <param name="crop_x"> IN: Column of the crop in the input image, aligned to the coarsest octave. </param>
+/// <param name="crop_y"> IN: Row of the crop in the input image, aligned to the coarsest octave. </param>
+/// <param name="rect"> IN: Rectangle of the input image to copy. </param>
+static void copy_levels(struct ethsift_image dst[], const struct ethsift_image src[], uint32_t level_count, uint32_t octave_count,
+                        uint32_t crop_x, uint32_t crop_y, const struct ethsift_roi *rect){
+  for (uint32_t o = 0; o < octave_count; ++o) {
+    // The first pixel of the level at or past an input coordinate, as in region_accepts.
+    const uint32_t round = (1u << o) - 1;
+    const uint32_t r0 = ((rect->y << g_upsample) + round) >> o;
+    const uint32_t r1 = (((rect->y + rect->height) << g_upsample) + round) >> o;
+    const uint32_t c0 = ((rect->x << g_upsample) + round) >> o;
+    const uint32_t c1 = (((rect->x + rect->width) << g_upsample) + round) >> o;
+    const uint32_t oy = (crop_y << g_upsample) >> o;
+    const uint32_t ox = (crop_x << g_upsample) >> o;
+    for (uint32_t k = 0; k < level_count; ++k) {
+      const struct ethsift_image d = dst[o * level_count + k];
+      const struct ethsift_image s = src[o * level_count + k];
+      const uint32_t rows = internal_min(internal_min(r1, d.height), oy + s.height);
+      const uint32_t cols = internal_min(internal_min(c1, d.width), ox + s.width);
+      if (cols <= c0)
+        continue;
+      for (uint32_t r = r0; r < rows; ++r)
+        memcpy(d.pixels + r * d.width + c0, s.pixels + (r - oy) * s.width + (c0 - ox), (cols - c0) * sizeof(float));
+      inc_read((rows - r0) * (cols - c0), float);
+      inc_write((rows - r0) * (cols - c0), float);
+    }
+  }
+}
+
+/// <summary>
+/// Pick the crop of one axis to rebuild a rectangle from: a halo of ETHSIFT_VIDEO_HALO pixels on either
+/// side, the start aligned to the coarsest octave, and large enough to hold all octaves. The halo covers
+/// the blur of the first octaves, coarser ones differ from the whole frame near the border of the crop.
+/// </summary>
+static void crop_axis(uint32_t begin, uint32_t end, uint32_t size, uint32_t align, uint32_t min_size,
+                      uint32_t *crop_begin, uint32_t *crop_end){
+  const uint32_t halo = ETHSIFT_VIDEO_HALO;
+  uint32_t b = (begin < halo ? 0 : begin - halo) & ~(align - 1);
+  uint32_t e = internal_min(end + halo, size);
+  if (e - b < min_size) {
+    e = internal_min(b + min_size, size);
+    if (e - b < min_size)
+      b = (size - min_size) & ~(align - 1);
+  }
+  *crop_begin = b;
+  *crop_end = e;
+}
+
+/// <summary>
+/// Rebuild the pyramids of the whole frame inside rect from the pixels of the frame.
+/// </summary>
+/// <returns> 1 IF computation was successful, ELSE 0. </returns>
+static int rebuild_rect(struct ethsift_video *video, struct ethsift_image_view frame, const struct ethsift_roi *rect){
+  const uint32_t gaussian_count = ETHSIFT_INTVLS + 3;
+  const uint32_t dog_count = ETHSIFT_INTVLS + 2;
+  struct video_pyramids *whole = &video->pyramids;
+
+  if (rect->width == video->width && rect->height == video->height)
+    return ethsift_build_pyramids(frame, video->octave_count, whole->gaussians, whole->differences,
+                                  whole->gradients, whole->rotations);
+
+  // Crops start on the grid of the coarsest octave so that every octave samples the same pixels.
+  const uint32_t octaves = video->octave_count - video->upsample;
+  const uint32_t align = 1u << int_max((int) octaves - 1, 0);
+  const uint32_t min_size = 2u << octaves;
+  uint32_t x0, x1, y0, y1;
+  crop_axis(rect->x, rect->x + rect->width, video->width, align, min_size, &x0, &x1);
+  crop_axis(rect->y, rect->y + rect->height, video->height, align, min_size, &y0, &y1);
+
+  struct ethsift_image_view crop = frame;
+  crop.data = (const uint8_t *) frame.data + y0 * frame.stride + x0 * format_size(frame.format);
+  crop.width = x1 - x0;
+  crop.height = y1 - y0;
+
+  struct video_pyramids part = {0};
+  if (!allocate_pyramids(&part, crop.width, crop.height, video->octave_count, video->octant))
+    return 0;
+  ethsift_build_pyramids(crop, video->octave_count, part.gaussians, part.differences, part.gradients, part.rotations);
+  copy_levels(whole->gaussians, part.gaussians, gaussian_count, video->octave_count, x0, y0, rect);
+  copy_levels(whole->differences, part.differences, dog_count, video->octave_count, x0, y0, rect);
+  copy_levels(whole->gradients, part.gradients, gaussian_count, video->octave_count, x0, y0, rect);
+  if (!video->octant)
+    copy_levels(whole->rotations, part.rotations, gaussian_count, video->octave_count, x0, y0, rect);
+  free_pyramids(&part);
+  return 1;
+}
+
+/// <summary>
+/// Compare the frame against the reference tile by tile, mark tiles whose mean absolute difference
+/// exceeds the threshold as changed, and every tile within one tile of them for recomputation.
+/// </summary>
+/// <returns> Number of tiles to recompute. </returns>
+static uint32_t mark_tiles(struct ethsift_video *video, struct ethsift_image_view frame){
+  const uint32_t tile = ETHSIFT_VIDEO_TILE;
+  const uint32_t pixel_size = format_size(frame.format);
+  const uint32_t tile_count = video->tiles_x * video->tiles_y;
+
+  if (frame.format != video->format || view_range(frame) != video->range) {
+    memset(video->tile_state, TILE_RECOMPUTE, tile_count);
+    return tile_count;
+  }
+
+  memset(video->tile_state, TILE_CLEAN, tile_count);
+  for (uint32_t ty = 0; ty < video->tiles_y; ++ty) {
+    const uint32_t y0 = ty * tile;
+    const uint32_t y1 = internal_min(y0 + tile, video->height);
+    float *sad = video->tile_sad;
+    memset(sad, 0, video->tiles_x * sizeof(float));
+    for (uint32_t y = y0; y < y1; ++y) {
+      const uint8_t *row = (const uint8_t *) frame.data + y * frame.stride;
+      const uint8_t *ref = video->reference + y * video->width * pixel_size;
+      for (uint32_t tx = 0; tx < video->tiles_x; ++tx) {
+        const uint32_t x0 = tx * tile;
+        const uint32_t x1 = internal_min(x0 + tile, video->width);
+        sad[tx] += g_kernels.row_sad(row + x0 * pixel_size, ref + x0 * pixel_size, x1 - x0, frame.format);
+      }
+    }
+    for (uint32_t tx = 0; tx < video->tiles_x; ++tx) {
+      const uint32_t x0 = tx * tile;
+      const uint32_t pixels = (internal_min(x0 + tile, video->width) - x0) * (y1 - y0);
+      if (video->threshold * pixels < sad[tx])
+        video->tile_state[ty * video->tiles_x + tx] = TILE_CHANGED;
+    }
+  }
+
+  // The blur carries a change across tile borders, so the tiles around it are rebuilt as well. One
+  // tile covers the blur of the first two octaves; octave o blurs across about 16 << o input pixels,
+  // so coarse levels outside the ring keep values of the old frame and their keypoints are approximate.
+  uint32_t count = 0;
+  for (uint32_t ty = 0; ty < video->tiles_y; ++ty) {
+    for (uint32_t tx = 0; tx < video->tiles_x; ++tx) {
+      uint8_t *state = &video->tile_state[ty * video->tiles_x + tx];
+      if (*state == TILE_CHANGED)
+        continue;
+      for (int dy = -1; dy <= 1 && *state == TILE_CLEAN; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          const int ny = (int) ty + dy, nx = (int) tx + dx;
+          if (0 <= ny && ny < (int) video->tiles_y && 0 <= nx && nx < (int) video->tiles_x
+              && video->tile_state[ny * video->tiles_x + nx] == TILE_CHANGED) {
+            *state = TILE_RECOMPUTE;
+            break;
+          }
+        }
+      }
+    }
+  }
+  for (uint32_t t = 0; t < tile_count; ++t) {
+    if (video->tile_state[t] != TILE_CLEAN) {
+      video->tile_state[t] = TILE_RECOMPUTE;
+      ++count;
+    }
+  }
+  return count;
+}
+
+/// <summary>
+/// Cover the tiles to recompute with rectangles, greedily growing each to the right and then down.
+/// </summary>
+/// <returns> Number of rectangles written to video->rects. </returns>
+static uint32_t collect_rects(struct ethsift_video *video){
+  const uint32_t tile = ETHSIFT_VIDEO_TILE;
+  const uint32_t tiles_x = video->tiles_x;
+  uint8_t *state = video->tile_state;
+  uint32_t count = 0;
+  for (uint32_t ty = 0; ty < video->tiles_y; ++ty) {
+    for (uint32_t tx = 0; tx < tiles_x; ++tx) {
+      if (state[ty * tiles_x + tx] != TILE_RECOMPUTE)
+        continue;
+      uint32_t tx1 = tx;
+      while (tx1 < tiles_x && state[ty * tiles_x + tx1] == TILE_RECOMPUTE)
+        ++tx1;
+      uint32_t ty1 = ty + 1;
+      for (; ty1 < video->tiles_y; ++ty1) {
+        uint32_t c = tx;
+        while (c < tx1 && state[ty1 * tiles_x + c] == TILE_RECOMPUTE)
+          ++c;
+        if (c < tx1)
+          break;
+      }
+      for (uint32_t r = ty; r < ty1; ++r)
+        memset(state + r * tiles_x + tx, TILE_ASSIGNED, tx1 - tx);
+
+      struct ethsift_roi *rect = &video->rects[count++];
+      rect->x = tx * tile;
+      rect->y = ty * tile;
+      rect->width = internal_min(tx1 * tile, video->width) - rect->x;
+      rect->height = internal_min(ty1 * tile, video->height) - rect->y;
+    }
+  }
+  return count;
+}
+
+/// <summary>
+/// Test whether the keypoint lies in a tile recomputed by the current frame.
+/// </summary>
+static int in_recomputed_tile(const struct ethsift_video *video, const struct ethsift_keypoint *keypoint){
+  const int tx = int_min(int_max((int) keypoint->global_pos.x, 0), (int) video->width - 1) / ETHSIFT_VIDEO_TILE;
+  const int ty = int_min(int_max((int) keypoint->global_pos.y, 0), (int) video->height - 1) / ETHSIFT_VIDEO_TILE;
+  return video->tile_state[ty * video->tiles_x + tx] != TILE_CLEAN;
+}
+
+/// <summary>
+/// Test whether the keypoint lies inside the rectangle.
+/// </summary>
+static int in_rect(const struct ethsift_roi *rect, const struct ethsift_keypoint *keypoint){
+  const float x = keypoint->global_pos.x, y = keypoint->global_pos.y;
+  return rect->x <= x && x < rect->x + rect->width && rect->y <= y && y < rect->y + rect->height;
+}
+
+/// <summary>
+/// Detect and describe the keypoints inside a rebuilt rectangle, and append them to the video's keypoints.
+/// Extrema are searched ETHSIFT_ROI_HALO pixels around the rectangle, since refinement can move a
+/// keypoint into it, and only keypoints that end up inside of it are kept.
+/// </summary>
+/// <returns> 1 IF computation was successful, ELSE 0. </returns>
+static int detect_rect(struct ethsift_video *video, const struct ethsift_roi *rect){
+  const uint32_t gaussian_count = ETHSIFT_INTVLS + 3;
+  const uint32_t halo = ETHSIFT_ROI_HALO;
+  struct video_pyramids *whole = &video->pyramids;
+  struct ethsift_image *orientations = video->octant ? whole->gaussians : whole->rotations;
+
+  struct detect_region region = {0, 0,
+                                 rect->x < halo ? 0 : rect->x - halo,
+                                 rect->y < halo ? 0 : rect->y - halo,
+                                 internal_min(rect->x + rect->width + halo, video->width),
+                                 internal_min(rect->y + rect->height + halo, video->height),
+                                 NULL, video->width};
+  uint32_t count = ETHSIFT_MAX_TRACKABLE_KEYPOINTS;
+  if (!ethsift_detect_keypoints_region(whole->differences, whole->gradients, orientations, video->octave_count,
+                                       gaussian_count, video->detected, &count, &region))
+    return 0;
+  count = internal_min(count, ETHSIFT_MAX_TRACKABLE_KEYPOINTS);
+
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (in_rect(rect, &video->detected[i]))
+      video->detected[kept++] = video->detected[i];
+  }
+  if (kept == 0)
+    return 1;
+
+  if (g_descriptor_mode == ETHSIFT_DESCRIPTOR_PATCH)
+    ethsift_extract_descriptor_patch(whole->gaussians, video->octave_count, gaussian_count, video->detected, kept);
+  else
+    ethsift_extract_descriptor(whole->gradients, orientations, video->octave_count, gaussian_count, video->detected, kept);
+
+  if (video->keypoint_capacity < video->keypoint_count + kept) {
+    const uint32_t capacity = internal_max(video->keypoint_count + kept, video->keypoint_capacity * 2);
+    struct ethsift_keypoint *grown = realloc(video->keypoints, capacity * sizeof(struct ethsift_keypoint));
+    if (!grown)
+      return 0;
+    video->keypoints = grown;
+    video->keypoint_capacity = capacity;
+  }
+  memcpy(video->keypoints + video->keypoint_count, video->detected, kept * sizeof(struct ethsift_keypoint));
+  video->keypoint_count += kept;
+  return 1;
+}
+
+/// <summary>
+/// Create the state that carries pyramids and keypoints from one frame of a video to the next.
+/// </summary>
+/// <param name="width"> IN: Width of the frames. </param>
+/// <param name="height"> IN: Height of the frames. </param>
+/// <param name="threshold"> IN: Mean absolute difference per pixel, in units of the pixel format, above
+///                          which a tile counts as changed. </param>
+/// <param name="video"> OUT: The new state, release it with ethsift_video_free. </param>
+/// <returns> 1 IF the state could be allocated, ELSE 0. </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_video_create(uint32_t width, uint32_t height, float threshold, struct ethsift_video **video){
+  const int octave_count = (int)log2f((float)int_min((int) width, (int) height)) - 3 + (int) g_upsample;
+  if (octave_count < 1 || threshold < 0)
+    return 0;
+  if (!fits_blur_buffers(width, height))
+    return 0;
+
+  struct ethsift_video *state = calloc(1, sizeof(struct ethsift_video));
+  if (!state)
+    return 0;
+  state->width = width;
+  state->height = height;
+  state->octave_count = octave_count;
+  state->upsample = g_upsample;
+  state->octant = (g_orientation_mode == ETHSIFT_ORIENTATION_OCTANT);
+  state->threshold = threshold;
+  state->format = UINT32_MAX;
+  state->tiles_x = (width + ETHSIFT_VIDEO_TILE - 1) / ETHSIFT_VIDEO_TILE;
+  state->tiles_y = (height + ETHSIFT_VIDEO_TILE - 1) / ETHSIFT_VIDEO_TILE;
+
+  // The reference is sized for the widest pixel format.
+  state->reference = malloc((size_t) width * height * sizeof(float));
+  state->tile_state = malloc(state->tiles_x * state->tiles_y);
+  state->tile_sad = malloc(state->tiles_x * sizeof(float));
+  state->rects = malloc(state->tiles_x * state->tiles_y * sizeof(struct ethsift_roi));
+  state->detected = malloc(ETHSIFT_MAX_TRACKABLE_KEYPOINTS * sizeof(struct ethsift_keypoint));
+  if (!state->reference || !state->tile_state || !state->tile_sad || !state->rects || !state->detected
+      || !allocate_pyramids(&state->pyramids, width, height, octave_count, state->octant)) {
+    ethsift_video_free(state);
+    return 0;
+  }
+  *video = state;
+  return 1;
+}
+
+/// <summary>
+/// Release the state of a video and all of its pyramids.
+/// </summary>
+/// <param name="video"> IN: State created by ethsift_video_create, may be NULL. </param>
+/// <returns> 1 </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_video_free(struct ethsift_video *video){
+  if (!video)
+    return 1;
+  free_pyramids(&video->pyramids);
+  free(video->reference);
+  free(video->tile_state);
+  free(video->tile_sad);
+  free(video->rects);
+  free(video->keypoints);
+  free(video->detected);
+  free(video);
+  return 1;
+}
+
+/// <summary>
+/// Compute the keypoints of the next frame of a video. Only tiles that changed since the pyramids were
+/// last built, plus a halo of one tile, are rebuilt and searched for keypoints. The keypoints of all
+/// other tiles are carried over from the previous frame. Coarse octaves blur changes further than one
+/// tile, so their keypoints around the rebuilt tiles only approximate those of the whole frame.
+/// </summary>
+/// <param name="video"> IN/OUT: State of the video. </param>
+/// <param name="frame"> IN: The frame, of the size the state was created with. </param>
+/// <param name="keypoints"> OUT: Keypoints of the frame. </param>
+/// <param name="keypoint_count"> IN: How many keypoints we can store at most (allocated size of memory).
+///                               OUT: Number of keypoints of the frame. </param>
+/// <returns> 1 IF computation was successful, ELSE 0. </returns>
+/// <remarks> 3 * w * h + ethsift_compute_keypoints on the rebuilt tiles flops </remarks>
+int ethsift_video_process(struct ethsift_video *video, struct ethsift_image_view frame, struct ethsift_keypoint keypoints[], uint32_t *keypoint_count){
+  if (frame.width != video->width || frame.height != video->height || ETHSIFT_FORMAT_U16 < frame.format)
+    return 0;
+  // The layout of the pyramids was fixed when the state was created.
+  if (g_upsample != video->upsample || (g_orientation_mode == ETHSIFT_ORIENTATION_OCTANT) != video->octant)
+    return 0;
+
+  video->recomputed_tiles = mark_tiles(video, frame);
+  if (video->recomputed_tiles) {
+    const uint32_t rect_count = collect_rects(video);
+    for (uint32_t i = 0; i < rect_count; ++i) {
+      if (!rebuild_rect(video, frame, &video->rects[i]))
+        return 0;
+    }
+
+    // Keypoints of rebuilt tiles are detected again once all of them are up to date.
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < video->keypoint_count; ++i) {
+      if (!in_recomputed_tile(video, &video->keypoints[i]))
+        video->keypoints[kept++] = video->keypoints[i];
+    }
+    video->keypoint_count = kept;
+    for (uint32_t i = 0; i < rect_count; ++i) {
+      if (!detect_rect(video, &video->rects[i]))
+        return 0;
+    }
+
+    // Later frames are compared against the pixels the pyramids now hold.
+    const uint32_t pixel_size = format_size(frame.format);
+    const uint32_t ref_stride = video->width * pixel_size;
+    for (uint32_t i = 0; i < rect_count; ++i) {
+      const struct ethsift_roi *rect = &video->rects[i];
+      for (uint32_t y = rect->y; y < rect->y + rect->height; ++y)
+        memcpy(video->reference + y * ref_stride + rect->x * pixel_size,
+               (const uint8_t *) frame.data + y * frame.stride + rect->x * pixel_size, rect->width * pixel_size);
+    }
+    video->format = frame.format;
+    video->range = view_range(frame);
+  }
+
+  const uint32_t stored = internal_min(video->keypoint_count, *keypoint_count);
+  memcpy(keypoints, video->keypoints, stored * sizeof(struct ethsift_keypoint));
+  *keypoint_count = video->keypoint_count;
+  return 1;
+}
+
+/// <summary>
+/// Report how much of the last frame had to be rebuilt.
+/// </summary>
+/// <param name="video"> IN: State of the video. </param>
+/// <param name="recomputed_tiles"> OUT: Number of tiles the last call to ethsift_video_process rebuilt. </param>
+/// <param name="tile_count"> OUT: Number of tiles of a frame. </param>
+/// <returns> 1 </returns>
+/// <remarks> 0 flops </remarks>
+int ethsift_video_stats(const struct ethsift_video *video, uint32_t *recomputed_tiles, uint32_t *tile_count){
+  *recomputed_tiles = video->recomputed_tiles;
+  *tile_count = video->tiles_x * video->tiles_y;
+  return 1;
+}